@@ -0,0 +1,137 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/fused_attention.h"
+
+#include <cmath>
+#include <vector>
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/softmax.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// The attention of a prompt of seq_len tokens: the dense scores with the
+// causal mask tensor against CausalAttention.
+static void CausalAttentionBenchmarkHelper(int64_t batch_size,
+                                           int64_t seq_len, int n_step) {
+  constexpr int64_t num_heads = 12, size_per_head = 64;
+  auto q = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, seq_len, size_per_head}, kDLCPU, 0);
+  auto k = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, seq_len, size_per_head}, kDLCPU, 0);
+  auto v = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, seq_len, size_per_head}, kDLCPU, 0);
+  float scale = 1.f / std::sqrt(static_cast<float>(size_per_head));
+  // the flops of the two dense GEMMs
+  double g_flops =
+      4. * batch_size * num_heads * seq_len * seq_len * size_per_head / 1e9;
+
+  core::Tensor mask(nullptr), score(nullptr), context(nullptr);
+  auto* mask_ptr =
+      mask.Reshape<float>({batch_size, seq_len, seq_len}, kDLCPU, 0);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t i = 0; i < seq_len; ++i) {
+      for (int64_t j = 0; j < seq_len; ++j) {
+        mask_ptr[(b * seq_len + i) * seq_len + j] = j > i ? -1e18f : 0.f;
+      }
+    }
+  }
+  auto dense_res = benchmark::TestFuncSpeed(
+      [&]() {
+        score.Reshape<float>({batch_size, num_heads, seq_len, seq_len},
+                             kDLCPU, 0);
+        BatchMatMul(q, false, k, true, scale, &score, 0.f);
+        ApplyMaskAndSoftmax(&score, mask, 1.f);
+        context.Reshape<float>({batch_size, num_heads, seq_len, size_per_head},
+                               kDLCPU, 0);
+        BatchMatMul(score, false, v, false, 1.f, &context, 0.f);
+      },
+      n_step, "dense", g_flops, kDLCPU);
+  auto causal_res = benchmark::TestFuncSpeed(
+      [&]() {
+        CausalAttention(q, k, v, core::Tensor(nullptr), scale, &score,
+                        &context);
+      },
+      n_step, "causal", g_flops, kDLCPU);
+  // in dense-equivalent GFLOPS, the ratio is the speedup.
+  std::cout << "CPU causal attention " << batch_size << ", " << seq_len
+            << ": masked dense " << dense_res << " GFLOPS, causal "
+            << causal_res << " GFLOPS" << std::endl;
+}
+
+TEST_CASE("causal-attention-cpu-benchmark") {
+  constexpr int n_step = 20;
+  for (int64_t batch_size : {1, 4}) {
+    for (int64_t seq_len : {32, 128, 512, 1024}) {
+      CausalAttentionBenchmarkHelper(batch_size, seq_len, n_step);
+    }
+  }
+}
+
+// The attention of a decoding step over a cache of cache_len positions: the
+// generic batched GEMMs and softmax against DecodeAttention.
+static void DecodeAttentionBenchmarkHelper(int64_t batch_size,
+                                           int64_t cache_len, int n_step) {
+  constexpr int64_t num_heads = 12, size_per_head = 64;
+  auto q = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, 1, size_per_head}, kDLCPU, 0);
+  auto k = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, cache_len, size_per_head}, kDLCPU, 0);
+  auto v = common::CreateTensorAndFillRandom<float>(
+      {batch_size, num_heads, cache_len, size_per_head}, kDLCPU, 0);
+  float scale = 1.f / std::sqrt(static_cast<float>(size_per_head));
+  // the step reads the whole k and v caches, report GB/s.
+  double g_bytes = 2. * k.numel() * sizeof(float) / 1e9;
+
+  core::Tensor score(nullptr), context(nullptr);
+  auto generic_res = benchmark::TestFuncSpeed(
+      [&]() {
+        score.Reshape<float>({batch_size, num_heads, 1, cache_len}, kDLCPU,
+                             0);
+        BatchMatMul(q, false, k, true, scale, &score, 0.f);
+        ApplyMaskAndSoftmax(&score, core::Tensor(nullptr), 1.f);
+        context.Reshape<float>({batch_size, num_heads, 1, size_per_head},
+                               kDLCPU, 0);
+        BatchMatMul(score, false, v, false, 1.f, &context, 0.f);
+      },
+      n_step, "generic", g_bytes, kDLCPU);
+  auto decode_res = benchmark::TestFuncSpeed(
+      [&]() {
+        DecodeAttention(q, k, v, core::Tensor(nullptr), scale, &score,
+                        &context);
+      },
+      n_step, "decode", g_bytes, kDLCPU);
+  std::cout << "CPU decode attention " << batch_size << ", " << cache_len
+            << ": generic " << generic_res << " GB/s, decode " << decode_res
+            << " GB/s" << std::endl;
+}
+
+TEST_CASE("decode-attention-cpu-benchmark") {
+  constexpr int n_step = 100;
+  for (int64_t batch_size : {1, 8}) {
+    for (int64_t cache_len : {16, 128, 1024, 4096}) {
+      DecodeAttentionBenchmarkHelper(batch_size, cache_len, n_step);
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,80 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/copy_engine.h"
+
+#include <cstring>
+#include <vector>
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+static void CopyBenchmarkHelper(size_t n_bytes, int n_step) {
+  std::vector<char> src(n_bytes, 1), dst(n_bytes);
+  // read and written
+  auto g_bytes = 2 * n_bytes / 1e9;
+  auto memcpy_res = benchmark::TestFuncSpeed(
+      [&]() { std::memcpy(dst.data(), src.data(), n_bytes); }, n_step,
+      "memcpy", g_bytes, kDLCPU);
+  auto engine_res = benchmark::TestFuncSpeed(
+      [&]() {
+        core::Memcpy(dst.data(), src.data(), n_bytes,
+                     core::MemcpyFlag::kCPU2CPU);
+      },
+      n_step, "engine", g_bytes, kDLCPU);
+  std::cout << "CPU Copy " << n_bytes / 1024 << " KB, memcpy " << memcpy_res
+            << " GB/s, copy engine " << engine_res << " GB/s" << std::endl;
+}
+
+static void Copy2DBenchmarkHelper(size_t width, size_t height, int n_step) {
+  size_t src_pitch = 3 * width;
+  std::vector<char> src(src_pitch * height, 1), dst(width * height);
+  auto g_bytes = 2 * width * height / 1e9;
+  auto loop_res = benchmark::TestFuncSpeed(
+      [&]() {
+        for (size_t i = 0; i < height; ++i) {
+          std::memcpy(dst.data() + i * width, src.data() + i * src_pitch,
+                      width);
+        }
+      },
+      n_step, "loop", g_bytes, kDLCPU);
+  auto engine_res = benchmark::TestFuncSpeed(
+      [&]() {
+        core::Memcpy2D(dst.data(), width, src.data(), src_pitch, width, height,
+                       core::MemcpyFlag::kCPU2CPU);
+      },
+      n_step, "engine", g_bytes, kDLCPU);
+  std::cout << "CPU Copy2D " << height << " rows of " << width
+            << " bytes, memcpy loop " << loop_res << " GB/s, copy engine "
+            << engine_res << " GB/s" << std::endl;
+}
+
+TEST_CASE("copy-cpu-benchmark") {
+  constexpr int n_step = 50;
+  for (size_t kb : {16, 256, 1024, 4 * 1024, 16 * 1024, 64 * 1024}) {
+    CopyBenchmarkHelper(kb * 1024, n_step);
+  }
+  // SeqPoolWithIdx of a batch of BERT base rows, the KV cache Concat of a
+  // decoder step.
+  Copy2DBenchmarkHelper(768 * 4, 64, n_step);
+  Copy2DBenchmarkHelper(100 * 64 * 4, 20 * 16, n_step);
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,95 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/generation.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// A greedy decode step of a toy language model: the logits of the hidden
+// state, argmax, and the embedding of the token as the next hidden state.
+static DecodeStep ToyDecodeStep(int64_t hidden_size, int64_t vocab_size,
+                                int n_layers) {
+  auto weight = std::make_shared<core::Tensor>(
+      common::CreateTensorAndFillRandom<float>({hidden_size, hidden_size},
+                                               kDLCPU, 0));
+  auto lm_head = std::make_shared<core::Tensor>(
+      common::CreateTensorAndFillRandom<float>({hidden_size, vocab_size},
+                                               kDLCPU, 0));
+  auto embedding = std::make_shared<core::Tensor>(
+      common::CreateTensorAndFillRandom<float>({vocab_size, hidden_size},
+                                               kDLCPU, 0));
+  auto hidden = std::make_shared<core::Tensor>(
+      common::CreateTensorAndFillRandom<float>({1, hidden_size}, kDLCPU, 0));
+  auto temp = std::make_shared<core::Tensor>(nullptr);
+  auto logits = std::make_shared<core::Tensor>(nullptr);
+  return [=](int64_t) {
+    temp->Reshape<float>({1, hidden_size}, kDLCPU, 0);
+    for (int i = 0; i < n_layers; ++i) {
+      MatMul(*hidden, false, *weight, false, 1.0, temp.get(), 0.0);
+      MatMul(*temp, false, *weight, false, 1.0, hidden.get(), 0.0);
+    }
+    auto* data = logits->Reshape<float>({1, vocab_size}, kDLCPU, 0);
+    MatMul(*hidden, false, *lm_head, false, 1.0, logits.get(), 0.0);
+    int64_t token = std::max_element(data, data + vocab_size) - data;
+    std::memcpy(hidden->mutableData<float>(),
+                embedding->data<float>() + token * hidden_size,
+                hidden_size * sizeof(float));
+    return token;
+  };
+}
+
+TEST_CASE("generation-cpu-benchmark") {
+  constexpr int64_t hidden_size = 768, vocab_size = 8000;
+  constexpr int n_layers = 12;
+  std::vector<int64_t> n_tokens_list{16, 64};
+  for (auto n_tokens : n_tokens_list) {
+    auto step = ToyDecodeStep(hidden_size, vocab_size, n_layers);
+    // blocking: the first token is seen with the whole sequence
+    benchmark::CPUTimer timer;
+    std::vector<int64_t> tokens;
+    GenerateTokens(step, n_tokens, -1, [&](int64_t token) {
+      tokens.push_back(token);
+      return true;
+    });
+    double blocking_ms = timer.ElapseSecond() * 1e3;
+
+    TokenStream stream;
+    stream.Start(step, n_tokens);
+    int64_t token;
+    while (stream.Next(&token)) {
+    }
+    auto& timing = stream.timing();
+    std::cout << "CPU generation " << n_tokens << " tokens, blocking "
+              << blocking_ms << " ms, streaming ttft " << timing.first_token_ms
+              << " ms, inter-token mean " << timing.MeanInterTokenMs()
+              << " ms, p50 " << timing.InterTokenPercentileMs(0.5)
+              << " ms, p99 " << timing.InterTokenPercentileMs(0.99)
+              << " ms, total " << timing.total_ms << " ms" << std::endl;
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
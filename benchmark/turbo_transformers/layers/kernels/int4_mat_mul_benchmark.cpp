@@ -0,0 +1,124 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+// Tokens per second of the linear modules of a transformer decoder step at
+// batch 1 to 4, where the GEMMs are bound by the bandwidth of the weights,
+// with float, int8 and weight-only int4 weights, and the accuracy of the
+// quantized outputs against float.
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/int4_mat_mul.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+struct Linear {
+  core::Tensor weight{nullptr};  // (in_dim, out_dim)
+  QuantizedWeight int8;
+  Int4Weight int4;
+};
+
+// the relative L2 error of y against the reference
+double RelativeError(const core::Tensor& y, const core::Tensor& reference) {
+  double err = 0, norm = 0;
+  for (int64_t i = 0; i < y.numel(); ++i) {
+    double d = y.data<float>()[i] - reference.data<float>()[i];
+    err += d * d;
+    norm += reference.data<float>()[i] * reference.data<float>()[i];
+  }
+  return std::sqrt(err / norm);
+}
+
+}  // namespace
+
+TEST_CASE("int4-matmul-cpu-benchmark") {
+  constexpr int n_step = 50;
+  const int64_t hidden = 768, d_ff = 3072, n_layers = 6;
+  std::vector<std::pair<int64_t, int64_t>> shapes = {
+      {hidden, 3 * hidden}, {hidden, hidden}, {hidden, d_ff}, {d_ff, hidden}};
+  std::vector<Linear> linears;
+  for (int64_t l = 0; l < n_layers; ++l) {
+    for (auto& shape : shapes) {
+      Linear linear;
+      linear.weight = common::CreateTensorAndFillRandom<float>(
+          {shape.first, shape.second}, kDLCPU, 0);
+      QuantizeWeight(linear.weight, false, &linear.int8);
+      QuantizeWeightInt4(linear.weight, false,
+                         DefaultInt4GroupSize(shape.first), &linear.int4);
+      linears.emplace_back(std::move(linear));
+    }
+  }
+  std::cout << "CPU decoder step, " << n_layers << " layers of hidden "
+            << hidden << ", weight MB: fp32 "
+            << linears.size() / shapes.size() *
+                   (4. * hidden * hidden + 2. * hidden * d_ff) * 4 / 1e6
+            << std::endl;
+
+  for (int64_t batch : {1, 2, 4}) {
+    std::vector<core::Tensor> inputs, outputs, references;
+    for (auto& linear : linears) {
+      int64_t in_dim = linear.weight.shape(0), out_dim = linear.weight.shape(1);
+      inputs.push_back(
+          common::CreateTensorAndFillRandom<float>({batch, in_dim}, kDLCPU, 0));
+      outputs.push_back(
+          common::CreateTensor<float>({batch, out_dim}, kDLCPU, 0));
+      references.push_back(
+          common::CreateTensor<float>({batch, out_dim}, kDLCPU, 0));
+      MatMul(inputs.back(), false, linear.weight, false, 1.0,
+             &references.back(), 0.0);
+    }
+    for (std::string precision : {"fp32", "int8", "int4"}) {
+      auto step = [&]() {
+        for (size_t i = 0; i < linears.size(); ++i) {
+          if (precision == "fp32") {
+            MatMul(inputs[i], false, linears[i].weight, false, 1.0,
+                   &outputs[i], 0.0);
+          } else if (precision == "int8") {
+            QuantizedMatMul(inputs[i], linears[i].int8, &outputs[i]);
+          } else {
+            Int4MatMul(inputs[i], linears[i].int4, &outputs[i]);
+          }
+        }
+      };
+      // tokens per second of the steps
+      auto tokens_per_second = benchmark::TestFuncSpeed(
+          step, n_step, precision, static_cast<double>(batch), kDLCPU);
+      double max_error = 0;
+      for (size_t i = 0; i < linears.size(); ++i) {
+        max_error = std::max(max_error, RelativeError(outputs[i],
+                                                      references[i]));
+      }
+      std::cout << "batch " << batch << " " << precision
+                << " tokens/s: " << tokens_per_second
+                << " max relative error: " << max_error << std::endl;
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
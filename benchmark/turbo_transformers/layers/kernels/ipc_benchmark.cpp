@@ -0,0 +1,215 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+// Requests per second and latency of the local inference daemon against the
+// same model called in process. Every client is a forked process sending
+// requests of one sequence of 128 ids through IpcClient, the model is the
+// mean of the embeddings of the ids so that the cost of the transport and
+// the batching dominates.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "example/cpp/ipc_client.h"
+#include "example/cpp/ipc_daemon.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+const int64_t kHidden = 768, kVocab = 4096, kSeqLen = 128;
+const int kRequests = 2000;
+
+class MeanEmbedding {
+ public:
+  MeanEmbedding() : table_(kVocab * kHidden) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    for (auto &v : table_) {
+      v = dist(rng);
+    }
+  }
+
+  std::vector<float> operator()(
+      const std::vector<std::vector<int64_t>> &inputs) const {
+    std::vector<float> outputs(inputs.size() * kHidden);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      Embed(inputs[i].data(), inputs[i].size(), outputs.data() + i * kHidden);
+    }
+    return outputs;
+  }
+
+  void operator()(const ipc::IpcDaemon::SequenceBatch &batch,
+                  core::RequestTiming *) const {
+    for (size_t i = 0; i < batch.ids.size(); ++i) {
+      Embed(batch.ids[i], batch.lengths[i], batch.outputs[i]);
+    }
+  }
+
+ private:
+  void Embed(const int64_t *ids, int64_t length, float *output) const {
+    std::fill(output, output + kHidden, 0.f);
+    float scale = 1.f / length;
+    for (int64_t i = 0; i < length; ++i) {
+      const float *row = table_.data() + ids[i] % kVocab * kHidden;
+      for (int64_t j = 0; j < kHidden; ++j) {
+        output[j] += row[j] * scale;
+      }
+    }
+  }
+
+  std::vector<float> table_;
+};
+
+std::vector<std::vector<int64_t>> Request(std::mt19937 *rng) {
+  std::uniform_int_distribution<int64_t> id(0, kVocab - 1);
+  std::vector<int64_t> ids(kSeqLen);
+  for (auto &v : ids) {
+    v = id(*rng);
+  }
+  return {ids};
+}
+
+// Sends kRequests requests and writes the seconds they took to fd.
+void RunClient(const std::string &socket_path, int seed, int fd) {
+  std::unique_ptr<ipc::IpcClient> client;
+  // the daemon starts after the clients are forked.
+  while (client == nullptr) {
+    try {
+      client.reset(new ipc::IpcClient(socket_path));
+    } catch (std::exception &) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  uint32_t model = client->Lookup("mean");
+  std::mt19937 rng(seed);
+  auto request = Request(&rng);
+  for (int i = 0; i < 10; ++i) {
+    client->Infer(model, request);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRequests; ++i) {
+    client->Infer(model, request);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (write(fd, &seconds, sizeof(seconds)) != sizeof(seconds)) {
+    _exit(1);
+  }
+}
+
+// Serves n_clients forked clients, returns the seconds each took.
+std::vector<double> RunDaemon(int n_clients, int64_t max_delay_us) {
+  std::string socket_path =
+      "/tmp/tt_ipc_benchmark_" + std::to_string(getpid()) + ".sock";
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  std::vector<pid_t> pids;
+  for (int i = 0; i < n_clients; ++i) {
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+      close(fds[0]);
+      RunClient(socket_path, i, fds[1]);
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+  close(fds[1]);
+  MeanEmbedding model;
+  ipc::IpcDaemonOptions options;
+  options.max_delay_us = max_delay_us;
+  ipc::IpcDaemon daemon(socket_path, options);
+  daemon.AddModel("mean", kHidden, model);
+  daemon.Start();
+  std::vector<double> seconds(n_clients);
+  size_t bytes = seconds.size() * sizeof(double), n_read = 0;
+  auto *data = reinterpret_cast<char *>(seconds.data());
+  ssize_t n;
+  while (n_read < bytes &&
+         (n = read(fds[0], data + n_read, bytes - n_read)) > 0) {
+    n_read += n;
+  }
+  close(fds[0]);
+  for (auto pid : pids) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+  REQUIRE(n_read == bytes);
+  daemon.Stop();
+  return seconds;
+}
+
+// The same requests from n_threads threads calling the model in process.
+std::vector<double> RunInProcess(int n_threads) {
+  MeanEmbedding model;
+  std::vector<double> seconds(n_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 rng(t);
+      auto request = Request(&rng);
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < kRequests; ++i) {
+        model(request);
+      }
+      seconds[t] = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return seconds;
+}
+
+void Report(const std::string &name, const std::vector<double> &seconds) {
+  double throughput = 0, latency = 0;
+  for (auto s : seconds) {
+    throughput += kRequests / s;
+    latency += s / kRequests * 1e6 / seconds.size();
+  }
+  std::cout << name << ", " << seconds.size()
+            << " clients: requests/s " << throughput << ", mean latency "
+            << latency << " us" << std::endl;
+}
+
+}  // namespace
+
+TEST_CASE("ipc-daemon-cpu-benchmark") {
+  for (int n_clients : {1, 4, 8}) {
+    Report("in process", RunInProcess(n_clients));
+    Report("daemon, no batching delay", RunDaemon(n_clients, 0));
+    Report("daemon, 200us batching delay", RunDaemon(n_clients, 200));
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -14,6 +14,7 @@
 #include <ctime>
 #include "benchmark_help.h"
 #include "catch2/catch.hpp"
+#include "turbo_transformers/core/gemm_backend.h"
 #include "turbo_transformers/core/tensor.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
@@ -137,6 +138,25 @@ TEST_CASE("matmal-cpu-benchmark-general") {
   std::cout << std::endl;
 }
 
+// Compares every registered backend in one run, libraries listed in
+// TT_GEMM_BACKENDS are loaded too, e.g.
+//   TT_GEMM_BACKENDS=openblas-so=/usr/lib/libopenblas.so ./matmul_benchmark
+TEST_CASE("matmal-cpu-benchmark-backends") {
+  auto& registry = core::GemmBackendRegistry::GetInstance();
+  int64_t k = 12 * 64, n = 12 * 64 * 3;
+  std::vector<int64_t> m_list{1, 10, 40, 120};
+  std::vector<int64_t> dim_list{100, 500};
+  for (auto& name : registry.List()) {
+    std::cout << "=================================" << std::endl;
+    std::cout << "CPU MatMul Benchmark, gemm backend " << name << std::endl;
+    core::GemmBackendGuard guard(name);
+    MatmulBenchmarkHelper(kDLCPU, false, {k, n}, m_list);
+    MatmulBenchmarkHelper(kDLCPU, true, {n, k}, m_list);
+    MatmulBenchmarkGeneralHelper(kDLCPU, false, dim_list);
+    std::cout << std::endl;
+  }
+}
+
 #ifdef TT_WITH_CUDA
 
 TEST_CASE("matmal-gpu-gemm7-benchmark") {
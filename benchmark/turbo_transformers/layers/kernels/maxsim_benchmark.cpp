@@ -0,0 +1,67 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/kernels/maxsim.h"
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+template <typename T>
+static void MaxSimBenchmarkHelper(int64_t n_docs, int64_t doc_len,
+                                  int64_t q_len, int64_t hidden_size,
+                                  const std::string& info, int n_step) {
+  auto query = common::CreateTensorAndFillRandom<float>({q_len, hidden_size},
+                                                        kDLCPU, 0);
+  auto encoder_out = common::CreateTensorAndFillRandom<float>(
+      {n_docs, doc_len, hidden_size}, kDLCPU, 0);
+  core::Tensor docs(nullptr), scales(nullptr), lengths(nullptr);
+  PackDocTokens<T>(encoder_out, core::Tensor(nullptr), true, &docs, &scales,
+                   &lengths);
+  core::Tensor scores(nullptr);
+  // bytes of the document token matrices read per call
+  auto g_bytes = n_docs * doc_len * hidden_size * sizeof(T) / 1e9;
+  auto res = benchmark::TestFuncSpeed(
+      [&]() {
+        MaxSim<T>(query, core::Tensor(nullptr), docs, scales, lengths,
+                  &scores);
+      },
+      n_step, info, g_bytes, kDLCPU);
+  std::cout << "CPU MaxSim " << info << " " << n_docs << " docs, " << doc_len
+            << " doc tokens, " << q_len << " query tokens: " << res << " GB/s"
+            << std::endl;
+}
+
+TEST_CASE("maxsim-cpu-benchmark") {
+  constexpr int64_t hidden_size = 128;
+  constexpr int64_t q_len = 32;
+  constexpr int n_step = 50;
+  std::vector<int64_t> n_docs_list{100, 1000};
+  std::vector<int64_t> doc_len_list{64, 180};
+  for (auto n_docs : n_docs_list)
+    for (auto doc_len : doc_len_list) {
+      MaxSimBenchmarkHelper<core::Half>(n_docs, doc_len, q_len, hidden_size,
+                                        "fp16", n_step);
+      MaxSimBenchmarkHelper<int8_t>(n_docs, doc_len, q_len, hidden_size,
+                                    "int8", n_step);
+    }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,182 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+// The latency of the first requests of a freshly loaded BERT encoder, cold
+// and after core::Warmup. Each scenario runs in a forked process so that
+// neither finds the thread pools, the heap or the code warmed up by the
+// other. The warm scenario declares TT_WARMUP_MAX_BATCH x TT_WARMUP_MAX_SEQ
+// (4 x 128 by default) as its largest shape, then both serve requests of
+// random smaller shapes and report the latency of the first ones against
+// the steady state.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "benchmark_help.h"
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/core/warmup.h"
+#include "turbo_transformers/layers/bert_attention.h"
+#include "turbo_transformers/layers/bert_intermediate.h"
+#include "turbo_transformers/layers/bert_output.h"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+int64_t EnvOr(const char* name, int64_t default_value) {
+  const char* value = std::getenv(name);
+  return value == nullptr ? default_value : std::atoll(value);
+}
+
+core::Tensor Random(std::initializer_list<int64_t> shape) {
+  return common::CreateTensorAndFillRandom<float>(shape, kDLCPU, 0);
+}
+
+const int kRequests = 32;
+
+class Encoder {
+ public:
+  Encoder(int64_t n_layers, int64_t h, int64_t d_ff, int64_t heads) : h_(h) {
+    for (int64_t i = 0; i < n_layers; ++i) {
+      attention_.emplace_back(new BertAttention(
+          Random({h, 3 * h}), Random({3 * h}), Random({h, h}), Random({h}),
+          Random({h}), Random({h}), heads));
+      intermediate_.emplace_back(
+          new BertIntermediate(Random({h, d_ff}), Random({d_ff})));
+      output_.emplace_back(new BertOutput(Random({d_ff, h}), Random({h}),
+                                          Random({h}), Random({h})));
+    }
+  }
+
+  void operator()(int64_t batch, int64_t seq_len) {
+    hidden_.Reshape<float>({batch, seq_len, h_}, kDLCPU, 0);
+    common::FillRandom<float>(hidden_);
+    core::Tensor mask(nullptr);
+    for (size_t i = 0; i < attention_.size(); ++i) {
+      (*attention_[i])(hidden_, mask, &attention_out_);
+      (*intermediate_[i])(attention_out_, &intermediate_out_);
+      (*output_[i])(intermediate_out_, attention_out_, &hidden_);
+    }
+  }
+
+ private:
+  int64_t h_;
+  std::vector<std::unique_ptr<BertAttention>> attention_;
+  std::vector<std::unique_ptr<BertIntermediate>> intermediate_;
+  std::vector<std::unique_ptr<BertOutput>> output_;
+  core::Tensor hidden_{nullptr};
+  core::Tensor attention_out_{nullptr};
+  core::Tensor intermediate_out_{nullptr};
+};
+
+// Loads an encoder, warms it up if asked to and writes the latencies of its
+// first kRequests requests to fd.
+void RunScenario(bool warmup, int fd) {
+  int64_t max_batch = EnvOr("TT_WARMUP_MAX_BATCH", 4);
+  int64_t max_seq = EnvOr("TT_WARMUP_MAX_SEQ", 128);
+  Encoder encoder(EnvOr("TT_WARMUP_LAYERS", 4), 768, 3072, 12);
+  if (warmup) {
+    core::WarmupOptions options;
+    options.keep_heap = EnvOr("TT_WARMUP_KEEP_HEAP", 1) != 0;
+    options.lock_memory = EnvOr("TT_WARMUP_MLOCK", 0) != 0;
+    auto report = core::Warmup({{max_batch, max_seq}},
+                               [&](int64_t batch_size, int64_t seq_len) {
+                                 encoder(batch_size, seq_len);
+                               },
+                               options);
+    std::cout << "warm-up: thread pools " << report.thread_pools_ms
+              << " ms, dummy runs";
+    for (auto ms : report.run_ms) {
+      std::cout << " " << ms << " ms";
+    }
+    std::cout << (report.memory_locked ? ", memory locked" : "") << std::endl;
+  }
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int64_t> batch(1, max_batch);
+  std::uniform_int_distribution<int64_t> seq(max_seq / 4, max_seq);
+  std::vector<double> latencies;
+  for (int i = 0; i < kRequests; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    encoder(batch(rng), seq(rng));
+    latencies.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  auto bytes = latencies.size() * sizeof(double);
+  if (write(fd, latencies.data(), bytes) != static_cast<ssize_t>(bytes)) {
+    _exit(1);
+  }
+}
+
+std::vector<double> ForkScenario(bool warmup) {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pid = fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    close(fds[0]);
+    RunScenario(warmup, fds[1]);
+    close(fds[1]);
+    _exit(0);
+  }
+  close(fds[1]);
+  std::vector<double> latencies(kRequests);
+  size_t bytes = latencies.size() * sizeof(double), n_read = 0;
+  auto* data = reinterpret_cast<char*>(latencies.data());
+  ssize_t n;
+  while (n_read < bytes &&
+         (n = read(fds[0], data + n_read, bytes - n_read)) > 0) {
+    n_read += n;
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(n_read == bytes);
+  return latencies;
+}
+
+void Report(const char* name, std::vector<double> latencies) {
+  std::vector<double> steady(latencies.begin() + kRequests / 2,
+                             latencies.end());
+  std::sort(steady.begin(), steady.end());
+  std::cout << name << ": first " << latencies[0] << " ms, second "
+            << latencies[1] << " ms, third " << latencies[2]
+            << " ms, steady median " << steady[steady.size() / 2] << " ms"
+            << std::endl;
+}
+
+}  // namespace
+
+TEST_CASE("warmup-first-request-cpu-benchmark") {
+  Report("cold", ForkScenario(false));
+  Report("warm", ForkScenario(true));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
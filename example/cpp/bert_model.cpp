@@ -13,18 +13,27 @@
 
 #include "bert_model.h"
 
+#include <algorithm>
+#include <mutex>
 #include <string>
 #include <utility>
 
 #include "cnpy.h"
+#include "turbo_transformers/core/memory_trimmer.h"
 #include "turbo_transformers/core/tensor_copy.h"
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/core/warmup.h"
 #include "turbo_transformers/layers/bert_attention.h"
 #include "turbo_transformers/layers/bert_embedding.h"
 #include "turbo_transformers/layers/bert_intermediate.h"
 #include "turbo_transformers/layers/bert_output.h"
 #include "turbo_transformers/layers/bert_pooler.h"
+#include "turbo_transformers/layers/calibration.h"
 #include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/kernels/sequence_packing.h"
 #include "turbo_transformers/layers/prepare_bert_masks.h"
+#include "turbo_transformers/layers/sequence_packing.h"
 #include "turbo_transformers/layers/sequence_pool.h"
 #include "turbo_transformers/loaders/npz_load.h"
 
@@ -48,8 +57,24 @@ static std::unique_ptr<layers::BertPooler> LoadPooler(NPZMapView npz,
       new layers::BertPooler(params["dense.weight"], params["dense.bias"]));
 }
 
+// Loads "<module>.pq_codebooks" and "<module>.pq_codes" of npz if it has
+// them.
+static bool LoadPQWeight(NPZMapView npz, const std::string &module,
+                         layers::kernels::PQWeight *weight) {
+  if (!npz.IsExist(module + ".pq_codes")) {
+    return false;
+  }
+  NPZLoader params(std::move(npz), DLDeviceType::kDLCPU);
+  *weight = layers::kernels::MakePQWeight(
+      params[module + ".pq_codebooks"],
+      params.LoadT<uint8_t>(module + ".pq_codes"));
+  return true;
+}
+
 struct BERTLayer {
-  explicit BERTLayer(NPZLoader params, int64_t n_heads) {
+  // The feed-forward modules pq has codes for are built on them, their float
+  // weights are not loaded.
+  BERTLayer(NPZLoader params, int64_t n_heads, NPZMapView *pq = nullptr) {
     // define layer network here
     attention_.reset(new layers::BertAttention(
         params["attention.qkv.weight"], params["attention.qkv.bias"],
@@ -57,20 +82,58 @@ struct BERTLayer {
         params["attention.output.dense.bias"],
         params["attention.output.LayerNorm.weight"],
         params["attention.output.LayerNorm.bias"], n_heads));
-    intermediate_.reset(
-        new layers::BertIntermediate(params["intermediate.dense.weight"],
-                                     params["intermediate.dense.bias"]));
-    output_.reset(new layers::BertOutput(
-        params["output.dense.weight"], params["output.dense.bias"],
-        params["output.LayerNorm.weight"], params["output.LayerNorm.bias"]));
+    layers::kernels::PQWeight pq_weight;
+    if (pq != nullptr && LoadPQWeight(*pq, "intermediate.dense", &pq_weight)) {
+      intermediate_.reset(new layers::BertIntermediate(
+          std::move(pq_weight), params["intermediate.dense.bias"]));
+    } else {
+      intermediate_.reset(
+          new layers::BertIntermediate(params["intermediate.dense.weight"],
+                                       params["intermediate.dense.bias"]));
+    }
+    if (pq != nullptr && LoadPQWeight(*pq, "output.dense", &pq_weight)) {
+      output_.reset(new layers::BertOutput(
+          std::move(pq_weight), params["output.dense.bias"],
+          params["output.LayerNorm.weight"], params["output.LayerNorm.bias"]));
+    } else {
+      output_.reset(new layers::BertOutput(
+          params["output.dense.weight"], params["output.dense.bias"],
+          params["output.LayerNorm.weight"],
+          params["output.LayerNorm.bias"]));
+    }
   }
 
+  // intermediate_quant receives the intermediate output quantized by the
+  // epilogue of BertIntermediate if BertOutput runs in int8 with a static
+  // input scale.
   void operator()(core::Tensor &hidden, core::Tensor &mask,
                   core::Tensor *attention_out, core::Tensor *intermediate_out,
+                  layers::kernels::QuantizedActivation *intermediate_quant,
                   core::Tensor *output) {
     (*attention_)(hidden, mask, attention_out);
-    (*intermediate_)(*attention_out, intermediate_out);
-    (*output_)(*intermediate_out, *attention_out, output);
+    (*intermediate_)(*attention_out, intermediate_out, intermediate_quant);
+    (*output_)(*intermediate_out, *attention_out, output, intermediate_quant);
+  }
+
+  void ApplyPrecisionPlan(const layers::PrecisionPlan &plan,
+                          const std::string &prefix) {
+    auto qkv = prefix + "attention.qkv";
+    auto dense = prefix + "attention.output.dense";
+    auto intermediate = prefix + "intermediate.dense";
+    auto output = prefix + "output.dense";
+    attention_->SetPrecision("qkv", plan.Get(qkv), false,
+                             plan.GetInputScale(qkv));
+    attention_->SetPrecision("dense", plan.Get(dense), false,
+                             plan.GetInputScale(dense));
+    // the product-quantized modules have no float weight to switch to
+    if (!intermediate_->is_pq()) {
+      intermediate_->SetPrecision(plan.Get(intermediate),
+                                  plan.GetInputScale(intermediate));
+    }
+    if (!output_->is_pq()) {
+      output_->SetPrecision(plan.Get(output), plan.GetInputScale(output));
+    }
+    intermediate_->SetOutputScale(output_->input_scale());
   }
 
   std::unique_ptr<layers::BertAttention> attention_;
@@ -78,20 +141,57 @@ struct BERTLayer {
   std::unique_ptr<layers::BertOutput> output_;
 };
 
+// The intermediate tensors of one inference. A workspace is reused by the
+// following requests to avoid reallocating the buffers, and its trimmer
+// releases the capacity left behind by the rare long requests.
+struct Workspace {
+  Workspace() {
+    for (auto *tensor :
+         {&inputs_tensor, &masks_tensor, &gpuInputs_tensor, &gpuMasks_tensor,
+          &extendedAttentionMask, &hidden, &attOut, &intermediateOut,
+          &unpacked, &poolingOutput, &output, &intermediateQuant.data}) {
+      trimmer.Track(tensor);
+    }
+  }
+
+  core::Tensor inputs_tensor{nullptr};
+  core::Tensor masks_tensor{nullptr};
+  core::Tensor gpuInputs_tensor{nullptr};
+  core::Tensor gpuMasks_tensor{nullptr};
+  core::Tensor extendedAttentionMask{nullptr};
+  core::Tensor hidden{nullptr};
+  core::Tensor attOut{nullptr};
+  core::Tensor intermediateOut{nullptr};
+  layers::kernels::QuantizedActivation intermediateQuant;
+  core::Tensor unpacked{nullptr};
+  core::Tensor poolingOutput{nullptr};
+  core::Tensor output{nullptr};
+  core::MemoryTrimmer trimmer;
+};
+
 struct BertModel::Impl {
-  explicit Impl(const std::string &filename, DLDeviceType device_type,
-                size_t n_layers, int64_t n_heads)
+  Impl(const std::string &filename, DLDeviceType device_type, size_t n_layers,
+       int64_t n_heads, const std::string &pq_filename)
       : device_type_(device_type) {
     auto npz = cnpy::npz_load(filename);
     NPZMapView root("", &npz);
+    cnpy::npz_t pq_npz;
+    if (!pq_filename.empty()) {
+      TT_ENFORCE(device_type == DLDeviceType::kDLCPU,
+                 "the product-quantized weights only run on CPU");
+      pq_npz = cnpy::npz_load(pq_filename);
+    }
+    NPZMapView pq_root("", &pq_npz);
 
     // HERE define your network model
     embedding_ = LoadEmbedding(root.Sub("embeddings"), device_type);
 
     for (size_t i = 0; i < n_layers; ++i) {
-      auto view = root.Sub("encoder.layer." + std::to_string(i));
-      NPZLoader params(view, device_type);
-      encoders_.emplace_back(std::move(params), n_heads);
+      auto layer = "encoder.layer." + std::to_string(i);
+      NPZLoader params(root.Sub(layer), device_type);
+      auto pq = pq_root.Sub(layer);
+      encoders_.emplace_back(std::move(params), n_heads,
+                             pq_filename.empty() ? nullptr : &pq);
     }
 
     if (root.IsExist("pooler")) {
@@ -132,39 +232,126 @@ struct BertModel::Impl {
     }
   }
 
-  // do inference
   std::vector<float> operator()(
       const std::vector<std::vector<int64_t>> &inputs,
       const std::vector<std::vector<int64_t>> &poistion_ids,
       const std::vector<std::vector<int64_t>> &segment_ids, PoolType pooling,
-      bool use_pooler) {
-    core::Tensor inputs_tensor{nullptr};
-    core::Tensor masks_tensor{nullptr};
-
-    core::Tensor gpuInputs_tensor{nullptr};
-    core::Tensor gpuMasks_tensor{nullptr};
-
-    int64_t max_seq_len =
-        std::accumulate(inputs.begin(), inputs.end(), 0,
-                        [](size_t len, const std::vector<int64_t> &input_ids) {
-                          return std::max(len, input_ids.size());
-                        });
-    int64_t batch_size = inputs.size();
-    auto *iptr = inputs_tensor.Reshape<int64_t>({batch_size, max_seq_len},
+      bool use_pooler, const std::vector<std::string> &adapters,
+      core::RequestTiming *timing) {
+    std::vector<const int64_t *> ids;
+    std::vector<int64_t> lengths;
+    for (auto &input : inputs) {
+      ids.push_back(input.data());
+      lengths.push_back(input.size());
+    }
+    std::vector<float> vec;
+    auto workspace = AcquireWorkspace();
+    Infer(workspace.get(), ids, lengths, poistion_ids, segment_ids, adapters,
+          timing, [&](const core::Tensor &hidden) {
+            auto &output =
+                use_pooler ? Pool(workspace.get(), hidden, pooling, true)
+                           : hidden;
+            vec.resize(output.numel());
+            core::Copy(output, vec);
+          });
+    ReleaseWorkspace(std::move(workspace));
+    return vec;
+  }
+
+  void operator()(const std::vector<const int64_t *> &ids,
+                  const std::vector<int64_t> &lengths,
+                  const std::vector<float *> &outputs, PoolType pooling,
+                  bool use_pooler, core::RequestTiming *timing) {
+    TT_ENFORCE_EQ(ids.size(), lengths.size(),
+                  "every sequence needs its length");
+    TT_ENFORCE_EQ(outputs.size(), ids.size(),
+                  "every sequence needs its outputs");
+    auto workspace = AcquireWorkspace();
+    Infer(workspace.get(), ids, lengths, {}, {}, {}, timing,
+          [&](const core::Tensor &hidden) {
+            auto &output = Pool(workspace.get(), hidden, pooling, use_pooler);
+            int64_t dim = output.numel() / output.shape(0);
+            for (size_t i = 0; i < outputs.size(); ++i) {
+              core::Copy(output.data<float>() + i * dim, dim, device_type_,
+                         DLDeviceType::kDLCPU, outputs[i]);
+            }
+          });
+    ReleaseWorkspace(std::move(workspace));
+  }
+
+  // (batch_size, hidden_size) the pooled hidden states, passed through the
+  // pooler if use_pooler.
+  const core::Tensor &Pool(Workspace *workspace, const core::Tensor &hidden,
+                           PoolType pooling, bool use_pooler) {
+    auto &poolingOutput = workspace->poolingOutput;
+    layers::SequencePool(static_cast<layers::types::PoolType>(pooling))(
+        hidden, &poolingOutput);
+    if (!use_pooler) {
+      return poolingOutput;
+    }
+    (*pooler_)(poolingOutput, &workspace->output);
+    return workspace->output;
+  }
+
+  // do inference, sequence i is the lengths[i] ids at ids[i]. The
+  // (batch_size, max_seq_len, hidden_size) last hidden states are handed to
+  // write_outputs, timed as the pooling.
+  void Infer(Workspace *workspace, const std::vector<const int64_t *> &ids,
+             const std::vector<int64_t> &lengths,
+             const std::vector<std::vector<int64_t>> &poistion_ids,
+             const std::vector<std::vector<int64_t>> &segment_ids,
+             const std::vector<std::string> &adapters,
+             core::RequestTiming *timing,
+             const std::function<void(const core::Tensor &)> &write_outputs) {
+    core::StageTimer timer(timing);
+    std::unique_ptr<layers::LoRABatch> lora;
+    if (!adapters.empty()) {
+      TT_ENFORCE(adapter_cache_ != nullptr,
+                 "call SetAdapterLoader before using adapters");
+      TT_ENFORCE_EQ(adapters.size(), ids.size(),
+                    "every input needs an adapter name");
+      lora.reset(new layers::LoRABatch(adapter_cache_.get(), adapters));
+    }
+    auto &inputs_tensor = workspace->inputs_tensor;
+    auto &masks_tensor = workspace->masks_tensor;
+    auto &gpuInputs_tensor = workspace->gpuInputs_tensor;
+    auto &gpuMasks_tensor = workspace->gpuMasks_tensor;
+
+    TT_ENFORCE(!lengths.empty(), "the batch has no sequence");
+    int64_t max_seq_len = *std::max_element(lengths.begin(), lengths.end());
+    int64_t batch_size = ids.size();
+    int64_t request_id = core::NextTraceRequestId();
+    TT_TRACE_REQUEST_BEGIN(request_id, batch_size, max_seq_len);
+
+    // the inputs run as packed rows of several sequences or one padded row
+    // per sequence.
+    std::unique_ptr<layers::SequencePacking> packing;
+    if (packing_row_len_ > 0 && device_type_ == DLDeviceType::kDLCPU &&
+        lora == nullptr) {
+      packing.reset(new layers::SequencePacking(lengths, packing_row_len_));
+    }
+    int64_t n_rows = packing ? packing->n_rows() : batch_size;
+    int64_t row_len = packing ? packing->row_len() : max_seq_len;
+    auto *iptr = inputs_tensor.Reshape<int64_t>({n_rows, row_len},
                                                 DLDeviceType::kDLCPU, 0);
-    auto *mptr = masks_tensor.Reshape<int64_t>({batch_size, max_seq_len},
+    auto *mptr = masks_tensor.Reshape<int64_t>({n_rows, row_len},
                                                DLDeviceType::kDLCPU, 0);
 
-    for (size_t i = 0; i < inputs.size();
-         ++i, iptr += max_seq_len, mptr += max_seq_len) {
-      auto &input = inputs[i];
-      // TODO(jiaruifang) Bert_Attention use mask value as 1 to indicate a valid
-      // position.
-      std::copy(input.begin(), input.end(), iptr);
-      std::fill(mptr, mptr + input.size(), 1);
-      if (input.size() != static_cast<size_t>(max_seq_len)) {
-        std::fill(iptr + input.size(), iptr + max_seq_len, 0);
-        std::fill(mptr + input.size(), mptr + max_seq_len, 0);
+    if (packing) {
+      packing->Pack(ids, static_cast<int64_t>(0), iptr);
+      packing->PackMask(mptr);
+    } else {
+      for (int64_t i = 0; i < batch_size;
+           ++i, iptr += max_seq_len, mptr += max_seq_len) {
+        int64_t length = lengths[i];
+        // TODO(jiaruifang) Bert_Attention use mask value as 1 to indicate a
+        // valid position.
+        std::copy(ids[i], ids[i] + length, iptr);
+        std::fill(mptr, mptr + length, 1);
+        if (length != max_seq_len) {
+          std::fill(iptr + length, iptr + max_seq_len, 0);
+          std::fill(mptr + length, mptr + max_seq_len, 0);
+        }
       }
     }
     if (device_type_ == DLDeviceType::kDLGPU) {
@@ -182,69 +369,256 @@ struct BertModel::Impl {
 
     core::Tensor seqType(nullptr);
     core::Tensor positionIds(nullptr);
-    core::Tensor extendedAttentionMask(nullptr);
+    auto &extendedAttentionMask = workspace->extendedAttentionMask;
     if (poistion_ids.size() != 0) {
       TT_ENFORCE_EQ(
           poistion_ids.size(), static_cast<size_t>(batch_size),
           "Position ids should have the same batch size as input ids");
-      PadTensor(poistion_ids, batch_size, max_seq_len, static_cast<int64_t>(0),
-                device_type_, &positionIds);
+      if (packing) {
+        packing->Pack(poistion_ids, static_cast<int64_t>(0),
+                      positionIds.Reshape<int64_t>({n_rows, row_len},
+                                                   DLDeviceType::kDLCPU, 0));
+      } else {
+        PadTensor(poistion_ids, batch_size, max_seq_len,
+                  static_cast<int64_t>(0), device_type_, &positionIds);
+      }
+    } else if (packing) {
+      // the positions restart at every sequence of a row
+      packing->PackPositionIds(positionIds.Reshape<int64_t>(
+          {n_rows, row_len}, DLDeviceType::kDLCPU, 0));
     }
     if (segment_ids.size() != 0) {
       TT_ENFORCE_EQ(segment_ids.size(), static_cast<size_t>(batch_size),
                     "Segment ids should have the same batch size as input ids");
-      PadTensor(segment_ids, batch_size, max_seq_len, static_cast<int64_t>(0),
-                device_type_, &seqType);
+      if (packing) {
+        packing->Pack(segment_ids, static_cast<int64_t>(0),
+                      seqType.Reshape<int64_t>({n_rows, row_len},
+                                               DLDeviceType::kDLCPU, 0));
+      } else {
+        PadTensor(segment_ids, batch_size, max_seq_len,
+                  static_cast<int64_t>(0), device_type_, &seqType);
+      }
     }
 
     layers::PrepareBertMasks()(
         inputIds,
         device_type_ == DLDeviceType::kDLCPU ? &masks_tensor : &gpuMasks_tensor,
         &seqType, &positionIds, &extendedAttentionMask);
+    timer.Lap(&core::RequestTiming::prepare_ms);
 
     // start inference the BERT
-    core::Tensor hidden(nullptr);
+    auto &hidden = workspace->hidden;
     (*embedding_)(inputIds, positionIds, seqType, &hidden);
-    core::Tensor attOut(nullptr);
-    core::Tensor intermediateOut(nullptr);
-    for (auto &layer : encoders_) {
-      layer(hidden, extendedAttentionMask, &attOut, &intermediateOut, &hidden);
+    timer.Lap(&core::RequestTiming::embedding_ms);
+    auto &attOut = workspace->attOut;
+    auto &intermediateOut = workspace->intermediateOut;
+    {
+      layers::PackingScope packing_scope(packing.get());
+      for (size_t i = 0; i < encoders_.size(); ++i) {
+        auto prefix = "encoder.layer." + std::to_string(i) + ".";
+        layers::LoRAScope scope(lora.get(), prefix);
+        layers::CalibrationScope calibration(calibrator_, prefix);
+        encoders_[i](hidden, extendedAttentionMask, &attOut, &intermediateOut,
+                     &workspace->intermediateQuant, &hidden);
+        timer.LapLayer();
+      }
+    }
+    auto *result = &hidden;
+    if (packing) {
+      // back to one padded row per sequence for the pooling and the outputs
+      layers::kernels::UnpackSequences(hidden, packing->segments(),
+                                       max_seq_len, &workspace->unpacked);
+      result = &workspace->unpacked;
     }
 
-    std::vector<float> vec;
-    if (use_pooler) {
-      core::Tensor output(nullptr);
-      core::Tensor poolingOutput(nullptr);
-      layers::SequencePool(static_cast<layers::types::PoolType>(pooling))(
-          hidden, &poolingOutput);
-      (*pooler_)(poolingOutput, &output);
-      vec.resize(output.numel());
-      core::Copy(output, vec);
-    } else {
-      vec.resize(hidden.numel());
-      core::Copy(hidden, vec);
+    write_outputs(*result);
+    timer.Lap(&core::RequestTiming::pooling_ms);
+    timer.Finish();
+
+    TT_TRACE_REQUEST_END(request_id, batch_size, max_seq_len);
+  }
+
+  core::WarmupReport Warmup(const std::vector<core::WarmupShape> &shapes,
+                            const core::WarmupOptions &options,
+                            int64_t n_workspaces) {
+    TT_ENFORCE_GT(n_workspaces, 0, "warm up at least one workspace");
+    // held at once, so that every dummy run lands in its own workspace.
+    std::vector<std::unique_ptr<Workspace>> workspaces;
+    for (int64_t i = 0; i < n_workspaces; ++i) {
+      workspaces.emplace_back(AcquireWorkspace());
+    }
+    auto report = core::Warmup(
+        shapes,
+        [&](int64_t batch_size, int64_t seq_len) {
+          std::vector<int64_t> zeros(seq_len, 0);
+          std::vector<const int64_t *> ids(batch_size, zeros.data());
+          std::vector<int64_t> lengths(batch_size, seq_len);
+          for (auto &workspace : workspaces) {
+            Infer(workspace.get(), ids, lengths, {}, {}, {}, nullptr,
+                  [&](const core::Tensor &hidden) {
+                    Pool(workspace.get(), hidden, PoolType::kFirst,
+                         pooler_ != nullptr);
+                  });
+          }
+        },
+        options);
+    for (auto &workspace : workspaces) {
+      ReleaseWorkspace(std::move(workspace));
     }
+    return report;
+  }
 
-    return vec;
+  std::unique_ptr<Workspace> AcquireWorkspace() {
+    std::lock_guard<std::mutex> guard(workspace_mutex_);
+    if (workspaces_.empty()) {
+      return std::unique_ptr<Workspace>(new Workspace());
+    }
+    auto workspace = std::move(workspaces_.back());
+    workspaces_.pop_back();
+    return workspace;
+  }
+
+  void ReleaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    workspace->trimmer.Step();
+    std::lock_guard<std::mutex> guard(workspace_mutex_);
+    workspaces_.emplace_back(std::move(workspace));
+  }
+
+  void TrimMemory() {
+    std::lock_guard<std::mutex> guard(workspace_mutex_);
+    for (auto &workspace : workspaces_) {
+      workspace->trimmer.Trim();
+    }
   }
 
   std::unique_ptr<layers::BERTEmbedding> embedding_;
   std::vector<BERTLayer> encoders_;
   std::unique_ptr<layers::BertPooler> pooler_;
+  std::unique_ptr<layers::LoRAAdapterCache> adapter_cache_;
+  // set while BertModel::Calibrate runs the sample requests.
+  layers::Calibrator *calibrator_{nullptr};
+  // the row length of the packed requests, 0 pads them.
+  int64_t packing_row_len_{0};
 
   DLDeviceType device_type_;
+
+  // the idle workspaces, one is created for each concurrent request.
+  std::mutex workspace_mutex_;
+  std::vector<std::unique_ptr<Workspace>> workspaces_;
 };
 
 BertModel::BertModel(const std::string &filename, DLDeviceType device_type,
-                     size_t n_layers, int64_t n_heads)
-    : m_(new Impl(filename, device_type, n_layers, n_heads)) {}
+                     size_t n_layers, int64_t n_heads,
+                     const std::string &pq_filename)
+    : m_(new Impl(filename, device_type, n_layers, n_heads, pq_filename)) {}
 
 std::vector<float> BertModel::operator()(
     const std::vector<std::vector<int64_t>> &inputs,
     const std::vector<std::vector<int64_t>> &poistion_ids,
     const std::vector<std::vector<int64_t>> &segment_ids, PoolType pooling,
-    bool use_pooler) const {
-  return m_->operator()(inputs, poistion_ids, segment_ids, pooling, use_pooler);
+    bool use_pooler, const std::vector<std::string> &adapters,
+    core::RequestTiming *timing) const {
+  return m_->operator()(inputs, poistion_ids, segment_ids, pooling, use_pooler,
+                        adapters, timing);
+}
+
+void BertModel::operator()(const std::vector<const int64_t *> &ids,
+                           const std::vector<int64_t> &lengths,
+                           const std::vector<float *> &outputs,
+                           PoolType pooling, bool use_pooler,
+                           core::RequestTiming *timing) const {
+  m_->operator()(ids, lengths, outputs, pooling, use_pooler, timing);
+}
+
+void BertModel::SetAdapterLoader(layers::LoRAAdapterCache::Loader loader,
+                                 size_t capacity_bytes) {
+  m_->adapter_cache_.reset(
+      new layers::LoRAAdapterCache(std::move(loader), capacity_bytes));
 }
 
+void BertModel::ApplyPrecisionPlan(const layers::PrecisionPlan &plan) {
+  for (size_t i = 0; i < m_->encoders_.size(); ++i) {
+    m_->encoders_[i].ApplyPrecisionPlan(
+        plan, "encoder.layer." + std::to_string(i) + ".");
+  }
+}
+
+void BertModel::Calibrate(
+    const std::vector<std::vector<std::vector<int64_t>>> &samples,
+    layers::CalibrationMethod method, layers::PrecisionPlan *plan,
+    double percentile) {
+  layers::Calibrator calibrator;
+  m_->calibrator_ = &calibrator;
+  try {
+    for (auto &inputs : samples) {
+      m_->operator()(inputs, {}, {}, PoolType::kFirst, false, {}, nullptr);
+    }
+  } catch (...) {
+    m_->calibrator_ = nullptr;
+    throw;
+  }
+  m_->calibrator_ = nullptr;
+  calibrator.ExportScales(method, plan, percentile);
+}
+
+std::shared_ptr<layers::LoRAAdapter> BertModel::LoadAdapter(
+    const std::string &filename, DLDeviceType device_type, float scale) {
+  static const std::string suffix_a = ".lora_A", suffix_b = ".lora_B";
+  auto npz = cnpy::npz_load(filename);
+  NPZMapView root("", &npz);
+  NPZLoader params(root, device_type);
+  auto adapter = std::make_shared<layers::LoRAAdapter>();
+  for (auto &item : npz) {
+    auto &key = item.first;
+    if (key.size() > suffix_a.size() &&
+        key.compare(key.size() - suffix_a.size(), suffix_a.size(),
+                    suffix_a) == 0) {
+      auto module = key.substr(0, key.size() - suffix_a.size());
+      adapter->Add(module, params[key], params[module + suffix_b], scale);
+    }
+  }
+  return adapter;
+}
+
+int64_t BertModel::LoadPQCodebooks(const std::string &filename) {
+  TT_ENFORCE(m_->device_type_ == DLDeviceType::kDLCPU,
+             "the product-quantized weights only run on CPU");
+  auto npz = cnpy::npz_load(filename);
+  NPZMapView root("", &npz);
+  int64_t n_modules = 0;
+  for (size_t i = 0; i < m_->encoders_.size(); ++i) {
+    auto view = root.Sub("encoder.layer." + std::to_string(i));
+    auto &layer = m_->encoders_[i];
+    layers::kernels::PQWeight weight;
+    if (LoadPQWeight(view, "intermediate.dense", &weight)) {
+      layer.intermediate_->SetPQWeight(std::move(weight));
+      ++n_modules;
+    }
+    if (LoadPQWeight(view, "output.dense", &weight)) {
+      layer.output_->SetPQWeight(std::move(weight));
+      ++n_modules;
+    }
+  }
+  return n_modules;
+}
+
+void BertModel::SetSequencePacking(int64_t row_len) {
+  TT_ENFORCE_GE(row_len, 0, "the row length can not be negative");
+  m_->packing_row_len_ = row_len;
+}
+
+core::WarmupReport BertModel::Warmup(
+    const std::vector<core::WarmupShape> &shapes,
+    const core::WarmupOptions &options, int64_t n_workspaces) {
+  return m_->Warmup(shapes, options, n_workspaces);
+}
+
+int64_t BertModel::vocab_size() const { return m_->embedding_->vocab_size(); }
+
+int64_t BertModel::max_positions() const {
+  return m_->embedding_->max_positions();
+}
+
+void BertModel::TrimMemory() const { m_->TrimMemory(); }
+
 BertModel::~BertModel() = default;
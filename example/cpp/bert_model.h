@@ -18,6 +18,11 @@
 #include <vector>
 
 #include "dlpack/dlpack.h"
+#include "turbo_transformers/core/request_timing.h"
+#include "turbo_transformers/core/warmup.h"
+#include "turbo_transformers/layers/calibration.h"
+#include "turbo_transformers/layers/lora.h"
+#include "turbo_transformers/layers/precision_plan.h"
 #include "turbo_transformers/layers/types.h"
 
 using namespace turbo_transformers;
@@ -25,15 +30,99 @@ using PoolType = layers::types::PoolType;
 
 class BertModel {
  public:
+  // pq_filename, if not empty, is an output of tools/train_pq_codebooks.py.
+  // The feed-forward modules it has codes for are built on their
+  // product-quantized weights, see LoadPQCodebooks, and their float weights
+  // are never loaded. CPU only.
   BertModel(const std::string &filename, DLDeviceType device_type,
-            size_t n_layers, int64_t n_heads);
+            size_t n_layers, int64_t n_heads,
+            const std::string &pq_filename = "");
   ~BertModel();
 
+  // timing, if not null, receives where the time of the request went: the
+  // preparation of the inputs, the embedding, each encoder layer and the
+  // pooling. The stages are added to, pass a fresh one to every request.
   std::vector<float> operator()(
       const std::vector<std::vector<int64_t>> &inputs,
       const std::vector<std::vector<int64_t>> &poistion_ids,
       const std::vector<std::vector<int64_t>> &segment_ids,
-      PoolType pooling = PoolType::kFirst, bool use_pooler = false) const;
+      PoolType pooling = PoolType::kFirst, bool use_pooler = false,
+      const std::vector<std::string> &adapters = {},
+      core::RequestTiming *timing = nullptr) const;
+  // Runs the sequences where they are, e.g. in the shared memory of a
+  // client: sequence i is the lengths[i] ids at ids[i], and its pooled
+  // hidden state, passed through the pooler if use_pooler, is written to the
+  // hidden_size floats at outputs[i] on CPU.
+  void operator()(const std::vector<const int64_t *> &ids,
+                  const std::vector<int64_t> &lengths,
+                  const std::vector<float *> &outputs,
+                  PoolType pooling = PoolType::kFirst, bool use_pooler = false,
+                  core::RequestTiming *timing = nullptr) const;
+
+  // Serves the LoRA fine-tunes of this model. adapters[i] names the adapter
+  // of inputs[i], an empty name runs the base model. The adapters are loaded
+  // by loader on first use and at most capacity_bytes of them are cached.
+  void SetAdapterLoader(layers::LoRAAdapterCache::Loader loader,
+                        size_t capacity_bytes);
+
+  // Switches the linear modules to the precisions chosen by the precision
+  // planner, e.g. the plan of PrecisionPlan::Load("bert.plan"). Modules are
+  // named as in the model npz, e.g. "encoder.layer.0.intermediate.dense". It
+  // must not run concurrently with inference.
+  void ApplyPrecisionPlan(const layers::PrecisionPlan &plan);
+
+  // Runs the sample batches of input ids in Float32 and sets the static int8
+  // input scales of the linear modules in plan, chosen by method from the
+  // activation histograms. Save the plan next to the weights, the int8
+  // modules of the applied plan then skip the range computation of their
+  // inputs. Call it before ApplyPrecisionPlan, not concurrently with
+  // inference.
+  void Calibrate(const std::vector<std::vector<std::vector<int64_t>>> &samples,
+                 layers::CalibrationMethod method, layers::PrecisionPlan *plan,
+                 double percentile = 99.99);
+
+  // Replaces the weights of the feed-forward modules saved in filename, the
+  // output of tools/train_pq_codebooks.py, by their product-quantized
+  // "<module>.pq_codebooks" and "<module>.pq_codes", e.g.
+  // "encoder.layer.0.intermediate.dense.pq_codes". Returns the number of
+  // modules replaced. Their float weights are released, ApplyPrecisionPlan
+  // leaves them product-quantized. CPU only, it must not run concurrently
+  // with inference.
+  int64_t LoadPQCodebooks(const std::string &filename);
+
+  // Packs the short sequences of a request end to end into rows of row_len
+  // tokens on CPU, their self attention skips the blocks across sequences.
+  // The outputs are the same as with padding. The requests with adapters are
+  // still padded, and 0 disables the packing. It must not run concurrently
+  // with inference.
+  void SetSequencePacking(int64_t row_len);
+
+  // Prepares the model for a predictable first-request latency: starts the
+  // thread pools and runs dummy inferences of every (batch_size, seq_len) of
+  // shapes, the largest shapes the deployment will serve, in n_workspaces
+  // workspaces, its expected number of concurrent requests. The workspaces
+  // are grown once and the pages of the weights and the workspaces are
+  // faulted in, and locked with options.lock_memory. Call it before serving,
+  // not concurrently with inference.
+  core::WarmupReport Warmup(
+      const std::vector<core::WarmupShape> &shapes,
+      const core::WarmupOptions &options = core::WarmupOptions(),
+      int64_t n_workspaces = 1);
+
+  // The ids of the inputs must be below vocab_size, and the sequences at
+  // most max_positions tokens long.
+  int64_t vocab_size() const;
+  int64_t max_positions() const;
+
+  // Shrinks the idle workspaces to the recent high-water mark of the request
+  // sizes. The workspaces are also trimmed periodically between requests.
+  void TrimMemory() const;
+
+  // Loads an adapter saved as "<projection>.lora_A" (in_dim, rank) and
+  // "<projection>.lora_B" (rank, out_dim) pairs, projections are named as in
+  // the model npz, e.g. "encoder.layer.0.attention.qkv".
+  static std::shared_ptr<layers::LoRAAdapter> LoadAdapter(
+      const std::string &filename, DLDeviceType device_type, float scale);
 
  private:
   struct Impl;
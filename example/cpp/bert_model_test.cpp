@@ -179,5 +179,61 @@ TEST_CASE("Bert-multiple-thread", "Cpp interface") {
   test_multiple_threads(true, 10);
 }
 
+TEST_CASE("Bert-request-timing", "Cpp interface") {
+  BertModel model(model_file_path, DLDeviceType::kDLCPU, 12, 12);
+  core::RequestTiming timing;
+  model({{12166, 10699, 16752, 4454}, {5342, 16471}}, {}, {},
+        PoolType::kFirst, true, {}, &timing);
+  REQUIRE(timing.layer_ms.size() == 12);
+  double stages = timing.prepare_ms + timing.embedding_ms + timing.pooling_ms;
+  for (double ms : timing.layer_ms) {
+    REQUIRE(ms > 0.);
+    stages += ms;
+  }
+  REQUIRE(timing.embedding_ms > 0.);
+  REQUIRE(timing.total_ms >= stages);
+}
+
+TEST_CASE("Bert-sequence-packing", "Cpp interface") {
+  BertModel model(model_file_path, DLDeviceType::kDLCPU, 12, 12);
+  std::vector<std::vector<int64_t>> input_ids{
+      {12166, 10699, 16752, 4454}, {5342, 16471}, {817, 16022, 4454}, {2}};
+  std::vector<std::vector<int64_t>> segment_ids{
+      {1, 1, 1, 0}, {1, 0}, {0, 0, 1}, {1}};
+  auto padded = model(input_ids, {}, segment_ids, PoolType::kFirst, false);
+  model.SetSequencePacking(6);
+  auto packed = model(input_ids, {}, segment_ids, PoolType::kFirst, false);
+  REQUIRE(packed.size() == padded.size());
+  for (size_t i = 0; i < input_ids.size(); ++i) {
+    for (size_t t = 0; t < input_ids[i].size(); ++t) {
+      for (size_t j = 0; j < 768; ++j) {
+        size_t idx = (i * 4 + t) * 768 + j;
+        REQUIRE(fabs(packed[idx] - padded[idx]) < 1e-3);
+      }
+    }
+  }
+}
+
+TEST_CASE("Bert-in-place", "Cpp interface") {
+  BertModel model(model_file_path, DLDeviceType::kDLCPU, 12, 12);
+  std::vector<std::vector<int64_t>> input_ids{{12166, 10699, 16752, 4454},
+                                              {5342, 16471}};
+  auto hidden = model(input_ids, {}, {}, PoolType::kFirst, false);
+  auto pooled = model(input_ids, {}, {}, PoolType::kFirst, true);
+  std::vector<float> outputs(2 * 768);
+  for (bool use_pooler : {false, true}) {
+    model({input_ids[0].data(), input_ids[1].data()}, {4, 2},
+          {outputs.data(), outputs.data() + 768}, PoolType::kFirst,
+          use_pooler);
+    for (size_t i = 0; i < input_ids.size(); ++i) {
+      for (size_t j = 0; j < 768; ++j) {
+        float expected = use_pooler ? pooled[i * 768 + j]
+                                    : hidden[i * 4 * 768 + j];
+        REQUIRE(fabs(outputs[i * 768 + j] - expected) < 1e-5);
+      }
+    }
+  }
+}
+
 }  // namespace loaders
 }  // namespace turbo_transformers
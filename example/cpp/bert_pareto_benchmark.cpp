@@ -0,0 +1,508 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+// Compares the fast modes of BertModel on a local evaluation set to pick the
+// mode of a deployment:
+//   bert_pareto_benchmark bert.npz 12 12 eval.txt [--option=value ...]
+// eval.txt holds one sequence of input ids per line, separated by spaces and
+// optionally preceded by its integer label and a tab. Every mode runs the
+// set in batches on a freshly loaded model and is scored against the labels,
+// or by its agreement with fp32, for latency, throughput, memory and
+// accuracy. The modes on the accuracy-versus-latency Pareto frontier are
+// marked in the csv and listed in the json.
+//
+// The options:
+//   --batch=8                  sequences per request
+//   --repeats=3                timed passes over the set after a warm-up
+//   --head=head.npz            a classifier "classifier.weight" (n_labels,
+//                              hidden) and "classifier.bias" on the pooled
+//                              outputs, for the accuracy and the agreement
+//   --pq=pq.npz                the codebooks of tools/train_pq_codebooks.py
+//   --plan=name:file.plan      a precision plan, e.g. of the planner,
+//                              repeatable
+//   --packing=128              also runs every mode with sequence packing
+//   --calibration-batches=8    the batches calibrating the static int8 mode
+//   --csv=pareto.csv --json=pareto.json
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bert_model.h"
+#include "cnpy.h"
+#include "turbo_transformers/core/allocator.h"
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/layers/precision_plan.h"
+
+namespace {
+
+using turbo_transformers::layers::PrecisionPlan;
+using turbo_transformers::layers::types::QuantType;
+using Batch = std::vector<std::vector<int64_t>>;
+
+struct Options {
+  std::string model;
+  size_t n_layers{12};
+  int64_t n_heads{12};
+  std::string eval;
+  int64_t batch{8};
+  int64_t repeats{3};
+  std::string head;
+  std::string pq;
+  std::vector<std::pair<std::string, std::string>> plans;
+  int64_t packing{0};
+  int64_t calibration_batches{8};
+  std::string csv{"pareto.csv"};
+  std::string json{"pareto.json"};
+};
+
+struct EvalSet {
+  std::vector<std::vector<int64_t>> sequences;
+  // -1 for the unlabelled sequences
+  std::vector<int64_t> labels;
+
+  bool labelled() const {
+    return std::all_of(labels.begin(), labels.end(),
+                       [](int64_t label) { return label >= 0; });
+  }
+};
+
+EvalSet LoadEvalSet(const std::string &filename) {
+  std::ifstream in(filename);
+  TT_ENFORCE(in.good(), "can not open %s", filename);
+  EvalSet set;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    int64_t label = -1;
+    auto tab = line.find('\t');
+    if (tab != std::string::npos) {
+      label = std::stol(line.substr(0, tab));
+      line = line.substr(tab + 1);
+    }
+    std::istringstream ids(line);
+    std::vector<int64_t> sequence;
+    int64_t id;
+    while (ids >> id) {
+      sequence.push_back(id);
+    }
+    TT_ENFORCE(!sequence.empty(), "an empty sequence in %s", filename);
+    set.sequences.push_back(std::move(sequence));
+    set.labels.push_back(label);
+  }
+  TT_ENFORCE(!set.sequences.empty(), "%s has no sequences", filename);
+  return set;
+}
+
+// A linear classifier on the pooled outputs.
+struct Head {
+  std::vector<float> weight;  // (n_labels, hidden)
+  std::vector<float> bias;
+  int64_t n_labels{0};
+  int64_t hidden{0};
+
+  bool empty() const { return n_labels == 0; }
+
+  int64_t Predict(const float *pooled) const {
+    int64_t best = 0;
+    float best_logit = 0.f;
+    for (int64_t i = 0; i < n_labels; ++i) {
+      float logit = bias[i];
+      for (int64_t j = 0; j < hidden; ++j) {
+        logit += weight[i * hidden + j] * pooled[j];
+      }
+      if (i == 0 || logit > best_logit) {
+        best = i;
+        best_logit = logit;
+      }
+    }
+    return best;
+  }
+};
+
+Head LoadHead(const std::string &filename) {
+  auto npz = cnpy::npz_load(filename);
+  TT_ENFORCE(npz.count("classifier.weight") && npz.count("classifier.bias"),
+             "%s has no classifier.weight and classifier.bias", filename);
+  auto &weight = npz["classifier.weight"];
+  auto &bias = npz["classifier.bias"];
+  TT_ENFORCE(weight.shape.size() == 2 && weight.word_size == 4 &&
+                 bias.word_size == 4 && bias.shape.size() == 1 &&
+                 bias.shape[0] == weight.shape[0],
+             "the classifier of %s must be float32 (n_labels, hidden) and "
+             "(n_labels)",
+             filename);
+  Head head;
+  head.n_labels = weight.shape[0];
+  head.hidden = weight.shape[1];
+  head.weight.assign(weight.data<float>(),
+                     weight.data<float>() + head.n_labels * head.hidden);
+  head.bias.assign(bias.data<float>(), bias.data<float>() + head.n_labels);
+  return head;
+}
+
+struct Mode {
+  std::string name;
+  // configures a freshly loaded model
+  std::function<void(BertModel *)> apply;
+  int64_t packing{0};
+  // the PQ codebooks the model is loaded with
+  std::string pq;
+};
+
+struct Result {
+  std::string name;
+  double p50_ms{0.};
+  double p99_ms{0.};
+  double sequences_per_s{0.};
+  double rss_mb{0.};
+  // the mean cosine similarity of the pooled outputs to fp32
+  double cosine{1.};
+  // the predictions of the head, the same as fp32 and the same as the label
+  double agreement{-1.};
+  double accuracy{-1.};
+  double score{0.};
+  bool pareto{false};
+};
+
+PrecisionPlan UniformPlan(size_t n_layers, QuantType attention,
+                          QuantType ffn) {
+  PrecisionPlan plan;
+  for (size_t i = 0; i < n_layers; ++i) {
+    auto prefix = "encoder.layer." + std::to_string(i) + ".";
+    plan.Set(prefix + "attention.qkv", attention);
+    plan.Set(prefix + "attention.output.dense", attention);
+    plan.Set(prefix + "intermediate.dense", ffn);
+    plan.Set(prefix + "output.dense", ffn);
+  }
+  return plan;
+}
+
+std::vector<Mode> BuildModes(const Options &options,
+                             const std::vector<Batch> &batches) {
+  std::vector<Mode> modes;
+  auto uniform = [&](const std::string &name, QuantType attention,
+                     QuantType ffn) {
+    auto plan = UniformPlan(options.n_layers, attention, ffn);
+    modes.push_back({name, [plan](BertModel *model) {
+                       model->ApplyPrecisionPlan(plan);
+                     }});
+  };
+  // fp32 first, the reference of the agreement
+  modes.push_back({"fp32", [](BertModel *) {}});
+  uniform("int8-ffn", QuantType::kFloat32, QuantType::kInt8);
+  uniform("int8", QuantType::kInt8, QuantType::kInt8);
+  uniform("int4-attention-int8-ffn", QuantType::kInt4, QuantType::kInt8);
+  std::vector<Batch> calibration(
+      batches.begin(),
+      batches.begin() + std::min<size_t>(options.calibration_batches,
+                                         batches.size()));
+  size_t n_layers = options.n_layers;
+  modes.push_back({"int8-static", [calibration, n_layers](BertModel *model) {
+                     auto plan = UniformPlan(n_layers, QuantType::kInt8,
+                                             QuantType::kInt8);
+                     model->Calibrate(
+                         calibration,
+                         turbo_transformers::layers::CalibrationMethod::
+                             kPercentile,
+                         &plan);
+                     model->ApplyPrecisionPlan(plan);
+                   }});
+  if (!options.pq.empty()) {
+    // loaded with the model, so the float FFN weights are never resident
+    Mode pq_ffn{"pq-ffn", [](BertModel *) {}};
+    pq_ffn.pq = options.pq;
+    modes.push_back(std::move(pq_ffn));
+  }
+  for (auto &name_file : options.plans) {
+    auto plan = PrecisionPlan::Load(name_file.second);
+    modes.push_back({name_file.first, [plan](BertModel *model) {
+                       model->ApplyPrecisionPlan(plan);
+                     }});
+  }
+  if (options.packing > 0) {
+    size_t n_modes = modes.size();
+    for (size_t i = 0; i < n_modes; ++i) {
+      auto packed = modes[i];
+      packed.name += "+packing";
+      packed.packing = options.packing;
+      modes.push_back(std::move(packed));
+    }
+  }
+  return modes;
+}
+
+double Percentile(std::vector<double> values, double p) {
+  size_t k = std::min(values.size() - 1,
+                      static_cast<size_t>(p * (values.size() - 1) + 0.5));
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+double Cosine(const float *a, const float *b, int64_t n) {
+  double dot = 0., norm_a = 0., norm_b = 0.;
+  for (int64_t i = 0; i < n; ++i) {
+    dot += a[i] * b[i];
+    norm_a += a[i] * a[i];
+    norm_b += b[i] * b[i];
+  }
+  return norm_a == 0. || norm_b == 0. ? (norm_a == norm_b ? 1. : 0.)
+                                      : dot / std::sqrt(norm_a * norm_b);
+}
+
+// Runs the mode over the set and returns the pooled outputs of every
+// sequence in *outputs.
+Result RunMode(const Options &options, const Mode &mode,
+               const std::vector<Batch> &batches,
+               std::vector<float> *outputs) {
+  auto &allocator = turbo_transformers::core::Allocator::GetInstance();
+  allocator.Trim(kDLCPU);
+  size_t rss_before = turbo_transformers::core::GetResidentMemoryBytes();
+  BertModel model(options.model, kDLCPU, options.n_layers, options.n_heads,
+                  mode.pq);
+  mode.apply(&model);
+  model.SetSequencePacking(mode.packing);
+
+  Result result;
+  result.name = mode.name;
+  outputs->clear();
+  int64_t n_sequences = 0;
+  for (auto &batch : batches) {
+    auto pooled = model(batch, {}, {}, PoolType::kFirst, true);
+    outputs->insert(outputs->end(), pooled.begin(), pooled.end());
+    n_sequences += batch.size();
+  }
+  std::vector<double> latencies;
+  double total_s = 0.;
+  for (int64_t r = 0; r < options.repeats; ++r) {
+    for (auto &batch : batches) {
+      auto start = std::chrono::steady_clock::now();
+      model(batch, {}, {}, PoolType::kFirst, true);
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+      latencies.push_back(ms);
+      total_s += ms / 1e3;
+    }
+  }
+  result.rss_mb =
+      (static_cast<double>(
+           turbo_transformers::core::GetResidentMemoryBytes()) -
+       static_cast<double>(rss_before)) /
+      (1 << 20);
+  result.p50_ms = Percentile(latencies, 0.5);
+  result.p99_ms = Percentile(latencies, 0.99);
+  result.sequences_per_s = n_sequences * options.repeats / total_s;
+  return result;
+}
+
+void Score(const EvalSet &set, const Head &head,
+           const std::vector<float> &reference,
+           const std::vector<float> &outputs, Result *result) {
+  int64_t n = set.sequences.size();
+  int64_t hidden = outputs.size() / n;
+  TT_ENFORCE(head.empty() || head.hidden == hidden,
+             "the classifier takes %d features, the model outputs %d",
+             head.hidden, hidden);
+  double cosine = 0.;
+  int64_t agree = 0, correct = 0;
+  for (int64_t i = 0; i < n; ++i) {
+    const float *output = outputs.data() + i * hidden;
+    cosine += Cosine(output, reference.data() + i * hidden, hidden);
+    if (!head.empty()) {
+      int64_t prediction = head.Predict(output);
+      agree += prediction == head.Predict(reference.data() + i * hidden);
+      correct += prediction == set.labels[i];
+    }
+  }
+  result->cosine = cosine / n;
+  result->score = result->cosine;
+  if (!head.empty()) {
+    result->agreement = static_cast<double>(agree) / n;
+    result->score = result->agreement;
+    if (set.labelled()) {
+      result->accuracy = static_cast<double>(correct) / n;
+      result->score = result->accuracy;
+    }
+  }
+}
+
+// A mode is on the frontier if no other mode is at least as fast and as
+// accurate, and strictly better in one of them.
+void MarkPareto(std::vector<Result> *results) {
+  for (auto &a : *results) {
+    a.pareto = std::none_of(
+        results->begin(), results->end(), [&](const Result &b) {
+          return b.p50_ms <= a.p50_ms && b.score >= a.score &&
+                 (b.p50_ms < a.p50_ms || b.score > a.score);
+        });
+  }
+}
+
+void WriteCsv(const std::string &filename,
+              const std::vector<Result> &results) {
+  std::ofstream out(filename);
+  out << "mode,p50_ms,p99_ms,sequences_per_s,rss_mb,cosine,agreement,"
+         "accuracy,score,pareto\n";
+  for (auto &r : results) {
+    out << r.name << "," << r.p50_ms << "," << r.p99_ms << ","
+        << r.sequences_per_s << "," << r.rss_mb << "," << r.cosine << ","
+        << r.agreement << "," << r.accuracy << "," << r.score << ","
+        << r.pareto << "\n";
+  }
+}
+
+void WriteJson(const std::string &filename, const std::string &metric,
+               const std::vector<Result> &results) {
+  std::ofstream out(filename);
+  out << "{\n  \"metric\": \"" << metric << "\",\n  \"modes\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto &r = results[i];
+    out << "    {\"mode\": \"" << r.name << "\", \"p50_ms\": " << r.p50_ms
+        << ", \"p99_ms\": " << r.p99_ms
+        << ", \"sequences_per_s\": " << r.sequences_per_s
+        << ", \"rss_mb\": " << r.rss_mb << ", \"cosine\": " << r.cosine
+        << ", \"agreement\": " << r.agreement
+        << ", \"accuracy\": " << r.accuracy << ", \"score\": " << r.score
+        << ", \"pareto\": " << (r.pareto ? "true" : "false") << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ],\n  \"pareto\": [";
+  bool first = true;
+  for (auto &r : results) {
+    if (r.pareto) {
+      out << (first ? "" : ", ") << "\"" << r.name << "\"";
+      first = false;
+    }
+  }
+  out << "]\n}\n";
+}
+
+bool ParseOptions(int argc, char *argv[], Options *options) {
+  if (argc < 5) {
+    return false;
+  }
+  options->model = argv[1];
+  options->n_layers = std::stoul(argv[2]);
+  options->n_heads = std::stol(argv[3]);
+  options->eval = argv[4];
+  for (int i = 5; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto equal = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equal == std::string::npos) {
+      return false;
+    }
+    auto key = arg.substr(2, equal - 2);
+    auto value = arg.substr(equal + 1);
+    if (key == "batch") {
+      options->batch = std::stol(value);
+    } else if (key == "repeats") {
+      options->repeats = std::stol(value);
+    } else if (key == "head") {
+      options->head = value;
+    } else if (key == "pq") {
+      options->pq = value;
+    } else if (key == "plan") {
+      auto colon = value.find(':');
+      if (colon == std::string::npos) {
+        return false;
+      }
+      options->plans.emplace_back(value.substr(0, colon),
+                                  value.substr(colon + 1));
+    } else if (key == "packing") {
+      options->packing = std::stol(value);
+    } else if (key == "calibration-batches") {
+      options->calibration_batches = std::stol(value);
+    } else if (key == "csv") {
+      options->csv = value;
+    } else if (key == "json") {
+      options->json = value;
+    } else {
+      return false;
+    }
+  }
+  return options->batch > 0 && options->repeats > 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " model.npz n_layers n_heads eval.txt [--batch=8] "
+                 "[--repeats=3] [--head=head.npz] [--pq=pq.npz] "
+                 "[--plan=name:file.plan ...] [--packing=row_len] "
+                 "[--calibration-batches=8] [--csv=pareto.csv] "
+                 "[--json=pareto.json]"
+              << std::endl;
+    return 1;
+  }
+  auto set = LoadEvalSet(options.eval);
+  Head head;
+  if (!options.head.empty()) {
+    head = LoadHead(options.head);
+  }
+  std::vector<Batch> batches;
+  for (size_t i = 0; i < set.sequences.size(); i += options.batch) {
+    batches.emplace_back(
+        set.sequences.begin() + i,
+        set.sequences.begin() +
+            std::min(set.sequences.size(), i + options.batch));
+  }
+  std::string metric = head.empty()
+                           ? "cosine"
+                           : (set.labelled() ? "accuracy" : "agreement");
+
+  std::vector<Result> results;
+  std::vector<float> reference, outputs;
+  for (auto &mode : BuildModes(options, batches)) {
+    try {
+      auto result = RunMode(options, mode, batches, &outputs);
+      if (reference.empty()) {
+        reference = outputs;
+      }
+      Score(set, head, reference, outputs, &result);
+      std::cerr << result.name << ": p50 " << result.p50_ms << "ms, "
+                << result.sequences_per_s << " sequences/s, " << metric
+                << " " << result.score << std::endl;
+      results.push_back(result);
+    } catch (std::exception &e) {
+      if (reference.empty()) {
+        throw;
+      }
+      // e.g. a mode not supported by this build
+      std::cerr << mode.name << " skipped: " << e.what() << std::endl;
+    }
+  }
+  MarkPareto(&results);
+  WriteCsv(options.csv, results);
+  WriteJson(options.json, metric, results);
+  for (auto &r : results) {
+    if (r.pareto) {
+      std::cout << r.name << " " << r.p50_ms << "ms " << metric << " "
+                << r.score << std::endl;
+    }
+  }
+  return 0;
+}
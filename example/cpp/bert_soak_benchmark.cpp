@@ -0,0 +1,285 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+// A soak test reproducing offline the slow memory growth and latency drift
+// seen after days in production:
+//   bert_soak_benchmark bert.npz 12 12 [--option=value ...]
+// Worker threads send requests of random shapes and pooling to one
+// BertModel, so they run through its workspace pool and trimming, the masks,
+// the embedding and the pooling of the serving path, while the main thread
+// samples the RSS, the bytes cached by the allocator and the latency
+// percentiles, and flags monotonic growth or drift at the end.
+//
+// The options:
+//   --seconds=60           the length of the soak, set hours for a real one
+//   --threads=2            the workers
+//   --sample-seconds=5     the sampling period
+//   --max-batch=8          sequences per request
+//   --max-seq-len=256      tokens per sequence, at most the position table
+//   --vocab=1000           the ids are drawn below it, at most the vocabulary
+//   --csv=soak.csv         also writes the samples there
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bert_model.h"
+#include "turbo_transformers/core/allocator.h"
+#include "turbo_transformers/core/memory.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string model;
+  size_t n_layers{12};
+  int64_t n_heads{12};
+  double seconds{60};
+  int threads{2};
+  double sample_seconds{5};
+  int64_t max_batch{8};
+  int64_t max_seq_len{256};
+  int64_t vocab{1000};
+  std::string csv;
+};
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0.;
+  }
+  size_t k = std::min(values.size() - 1,
+                      static_cast<size_t>(p * (values.size() - 1) + 0.5));
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+class LatencyWindow {
+ public:
+  void Add(double ms) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    latencies_.push_back(ms);
+  }
+  std::vector<double> Drain() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<double> drained;
+    drained.swap(latencies_);
+    return drained;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<double> latencies_;
+};
+
+struct SoakSample {
+  double elapsed_s;
+  size_t rss_bytes;
+  size_t cached_bytes;
+  size_t requests;
+  double p50_ms, p99_ms;
+};
+
+// The least squares slope of y over x.
+double Slope(const std::vector<double> &x, const std::vector<double> &y) {
+  double n = x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    sx += x[i];
+    sy += y[i];
+    sxx += x[i] * x[i];
+    sxy += x[i] * y[i];
+  }
+  double denominator = n * sxx - sx * sx;
+  return denominator == 0 ? 0 : (n * sxy - sx * sy) / denominator;
+}
+
+double Median(std::vector<double> values) { return Percentile(values, 0.5); }
+
+// Flags the growth of a quantity whose samples after the warmup rise at
+// almost every step, and the drift of a latency whose last quarter is well
+// above its first quarter.
+void ReportDrift(const std::vector<SoakSample> &all_samples) {
+  size_t warmup = all_samples.size() / 5;
+  std::vector<SoakSample> samples(all_samples.begin() + warmup,
+                                  all_samples.end());
+  if (samples.size() < 4) {
+    std::cout << "soak: too few samples after warmup to judge drift"
+              << std::endl;
+    return;
+  }
+  std::vector<double> hours, rss, cached;
+  size_t rises = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    hours.push_back(samples[i].elapsed_s / 3600.);
+    rss.push_back(samples[i].rss_bytes);
+    cached.push_back(samples[i].cached_bytes);
+    if (i > 0 && samples[i].rss_bytes > samples[i - 1].rss_bytes) {
+      ++rises;
+    }
+  }
+  double rise_fraction = static_cast<double>(rises) / (samples.size() - 1);
+  double growth = (rss.back() - rss.front()) / rss.front();
+  bool rss_growing = rise_fraction >= 0.8 && growth > 0.05;
+  std::cout << "soak: RSS slope " << Slope(hours, rss) / (1 << 20)
+            << " MB/hour, rose in " << rise_fraction * 100
+            << "% of the samples, " << growth * 100 << "% overall -> "
+            << (rss_growing ? "FLAGGED monotonic growth" : "ok") << std::endl;
+  std::cout << "soak: allocator cache slope "
+            << Slope(hours, cached) / (1 << 20) << " MB/hour" << std::endl;
+
+  size_t quarter = samples.size() / 4;
+  std::vector<double> first, last;
+  for (size_t i = 0; i < quarter; ++i) {
+    first.push_back(samples[i].p99_ms);
+    last.push_back(samples[samples.size() - 1 - i].p99_ms);
+  }
+  double ratio = Median(first) > 0 ? Median(last) / Median(first) : 1.;
+  std::cout << "soak: p99 " << Median(first) << " -> " << Median(last)
+            << " ms (x" << ratio << ") -> "
+            << (ratio > 1.25 ? "FLAGGED drift" : "ok") << std::endl;
+}
+
+bool ParseOptions(int argc, char *argv[], Options *options) {
+  if (argc < 4) {
+    return false;
+  }
+  options->model = argv[1];
+  options->n_layers = std::stoul(argv[2]);
+  options->n_heads = std::stol(argv[3]);
+  for (int i = 4; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto equal = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equal == std::string::npos) {
+      return false;
+    }
+    auto key = arg.substr(2, equal - 2);
+    auto value = arg.substr(equal + 1);
+    if (key == "seconds") {
+      options->seconds = std::stod(value);
+    } else if (key == "threads") {
+      options->threads = std::stoi(value);
+    } else if (key == "sample-seconds") {
+      options->sample_seconds = std::stod(value);
+    } else if (key == "max-batch") {
+      options->max_batch = std::stol(value);
+    } else if (key == "max-seq-len") {
+      options->max_seq_len = std::stol(value);
+    } else if (key == "vocab") {
+      options->vocab = std::stol(value);
+    } else if (key == "csv") {
+      options->csv = value;
+    } else {
+      return false;
+    }
+  }
+  return options->threads > 0 && options->sample_seconds > 0 &&
+         options->max_batch > 0 && options->max_seq_len > 0 &&
+         options->vocab > 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " model.npz n_layers n_heads [--seconds=60] [--threads=2] "
+                 "[--sample-seconds=5] [--max-batch=8] [--max-seq-len=256] "
+                 "[--vocab=1000] [--csv=soak.csv]"
+              << std::endl;
+    return 1;
+  }
+  BertModel model(options.model, kDLCPU, options.n_layers, options.n_heads);
+  LatencyWindow latency;
+  std::atomic<bool> stop{false};
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < options.threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::mt19937 gen(t);
+      std::uniform_int_distribution<int64_t> batch(1, options.max_batch);
+      // mostly short requests with a long tail, the pattern that strands
+      // workspace capacity
+      std::exponential_distribution<double> seq_len(8. / options.max_seq_len);
+      std::uniform_int_distribution<int64_t> id(0, options.vocab - 1);
+      std::uniform_int_distribution<int> pooling(0, 3);
+      std::bernoulli_distribution use_pooler(0.5);
+      const PoolType poolings[] = {PoolType::kFirst, PoolType::kLast,
+                                   PoolType::kMean, PoolType::kMax};
+      std::vector<std::vector<int64_t>> inputs;
+      while (!stop.load()) {
+        inputs.resize(batch(gen));
+        for (auto &sequence : inputs) {
+          sequence.resize(std::min<int64_t>(
+              options.max_seq_len, 1 + static_cast<int64_t>(seq_len(gen))));
+          for (auto &token : sequence) {
+            token = id(gen);
+          }
+        }
+        auto start = Clock::now();
+        model(inputs, {}, {}, poolings[pooling(gen)], use_pooler(gen));
+        latency.Add(Seconds(start) * 1e3);
+      }
+    });
+  }
+
+  std::vector<SoakSample> samples;
+  std::unique_ptr<std::ofstream> csv;
+  if (!options.csv.empty()) {
+    csv.reset(new std::ofstream(options.csv));
+    *csv << "elapsed_s,rss_bytes,cached_bytes,requests,p50_ms,p99_ms\n";
+  }
+  auto start = Clock::now();
+  std::cout << "soak: " << options.threads << " threads for "
+            << options.seconds << " s" << std::endl;
+  while (Seconds(start) < options.seconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        static_cast<int64_t>(options.sample_seconds * 1e3)));
+    auto latencies = latency.Drain();
+    SoakSample sample{Seconds(start),
+                      core::GetResidentMemoryBytes(),
+                      core::Allocator::GetInstance().cached_bytes(kDLCPU),
+                      latencies.size(),
+                      Percentile(latencies, 0.5),
+                      Percentile(latencies, 0.99)};
+    samples.push_back(sample);
+    std::cout << "soak: " << sample.elapsed_s << " s, RSS "
+              << sample.rss_bytes / (1 << 20) << " MB, cached "
+              << sample.cached_bytes / (1 << 20) << " MB, "
+              << sample.requests << " req p50 " << sample.p50_ms << " p99 "
+              << sample.p99_ms << " ms" << std::endl;
+    if (csv) {
+      *csv << sample.elapsed_s << "," << sample.rss_bytes << ","
+           << sample.cached_bytes << "," << sample.requests << ","
+           << sample.p50_ms << "," << sample.p99_ms << std::endl;
+    }
+  }
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  ReportDrift(samples);
+  return 0;
+}
@@ -0,0 +1,257 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "ipc_client.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "ipc_protocol.h"
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace ipc {
+
+namespace {
+
+void SendMessage(int fd, const Message &message) {
+  TT_ENFORCE_EQ(send(fd, &message, sizeof(message), MSG_NOSIGNAL),
+                static_cast<ssize_t>(sizeof(message)),
+                "can not send to the daemon: %s", std::strerror(errno));
+}
+
+Message ReceiveMessage(int fd) {
+  Message message;
+  TT_ENFORCE_EQ(recv(fd, &message, sizeof(message), 0),
+                static_cast<ssize_t>(sizeof(message)),
+                "the daemon closed the connection");
+  return message;
+}
+
+}  // namespace
+
+IpcClient::IpcClient(const std::string &socket_path, int64_t n_slots,
+                     int64_t slot_bytes) {
+  TT_ENFORCE_GT(n_slots, 0, "a client needs a slot");
+  TT_ENFORCE_GE(slot_bytes, static_cast<int64_t>(2 * kSlotHeaderBytes),
+                "the slots of %d bytes are too small", slot_bytes);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  TT_ENFORCE_LT(socket_path.size(), sizeof(address.sun_path),
+                "the socket path %s is too long", socket_path);
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  slot_bytes_ = AlignSlot(slot_bytes);
+  shared_bytes_ = SharedBytes(n_slots, slot_bytes_);
+  int shared_fd = -1;
+  try {
+    fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    TT_ENFORCE_GE(fd_, 0, "socket: %s", std::strerror(errno));
+    TT_ENFORCE_EQ(connect(fd_, reinterpret_cast<sockaddr *>(&address),
+                          sizeof(address)),
+                  0, "can not connect to %s: %s", socket_path,
+                  std::strerror(errno));
+    // sealed so the daemon can rely on the size of its mapping.
+    shared_fd = memfd_create("turbo_transformers_ipc",
+                             MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    TT_ENFORCE_GE(shared_fd, 0, "memfd_create: %s", std::strerror(errno));
+    TT_ENFORCE(ftruncate(shared_fd, shared_bytes_) == 0 &&
+                   fcntl(shared_fd, F_ADD_SEALS,
+                         F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0,
+               "can not size the shared memory: %s", std::strerror(errno));
+    shared_ = mmap(nullptr, shared_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   shared_fd, 0);
+    TT_ENFORCE(shared_ != MAP_FAILED, "mmap: %s", std::strerror(errno));
+    SharedHeader header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.n_slots = static_cast<uint32_t>(n_slots);
+    header.slot_bytes = slot_bytes_;
+    std::memcpy(shared_, &header, sizeof(header));
+
+    Message hello{};
+    hello.type = MessageType::kHello;
+    iovec iov{&hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &shared_fd, sizeof(int));
+    TT_ENFORCE_EQ(sendmsg(fd_, &msg, MSG_NOSIGNAL),
+                  static_cast<ssize_t>(sizeof(hello)),
+                  "can not send to the daemon: %s", std::strerror(errno));
+    close(shared_fd);
+    shared_fd = -1;
+    auto reply = ReceiveMessage(fd_);
+    TT_ENFORCE(reply.type == MessageType::kHello && reply.status == kOk,
+               "the daemon refused the shared memory");
+  } catch (...) {
+    if (shared_fd >= 0) {
+      close(shared_fd);
+    }
+    if (shared_ != nullptr && shared_ != MAP_FAILED) {
+      munmap(shared_, shared_bytes_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    throw;
+  }
+  slots_.resize(n_slots);
+}
+
+IpcClient::~IpcClient() {
+  munmap(shared_, shared_bytes_);
+  close(fd_);
+}
+
+char *IpcClient::slot(int64_t i) const {
+  return static_cast<char *>(shared_) + kSharedHeaderBytes + i * slot_bytes_;
+}
+
+uint32_t IpcClient::Lookup(const std::string &name, int64_t *output_dim) {
+  TT_ENFORCE_LE(name.size(), kMaxModelName, "the model name %s is too long",
+                name);
+  TT_ENFORCE(std::none_of(slots_.begin(), slots_.end(),
+                          [](const SlotState &s) { return s.pending; }),
+             "look up the models before the requests");
+  Message message{};
+  message.type = MessageType::kLookup;
+  std::memcpy(message.name, name.data(), name.size());
+  SendMessage(fd_, message);
+  auto reply = ReceiveMessage(fd_);
+  TT_ENFORCE(reply.type == MessageType::kLookup && reply.status == kOk,
+             "the daemon has no model %s", name);
+  if (output_dim != nullptr) {
+    *output_dim = reply.value;
+  }
+  return reply.slot;
+}
+
+int64_t *IpcClient::PrepareRequest(int64_t slot, uint32_t model,
+                                   const std::vector<int64_t> &lengths) {
+  TT_ENFORCE(slot >= 0 && slot < n_slots(), "no slot %d", slot);
+  TT_ENFORCE(!slots_[slot].pending, "the slot %d has a request in flight",
+             slot);
+  TT_ENFORCE(!lengths.empty(), "a request needs a sequence");
+  uint64_t n_tokens = 0;
+  for (auto length : lengths) {
+    TT_ENFORCE_GT(length, 0, "the sequences can not be empty");
+    n_tokens += length;
+  }
+  SlotHeader header{};
+  header.model = model;
+  header.n_sequences = static_cast<uint32_t>(lengths.size());
+  header.n_tokens = n_tokens;
+  header.output_offset = OutputOffset(lengths.size(), n_tokens);
+  TT_ENFORCE_LT(header.output_offset, slot_bytes_,
+                "%d tokens do not fit the slots of %d bytes", n_tokens,
+                slot_bytes_);
+  char *base = this->slot(slot);
+  std::memcpy(base, &header, sizeof(header));
+  auto *dst = reinterpret_cast<int64_t *>(base + kSlotHeaderBytes);
+  std::copy(lengths.begin(), lengths.end(), dst);
+  return dst + lengths.size();
+}
+
+void IpcClient::Submit(int64_t slot) {
+  TT_ENFORCE(slot >= 0 && slot < n_slots(), "no slot %d", slot);
+  TT_ENFORCE(!slots_[slot].pending, "the slot %d has a request in flight",
+             slot);
+  Message message{};
+  message.type = MessageType::kInfer;
+  message.slot = static_cast<uint32_t>(slot);
+  slots_[slot] = SlotState();
+  // stamped before the send, the daemon may receive it before we return.
+  slots_[slot].submitted = std::chrono::steady_clock::now();
+  SendMessage(fd_, message);
+  slots_[slot].pending = true;
+}
+
+void IpcClient::ReceiveCompletion() {
+  auto reply = ReceiveMessage(fd_);
+  TT_ENFORCE(reply.type == MessageType::kInfer &&
+                 reply.slot < slots_.size() && slots_[reply.slot].pending,
+             "unexpected reply of the daemon");
+  auto &state = slots_[reply.slot];
+  state.done = true;
+  state.status = reply.status;
+  state.value = reply.value;
+}
+
+const float *IpcClient::Wait(int64_t slot, int64_t *n_outputs,
+                             core::RequestTiming *timing) {
+  TT_ENFORCE(slot >= 0 && slot < n_slots() && slots_[slot].pending,
+             "the slot %d has no request in flight", slot);
+  while (!slots_[slot].done) {
+    ReceiveCompletion();
+  }
+  auto &state = slots_[slot];
+  state.pending = false;
+  SlotHeader header;
+  std::memcpy(&header, this->slot(slot), sizeof(header));
+  if (timing != nullptr) {
+    timing->queue_ms = header.queue_ms;
+    timing->batch_ms = header.batch_ms;
+    timing->prepare_ms = header.prepare_ms;
+    timing->embedding_ms = header.embedding_ms;
+    timing->layer_ms.assign(
+        header.layer_ms,
+        header.layer_ms + std::min<size_t>(header.n_layers, kMaxTimedLayers));
+    timing->pooling_ms = header.pooling_ms;
+    timing->total_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - state.submitted)
+                           .count();
+  }
+  const char *outputs = this->slot(slot) + header.output_offset;
+  if (state.status != kOk) {
+    TT_THROW("the request failed: %s", std::string(outputs, state.value));
+  }
+  if (n_outputs != nullptr) {
+    *n_outputs = state.value;
+  }
+  return reinterpret_cast<const float *>(outputs);
+}
+
+std::vector<float> IpcClient::Infer(
+    uint32_t model, const std::vector<std::vector<int64_t>> &inputs) {
+  std::vector<int64_t> lengths;
+  for (auto &input : inputs) {
+    lengths.push_back(input.size());
+  }
+  int64_t *ids = PrepareRequest(0, model, lengths);
+  for (auto &input : inputs) {
+    ids = std::copy(input.begin(), input.end(), ids);
+  }
+  Submit(0);
+  int64_t n_outputs;
+  const float *outputs = Wait(0, &n_outputs);
+  return std::vector<float>(outputs, outputs + n_outputs);
+}
+
+}  // namespace ipc
+}  // namespace turbo_transformers
@@ -0,0 +1,82 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "turbo_transformers/core/request_timing.h"
+
+namespace turbo_transformers {
+namespace ipc {
+
+// A local client of IpcDaemon. The inputs are written in place into shared
+// memory and the outputs are read from it, split into n_slots slots of
+// slot_bytes, the room of the inputs and the outputs of one request. The
+// requests of different slots can be in flight at once. A client is used
+// by one thread at a time.
+class IpcClient {
+ public:
+  IpcClient(const std::string &socket_path, int64_t n_slots = 4,
+            int64_t slot_bytes = 1 << 20);
+  ~IpcClient();
+
+  IpcClient(const IpcClient &) = delete;
+  IpcClient &operator=(const IpcClient &) = delete;
+
+  int64_t n_slots() const { return static_cast<int64_t>(slots_.size()); }
+
+  // The id of the model name in the requests, and its output dim.
+  uint32_t Lookup(const std::string &name, int64_t *output_dim = nullptr);
+
+  // Prepares a request to model of sequences of lengths in a free slot, and
+  // returns the room of their concatenated input ids to fill before Submit.
+  int64_t *PrepareRequest(int64_t slot, uint32_t model,
+                          const std::vector<int64_t> &lengths);
+  void Submit(int64_t slot);
+  // Waits for the request of slot and returns its n_outputs outputs, in the
+  // shared memory until the slot is prepared again. Throws the error of a
+  // failed request. timing, if not null, receives the wait of the request in
+  // the daemon, queue_ms and batch_ms, the stages the model timed while
+  // running its batch, and its total_ms since Submit.
+  const float *Wait(int64_t slot, int64_t *n_outputs,
+                    core::RequestTiming *timing = nullptr);
+
+  // Runs inputs in slot 0 and returns a copy of the outputs.
+  std::vector<float> Infer(uint32_t model,
+                           const std::vector<std::vector<int64_t>> &inputs);
+
+ private:
+  struct SlotState {
+    bool pending{false};
+    bool done{false};
+    int32_t status{0};
+    uint32_t value{0};
+    std::chrono::steady_clock::time_point submitted;
+  };
+
+  char *slot(int64_t i) const;
+  // Receives the reply of a request in flight.
+  void ReceiveCompletion();
+
+  int fd_{-1};
+  void *shared_{nullptr};
+  size_t shared_bytes_{0};
+  uint64_t slot_bytes_{0};
+  std::vector<SlotState> slots_;
+};
+
+}  // namespace ipc
+}  // namespace turbo_transformers
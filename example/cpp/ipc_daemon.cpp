@@ -0,0 +1,535 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "ipc_daemon.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "ipc_protocol.h"
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace ipc {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+float ElapsedMs(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// Writes the timing fields of the SlotHeader at slot.
+void WriteTiming(const core::RequestTiming &timing, char *slot) {
+  SlotHeader header{};
+  header.queue_ms = timing.queue_ms;
+  header.batch_ms = timing.batch_ms;
+  header.prepare_ms = timing.prepare_ms;
+  header.embedding_ms = timing.embedding_ms;
+  header.pooling_ms = timing.pooling_ms;
+  header.n_layers = static_cast<uint32_t>(
+      std::min(timing.layer_ms.size(), kMaxTimedLayers));
+  std::copy(timing.layer_ms.begin(),
+            timing.layer_ms.begin() + header.n_layers, header.layer_ms);
+  constexpr size_t begin = offsetof(SlotHeader, queue_ms);
+  std::memcpy(slot + begin, reinterpret_cast<const char *>(&header) + begin,
+              sizeof(header) - begin);
+}
+
+// The error of a request beyond the limits of its model, empty if none.
+std::string CheckLimits(const IpcModelLimits &limits,
+                        const std::vector<int64_t> &lengths,
+                        const std::vector<int64_t> &ids) {
+  if (limits.max_length > 0) {
+    for (int64_t length : lengths) {
+      if (length > limits.max_length) {
+        return "a sequence has more than " +
+               std::to_string(limits.max_length) + " tokens";
+      }
+    }
+  }
+  if (limits.vocab_size > 0) {
+    for (int64_t id : ids) {
+      if (id < 0 || id >= limits.vocab_size) {
+        return "an id is not in [0, " + std::to_string(limits.vocab_size) +
+               ")";
+      }
+    }
+  }
+  return std::string();
+}
+
+// A client and its shared memory, kept mapped until its last request is
+// done.
+struct Connection {
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() {
+    if (shared != nullptr) {
+      munmap(shared, shared_bytes);
+    }
+    close(fd);
+  }
+
+  char *slot(uint32_t i) const {
+    return static_cast<char *>(shared) + kSharedHeaderBytes + i * slot_bytes;
+  }
+
+  // A client gone is noticed by the reader of the connection.
+  void Send(const Message &message) {
+    std::lock_guard<std::mutex> lock(send_mutex);
+    send(fd, &message, sizeof(message), MSG_NOSIGNAL);
+  }
+
+  void Reply(MessageType type, uint32_t slot, int32_t status,
+             uint32_t value) {
+    Message message{};
+    message.type = type;
+    message.slot = slot;
+    message.status = status;
+    message.value = value;
+    Send(message);
+  }
+
+  // Writes the error text of a request to its outputs.
+  void Fail(uint32_t slot, uint64_t output_offset, const std::string &error) {
+    uint64_t length = 0;
+    if (output_offset < slot_bytes) {
+      length = std::min<uint64_t>(error.size(), slot_bytes - output_offset);
+      std::memcpy(this->slot(slot) + output_offset, error.data(), length);
+    }
+    Reply(MessageType::kInfer, slot, kError, static_cast<uint32_t>(length));
+  }
+
+  const int fd;
+  void *shared{nullptr};
+  size_t shared_bytes{0};
+  uint32_t n_slots{0};
+  uint64_t slot_bytes{0};
+  std::mutex send_mutex;
+  std::atomic<bool> closed{false};
+};
+
+struct Request {
+  std::shared_ptr<Connection> connection;
+  uint32_t slot;
+  uint64_t output_offset;
+  int64_t n_tokens;
+  // the ids in the slot, copied to ids when the request leaves the queue.
+  const int64_t *shared_ids;
+  std::vector<int64_t> ids;
+  std::vector<int64_t> lengths;
+  Clock::time_point received;
+  Clock::time_point dequeued;
+};
+
+struct Model {
+  std::string name;
+  int64_t output_dim;
+  IpcDaemon::RunFunc run;
+  IpcModelLimits limits;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Request> queue;
+  std::thread batcher;
+};
+
+struct Reader {
+  std::shared_ptr<Connection> connection;
+  std::thread thread;
+};
+
+}  // namespace
+
+struct IpcDaemon::Impl {
+  Impl(std::string socket_path, IpcDaemonOptions options)
+      : socket_path_(std::move(socket_path)), options_(options) {}
+
+  void Start() {
+    TT_ENFORCE(!started_, "the daemon is already started");
+    TT_ENFORCE(!models_.empty(), "the daemon has no model");
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    TT_ENFORCE_LT(socket_path_.size(), sizeof(address.sun_path),
+                  "the socket path %s is too long", socket_path_);
+    std::strncpy(address.sun_path, socket_path_.c_str(),
+                 sizeof(address.sun_path) - 1);
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    TT_ENFORCE_GE(listen_fd_, 0, "socket: %s", std::strerror(errno));
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(listen_fd_, 128) != 0) {
+      int error = errno;
+      close(listen_fd_);
+      TT_THROW("can not listen on %s: %s", socket_path_, std::strerror(error));
+    }
+    started_ = true;
+    for (auto &model : models_) {
+      model->batcher = std::thread(&Impl::Batch, this, model.get());
+    }
+    accept_thread_ = std::thread(&Impl::Accept, this);
+  }
+
+  void Stop() {
+    if (!started_ || stopping_.exchange(true)) {
+      return;
+    }
+    // wakes up the accept.
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+    {
+      std::lock_guard<std::mutex> lock(readers_mutex_);
+      for (auto &reader : readers_) {
+        shutdown(reader.connection->fd, SHUT_RDWR);
+      }
+    }
+    for (auto &reader : readers_) {
+      reader.thread.join();
+    }
+    readers_.clear();
+    for (auto &model : models_) {
+      {
+        std::lock_guard<std::mutex> lock(model->mutex);
+      }
+      model->cv.notify_all();
+      model->batcher.join();
+      model->queue.clear();
+    }
+  }
+
+  void Accept() {
+    while (!stopping_) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        break;
+      }
+      std::lock_guard<std::mutex> lock(readers_mutex_);
+      // joins the readers of the clients gone.
+      for (auto it = readers_.begin(); it != readers_.end();) {
+        if (it->connection->closed) {
+          it->thread.join();
+          it = readers_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      auto connection = std::make_shared<Connection>(fd);
+      readers_.push_back(
+          Reader{connection, std::thread(&Impl::Serve, this, connection)});
+    }
+  }
+
+  // Maps the shared memory sent by the hello of a client.
+  void Hello(Connection *connection) {
+    Message message{};
+    iovec iov{&message, sizeof(message)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(connection->fd, &msg, MSG_CMSG_CLOEXEC);
+    TT_ENFORCE(n == static_cast<ssize_t>(sizeof(message)) &&
+                   message.type == MessageType::kHello,
+               "a client must start with a hello");
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    TT_ENFORCE(cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+                   cmsg->cmsg_type == SCM_RIGHTS,
+               "the hello carries no shared memory");
+    int shared_fd;
+    std::memcpy(&shared_fd, CMSG_DATA(cmsg), sizeof(shared_fd));
+    struct stat st;
+    // the file can not shrink under the mapping.
+    bool sealed = (fcntl(shared_fd, F_GET_SEALS) & F_SEAL_SHRINK) != 0;
+    bool mapped = sealed && fstat(shared_fd, &st) == 0 &&
+                  st.st_size >= static_cast<off_t>(kSharedHeaderBytes);
+    if (mapped) {
+      void *shared = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, shared_fd, 0);
+      mapped = shared != MAP_FAILED;
+      if (mapped) {
+        connection->shared = shared;
+        connection->shared_bytes = st.st_size;
+      }
+    }
+    close(shared_fd);
+    SharedHeader header{};
+    if (mapped) {
+      std::memcpy(&header, connection->shared, sizeof(header));
+    }
+    bool valid = mapped && header.magic == kMagic &&
+                 header.version == kVersion && header.n_slots > 0 &&
+                 header.slot_bytes >= 2 * kSlotHeaderBytes &&
+                 header.slot_bytes % 64 == 0 &&
+                 SharedBytes(header.n_slots, header.slot_bytes) <=
+                     connection->shared_bytes;
+    connection->Reply(MessageType::kHello, 0, valid ? kOk : kError, 0);
+    TT_ENFORCE(valid, "invalid shared memory of a client");
+    connection->n_slots = header.n_slots;
+    connection->slot_bytes = header.slot_bytes;
+  }
+
+  void Serve(std::shared_ptr<Connection> connection) {
+    try {
+      Hello(connection.get());
+      Message message;
+      while (recv(connection->fd, &message, sizeof(message), 0) ==
+             static_cast<ssize_t>(sizeof(message))) {
+        if (message.type == MessageType::kLookup) {
+          Lookup(connection.get(), message);
+        } else if (message.type == MessageType::kInfer) {
+          Submit(connection, message.slot);
+        } else {
+          break;
+        }
+      }
+    } catch (std::exception &) {
+      // drops the client.
+    }
+    connection->closed = true;
+  }
+
+  void Lookup(Connection *connection, const Message &message) {
+    std::string name(message.name, strnlen(message.name, kMaxModelName));
+    for (size_t i = 0; i < models_.size(); ++i) {
+      if (models_[i]->name == name) {
+        connection->Reply(MessageType::kLookup, i, kOk,
+                          static_cast<uint32_t>(models_[i]->output_dim));
+        return;
+      }
+    }
+    connection->Reply(MessageType::kLookup, 0, kError, 0);
+  }
+
+  // Validates the request in a slot and queues it to the batcher of its
+  // model. The header and the lengths are read once here, the ids when the
+  // request leaves the queue, so a client overwriting them in flight can not
+  // pass the checks with other ids than those the model runs.
+  void Submit(const std::shared_ptr<Connection> &connection, uint32_t slot) {
+    auto received = Clock::now();
+    if (slot >= connection->n_slots) {
+      connection->Reply(MessageType::kInfer, slot, kError, 0);
+      return;
+    }
+    const char *base = connection->slot(slot);
+    SlotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    uint64_t slot_bytes = connection->slot_bytes;
+    uint64_t max_ids = (slot_bytes - kSlotHeaderBytes) / 8;
+    if (header.n_sequences == 0 || header.n_sequences > max_ids ||
+        header.n_tokens > max_ids - header.n_sequences ||
+        header.output_offset <
+            OutputOffset(header.n_sequences, header.n_tokens) ||
+        header.output_offset > slot_bytes) {
+      connection->Fail(slot, header.output_offset, "invalid request");
+      return;
+    }
+    if (header.model >= models_.size()) {
+      connection->Fail(slot, header.output_offset, "unknown model");
+      return;
+    }
+    Model *model = models_[header.model].get();
+    if (header.n_sequences * model->output_dim * sizeof(float) >
+        slot_bytes - header.output_offset) {
+      connection->Fail(slot, header.output_offset,
+                       "the outputs do not fit the slot");
+      return;
+    }
+    auto *lengths = reinterpret_cast<const int64_t *>(base + kSlotHeaderBytes);
+    const int64_t *ids = lengths + header.n_sequences;
+    Request request{connection, slot, header.output_offset,
+                    static_cast<int64_t>(header.n_tokens), ids, {}, {},
+                    received, received};
+    request.lengths.assign(lengths, lengths + header.n_sequences);
+    uint64_t offset = 0;
+    for (int64_t length : request.lengths) {
+      if (length <= 0 ||
+          static_cast<uint64_t>(length) > header.n_tokens - offset) {
+        connection->Fail(slot, header.output_offset,
+                         "the lengths do not sum to the tokens");
+        return;
+      }
+      offset += length;
+    }
+    if (offset != header.n_tokens) {
+      connection->Fail(slot, header.output_offset,
+                       "the lengths do not sum to the tokens");
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(model->mutex);
+      model->queue.push_back(std::move(request));
+    }
+    model->cv.notify_one();
+  }
+
+  // Takes the requests of a model in batches, up to the limits or
+  // max_delay_us after the first one.
+  void Batch(Model *model) {
+    while (true) {
+      std::vector<Request> batch;
+      {
+        std::unique_lock<std::mutex> lock(model->mutex);
+        model->cv.wait(lock,
+                       [&] { return stopping_ || !model->queue.empty(); });
+        if (stopping_) {
+          return;
+        }
+        auto deadline = Clock::now() +
+                        std::chrono::microseconds(options_.max_delay_us);
+        int64_t n_sequences = 0, n_tokens = 0;
+        bool full = false;
+        while (!full) {
+          while (!full && !model->queue.empty()) {
+            auto &next = model->queue.front();
+            int64_t sequences = next.lengths.size();
+            full = !batch.empty() &&
+                   (n_sequences + sequences > options_.max_batch_sequences ||
+                    n_tokens + next.n_tokens > options_.max_batch_tokens);
+            if (!full) {
+              n_sequences += sequences;
+              n_tokens += next.n_tokens;
+              next.dequeued = Clock::now();
+              batch.push_back(std::move(next));
+              model->queue.pop_front();
+            }
+          }
+          if (full || stopping_ ||
+              !model->cv.wait_until(lock, deadline, [&] {
+                return stopping_ || !model->queue.empty();
+              })) {
+            break;
+          }
+        }
+      }
+      Run(model, &batch);
+    }
+  }
+
+  // Copies the ids of the requests out of their slots, fails those beyond
+  // the limits of the model and runs the others together.
+  void Run(Model *model, std::vector<Request> *batch) {
+    std::vector<Request> accepted;
+    for (auto &request : *batch) {
+      request.ids.assign(request.shared_ids,
+                         request.shared_ids + request.n_tokens);
+      auto error = CheckLimits(model->limits, request.lengths, request.ids);
+      if (error.empty()) {
+        accepted.push_back(std::move(request));
+      } else {
+        request.connection->Fail(request.slot, request.output_offset, error);
+      }
+    }
+    batch->swap(accepted);
+    if (batch->empty()) {
+      return;
+    }
+    IpcDaemon::SequenceBatch sequences;
+    for (auto &request : *batch) {
+      const int64_t *ids = request.ids.data();
+      auto *outputs = reinterpret_cast<float *>(
+          request.connection->slot(request.slot) + request.output_offset);
+      for (int64_t length : request.lengths) {
+        sequences.ids.push_back(ids);
+        sequences.lengths.push_back(length);
+        sequences.outputs.push_back(outputs);
+        ids += length;
+        outputs += model->output_dim;
+      }
+    }
+    auto start = Clock::now();
+    core::RequestTiming timing;
+    std::string error;
+    try {
+      model->run(sequences, &timing);
+    } catch (std::exception &e) {
+      error = e.what();
+    }
+    for (auto &request : *batch) {
+      auto &connection = *request.connection;
+      timing.queue_ms = ElapsedMs(request.received, request.dequeued);
+      timing.batch_ms = ElapsedMs(request.dequeued, start);
+      WriteTiming(timing, connection.slot(request.slot));
+      if (!error.empty()) {
+        connection.Fail(request.slot, request.output_offset, error);
+        continue;
+      }
+      size_t n_outputs = request.lengths.size() * model->output_dim;
+      connection.Reply(MessageType::kInfer, request.slot, kOk,
+                       static_cast<uint32_t>(n_outputs));
+    }
+  }
+
+  std::string socket_path_;
+  IpcDaemonOptions options_;
+  std::vector<std::unique_ptr<Model>> models_;
+  int listen_fd_{-1};
+  bool started_{false};
+  std::atomic<bool> stopping_{false};
+  std::thread accept_thread_;
+  std::mutex readers_mutex_;
+  std::list<Reader> readers_;
+};
+
+IpcDaemon::IpcDaemon(std::string socket_path, IpcDaemonOptions options)
+    : m_(new Impl(std::move(socket_path), options)) {}
+
+IpcDaemon::~IpcDaemon() { Stop(); }
+
+void IpcDaemon::AddModel(const std::string &name, int64_t output_dim,
+                         RunFunc run, IpcModelLimits limits) {
+  TT_ENFORCE(!m_->started_, "add the models before Start");
+  TT_ENFORCE(!name.empty() && name.size() <= kMaxModelName,
+             "the model name must have 1 to %d characters", kMaxModelName);
+  TT_ENFORCE_GT(output_dim, 0, "the output dim must be positive");
+  TT_ENFORCE(limits.vocab_size >= 0 && limits.max_length >= 0,
+             "the limits of a model must not be negative");
+  std::unique_ptr<Model> model(new Model);
+  model->name = name;
+  model->output_dim = output_dim;
+  model->run = std::move(run);
+  model->limits = limits;
+  m_->models_.push_back(std::move(model));
+}
+
+void IpcDaemon::Start() { m_->Start(); }
+
+void IpcDaemon::Stop() { m_->Stop(); }
+
+}  // namespace ipc
+}  // namespace turbo_transformers
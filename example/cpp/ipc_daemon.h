@@ -0,0 +1,84 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "turbo_transformers/core/request_timing.h"
+
+namespace turbo_transformers {
+namespace ipc {
+
+struct IpcDaemonOptions {
+  // the limits of a batch of the requests of a model.
+  int64_t max_batch_sequences{64};
+  int64_t max_batch_tokens{16384};
+  // how long the batcher waits for more requests after the first one, 0
+  // only batches the requests queued while the model runs.
+  int64_t max_delay_us{0};
+};
+
+// The inputs a model can take, 0 leaves a limit unchecked. The requests
+// beyond them fail alone instead of reaching the model.
+struct IpcModelLimits {
+  // the ids must be in [0, vocab_size).
+  int64_t vocab_size{0};
+  // the most tokens of a sequence.
+  int64_t max_length{0};
+};
+
+// Hosts models for the local clients of other processes and languages, see
+// ipc_protocol.h. The input ids are read from and the outputs written to
+// the shared memory of the clients, and the requests of every model are
+// batched across the clients.
+class IpcDaemon {
+ public:
+  // The sequences of a batch: sequence i is the lengths[i] ids at ids[i],
+  // copied out of the shared memory of its client and checked against the
+  // limits of the model, and its output_dim outputs go to outputs[i] in that
+  // shared memory.
+  struct SequenceBatch {
+    std::vector<const int64_t *> ids;
+    std::vector<int64_t> lengths;
+    std::vector<float *> outputs;
+  };
+  // Runs a batch and writes its outputs, or throws. The stages the model
+  // times into timing, e.g. those of BertModel, are returned to every
+  // request of the batch.
+  using RunFunc =
+      std::function<void(const SequenceBatch &, core::RequestTiming *)>;
+
+  explicit IpcDaemon(std::string socket_path,
+                     IpcDaemonOptions options = IpcDaemonOptions());
+  ~IpcDaemon();
+
+  // Hosts a model, run is called by one batcher thread. Call it before
+  // Start.
+  void AddModel(const std::string &name, int64_t output_dim, RunFunc run,
+                IpcModelLimits limits = IpcModelLimits());
+  // Listens on the socket and serves in background threads.
+  void Start();
+  // Stops serving and removes the socket, the requests in flight fail.
+  void Stop();
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> m_;
+};
+
+}  // namespace ipc
+}  // namespace turbo_transformers
@@ -0,0 +1,81 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+// Serves BERT models to the local clients of IpcClient, in any language
+// implementing ipc_protocol.h:
+//   tt_ipc_daemon /tmp/turbo_transformers.sock bert=bert.npz:12:12 ...
+// hosts the npz of every name=path:n_layers:n_heads and returns the first
+// token of the last hidden states of every sequence, until SIGINT or
+// SIGTERM.
+
+#include <signal.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bert_model.h"
+#include "ipc_daemon.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " socket_path name=model.npz:n_layers:n_heads ..."
+              << std::endl;
+    return 1;
+  }
+  // blocked in every thread, waited for by main.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  turbo_transformers::ipc::IpcDaemon daemon(argv[1]);
+  for (int i = 2; i < argc; ++i) {
+    std::string spec = argv[i];
+    auto equal = spec.find('=');
+    auto colon = spec.rfind(':');
+    auto first_colon = spec.rfind(':', colon - 1);
+    if (equal == std::string::npos || colon == std::string::npos ||
+        first_colon == std::string::npos || first_colon < equal) {
+      std::cerr << "invalid model " << spec << std::endl;
+      return 1;
+    }
+    auto name = spec.substr(0, equal);
+    auto path = spec.substr(equal + 1, first_colon - equal - 1);
+    auto n_layers = std::stoul(spec.substr(first_colon + 1));
+    auto n_heads = std::stol(spec.substr(colon + 1));
+    auto model = std::make_shared<BertModel>(path, DLDeviceType::kDLCPU,
+                                             n_layers, n_heads);
+    model->Warmup({{1, 128}});
+    std::vector<std::vector<int64_t>> probe = {{0}};
+    int64_t output_dim = (*model)(probe, {}, {}).size();
+    daemon.AddModel(
+        name, output_dim,
+        [model](const turbo_transformers::ipc::IpcDaemon::SequenceBatch &batch,
+                core::RequestTiming *timing) {
+          (*model)(batch.ids, batch.lengths, batch.outputs, PoolType::kFirst,
+                   false, timing);
+        },
+        {model->vocab_size(), model->max_positions()});
+    std::cerr << "serving " << name << " from " << path << std::endl;
+  }
+  daemon.Start();
+  std::cerr << "listening on " << argv[1] << std::endl;
+  int signal;
+  sigwait(&signals, &signal);
+  daemon.Stop();
+  return 0;
+}
@@ -0,0 +1,210 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ipc_client.h"
+#include "ipc_daemon.h"
+
+namespace turbo_transformers {
+namespace ipc {
+
+// the sum and the length of every sequence.
+static void SumModel(const IpcDaemon::SequenceBatch &batch,
+                     core::RequestTiming *timing = nullptr) {
+  for (size_t i = 0; i < batch.ids.size(); ++i) {
+    float sum = 0;
+    for (int64_t j = 0; j < batch.lengths[i]; ++j) {
+      sum += batch.ids[i][j];
+    }
+    batch.outputs[i][0] = sum;
+    batch.outputs[i][1] = batch.lengths[i];
+  }
+}
+
+static std::string SocketPath() {
+  return "/tmp/tt_ipc_test_" + std::to_string(getpid()) + ".sock";
+}
+
+TEST_CASE("ipc-daemon-requests") {
+  IpcDaemon daemon(SocketPath());
+  daemon.AddModel("sum", 2, SumModel);
+  daemon.AddModel("fail", 1,
+                  [](const IpcDaemon::SequenceBatch &, core::RequestTiming *) {
+                    throw std::runtime_error("model error");
+                  });
+  daemon.AddModel("timed", 2,
+                  [](const IpcDaemon::SequenceBatch &batch,
+                     core::RequestTiming *timing) {
+                    timing->prepare_ms = 1.;
+                    timing->embedding_ms = 2.;
+                    timing->layer_ms = {3., 4.};
+                    timing->pooling_ms = 5.;
+                    SumModel(batch);
+                  });
+  daemon.Start();
+
+  IpcClient client(SocketPath(), 3, 4096);
+  int64_t output_dim;
+  uint32_t sum = client.Lookup("sum", &output_dim);
+  REQUIRE(output_dim == 2);
+  REQUIRE_THROWS(client.Lookup("missing"));
+
+  auto outputs = client.Infer(sum, {{1, 2, 3}, {10}});
+  REQUIRE(outputs == std::vector<float>({6, 3, 10, 1}));
+
+  // the requests of several slots in flight, waited for out of order.
+  for (int64_t slot = 0; slot < client.n_slots(); ++slot) {
+    int64_t *ids = client.PrepareRequest(slot, sum, {2});
+    ids[0] = slot;
+    ids[1] = 100;
+    client.Submit(slot);
+  }
+  REQUIRE_THROWS(client.Submit(0));
+  for (int64_t slot = client.n_slots() - 1; slot >= 0; --slot) {
+    int64_t n_outputs;
+    core::RequestTiming timing;
+    const float *output = client.Wait(slot, &n_outputs, &timing);
+    REQUIRE(n_outputs == 2);
+    REQUIRE(output[0] == 100 + slot);
+    REQUIRE(timing.queue_ms >= 0.);
+    REQUIRE(timing.batch_ms >= 0.);
+    REQUIRE(timing.total_ms >= timing.queue_ms + timing.batch_ms);
+    REQUIRE(timing.layer_ms.empty());
+  }
+
+  // the stages timed by the model reach the client.
+  int64_t *ids = client.PrepareRequest(0, client.Lookup("timed"), {1});
+  ids[0] = 5;
+  client.Submit(0);
+  core::RequestTiming timing;
+  client.Wait(0, nullptr, &timing);
+  REQUIRE(timing.prepare_ms == 1.);
+  REQUIRE(timing.embedding_ms == 2.);
+  REQUIRE(timing.layer_ms == std::vector<double>({3., 4.}));
+  REQUIRE(timing.pooling_ms == 5.);
+
+  // the errors of the model and of the requests.
+  uint32_t fail = client.Lookup("fail");
+  REQUIRE_THROWS_WITH(client.Infer(fail, {{1}}),
+                      Catch::Contains("model error"));
+  REQUIRE_THROWS_WITH(client.Infer(7, {{1}}),
+                      Catch::Contains("unknown model"));
+  REQUIRE_THROWS(client.Infer(sum, {std::vector<int64_t>(1000, 1)}));
+  REQUIRE_THROWS_WITH(
+      client.Infer(sum, std::vector<std::vector<int64_t>>(200, {1})),
+      Catch::Contains("do not fit"));
+  REQUIRE(client.Infer(sum, {{4}}) == std::vector<float>({4, 1}));
+}
+
+TEST_CASE("ipc-daemon-limits") {
+  std::atomic<int64_t> n_runs{0}, n_sequences{0};
+  IpcDaemonOptions options;
+  // the requests below are batched together
+  options.max_delay_us = 200000;
+  IpcDaemon daemon(SocketPath(), options);
+  IpcModelLimits limits;
+  limits.vocab_size = 100;
+  limits.max_length = 4;
+  daemon.AddModel("sum", 2,
+                  [&](const IpcDaemon::SequenceBatch &batch,
+                      core::RequestTiming *) {
+                    ++n_runs;
+                    n_sequences += batch.ids.size();
+                    SumModel(batch);
+                  },
+                  limits);
+  REQUIRE_THROWS(daemon.AddModel("negative", 2, SumModel, {-1, 0}));
+  daemon.Start();
+
+  // the requests beyond the limits fail alone, the others run.
+  IpcClient client(SocketPath(), 4, 4096);
+  uint32_t sum = client.Lookup("sum");
+  std::vector<std::vector<int64_t>> inputs = {
+      {1, 99}, {1, 100}, {-1}, {1, 2, 3, 4, 5}};
+  for (size_t slot = 0; slot < inputs.size(); ++slot) {
+    int64_t *ids = client.PrepareRequest(
+        slot, sum, {static_cast<int64_t>(inputs[slot].size())});
+    std::copy(inputs[slot].begin(), inputs[slot].end(), ids);
+    client.Submit(slot);
+  }
+  int64_t n_outputs;
+  const float *output = client.Wait(0, &n_outputs);
+  REQUIRE(n_outputs == 2);
+  REQUIRE(output[0] == 100);
+  REQUIRE_THROWS_WITH(client.Wait(1, &n_outputs),
+                      Catch::Contains("not in [0, 100)"));
+  REQUIRE_THROWS_WITH(client.Wait(2, &n_outputs),
+                      Catch::Contains("not in [0, 100)"));
+  REQUIRE_THROWS_WITH(client.Wait(3, &n_outputs),
+                      Catch::Contains("more than 4 tokens"));
+  REQUIRE(n_runs == 1);
+  REQUIRE(n_sequences == 1);
+}
+
+TEST_CASE("ipc-daemon-batching") {
+  std::atomic<int64_t> max_batch{0};
+  IpcDaemonOptions options;
+  options.max_batch_sequences = 8;
+  options.max_delay_us = 20000;
+  IpcDaemon daemon(SocketPath(), options);
+  daemon.AddModel("sum", 2,
+                  [&](const IpcDaemon::SequenceBatch &batch,
+                      core::RequestTiming *) {
+                    int64_t size = batch.ids.size();
+                    int64_t current = max_batch;
+                    while (size > current &&
+                           !max_batch.compare_exchange_weak(current, size)) {
+                    }
+                    SumModel(batch);
+                  });
+  daemon.Start();
+
+  // the requests of concurrent clients run in shared batches.
+  std::vector<std::thread> threads;
+  std::atomic<int> n_correct{0};
+  for (int i = 0; i < 6; ++i) {
+    threads.emplace_back([&, i]() {
+      IpcClient client(SocketPath());
+      uint32_t sum = client.Lookup("sum");
+      for (int r = 0; r < 4; ++r) {
+        auto outputs = client.Infer(sum, {{i, r}, {1, 1, 1}});
+        std::vector<float> expected = {static_cast<float>(i + r), 2, 3, 3};
+        if (outputs == expected) {
+          ++n_correct;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(n_correct == 24);
+  REQUIRE(max_batch > 2);
+  REQUIRE(max_batch <= 8);
+
+  daemon.Stop();
+  REQUIRE_THROWS(IpcClient(SocketPath()));
+}
+
+}  // namespace ipc
+}  // namespace turbo_transformers
@@ -0,0 +1,113 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The protocol between the inference daemon and its local clients, small
+// enough to be implemented by the clients in other languages.
+//
+// A client connects to the SOCK_SEQPACKET Unix socket of the daemon, creates
+// a shared memory file of a SharedHeader and n_slots slots of slot_bytes, and
+// sends it with a kHello message as SCM_RIGHTS. The payloads never cross the
+// socket: a request writes its sequences into a slot and sends a kInfer
+// message naming the slot, the daemon writes the outputs into the slot and
+// replies with a kInfer message naming it. The requests of different slots
+// may be in flight at once and complete out of order.
+//
+// A slot: a SlotHeader, the lengths of the n_sequences sequences and their
+// n_tokens input ids as int64, and the float outputs at output_offset, which
+// the daemon fills with n_sequences * output_dim floats, or with the text of
+// the error of a failed request. With the reply the daemon also writes the
+// timing breakdown of the request into the SlotHeader.
+
+namespace turbo_transformers {
+namespace ipc {
+
+constexpr uint32_t kMagic = 0x54545043;  // "TTPC"
+constexpr uint32_t kVersion = 2;
+constexpr size_t kSharedHeaderBytes = 64;
+constexpr size_t kSlotHeaderBytes = 256;
+constexpr size_t kMaxModelName = 64;
+constexpr size_t kMaxTimedLayers = 48;
+
+enum class MessageType : uint32_t {
+  // carries the shared memory file, replied with the status.
+  kHello = 1,
+  // asks the id of the model name, replied with the id in slot and the
+  // output dim in value.
+  kLookup = 2,
+  // runs the request of slot, replied with the status and the number of
+  // outputs, or the length of the error text, in value.
+  kInfer = 3,
+};
+
+enum Status : int32_t { kOk = 0, kError = 1 };
+
+// Every message is one packet of this size.
+struct Message {
+  MessageType type;
+  uint32_t slot;
+  int32_t status;
+  uint32_t value;
+  char name[kMaxModelName];
+};
+
+struct SharedHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t n_slots;
+  uint32_t reserved;
+  // a multiple of 64
+  uint64_t slot_bytes;
+};
+
+struct SlotHeader {
+  uint32_t model;
+  uint32_t n_sequences;
+  uint64_t n_tokens;
+  // from the beginning of the slot, a multiple of 64
+  uint64_t output_offset;
+  // written by the daemon: the wait in the queue of the model, and from
+  // leaving it to the run of the model.
+  float queue_ms;
+  float batch_ms;
+  // the stages of the run of the batch of the request, as in
+  // core::RequestTiming, 0 for the stages the model does not time. layer_ms
+  // holds the first n_layers layers, at most kMaxTimedLayers.
+  float prepare_ms;
+  float embedding_ms;
+  float pooling_ms;
+  uint32_t n_layers;
+  float layer_ms[kMaxTimedLayers];
+};
+
+static_assert(sizeof(SharedHeader) <= kSharedHeaderBytes,
+              "SharedHeader is too large");
+static_assert(sizeof(SlotHeader) <= kSlotHeaderBytes,
+              "SlotHeader is too large");
+
+inline uint64_t AlignSlot(uint64_t bytes) { return (bytes + 63) / 64 * 64; }
+
+// the offset of the outputs after the inputs of a request.
+inline uint64_t OutputOffset(uint64_t n_sequences, uint64_t n_tokens) {
+  return AlignSlot(kSlotHeaderBytes + (n_sequences + n_tokens) * 8);
+}
+
+inline size_t SharedBytes(uint64_t n_slots, uint64_t slot_bytes) {
+  return kSharedHeaderBytes + n_slots * slot_bytes;
+}
+
+}  // namespace ipc
+}  // namespace turbo_transformers
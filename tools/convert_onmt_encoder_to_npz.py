@@ -0,0 +1,67 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+import sys
+import numpy
+import torch
+
+# Attention: the q, k and v projections are fused into qkv.weight as
+# (hidden_dim, 3 * hidden_dim) and the other linear weights stored as
+# (in_dim, out_dim), while pytorch stores them as (out_dim, in_dim).
+# The embeddings are saved unchanged, they stay on the pytorch side.
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: \n"
+              "    convert_onmt_encoder_to_npz onmt_checkpoint.pt output_file")
+        exit(0)
+    torch.set_grad_enabled(False)
+
+    checkpoint = torch.load(sys.argv[1], map_location='cpu')
+    arrays = {
+        k: v.detach()
+        for k, v in checkpoint['model'].items() if k.startswith('encoder.')
+    }
+
+    q_key = 'self_attn.linear_query.'
+    k_key = 'self_attn.linear_keys.'
+    v_key = 'self_attn.linear_values.'
+
+    numpy_dict = {}
+    for k in arrays.keys():
+        if k.startswith('encoder.embeddings.'):
+            numpy_dict[k] = arrays[k].numpy()
+        elif q_key in k:
+            v = torch.cat([
+                arrays[k], arrays[k.replace(q_key, k_key)],
+                arrays[k.replace(q_key, v_key)]
+            ], 0)
+            if k.endswith('.weight'):
+                v = torch.t(v)
+            numpy_dict[k.replace(q_key, 'self_attn.qkv.')] = torch.clone(
+                v.contiguous()).numpy()
+        elif k_key in k or v_key in k:
+            continue
+        elif k.endswith('.weight') and arrays[k].dim() == 2:
+            numpy_dict[k] = torch.clone(torch.t(arrays[k]).contiguous()).numpy()
+        else:
+            numpy_dict[k] = arrays[k].numpy()
+    del arrays
+    del checkpoint
+    # uncompressed, so that the c++ cnpy loader can read it as well
+    numpy.savez(sys.argv[2], **numpy_dict)
+
+
+if __name__ == '__main__':
+    main()
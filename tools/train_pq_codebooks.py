@@ -0,0 +1,112 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+import argparse
+import re
+import numpy as np
+
+# Trains the product-quantization codebooks of the feed-forward weights of a
+# model npz offline, for BertModel::LoadPQCodebooks. The input channels of a
+# weight (in_dim, out_dim) are split into subspaces of sub_dim channels, and
+# the sub-vector of every output in a subspace is encoded as its nearest
+# centroid. For a module, e.g. encoder.layer.0.intermediate.dense, it saves
+#   <module>.pq_codebooks: (n_subspaces, sub_dim, n_centroids) float32
+#   <module>.pq_codes: (n_subspaces, out_dim) uint8
+# It runs the k-means of kernels::TrainWeightPQ.
+
+DEFAULT_MODULES = r'encoder\.layer\.\d+\.(intermediate|output)\.dense$'
+
+
+def nearest_centroids(points, centroids):
+    dist = (np.sum(centroids * centroids, axis=1)[np.newaxis, :] -
+            2 * points @ centroids.T)
+    return np.argmin(dist, axis=1)
+
+
+def train_subspace(points, n_centroids, n_iters):
+    out_dim = points.shape[0]
+    # starts from outputs evenly spread over the weight.
+    centroids = points[np.arange(n_centroids) * out_dim // n_centroids].copy()
+    assignment = nearest_centroids(points, centroids)
+    for _ in range(n_iters):
+        counts = np.bincount(assignment, minlength=n_centroids)
+        sums = np.zeros_like(centroids)
+        np.add.at(sums, assignment, points)
+        # an empty cluster keeps its centroid.
+        filled = counts > 0
+        centroids[filled] = sums[filled] / counts[filled, np.newaxis]
+        assignment = nearest_centroids(points, centroids)
+    return centroids, assignment
+
+
+def train_weight(weight, sub_dim, n_centroids, n_iters):
+    in_dim, out_dim = weight.shape
+    if in_dim % sub_dim != 0:
+        raise ValueError(f"{sub_dim} channels do not divide {in_dim}")
+    if not 0 < n_centroids <= min(256, out_dim):
+        raise ValueError(f"{n_centroids} centroids must be at most 256 "
+                         f"and {out_dim}")
+    n_subspaces = in_dim // sub_dim
+    codebooks = np.empty((n_subspaces, sub_dim, n_centroids), np.float32)
+    codes = np.empty((n_subspaces, out_dim), np.uint8)
+    for s in range(n_subspaces):
+        points = weight[s * sub_dim:(s + 1) * sub_dim, :].T.astype(np.float32)
+        centroids, assignment = train_subspace(points, n_centroids, n_iters)
+        codebooks[s] = centroids.T
+        codes[s] = assignment
+    return codebooks, codes
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="train the PQ codebooks of a model npz")
+    parser.add_argument("model", help="the model npz, e.g. bert.npz")
+    parser.add_argument("output", help="the npz of the codebooks and codes")
+    parser.add_argument("--sub_dim", type=int, default=4)
+    parser.add_argument("--n_centroids", type=int, default=16)
+    parser.add_argument("--n_iters", type=int, default=16)
+    parser.add_argument("--modules",
+                        default=DEFAULT_MODULES,
+                        help="a regex of the module names to quantize")
+    args = parser.parse_args()
+
+    model = np.load(args.model)
+    pattern = re.compile(args.modules)
+    arrays = {}
+    float_bytes = 0
+    for key in model.files:
+        if not key.endswith(".weight"):
+            continue
+        module = key[:-len(".weight")]
+        weight = model[key]
+        if weight.ndim != 2 or not pattern.search(module):
+            continue
+        codebooks, codes = train_weight(weight, args.sub_dim,
+                                        args.n_centroids, args.n_iters)
+        decoded = np.take_along_axis(codebooks, codes[:, np.newaxis, :],
+                                     axis=2).reshape(weight.shape)
+        error = np.linalg.norm(decoded - weight) / np.linalg.norm(weight)
+        print(f"{module}: {weight.shape} relative error {error:.4f}")
+        arrays[module + ".pq_codebooks"] = codebooks
+        arrays[module + ".pq_codes"] = codes
+        float_bytes += weight.size * 4
+    if not arrays:
+        raise ValueError(f"no module of {args.model} matches {args.modules}")
+    np.savez_compressed(args.output, **arrays)
+    ratio = float_bytes / sum(a.nbytes for a in arrays.values())
+    print(f"saved {len(arrays) // 2} modules to {args.output}, "
+          f"{ratio:.1f}x smaller than float32")
+
+
+if __name__ == '__main__':
+    main()
@@ -15,6 +15,9 @@
 
 #include <unordered_map>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #ifdef TT_WITH_CUDA
 #include <cuda_runtime.h>
 
@@ -103,6 +106,10 @@ struct Allocator::BestFitAllocatorImpl {
     void *allocated_addr;
     if (it != allocations_.end() && it->first >= size) {
       allocated_addr = it->second;
+      // record the size of the cached block, so that it returns to the cache
+      // with its full size.
+      size = it->first;
+      allocation_size_ -= size;
       allocations_.erase(it);
     } else {
       try {
@@ -124,6 +131,14 @@ struct Allocator::BestFitAllocatorImpl {
     addr_size_map_.erase(data);
   }
 
+  void trim(size_t keep_bytes, DLDeviceType dev) {
+    if (allocation_size_ > keep_bytes) {
+      free_cache(allocation_size_ - keep_bytes, dev);
+    }
+  }
+
+  size_t cached_bytes() const { return allocation_size_; }
+
   BestFitAllocatorImpl() : allocation_size_(0) {}
 
  private:
@@ -181,6 +196,30 @@ struct Allocator::CachingAllocatorImpl {
     }
   }
 
+  // cub releases its cached blocks all at once, so keep_bytes only decides
+  // whether the trimming is necessary.
+  void trim(size_t keep_bytes, DLDeviceType dev) {
+#ifdef TT_WITH_CUDA
+    if (dev == kDLGPU && cached_bytes() > keep_bytes) {
+      cub_allocator.FreeAllCached();
+    }
+#endif
+  }
+
+  size_t cached_bytes() {
+#ifdef TT_WITH_CUDA
+    size_t total = 0;
+    cub_allocator.mutex.Lock();
+    for (auto &block : cub_allocator.cached_blocks) {
+      total += block.bytes;
+    }
+    cub_allocator.mutex.Unlock();
+    return total;
+#else
+    return 0;
+#endif
+  }
+
  private:
 #ifdef TT_WITH_CUDA
   cub::CachingDeviceAllocator cub_allocator;
@@ -229,5 +268,24 @@ void Allocator::free(void *memory, const std::string &strategy,
   }
 }
 
+void Allocator::Trim(DLDeviceType dev, size_t keep_bytes) {
+  if (dev == kDLCPU) {
+#ifdef __GLIBC__
+    malloc_trim(keep_bytes);
+#endif
+    return;
+  }
+  bestfit_allocator_->trim(keep_bytes, dev);
+  caching_allocator_->trim(keep_bytes, dev);
+}
+
+size_t Allocator::cached_bytes(DLDeviceType dev) const {
+  if (dev == kDLCPU) {
+    return 0;
+  }
+  return bestfit_allocator_->cached_bytes() +
+         caching_allocator_->cached_bytes();
+}
+
 }  // namespace core
 }  // namespace turbo_transformers
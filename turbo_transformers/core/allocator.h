@@ -36,6 +36,15 @@ class Allocator {
 
   void free(void *memory, const std::string &strategy, DLDeviceType dev);
 
+  // Returns cached but unused memory of a device to the system. CPU memory is
+  // served by the C runtime heap, whose free pages are released with
+  // malloc_trim. The GPU caches release their free blocks until at most
+  // keep_bytes are left cached.
+  void Trim(DLDeviceType dev, size_t keep_bytes = 0);
+
+  // The bytes held by the caches of a device but not used by any tensor.
+  size_t cached_bytes(DLDeviceType dev) const;
+
  private:
   Allocator();
   struct BestFitAllocatorImpl;
@@ -0,0 +1,225 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/copy_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef TT_WITH_CUDA
+#include "turbo_transformers/core/cuda_enforce.cuh"
+#endif
+
+namespace turbo_transformers {
+namespace core {
+namespace {
+
+constexpr size_t kCacheLine = 64;
+// A chunk below this is not worth waking up a thread for.
+constexpr size_t kMinChunk = 64 * 1024;
+
+std::atomic<size_t> parallel_threshold{256 * 1024};
+std::atomic<size_t> non_temporal_threshold{4 * 1024 * 1024};
+
+void StreamCopy(char *dst, const char *src, size_t n) {
+#ifdef __SSE2__
+  size_t head = (16 - reinterpret_cast<uintptr_t>(dst) % 16) % 16;
+  head = std::min(head, n);
+  std::memcpy(dst, src, head);
+  dst += head;
+  src += head;
+  n -= head;
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+    __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+    __m128i d =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), a);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 48), d);
+  }
+  for (; i + 16 <= n; i += 16) {
+    _mm_stream_si128(
+        reinterpret_cast<__m128i *>(dst + i),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+  }
+  std::memcpy(dst + i, src + i, n - i);
+  // the streaming stores are weakly ordered, publish them before the
+  // consumer (or the barrier of the parallel region) reads dst.
+  _mm_sfence();
+#else
+  std::memcpy(dst, src, n);
+#endif
+}
+
+void CopyChunk(char *dst, const char *src, size_t n, bool non_temporal) {
+  if (non_temporal) {
+    StreamCopy(dst, src, n);
+  } else {
+    std::memcpy(dst, src, n);
+  }
+}
+
+int CopyThreads(size_t n) {
+#ifdef _OPENMP
+  if (n < parallel_threshold.load(std::memory_order_relaxed) ||
+      omp_in_parallel()) {
+    return 1;
+  }
+  return static_cast<int>(std::max<size_t>(
+      1, std::min<size_t>(omp_get_max_threads(), n / kMinChunk)));
+#else
+  return 1;
+#endif
+}
+
+// set while a copy runs on a team of threads.
+std::atomic<bool> team_busy{false};
+
+// The threads of a copy of n bytes. Every std::thread outside OpenMP starts a
+// team of its own, so at most one copy at a time runs in parallel and the
+// copies issued meanwhile by other threads, e.g. the batchers of the IPC
+// daemon, run serially instead of oversubscribing the cores.
+class CopyTeam {
+ public:
+  explicit CopyTeam(size_t n) : n_threads_(CopyThreads(n)) {
+    if (n_threads_ > 1 && team_busy.exchange(true, std::memory_order_acquire)) {
+      n_threads_ = 1;
+    }
+  }
+  ~CopyTeam() {
+    if (n_threads_ > 1) {
+      team_busy.store(false, std::memory_order_release);
+    }
+  }
+  int n_threads() const { return n_threads_; }
+
+ private:
+  int n_threads_;
+};
+
+void CPUMemcpy2D(char *dst, size_t dst_pitch, const char *src,
+                 size_t src_pitch, size_t width, size_t height) {
+  size_t total = width * height;
+  bool non_temporal =
+      total >= non_temporal_threshold.load(std::memory_order_relaxed);
+  CopyTeam team(total);
+  int n_threads = team.n_threads();
+  if (n_threads == 1) {
+    for (size_t i = 0; i < height; ++i) {
+      CopyChunk(dst + i * dst_pitch, src + i * src_pitch, width,
+                non_temporal);
+    }
+    return;
+  }
+#pragma omp parallel for num_threads(n_threads)
+  for (int64_t i = 0; i < static_cast<int64_t>(height); ++i) {
+    CopyChunk(dst + i * dst_pitch, src + i * src_pitch, width, non_temporal);
+  }
+}
+
+}  // namespace
+
+void *ParallelMemcpy(void *dst, const void *src, size_t n) {
+  auto *d = static_cast<char *>(dst);
+  auto *s = static_cast<const char *>(src);
+  bool non_temporal =
+      n >= non_temporal_threshold.load(std::memory_order_relaxed);
+  CopyTeam team(n);
+  int n_threads = team.n_threads();
+  if (n_threads == 1) {
+    CopyChunk(d, s, n, non_temporal);
+    return dst;
+  }
+  // chunk boundaries on cache lines, so that no two threads write the same
+  // line.
+  size_t chunk = (n / n_threads + kCacheLine - 1) / kCacheLine * kCacheLine;
+#pragma omp parallel for num_threads(n_threads)
+  for (int i = 0; i < n_threads; ++i) {
+    size_t begin = std::min(n, i * chunk);
+    size_t end = std::min(n, begin + chunk);
+    CopyChunk(d + begin, s + begin, end - begin, non_temporal);
+  }
+  return dst;
+}
+
+void Memcpy2D(void *dst, size_t dst_pitch, const void *src, size_t src_pitch,
+              size_t width, size_t height, MemcpyFlag flag) {
+  TT_ENFORCE(width <= dst_pitch && width <= src_pitch,
+             "Memcpy2D rows of %d bytes do not fit in the pitches %d, %d",
+             width, dst_pitch, src_pitch);
+  if (width == 0 || height == 0) return;
+  if (flag == MemcpyFlag::kCPU2CPU) {
+    if (width == dst_pitch && width == src_pitch) {
+      ParallelMemcpy(dst, src, width * height);
+    } else {
+      CPUMemcpy2D(static_cast<char *>(dst), dst_pitch,
+                  static_cast<const char *>(src), src_pitch, width, height);
+    }
+    return;
+  }
+#ifdef TT_WITH_CUDA
+  cudaMemcpyKind kind;
+  switch (flag) {
+    case MemcpyFlag::kCPU2GPU:
+      kind = cudaMemcpyHostToDevice;
+      break;
+    case MemcpyFlag::kGPU2CPU:
+      kind = cudaMemcpyDeviceToHost;
+      break;
+    case MemcpyFlag::kGPU2GPU:
+      kind = cudaMemcpyDeviceToDevice;
+      break;
+    default:
+      TT_THROW("The MemcpyFlag %d is not support now.",
+               static_cast<int>(flag));
+  }
+  TT_ENFORCE_CUDA_SUCCESS(
+      cudaMemcpy2D(dst, dst_pitch, src, src_pitch, width, height, kind));
+#else
+  TT_THROW(
+      "The MemcpyFlag %d is not support since turbo transformers is not "
+      "compiled with this device support",
+      static_cast<int>(flag));
+#endif
+}
+
+size_t ParallelCopyThreshold() {
+  return parallel_threshold.load(std::memory_order_relaxed);
+}
+
+size_t NonTemporalCopyThreshold() {
+  return non_temporal_threshold.load(std::memory_order_relaxed);
+}
+
+void SetCopyThresholds(size_t parallel_bytes, size_t non_temporal_bytes) {
+  parallel_threshold.store(parallel_bytes, std::memory_order_relaxed);
+  non_temporal_threshold.store(non_temporal_bytes, std::memory_order_relaxed);
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
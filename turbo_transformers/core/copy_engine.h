@@ -0,0 +1,49 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstddef>
+
+#include "turbo_transformers/core/memory.h"
+
+namespace turbo_transformers {
+namespace core {
+
+// The copy engine behind the kCPU2CPU Memcpy. A copy of at least
+// ParallelCopyThreshold() bytes is split in cache line aligned chunks across
+// the OpenMP threads, unless it is issued from inside a parallel region or
+// another copy already runs on a team of threads: each std::thread outside
+// OpenMP, e.g. a batcher of the IPC daemon, would start a full team of its
+// own and oversubscribe the cores. A copy of at least
+// NonTemporalCopyThreshold() bytes is written with streaming stores: it does
+// not fit in the private caches anyway, and bypassing the cache keeps the
+// weights of the next layer in the LLC.
+extern void *ParallelMemcpy(void *dst, const void *src, size_t n);
+
+// Copies `height` rows of `width` bytes, the rows `src_pitch` bytes apart in
+// src and `dst_pitch` bytes apart in dst, as cudaMemcpy2D. The gathers of
+// rows out of a larger tensor (Concat, SeqPoolWithIdx) are one call instead
+// of a Memcpy per row.
+extern void Memcpy2D(void *dst, size_t dst_pitch, const void *src,
+                     size_t src_pitch, size_t width, size_t height,
+                     MemcpyFlag flag);
+
+extern size_t ParallelCopyThreshold();
+extern size_t NonTemporalCopyThreshold();
+// Tunes the thresholds of the copy engine, in bytes. Mostly for tests and
+// benchmarks, the defaults suit the usual server CPUs.
+extern void SetCopyThresholds(size_t parallel_bytes, size_t non_temporal_bytes);
+
+}  // namespace core
+}  // namespace turbo_transformers
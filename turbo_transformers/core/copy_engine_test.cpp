@@ -0,0 +1,126 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/copy_engine.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+namespace {
+std::vector<uint8_t> Pattern(size_t n) {
+  std::vector<uint8_t> data(n);
+  for (size_t i = 0; i < n; ++i) {
+    data[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+  return data;
+}
+
+// Restores the default thresholds at the end of a test.
+struct ThresholdGuard {
+  ThresholdGuard()
+      : parallel(ParallelCopyThreshold()),
+        non_temporal(NonTemporalCopyThreshold()) {}
+  ~ThresholdGuard() { SetCopyThresholds(parallel, non_temporal); }
+  size_t parallel, non_temporal;
+};
+}  // namespace
+
+TEST_CASE("copy_engine-memcpy", "[copy_engine]") {
+  ThresholdGuard guard;
+  // serial, parallel and streaming paths, with misaligned ends on both
+  // sides.
+  for (auto thresholds : std::vector<std::pair<size_t, size_t>>{
+           {SIZE_MAX, SIZE_MAX}, {0, SIZE_MAX}, {SIZE_MAX, 0}, {0, 0}}) {
+    SetCopyThresholds(thresholds.first, thresholds.second);
+    for (size_t n : {0, 1, 15, 63, 64, 1000, 300 * 1024 + 5}) {
+      for (size_t offset : {0, 3, 16}) {
+        auto src = Pattern(n + offset);
+        std::vector<uint8_t> dst(n + 2 * offset + 2, 0xee);
+        Memcpy(dst.data() + offset + 1, src.data() + offset, n,
+               MemcpyFlag::kCPU2CPU);
+        REQUIRE(dst[offset] == 0xee);
+        REQUIRE(dst[offset + n + 1] == 0xee);
+        for (size_t i = 0; i < n; ++i) {
+          REQUIRE(dst[offset + 1 + i] == src[offset + i]);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("copy_engine-memcpy2d", "[copy_engine]") {
+  ThresholdGuard guard;
+  for (auto thresholds : std::vector<std::pair<size_t, size_t>>{
+           {SIZE_MAX, SIZE_MAX}, {0, 0}}) {
+    SetCopyThresholds(thresholds.first, thresholds.second);
+    constexpr size_t width = 100, src_pitch = 300, dst_pitch = 130,
+                     height = 37;
+    auto src = Pattern(src_pitch * height);
+    std::vector<uint8_t> dst(dst_pitch * height, 0xee);
+    Memcpy2D(dst.data(), dst_pitch, src.data() + 50, src_pitch, width, height,
+             MemcpyFlag::kCPU2CPU);
+    for (size_t row = 0; row < height; ++row) {
+      for (size_t i = 0; i < dst_pitch; ++i) {
+        if (i < width) {
+          REQUIRE(dst[row * dst_pitch + i] == src[row * src_pitch + 50 + i]);
+        } else {
+          REQUIRE(dst[row * dst_pitch + i] == 0xee);
+        }
+      }
+    }
+
+    // contiguous rows are one copy.
+    std::vector<uint8_t> flat(width * height);
+    Memcpy2D(flat.data(), width, dst.data(), dst_pitch, width, height,
+             MemcpyFlag::kCPU2CPU);
+    std::vector<uint8_t> flat2(width * height);
+    Memcpy2D(flat2.data(), width, flat.data(), width, width, height,
+             MemcpyFlag::kCPU2CPU);
+    REQUIRE(flat == flat2);
+  }
+  std::vector<uint8_t> buf(64);
+  REQUIRE_THROWS(Memcpy2D(buf.data(), 8, buf.data() + 32, 16, 16, 2,
+                          MemcpyFlag::kCPU2CPU));
+}
+
+TEST_CASE("copy_engine-concurrent-threads", "[copy_engine]") {
+  ThresholdGuard guard;
+  SetCopyThresholds(0, SIZE_MAX);
+  // the copies of plain threads share one team, the others run serially.
+  auto src = Pattern(1 << 20);
+  std::vector<std::vector<uint8_t>> dsts(4, std::vector<uint8_t>(src.size()));
+  std::vector<std::thread> threads;
+  for (auto &dst : dsts) {
+    threads.emplace_back([&src, &dst]() {
+      for (int i = 0; i < 20; ++i) {
+        Memcpy(dst.data(), src.data(), src.size(), MemcpyFlag::kCPU2CPU);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto &dst : dsts) {
+    REQUIRE(dst == src);
+  }
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -0,0 +1,377 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/gemm_backend.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "loguru.hpp"
+#include "turbo_transformers/core/blas.h"
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace core {
+
+void GemmBackend::SgemmBatch(bool a_trans, bool b_trans, int64_t m, int64_t n,
+                             int64_t k, float alpha, const float** A_array,
+                             int64_t lda, const float** B_array, int64_t ldb,
+                             float beta, float** C_array, int64_t ldc,
+                             int64_t batch_size) const {
+  for (int64_t i = 0; i < batch_size; ++i) {
+    Sgemm(a_trans, b_trans, m, n, k, alpha, A_array[i], lda, B_array[i], ldb,
+          beta, C_array[i], ldc);
+  }
+}
+
+void GemmBackend::Tanh(int64_t n, const float* in, float* out) const {
+  for (int64_t i = 0; i < n; ++i) {
+    out[i] = std::tanh(in[i]);
+  }
+}
+
+namespace {
+
+// The BLAS library linked at compile time.
+class BlasBackend : public GemmBackend {
+ public:
+  const std::string& name() const override { return name_; }
+
+  void Sgemm(bool a_trans, bool b_trans, int64_t m, int64_t n, int64_t k,
+             float alpha, const float* A, int64_t lda, const float* B,
+             int64_t ldb, float beta, float* C, int64_t ldc) const override {
+    cblas_sgemm(CblasRowMajor, a_trans ? CblasTrans : CblasNoTrans,
+                b_trans ? CblasTrans : CblasNoTrans, m, n, k, alpha, A, lda, B,
+                ldb, beta, C, ldc);
+  }
+
+  void SgemmBatch(bool a_trans, bool b_trans, int64_t m, int64_t n, int64_t k,
+                  float alpha, const float** A_array, int64_t lda,
+                  const float** B_array, int64_t ldb, float beta,
+                  float** C_array, int64_t ldc,
+                  int64_t batch_size) const override {
+    CBLAS_TRANSPOSE transA = a_trans ? CblasTrans : CblasNoTrans;
+    CBLAS_TRANSPOSE transB = b_trans ? CblasTrans : CblasNoTrans;
+    BlasInt M = m, N = n, K = k, LDA = lda, LDB = ldb, LDC = ldc;
+    BlasInt group_size = batch_size;
+    cblas_sgemm_batch(CblasRowMajor, &transA, &transB, &M, &N, &K, &alpha,
+                      A_array, &LDA, B_array, &LDB, &beta, C_array, &LDC, 1,
+                      &group_size);
+  }
+
+  void Tanh(int64_t n, const float* in, float* out) const override {
+    vsTanh(n, in, out);
+  }
+
+ private:
+#if defined(TT_BLAS_USE_MKL)
+  const std::string name_{"mkl"};
+#elif defined(TT_BLAS_USE_OPENBLAS)
+  const std::string name_{"openblas"};
+#elif defined(TT_BLAS_USE_BLIS)
+  const std::string name_{"blis"};
+#endif
+};
+
+// A portable kernel without any library, a baseline for the other backends.
+// The rows of C are computed in parallel, op(B) is read row by row when it is
+// not transposed, so the inner loop vectorizes.
+class ReferenceBackend : public GemmBackend {
+ public:
+  const std::string& name() const override { return name_; }
+
+  void Sgemm(bool a_trans, bool b_trans, int64_t m, int64_t n, int64_t k,
+             float alpha, const float* A, int64_t lda, const float* B,
+             int64_t ldb, float beta, float* C, int64_t ldc) const override {
+#pragma omp parallel for
+    for (int64_t i = 0; i < m; ++i) {
+      float* c = C + i * ldc;
+      for (int64_t j = 0; j < n; ++j) {
+        c[j] = beta == 0.f ? 0.f : beta * c[j];
+      }
+      if (b_trans) {
+        for (int64_t j = 0; j < n; ++j) {
+          const float* b = B + j * ldb;
+          float sum = 0.f;
+          for (int64_t p = 0; p < k; ++p) {
+            sum += (a_trans ? A[p * lda + i] : A[i * lda + p]) * b[p];
+          }
+          c[j] += alpha * sum;
+        }
+      } else {
+        for (int64_t p = 0; p < k; ++p) {
+          float a = alpha * (a_trans ? A[p * lda + i] : A[i * lda + p]);
+          const float* b = B + p * ldb;
+#pragma omp simd
+          for (int64_t j = 0; j < n; ++j) {
+            c[j] += a * b[j];
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  const std::string name_{"reference"};
+};
+
+// A cblas library opened with dlopen. RTLD_LOCAL keeps its symbols apart from
+// the BLAS linked at compile time. The CBLAS enums have the same values in
+// every implementation.
+class DynamicBlasBackend : public GemmBackend {
+ public:
+  DynamicBlasBackend(std::string name, const std::string& library_path)
+      : name_(std::move(name)) {
+    handle_ = dlopen(library_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle_ == nullptr) {
+      TT_THROW("can not load gemm backend %s from %s: %s", name_,
+               library_path, dlerror());
+    }
+    sgemm_ = reinterpret_cast<SgemmFunc>(dlsym(handle_, "cblas_sgemm"));
+    if (sgemm_ == nullptr) {
+      dlclose(handle_);
+      TT_THROW("%s does not export cblas_sgemm", library_path);
+    }
+    sgemm_batch_ = reinterpret_cast<SgemmBatchFunc>(
+        dlsym(handle_, "cblas_sgemm_batch"));
+    tanh_ = reinterpret_cast<TanhFunc>(dlsym(handle_, "vsTanh"));
+  }
+
+  ~DynamicBlasBackend() override { dlclose(handle_); }
+
+  const std::string& name() const override { return name_; }
+
+  void Sgemm(bool a_trans, bool b_trans, int64_t m, int64_t n, int64_t k,
+             float alpha, const float* A, int64_t lda, const float* B,
+             int64_t ldb, float beta, float* C, int64_t ldc) const override {
+    sgemm_(kRowMajor, a_trans ? kTrans : kNoTrans, b_trans ? kTrans : kNoTrans,
+           m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+  }
+
+  void SgemmBatch(bool a_trans, bool b_trans, int64_t m, int64_t n, int64_t k,
+                  float alpha, const float** A_array, int64_t lda,
+                  const float** B_array, int64_t ldb, float beta,
+                  float** C_array, int64_t ldc,
+                  int64_t batch_size) const override {
+    if (sgemm_batch_ == nullptr) {
+      GemmBackend::SgemmBatch(a_trans, b_trans, m, n, k, alpha, A_array, lda,
+                              B_array, ldb, beta, C_array, ldc, batch_size);
+      return;
+    }
+    int transA = a_trans ? kTrans : kNoTrans;
+    int transB = b_trans ? kTrans : kNoTrans;
+    int M = m, N = n, K = k, LDA = lda, LDB = ldb, LDC = ldc;
+    int group_size = batch_size;
+    sgemm_batch_(kRowMajor, &transA, &transB, &M, &N, &K, &alpha, A_array,
+                 &LDA, B_array, &LDB, &beta, C_array, &LDC, 1, &group_size);
+  }
+
+  void Tanh(int64_t n, const float* in, float* out) const override {
+    if (tanh_ == nullptr) {
+      GemmBackend::Tanh(n, in, out);
+    } else {
+      tanh_(n, in, out);
+    }
+  }
+
+ private:
+  enum : int { kRowMajor = 101, kNoTrans = 111, kTrans = 112 };
+
+  using SgemmFunc = void (*)(int, int, int, int, int, int, float, const float*,
+                             int, const float*, int, float, float*, int);
+  using SgemmBatchFunc = void (*)(int, const int*, const int*, const int*,
+                                  const int*, const int*, const float*,
+                                  const float**, const int*, const float**,
+                                  const int*, const float*, float**,
+                                  const int*, int, const int*);
+  using TanhFunc = void (*)(int, const float*, float*);
+
+  std::string name_;
+  void* handle_{nullptr};
+  SgemmFunc sgemm_{nullptr};
+  SgemmBatchFunc sgemm_batch_{nullptr};
+  TanhFunc tanh_{nullptr};
+};
+
+thread_local GemmBackend* thread_backend = nullptr;
+
+}  // namespace
+
+struct GemmBackendRegistry::Impl {
+  using CallSites = std::unordered_map<std::string, GemmBackend*>;
+
+  const std::shared_ptr<GemmBackend>& Find(const std::string& name) const {
+    auto it = backends_.find(name);
+    TT_ENFORCE(it != backends_.end(), "gemm backend %s is not registered",
+               name);
+    return it->second;
+  }
+
+  // Publishes a new copy of the call sites. Select may still read the
+  // previous copies, so they are kept, call sites change rarely.
+  void PublishCallSites(CallSites call_sites) {
+    call_site_copies_.emplace_back(new CallSites(std::move(call_sites)));
+    auto* published = call_site_copies_.back().get();
+    call_sites_.store(published->empty() ? nullptr : published,
+                      std::memory_order_release);
+  }
+
+  const CallSites& call_sites() const {
+    static const CallSites empty;
+    auto* published = call_sites_.load(std::memory_order_acquire);
+    return published == nullptr ? empty : *published;
+  }
+
+  // serializes the writers, Select does not take it
+  mutable std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<GemmBackend>> backends_;
+  // the backends replaced by Register, threads may still run on them
+  std::vector<std::shared_ptr<GemmBackend>> replaced_;
+  std::vector<std::unique_ptr<const CallSites>> call_site_copies_;
+  std::atomic<const CallSites*> call_sites_{nullptr};
+  std::atomic<GemmBackend*> default_{nullptr};
+};
+
+GemmBackendRegistry::GemmBackendRegistry() : impl_(new Impl()) {
+  auto blas = std::make_shared<BlasBackend>();
+  Register(blas);
+  Register(std::make_shared<ReferenceBackend>());
+  SetDefault(blas->name());
+
+  if (const char* libraries = std::getenv("TT_GEMM_BACKENDS")) {
+    std::string spec(libraries);
+    size_t begin = 0;
+    while (begin < spec.size()) {
+      size_t end = std::min(spec.find(',', begin), spec.size());
+      std::string item = spec.substr(begin, end - begin);
+      size_t eq = item.find('=');
+      if (eq == std::string::npos) {
+        LOG_S(WARNING) << "TT_GEMM_BACKENDS: ignore " << item
+                       << ", expect name=path";
+      } else {
+        try {
+          Load(item.substr(0, eq), item.substr(eq + 1));
+        } catch (const std::exception& e) {
+          LOG_S(WARNING) << e.what();
+        }
+      }
+      begin = end + 1;
+    }
+  }
+  if (const char* name = std::getenv("TT_GEMM_BACKEND")) {
+    SetDefault(name);
+  }
+}
+
+GemmBackendRegistry::~GemmBackendRegistry() = default;
+
+void GemmBackendRegistry::Register(std::shared_ptr<GemmBackend> backend) {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  const std::string& name = backend->name();
+  auto it = impl_->backends_.find(name);
+  if (it != impl_->backends_.end()) {
+    // rebind the users of the replaced backend
+    GemmBackend* replaced = it->second.get();
+    Impl::CallSites call_sites = impl_->call_sites();
+    for (auto& call_site : call_sites) {
+      if (call_site.second == replaced) {
+        call_site.second = backend.get();
+      }
+    }
+    impl_->PublishCallSites(std::move(call_sites));
+    if (impl_->default_.load() == replaced) {
+      impl_->default_.store(backend.get(), std::memory_order_release);
+    }
+    impl_->replaced_.emplace_back(std::move(it->second));
+  }
+  impl_->backends_[name] = std::move(backend);
+}
+
+void GemmBackendRegistry::Load(const std::string& name,
+                               const std::string& library_path) {
+  Register(std::make_shared<DynamicBlasBackend>(name, library_path));
+}
+
+bool GemmBackendRegistry::Has(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  return impl_->backends_.count(name) != 0;
+}
+
+std::vector<std::string> GemmBackendRegistry::List() const {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  std::vector<std::string> names;
+  for (auto& item : impl_->backends_) {
+    names.emplace_back(item.first);
+  }
+  return names;
+}
+
+std::shared_ptr<GemmBackend> GemmBackendRegistry::Get(
+    const std::string& name) const {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  return impl_->Find(name);
+}
+
+void GemmBackendRegistry::SetDefault(const std::string& name) {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  impl_->default_.store(impl_->Find(name).get(), std::memory_order_release);
+}
+
+std::string GemmBackendRegistry::default_name() const {
+  return impl_->default_.load(std::memory_order_acquire)->name();
+}
+
+void GemmBackendRegistry::SetCallSite(const std::string& call_site,
+                                      const std::string& name) {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  Impl::CallSites call_sites = impl_->call_sites();
+  if (name.empty()) {
+    call_sites.erase(call_site);
+  } else {
+    call_sites[call_site] = impl_->Find(name).get();
+  }
+  impl_->PublishCallSites(std::move(call_sites));
+}
+
+void GemmBackendRegistry::ClearCallSites() {
+  std::lock_guard<std::mutex> lock(impl_->mutex_);
+  impl_->PublishCallSites(Impl::CallSites());
+}
+
+std::string GemmBackendRegistry::SetThreadBackend(const std::string& name) {
+  std::string prev = thread_backend ? thread_backend->name() : "";
+  thread_backend = name.empty() ? nullptr : Get(name).get();
+  return prev;
+}
+
+GemmBackend* GemmBackendRegistry::Select(const std::string& call_site) const {
+  if (auto* call_sites = impl_->call_sites_.load(std::memory_order_acquire)) {
+    auto it = call_sites->find(call_site);
+    if (it != call_sites->end()) {
+      return it->second;
+    }
+  }
+  return thread_backend ? thread_backend
+                        : impl_->default_.load(std::memory_order_acquire);
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
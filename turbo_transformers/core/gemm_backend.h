@@ -0,0 +1,127 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "macros.h"
+
+namespace turbo_transformers {
+namespace core {
+
+// A provider of the CPU dense math used by the kernels. All matrices are row
+// major, as in cblas with CblasRowMajor.
+class GemmBackend {
+ public:
+  virtual ~GemmBackend() = default;
+
+  virtual const std::string& name() const = 0;
+
+  // C = alpha * op(A) * op(B) + beta * C, where op(A) is m x k and op(B) is
+  // k x n.
+  virtual void Sgemm(bool a_trans, bool b_trans, int64_t m, int64_t n,
+                     int64_t k, float alpha, const float* A, int64_t lda,
+                     const float* B, int64_t ldb, float beta, float* C,
+                     int64_t ldc) const = 0;
+
+  // batch_size GEMMs of the same shape. The default loops over Sgemm.
+  virtual void SgemmBatch(bool a_trans, bool b_trans, int64_t m, int64_t n,
+                          int64_t k, float alpha, const float** A_array,
+                          int64_t lda, const float** B_array, int64_t ldb,
+                          float beta, float** C_array, int64_t ldc,
+                          int64_t batch_size) const;
+
+  // out[i] = tanh(in[i]), in and out may be the same buffer.
+  virtual void Tanh(int64_t n, const float* in, float* out) const;
+};
+
+// The backends known to the process. Built in are the BLAS library selected
+// at compile time ("mkl", "openblas" or "blis") and "reference", a portable
+// OpenMP kernel. Other cblas compatible libraries can be loaded at runtime,
+// either with Load or by listing them in the environment variable
+// TT_GEMM_BACKENDS as "name=/path/libfoo.so,name2=/path/libbar.so".
+// TT_GEMM_BACKEND names the default backend.
+//
+// A kernel asks for the backend of its call site, the profiling name it is
+// invoked with, e.g. "MatMul", "BatchMatMul" or "Tanh". The backend of a call
+// site overrides the backend of the calling thread (see GemmBackendGuard),
+// which overrides the default one. Select runs on every kernel call, so it
+// takes no lock: the default backend and the call sites are published through
+// atomic pointers, and a registered backend lives as long as the registry,
+// also once replaced, so the pointer Select returns stays valid.
+class GemmBackendRegistry {
+ public:
+  ~GemmBackendRegistry();
+
+  static GemmBackendRegistry& GetInstance() {
+    static GemmBackendRegistry instance;
+    return instance;
+  }
+
+  // Registers a backend under backend->name(), replacing one of the same name.
+  void Register(std::shared_ptr<GemmBackend> backend);
+
+  // dlopens a shared library exporting cblas_sgemm and registers it as name.
+  // cblas_sgemm_batch and vsTanh are used when exported too. The library
+  // must use 32 bit integers (LP64).
+  void Load(const std::string& name, const std::string& library_path);
+
+  bool Has(const std::string& name) const;
+  std::vector<std::string> List() const;
+  std::shared_ptr<GemmBackend> Get(const std::string& name) const;
+
+  void SetDefault(const std::string& name);
+  std::string default_name() const;
+
+  // Uses the backend name for the kernel call site, an empty name removes
+  // the override.
+  void SetCallSite(const std::string& call_site, const std::string& name);
+  void ClearCallSites();
+
+  // Sets the backend of the calling thread and returns the previous one, an
+  // empty name removes the override.
+  std::string SetThreadBackend(const std::string& name);
+
+  GemmBackend* Select(const std::string& call_site) const;
+
+ private:
+  GemmBackendRegistry();
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  DISABLE_COPY_AND_ASSIGN(GemmBackendRegistry);
+};
+
+// Runs the kernels launched by this thread in its scope on one backend, e.g.
+// to serve two models with different backends from one process.
+class GemmBackendGuard {
+ public:
+  explicit GemmBackendGuard(const std::string& name)
+      : prev_(GemmBackendRegistry::GetInstance().SetThreadBackend(name)) {}
+  ~GemmBackendGuard() {
+    GemmBackendRegistry::GetInstance().SetThreadBackend(prev_);
+  }
+
+ private:
+  std::string prev_;
+
+  DISABLE_COPY_AND_ASSIGN(GemmBackendGuard);
+};
+
+}  // namespace core
+}  // namespace turbo_transformers
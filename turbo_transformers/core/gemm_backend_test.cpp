@@ -0,0 +1,134 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/gemm_backend.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+static std::vector<float> RandomVector(size_t size, std::mt19937* gen) {
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  std::vector<float> result(size);
+  for (auto& v : result) {
+    v = dist(*gen);
+  }
+  return result;
+}
+
+static bool AllClose(const std::vector<float>& a, const std::vector<float>& b,
+                     float eps = 1e-4) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::abs(a[i] - b[i]) > eps) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST_CASE("gemm_backend-builtin", "[gemm_backend]") {
+  auto& registry = GemmBackendRegistry::GetInstance();
+  auto names = registry.List();
+  REQUIRE(names.size() >= 2);
+  REQUIRE(registry.Has("reference"));
+  REQUIRE(registry.Has(registry.default_name()));
+  REQUIRE_THROWS(registry.Get("not-a-backend"));
+  REQUIRE_THROWS(registry.SetDefault("not-a-backend"));
+}
+
+TEST_CASE("gemm_backend-providers-agree", "[gemm_backend]") {
+  auto& registry = GemmBackendRegistry::GetInstance();
+  auto reference = registry.Get("reference");
+  std::mt19937 gen(0);
+  int64_t m = 7, n = 33, k = 65;
+  for (auto& name : registry.List()) {
+    auto backend = registry.Get(name);
+    for (bool a_trans : {false, true}) {
+      for (bool b_trans : {false, true}) {
+        auto A = RandomVector(m * k, &gen);
+        auto B = RandomVector(k * n, &gen);
+        auto C = RandomVector(m * n, &gen);
+        auto expected = C;
+        int64_t lda = a_trans ? m : k;
+        int64_t ldb = b_trans ? k : n;
+        reference->Sgemm(a_trans, b_trans, m, n, k, 0.5f, A.data(), lda,
+                         B.data(), ldb, 2.f, expected.data(), n);
+        backend->Sgemm(a_trans, b_trans, m, n, k, 0.5f, A.data(), lda,
+                       B.data(), ldb, 2.f, C.data(), n);
+        REQUIRE(AllClose(C, expected));
+      }
+    }
+
+    int64_t batch_size = 3;
+    auto A = RandomVector(batch_size * m * k, &gen);
+    auto B = RandomVector(batch_size * k * n, &gen);
+    std::vector<float> C(batch_size * m * n), expected(batch_size * m * n);
+    std::vector<const float*> A_array, B_array;
+    std::vector<float*> C_array;
+    for (int64_t i = 0; i < batch_size; ++i) {
+      A_array.push_back(A.data() + i * m * k);
+      B_array.push_back(B.data() + i * k * n);
+      C_array.push_back(C.data() + i * m * n);
+      reference->Sgemm(false, true, m, n, k, 1.f, A_array.back(), k,
+                       B_array.back(), k, 0.f, expected.data() + i * m * n,
+                       n);
+    }
+    backend->SgemmBatch(false, true, m, n, k, 1.f, A_array.data(), k,
+                        B_array.data(), k, 0.f, C_array.data(), n,
+                        batch_size);
+    REQUIRE(AllClose(C, expected));
+
+    auto x = RandomVector(100, &gen);
+    std::vector<float> y(x.size()), tanh_x(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+      tanh_x[i] = std::tanh(x[i]);
+    }
+    backend->Tanh(x.size(), x.data(), y.data());
+    REQUIRE(AllClose(y, tanh_x));
+  }
+}
+
+TEST_CASE("gemm_backend-selection", "[gemm_backend]") {
+  auto& registry = GemmBackendRegistry::GetInstance();
+  auto default_name = registry.default_name();
+  REQUIRE(registry.Select("MatMul")->name() == default_name);
+  {
+    GemmBackendGuard guard("reference");
+    REQUIRE(registry.Select("MatMul")->name() == "reference");
+    registry.SetCallSite("MatMul", default_name);
+    REQUIRE(registry.Select("MatMul")->name() == default_name);
+    REQUIRE(registry.Select("BatchMatMul")->name() == "reference");
+    registry.SetCallSite("MatMul", "");
+    REQUIRE(registry.Select("MatMul")->name() == "reference");
+  }
+  REQUIRE(registry.Select("MatMul")->name() == default_name);
+
+  registry.SetCallSite("Tanh", "reference");
+  REQUIRE(registry.Select("Tanh")->name() == "reference");
+  registry.ClearCallSites();
+  REQUIRE(registry.Select("Tanh")->name() == default_name);
+  REQUIRE_THROWS(registry.SetCallSite("MatMul", "not-a-backend"));
+  REQUIRE_THROWS(registry.Load("missing", "/not/a/libblas.so"));
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -13,8 +13,13 @@
 
 #include "turbo_transformers/core/memory.h"
 
+#include <unistd.h>
+
 #include <cstring>
+#include <fstream>
 #include <vector>
+
+#include "turbo_transformers/core/copy_engine.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_enforce.cuh"
 #endif
@@ -34,8 +39,7 @@ using MemcpyFuncTypes = std::function<void *(void *, const void *, size_t)>;
 static std::vector<MemcpyFuncTypes> InitMemcpyFuncs() {
   std::vector<MemcpyFuncTypes> results(
       static_cast<size_t>(MemcpyFlag::kNUM_MEMCPY_FLAGS));
-  results[static_cast<size_t>(MemcpyFlag::kCPU2CPU)] = std::memcpy;
-
+  // kCPU2CPU is copied by Memcpy directly, see ParallelMemcpy.
 #ifdef TT_WITH_CUDA
   for (auto &pair : std::vector<std::pair<MemcpyFlag, cudaMemcpyKind>>{
            {MemcpyFlag::kCPU2GPU, cudaMemcpyHostToDevice},
@@ -56,6 +60,11 @@ static std::vector<MemcpyFuncTypes> InitMemcpyFuncs() {
 void Memcpy(void *dst_data, const void *src_data, size_t data_size,
             MemcpyFlag flag) {
   if (data_size <= 0) return;
+  // the host copies, the most frequent, skip the std::function dispatch.
+  if (flag == MemcpyFlag::kCPU2CPU) {
+    ParallelMemcpy(dst_data, src_data, data_size);
+    return;
+  }
   static auto memcpyFuncs = InitMemcpyFuncs();
   auto f = static_cast<size_t>(flag);
   if (f >= memcpyFuncs.size()) {
@@ -80,5 +89,14 @@ MemcpyFlag ToMemcpyFlag(DLDeviceType dst, DLDeviceType src) {
   }
 }
 
+size_t GetResidentMemoryBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0, resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
 }  // namespace core
 }  // namespace turbo_transformers
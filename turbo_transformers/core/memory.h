@@ -37,5 +37,9 @@ extern void Memcpy(void *dst_data, const void *src_data, size_t data_size,
 
 extern MemcpyFlag ToMemcpyFlag(DLDeviceType dst, DLDeviceType src);
 
+// The resident set size of the current process in bytes. Returns 0 on the
+// platforms without /proc.
+extern size_t GetResidentMemoryBytes();
+
 }  // namespace core
 }  // namespace turbo_transformers
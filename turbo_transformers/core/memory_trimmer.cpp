@@ -0,0 +1,113 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/core/memory_trimmer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "turbo_transformers/core/allocator.h"
+
+namespace turbo_transformers {
+namespace core {
+
+HighWaterMark::HighWaterMark(size_t window, double percentile, double decay)
+    : window_(window), percentile_(percentile), decay_(decay) {
+  TT_ENFORCE_GT(window_, 0, "The window of HighWaterMark should be positive");
+  TT_ENFORCE(percentile_ >= 0. && percentile_ <= 1.,
+             "The percentile %f should be in [0, 1]", percentile_);
+  TT_ENFORCE(decay_ > 0. && decay_ <= 1., "The decay %f should be in (0, 1]",
+             decay_);
+}
+
+void HighWaterMark::Observe(int64_t value) {
+  history_.push_back(value);
+  if (history_.size() > window_) {
+    history_.pop_front();
+  }
+}
+
+int64_t HighWaterMark::Limit() const {
+  if (history_.empty()) {
+    return 0;
+  }
+  std::vector<double> decayed(history_.size());
+  double weight = 1.;
+  // the newest observation is at the back and keeps its full value.
+  for (size_t i = history_.size(); i-- > 0;) {
+    decayed[i] = history_[i] * weight;
+    weight *= decay_;
+  }
+  auto kth = decayed.begin() +
+             static_cast<int64_t>(percentile_ * (decayed.size() - 1));
+  std::nth_element(decayed.begin(), kth, decayed.end());
+  // never below the newest observation, which is the current usage.
+  return std::max(static_cast<int64_t>(std::ceil(*kth)), history_.back());
+}
+
+MemoryTrimmer::MemoryTrimmer(const TrimPolicy &policy)
+    : policy_(policy), last_trim_(std::chrono::steady_clock::now()) {}
+
+void MemoryTrimmer::Track(Tensor *tensor) {
+  TT_ENFORCE(tensor != nullptr, "Can not track a null tensor");
+  tensors_.push_back(tensor);
+  marks_.emplace_back(policy_.window, policy_.percentile, policy_.decay);
+}
+
+size_t MemoryTrimmer::Step() {
+  for (size_t i = 0; i < tensors_.size(); ++i) {
+    marks_[i].Observe(tensors_[i]->is_null() ? 0 : tensors_[i]->numel());
+  }
+  ++requests_since_trim_;
+  bool due = policy_.interval_requests > 0 &&
+             requests_since_trim_ >= policy_.interval_requests;
+  if (!due && policy_.interval_seconds > 0) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - last_trim_;
+    due = elapsed.count() >= policy_.interval_seconds;
+  }
+  return due ? Trim() : 0;
+}
+
+size_t MemoryTrimmer::Trim() {
+  size_t released = 0;
+  bool trim_cpu = false, trim_gpu = false;
+  for (size_t i = 0; i < tensors_.size(); ++i) {
+    auto *tensor = tensors_[i];
+    if (tensor->is_null()) {
+      continue;
+    }
+    int64_t limit = marks_[i].Limit();
+    if (tensor->capacity() <= static_cast<int64_t>(limit * policy_.slack)) {
+      continue;
+    }
+    size_t bytes = tensor->ShrinkToFit(limit);
+    if (bytes > 0) {
+      released += bytes;
+      (tensor->device_type() == kDLCPU ? trim_cpu : trim_gpu) = true;
+    }
+  }
+  auto &allocator = Allocator::GetInstance();
+  if (trim_cpu) {
+    allocator.Trim(kDLCPU);
+  }
+  if (trim_gpu) {
+    allocator.Trim(kDLGPU);
+  }
+  requests_since_trim_ = 0;
+  last_trim_ = std::chrono::steady_clock::now();
+  return released;
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
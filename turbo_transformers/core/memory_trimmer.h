@@ -0,0 +1,87 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace core {
+
+// Tracks the recent peak of a quantity, e.g. the number of elements a
+// workspace tensor needed for each request. The limit is a percentile of the
+// recent observations, where the older observations are decayed, so a rare
+// large request stops dominating the limit after a while.
+class HighWaterMark {
+ public:
+  explicit HighWaterMark(size_t window = 64, double percentile = 0.9,
+                         double decay = 0.98);
+
+  void Observe(int64_t value);
+
+  int64_t Limit() const;
+
+  void Reset() { history_.clear(); }
+
+ private:
+  size_t window_;
+  double percentile_;
+  double decay_;
+  std::deque<int64_t> history_;
+};
+
+struct TrimPolicy {
+  // the number of observations kept by the high-water marks.
+  size_t window{64};
+  double percentile{0.9};
+  double decay{0.98};
+  // Trim when either so many requests or so much time has passed since the
+  // last trimming. A non-positive value disables the corresponding trigger.
+  int64_t interval_requests{64};
+  double interval_seconds{10.};
+  // A tensor is only shrunk if its capacity exceeds limit * slack.
+  double slack{1.25};
+};
+
+// Shrinks the long-lived workspace tensors to their recent high-water mark
+// and returns the released memory to the system. Call Step() between the
+// requests of the thread owning the workspace; the trimmer is not
+// thread-safe.
+class MemoryTrimmer {
+ public:
+  explicit MemoryTrimmer(const TrimPolicy &policy = TrimPolicy());
+
+  // The tensor must outlive the trimmer.
+  void Track(Tensor *tensor);
+
+  // Records the usage of the tracked tensors and trims them when it is due.
+  // Returns the number of bytes released.
+  size_t Step();
+
+  // Trims the tracked tensors regardless of the intervals.
+  size_t Trim();
+
+ private:
+  TrimPolicy policy_;
+  std::vector<Tensor *> tensors_;
+  std::vector<HighWaterMark> marks_;
+  int64_t requests_since_trim_{0};
+  std::chrono::steady_clock::time_point last_trim_;
+};
+
+}  // namespace core
+}  // namespace turbo_transformers
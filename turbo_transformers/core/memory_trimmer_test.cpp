@@ -0,0 +1,94 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/core/memory_trimmer.h"
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+TEST_CASE("memory_trimmer-reshape-keeps-capacity", "[memory_trimmer]") {
+  Tensor tensor(nullptr);
+  tensor.Reshape<float>({4, 128}, kDLCPU, 0);
+  REQUIRE(tensor.capacity() == 4 * 128);
+  tensor.Reshape<float>({2, 8}, kDLCPU, 0);
+  REQUIRE(tensor.numel() == 2 * 8);
+  REQUIRE(tensor.capacity() == 4 * 128);
+  auto* data = tensor.Reshape<float>({4, 64}, kDLCPU, 0);
+  REQUIRE(tensor.capacity() == 4 * 128);
+  for (int i = 0; i < 4 * 64; ++i) {
+    data[i] = i;
+  }
+
+  REQUIRE(tensor.ShrinkToFit() == 4 * 64 * sizeof(float));
+  REQUIRE(tensor.capacity() == 4 * 64);
+  REQUIRE(tensor.n_dim() == 2);
+  REQUIRE(tensor.shape(0) == 4);
+  REQUIRE(tensor.shape(1) == 64);
+  for (int i = 0; i < 4 * 64; ++i) {
+    REQUIRE(tensor.data<float>()[i] == i);
+  }
+  REQUIRE(tensor.ShrinkToFit() == 0);
+}
+
+TEST_CASE("memory_trimmer-high-water-mark", "[memory_trimmer]") {
+  HighWaterMark mark(16, 0.9, 0.9);
+  REQUIRE(mark.Limit() == 0);
+  for (int i = 0; i < 15; ++i) {
+    mark.Observe(100);
+  }
+  // a single large observation does not raise the limit once it is older
+  // than the newest one.
+  mark.Observe(10000);
+  REQUIRE(mark.Limit() == 10000);
+  mark.Observe(100);
+  REQUIRE(mark.Limit() == 100);
+
+  // the large observations decay when they are the majority.
+  for (int i = 0; i < 16; ++i) {
+    mark.Observe(1000);
+  }
+  REQUIRE(mark.Limit() == 1000);
+  for (int i = 0; i < 8; ++i) {
+    mark.Observe(10);
+  }
+  REQUIRE(mark.Limit() < 1000);
+  REQUIRE(mark.Limit() >= 10);
+}
+
+TEST_CASE("memory_trimmer-step", "[memory_trimmer]") {
+  TrimPolicy policy;
+  policy.window = 8;
+  policy.interval_requests = 4;
+  policy.interval_seconds = 0;
+  MemoryTrimmer trimmer(policy);
+  Tensor workspace(nullptr);
+  trimmer.Track(&workspace);
+
+  // an empty workspace is skipped
+  REQUIRE(trimmer.Trim() == 0);
+
+  workspace.Reshape<float>({512, 768}, kDLCPU, 0);
+  REQUIRE(trimmer.Step() == 0);
+  size_t released = 0;
+  for (int i = 0; i < 8; ++i) {
+    workspace.Reshape<float>({16, 768}, kDLCPU, 0);
+    released += trimmer.Step();
+  }
+  REQUIRE(released == (512 - 16) * 768 * sizeof(float));
+  REQUIRE(workspace.capacity() == 16 * 768);
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -17,6 +17,11 @@
 #include "loguru.hpp"
 
 #ifdef WITH_PERFTOOLS
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <stack>
@@ -83,7 +88,73 @@ struct Profiler::ProfilerImpl {
       timer_map_.insert({ctx_name, elapsed_time});
     }
   }
+  void record_parallel_region(const std::string& ctx_name, double wall_ms,
+                              const std::vector<double>& busy_ms,
+                              const std::vector<int64_t>& chunks) {
+    auto& summary = parallel_map_[ctx_name];
+    int64_t threads = busy_ms.size();
+    double busy = 0, max_busy = 0;
+    for (auto worker_busy : busy_ms) {
+      busy += worker_busy;
+      max_busy = std::max(max_busy, worker_busy);
+    }
+    int64_t n_chunks = 0;
+    for (auto worker_chunks : chunks) {
+      n_chunks += worker_chunks;
+    }
+    auto minmax_chunks = std::minmax_element(chunks.begin(), chunks.end());
+    if (summary.regions == 0) {
+      summary.min_worker_chunks = *minmax_chunks.first;
+    }
+    ++summary.regions;
+    summary.max_threads = std::max(summary.max_threads, threads);
+    summary.wall_ms += wall_ms;
+    summary.busy_ms += busy;
+    summary.idle_ms += std::max(0., threads * wall_ms - busy);
+    summary.max_worker_busy_ms += max_busy;
+    summary.chunks += n_chunks;
+    summary.min_worker_chunks =
+        std::min(summary.min_worker_chunks, *minmax_chunks.first);
+    summary.max_worker_chunks =
+        std::max(summary.max_worker_chunks, *minmax_chunks.second);
+  }
+  ParallelRegionSummary parallel_region_summary(
+      const std::string& ctx_name) const {
+    auto it = parallel_map_.find(ctx_name);
+    return it == parallel_map_.end() ? ParallelRegionSummary() : it->second;
+  }
   void print_results() const {
+    print_timeline();
+    if (!parallel_map_.empty()) {
+      print_parallel_regions();
+    }
+  }
+  void print_parallel_regions() const {
+    std::cerr << std::endl
+              << profile_name_ << " Parallel regions (name , runs, threads, "
+              << "wall ms, idle %, imbalance, chunks/run, chunks/worker "
+              << "min-max): " << std::endl;
+    std::vector<std::pair<std::string, ParallelRegionSummary>> elems(
+        parallel_map_.begin(), parallel_map_.end());
+    // the worst balanced regions first.
+    std::sort(elems.begin(), elems.end(),
+              [](const std::pair<std::string, ParallelRegionSummary>& a,
+                 const std::pair<std::string, ParallelRegionSummary>& b) {
+                return a.second.imbalance() > b.second.imbalance();
+              });
+    for (auto& elem : elems) {
+      auto& summary = elem.second;
+      double capacity = summary.busy_ms + summary.idle_ms;
+      std::cerr << elem.first << " , " << summary.regions << ", "
+                << summary.max_threads << ", " << summary.wall_ms << ", "
+                << (capacity > 0 ? summary.idle_ms / capacity * 100 : 0.)
+                << " %, " << summary.imbalance() << ", "
+                << static_cast<double>(summary.chunks) / summary.regions
+                << ", " << summary.min_worker_chunks << "-"
+                << summary.max_worker_chunks << std::endl;
+    }
+  }
+  void print_timeline() const {
     std::cerr << std::endl << profile_name_ << " Time line: " << std::endl;
     std::vector<std::pair<std::string, double>> elems(timer_map_.begin(),
                                                       timer_map_.end());
@@ -99,6 +170,7 @@ struct Profiler::ProfilerImpl {
   }
   void clear() {
     timer_map_.clear();
+    parallel_map_.clear();
     while (!clock_stack_.empty()) {
       clock_stack_.pop();
     }
@@ -115,6 +187,7 @@ struct Profiler::ProfilerImpl {
 
  private:
   std::unordered_map<std::string, double> timer_map_;
+  std::unordered_map<std::string, ParallelRegionSummary> parallel_map_;
   std::stack<std::chrono::time_point<std::chrono::system_clock>> clock_stack_;
 #ifdef TT_WITH_CUDA
   std::stack<cudaEvent_t> event_stack_;
@@ -131,6 +204,20 @@ void Profiler::end_profile(const std::string& ctx_name, DLDeviceType dev_type) {
   if (gProfileEnabled) profiler_->end_profile(ctx_name, dev_type);
 }
 
+void Profiler::record_parallel_region(const std::string& ctx_name,
+                                      double wall_ms,
+                                      const std::vector<double>& busy_ms,
+                                      const std::vector<int64_t>& chunks) {
+  if (gProfileEnabled) {
+    profiler_->record_parallel_region(ctx_name, wall_ms, busy_ms, chunks);
+  }
+}
+
+ParallelRegionSummary Profiler::parallel_region_summary(
+    const std::string& ctx_name) const {
+  return profiler_->parallel_region_summary(ctx_name);
+}
+
 void Profiler::print_results() const {
   if (gProfileEnabled) {
     profiler_->print_results();
@@ -144,10 +231,54 @@ void Profiler::enable(const std::string& profile_name) {
   profiler_->set_name(profile_name);
 }
 void Profiler::disable() { gProfileEnabled = false; }
+bool Profiler::enabled() const { return gProfileEnabled; }
 
 Profiler::~Profiler() = default;
 Profiler::Profiler() : profiler_(new ProfilerImpl()) {}
 
+double ParallelRegionSummary::imbalance() const {
+  double mean_busy_ms = max_threads > 0 ? busy_ms / max_threads : 0;
+  return mean_busy_ms > 0 ? max_worker_busy_ms / mean_busy_ms : 1.;
+}
+
+ParallelRegionProfile::ParallelRegionProfile(const std::string& ctx_name)
+    : ctx_name_(ctx_name), enabled_(gProfileEnabled) {
+  if (enabled_) {
+#ifdef _OPENMP
+    workers_.resize(omp_get_max_threads());
+#else
+    workers_.resize(1);
+#endif
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+ParallelRegionProfile::~ParallelRegionProfile() {
+  if (!enabled_) {
+    return;
+  }
+  std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - start_;
+  std::vector<double> busy_ms;
+  std::vector<int64_t> chunks;
+  for (auto& worker : workers_) {
+    busy_ms.push_back(worker.busy_ms);
+    chunks.push_back(worker.chunks);
+  }
+  Profiler::GetInstance().record_parallel_region(ctx_name_, wall.count(),
+                                                 busy_ms, chunks);
+}
+
+void ParallelRegionProfile::add_chunk(double busy_ms) {
+#ifdef _OPENMP
+  auto& worker = workers_[omp_get_thread_num()];
+#else
+  auto& worker = workers_[0];
+#endif
+  worker.busy_ms += busy_ms;
+  ++worker.chunks;
+}
+
 #endif
 void EnableGperf(const std::string& profile_name) {
 #ifdef WITH_PERFTOOLS
@@ -18,7 +18,9 @@
 #ifdef WITH_PERFTOOLS
 #include <dlpack/dlpack.h>
 
+#include <chrono>
 #include <memory>
+#include <vector>
 
 #include "macros.h"
 #endif
@@ -27,6 +29,27 @@ namespace turbo_transformers {
 namespace core {
 
 #ifdef WITH_PERFTOOLS
+// The load balance of the runs of a named parallel region. Times are in ms.
+struct ParallelRegionSummary {
+  int64_t regions{0};
+  int64_t max_threads{0};
+  double wall_ms{0};
+  // the busy time of all the workers
+  double busy_ms{0};
+  // the wall time the workers spent waiting, at the closing barrier or for
+  // the region to start
+  double idle_ms{0};
+  // the sum over the runs of the busy time of their slowest worker
+  double max_worker_busy_ms{0};
+  int64_t chunks{0};
+  int64_t min_worker_chunks{0};
+  int64_t max_worker_chunks{0};
+
+  // The busy time of the slowest worker over the mean, 1 is a perfect
+  // balance and the number of threads is the worst.
+  double imbalance() const;
+};
+
 class Profiler {
  public:
   ~Profiler();
@@ -38,7 +61,15 @@ class Profiler {
   void start_profile(const std::string& ctx_name,
                      DLDeviceType dev_type = kDLCPU);
   void end_profile(const std::string& ctx_name, DLDeviceType dev_type = kDLCPU);
+  // Accounts one run of a parallel region from the busy time (ms) and the
+  // number of chunks of each of its workers.
+  void record_parallel_region(const std::string& ctx_name, double wall_ms,
+                              const std::vector<double>& busy_ms,
+                              const std::vector<int64_t>& chunks);
+  ParallelRegionSummary parallel_region_summary(
+      const std::string& ctx_name) const;
   void print_results() const;
+  bool enabled() const;
   void enable(const std::string& profile_name);
   void disable();
 
@@ -50,6 +81,63 @@ class Profiler {
 
   DISABLE_COPY_AND_ASSIGN(Profiler);
 };
+
+// Measures the load balance of an OpenMP parallel loop for the profiler:
+// construct a region before the loop and a chunk around the work of every
+// iteration.
+//   core::ParallelRegionProfile region(name);
+// #pragma omp parallel for
+//   for (int64_t i = 0; i < n; ++i) {
+//     core::ParallelChunkProfile chunk(&region);
+//     ...
+//   }
+// Both do nothing while the profiler is disabled.
+class ParallelRegionProfile {
+ public:
+  explicit ParallelRegionProfile(const std::string& ctx_name);
+  ~ParallelRegionProfile();
+
+  bool enabled() const { return enabled_; }
+  // Called by the worker running a chunk that took busy_ms.
+  void add_chunk(double busy_ms);
+
+ private:
+  // one cache line per worker
+  struct alignas(64) Worker {
+    double busy_ms{0};
+    int64_t chunks{0};
+  };
+
+  std::string ctx_name_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<Worker> workers_;
+
+  DISABLE_COPY_AND_ASSIGN(ParallelRegionProfile);
+};
+
+class ParallelChunkProfile {
+ public:
+  explicit ParallelChunkProfile(ParallelRegionProfile* region)
+      : region_(region->enabled() ? region : nullptr) {
+    if (region_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~ParallelChunkProfile() {
+    if (region_ != nullptr) {
+      std::chrono::duration<double, std::milli> busy =
+          std::chrono::steady_clock::now() - start_;
+      region_->add_chunk(busy.count());
+    }
+  }
+
+ private:
+  ParallelRegionProfile* region_;
+  std::chrono::steady_clock::time_point start_;
+
+  DISABLE_COPY_AND_ASSIGN(ParallelChunkProfile);
+};
 #endif
 void EnableGperf(const std::string& profile_file);
 void DisableGperf();
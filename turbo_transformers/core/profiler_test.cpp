@@ -0,0 +1,95 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/profiler.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <chrono>
+#include <thread>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+#ifdef WITH_PERFTOOLS
+TEST_CASE("profiler-parallel-region-balanced") {
+  auto& profiler = Profiler::GetInstance();
+  profiler.clear();
+  profiler.enable("test");
+  ParallelRegionSummary summary;
+  {
+    ParallelRegionProfile region("balanced");
+    for (int i = 0; i < 8; ++i) {
+      ParallelChunkProfile chunk(&region);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  summary = profiler.parallel_region_summary("balanced");
+  profiler.disable();
+  REQUIRE(summary.regions == 1);
+  REQUIRE(summary.chunks == 8);
+  REQUIRE(summary.busy_ms >= 8.);
+  REQUIRE(summary.busy_ms <= summary.wall_ms * summary.max_threads);
+}
+
+#ifdef _OPENMP
+TEST_CASE("profiler-parallel-region-imbalance") {
+  auto& profiler = Profiler::GetInstance();
+  profiler.clear();
+  profiler.enable("test");
+  int n_threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+  for (int run = 0; run < 2; ++run) {
+    ParallelRegionProfile region("imbalanced");
+    // with a static schedule the first worker gets all the work
+#pragma omp parallel for schedule(static, 1)
+    for (int i = 0; i < 4; ++i) {
+      ParallelChunkProfile chunk(&region);
+      if (i == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    }
+  }
+  omp_set_num_threads(n_threads);
+  auto summary = profiler.parallel_region_summary("imbalanced");
+  profiler.print_results();
+  profiler.disable();
+  REQUIRE(summary.regions == 2);
+  REQUIRE(summary.max_threads == 4);
+  REQUIRE(summary.chunks == 8);
+  REQUIRE(summary.min_worker_chunks == 1);
+  REQUIRE(summary.max_worker_chunks == 1);
+  REQUIRE(summary.imbalance() > 3.);
+  REQUIRE(summary.idle_ms > summary.busy_ms);
+}
+#endif
+
+TEST_CASE("profiler-parallel-region-disabled") {
+  auto& profiler = Profiler::GetInstance();
+  profiler.clear();
+  {
+    ParallelRegionProfile region("disabled");
+    ParallelChunkProfile chunk(&region);
+    REQUIRE(!region.enabled());
+  }
+  REQUIRE(profiler.parallel_region_summary("disabled").regions == 0);
+}
+#endif
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -0,0 +1,38 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/request_timing.h"
+
+#include <numeric>
+
+#include "absl/strings/str_format.h"
+
+namespace turbo_transformers {
+namespace core {
+
+std::string RequestTiming::ToString() const {
+  double layers_ms = std::accumulate(layer_ms.begin(), layer_ms.end(), 0.);
+  std::string layers;
+  for (double ms : layer_ms) {
+    absl::StrAppendFormat(&layers, layers.empty() ? "%.3f" : " %.3f", ms);
+  }
+  return absl::StrFormat(
+      "total %.3fms queue %.3f batch %.3f prepare %.3f embedding %.3f "
+      "layers %.3f [%s] pooling %.3f",
+      total_ms, queue_ms, batch_ms, prepare_ms, embedding_ms, layers_ms,
+      layers, pooling_ms);
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -0,0 +1,97 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace turbo_transformers {
+namespace core {
+
+// Where the time of one request went, in milliseconds. Filled by the callers
+// that are handed one, so the slow requests can be logged with the full
+// breakdown. The stages not crossed by the request stay 0.
+struct RequestTiming {
+  // waiting in the queue of a batcher until the batch is picked up.
+  double queue_ms{0.};
+  // gathering the requests of the batch and copying their inputs.
+  double batch_ms{0.};
+  // padding the inputs and PrepareBertMasks.
+  double prepare_ms{0.};
+  double embedding_ms{0.};
+  // one entry per encoder layer.
+  std::vector<double> layer_ms;
+  // the pooling, the head and the copy of the outputs.
+  double pooling_ms{0.};
+  double total_ms{0.};
+
+  // e.g. "total 12.1ms queue 0.0 batch 0.0 prepare 0.1 embedding 0.3
+  // layers 11.2 [0.9 0.9 ...] pooling 0.5"
+  std::string ToString() const;
+};
+
+// Times the consecutive stages of a request into a RequestTiming, or does
+// nothing when it is null so the callers time unconditionally. On GPU the
+// stages measure the launches only, the kernels are waited for by the copy
+// of the outputs.
+class StageTimer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit StageTimer(RequestTiming *timing) : timing_(timing) {
+    if (timing_ != nullptr) {
+      start_ = lap_ = Clock::now();
+    }
+  }
+
+  // Ends the current stage, adding its time to the stage of timing, e.g.
+  // timer.Lap(&RequestTiming::embedding_ms).
+  void Lap(double RequestTiming::*stage) {
+    if (timing_ != nullptr) {
+      timing_->*stage += LapMs();
+    }
+  }
+
+  // Ends the current stage as the next encoder layer.
+  void LapLayer() {
+    if (timing_ != nullptr) {
+      timing_->layer_ms.push_back(LapMs());
+    }
+  }
+
+  // Sets total_ms to the time since the construction.
+  void Finish() {
+    if (timing_ != nullptr) {
+      timing_->total_ms = std::chrono::duration<double, std::milli>(
+                              Clock::now() - start_)
+                              .count();
+    }
+  }
+
+ private:
+  double LapMs() {
+    auto now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - lap_).count();
+    lap_ = now;
+    return ms;
+  }
+
+  RequestTiming *timing_;
+  Clock::time_point start_;
+  Clock::time_point lap_;
+};
+
+}  // namespace core
+}  // namespace turbo_transformers
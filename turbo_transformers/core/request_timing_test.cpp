@@ -0,0 +1,56 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/request_timing.h"
+
+#include <thread>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+TEST_CASE("request-timing-stages", "[request_timing]") {
+  RequestTiming timing;
+  StageTimer timer(&timing);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  timer.Lap(&RequestTiming::prepare_ms);
+  for (int i = 0; i < 3; ++i) {
+    timer.LapLayer();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  timer.Lap(&RequestTiming::pooling_ms);
+  timer.Lap(&RequestTiming::pooling_ms);
+  timer.Finish();
+
+  REQUIRE(timing.prepare_ms >= 2.);
+  REQUIRE(timing.pooling_ms >= 1.);
+  REQUIRE(timing.layer_ms.size() == 3);
+  REQUIRE(timing.embedding_ms == 0.);
+  double stages = timing.prepare_ms + timing.pooling_ms;
+  for (double ms : timing.layer_ms) {
+    stages += ms;
+  }
+  REQUIRE(timing.total_ms >= stages);
+  REQUIRE(timing.ToString().find("layers") != std::string::npos);
+
+  // without a timing nothing is recorded
+  StageTimer noop(nullptr);
+  noop.Lap(&RequestTiming::prepare_ms);
+  noop.LapLayer();
+  noop.Finish();
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -14,6 +14,7 @@
 #pragma once
 #include <dlpack/dlpack.h>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <numeric>
@@ -59,6 +60,16 @@ struct DataTypeTrait<int64_t> {
   enum { DLPackTypeCode = kDLInt };
 };
 
+template <>
+struct DataTypeTrait<int8_t> {
+  enum { DLPackTypeCode = kDLInt };
+};
+
+template <>
+struct DataTypeTrait<uint8_t> {
+  enum { DLPackTypeCode = kDLUInt };
+};
+
 template <>
 struct DataTypeTrait<core::Half> {
   enum { DLPackTypeCode = kDLFloat };
@@ -119,12 +130,14 @@ class Tensor {
       tensor_ = absl::monostate();
     } else {
       tensor_ = details::DLManagedTensorPtr(tensor);
+      capacity_ = numel();
     }
   }
 
   DLManagedTensor *ToDLPack() {
     TT_ENFORCE(absl::holds_alternative<details::DLManagedTensorPtr>(tensor_),
                "Must own dltensor");
+    capacity_ = 0;
     return absl::get<details::DLManagedTensorPtr>(tensor_).release();
   }
 
@@ -159,9 +172,10 @@ class Tensor {
     auto &profile_ctx = core::Profiler::GetInstance();
     profile_ctx.start_profile(name, device_type);
 #endif
-    if (absl::visit(ReshapeNeedRealloc(shape_list), tensor_)) {
+    if (absl::visit(ReshapeNeedRealloc(shape_list, capacity_), tensor_)) {
       tensor_ = details::DLManagedTensorPtr(
           NewDLPackTensorT<T>(shape_list, device_type, device_id));
+      capacity_ = numel();
     }
 #ifdef WITH_PERFTOOLS
     profile_ctx.end_profile(name, device_type);
@@ -169,6 +183,39 @@ class Tensor {
     return this->template mutableData<T>();
   }
 
+  // The number of elements the owned buffer can hold. A Reshape to a smaller
+  // shape keeps the buffer, so the capacity stays at the high-water mark of
+  // all shapes this tensor has seen until ShrinkToFit is called.
+  int64_t capacity() const { return capacity_; }
+
+  // Releases the buffer capacity beyond max(numel(), keep_numel). The first
+  // numel() elements are preserved. Returns the number of bytes released.
+  size_t ShrinkToFit(int64_t keep_numel = 0) {
+    if (!absl::holds_alternative<details::DLManagedTensorPtr>(tensor_)) {
+      return 0;
+    }
+    auto &dl_tensor = to_dl_tensor();
+    int64_t cur_numel = numel();
+    int64_t target = std::max(cur_numel, keep_numel);
+    if (capacity_ <= target) {
+      return 0;
+    }
+    size_t type_byte_size = dl_tensor.dtype.bits / 8;
+    size_t released = (capacity_ - target) * type_byte_size;
+    std::vector<int64_t> shape_list(dl_tensor.shape,
+                                    dl_tensor.shape + dl_tensor.ndim);
+    details::DLManagedTensorPtr shrunk(NewDLPackTensor(
+        {target}, dl_tensor.ctx.device_type, dl_tensor.ctx.device_id,
+        dl_tensor.dtype.code, dl_tensor.dtype.bits, dl_tensor.dtype.lanes));
+    Memcpy(shrunk->dl_tensor.data, dl_tensor.data, cur_numel * type_byte_size,
+           ToMemcpyFlag(dl_tensor.ctx.device_type, dl_tensor.ctx.device_type));
+    tensor_ = std::move(shrunk);
+    capacity_ = target;
+    ReshapeNeedRealloc set_shape(shape_list, capacity_);
+    set_shape(absl::get<details::DLManagedTensorPtr>(tensor_));
+    return released;
+  }
+
   template <typename T>
   const T *data() const {
     auto &dltensor = to_dl_tensor();
@@ -199,6 +246,11 @@ class Tensor {
     return absl::holds_alternative<absl::monostate>(tensor_);
   }
 
+  template <typename T>
+  bool IsType() const {
+    return details::IsDataType<T>(to_dl_tensor().dtype);
+  }
+
   template <typename T>
   void Print(std::ostream &os) const {
     auto &dl_tensor = to_dl_tensor();
@@ -273,6 +325,7 @@ class Tensor {
 
     Tensor r(nullptr);
     r.tensor_ = std::move(result);
+    r.capacity_ = 0;
     return r;
   }
 
@@ -305,13 +358,14 @@ class Tensor {
  private:
   struct ReshapeNeedRealloc {
    public:
-    ReshapeNeedRealloc(const std::vector<int64_t> &shape_list)
-        : shape_list_(shape_list) {}
+    ReshapeNeedRealloc(const std::vector<int64_t> &shape_list, int64_t capacity)
+        : shape_list_(shape_list), capacity_(capacity) {}
 
     bool operator()(details::DLManagedTensorPtr &ptr) const {
       int64_t numel = std::accumulate(
           ptr->dl_tensor.shape, ptr->dl_tensor.shape + ptr->dl_tensor.ndim, 1,
           std::multiplies<int64_t>());
+      numel = std::max(numel, capacity_);
       if (numel >= std::accumulate(shape_list_.begin(), shape_list_.end(), 1,
                                    std::multiplies<int64_t>())) {
         if (ptr->dl_tensor.ndim != static_cast<int>(shape_list_.size())) {
@@ -333,6 +387,7 @@ class Tensor {
 
    private:
     const std::vector<int64_t> &shape_list_;
+    int64_t capacity_;
   };
 
   const DLTensor &to_dl_tensor() const {
@@ -340,6 +395,7 @@ class Tensor {
   }
 
   details::TensorPayload tensor_;
+  int64_t capacity_{0};
 };
 
 }  // namespace core
@@ -0,0 +1,174 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "turbo_transformers/core/tensor.h"
+
+// USDT (user statically defined tracing) probes, the tracepoints of
+// SystemTap's sys/sdt.h, for tracing a production build with eBPF tools such
+// as bpftrace, see tools/bpftrace. A probe is a single nop recorded in the
+// .note.stapsdt section of the binary, which a tracer turns into a breakpoint
+// when it attaches, so the probes cost a nop and their arguments when nobody
+// traces. They are compiled only with WITH_USDT on x86-64 linux, and every
+// macro expands to nothing otherwise.
+//
+// All the probes belong to the provider turbo_transformers:
+//   kernel_entry/kernel_exit(name, dim0, dim1, dim2, dim3)
+//   layer_entry/layer_exit(name, dim0, dim1, dim2, dim3)
+//   request_begin/request_end(request_id, batch_size, seq_len)
+// name is a const char*, the dims are the shape of the main input, 0 padded.
+// The seq_len of a generation is its token budget at request_begin and the
+// number of tokens generated at request_end.
+
+#if defined(WITH_USDT) && defined(__x86_64__) && defined(__linux__)
+#define TT_USDT_ENABLED 1
+
+// Emits the nop of the probe and its stapsdt note, the layout documented at
+// https://sourceware.org/systemtap/wiki/UserSpaceProbeImplementation
+#define TT_USDT_NOTE_(probe, args)                                   \
+  "990: nop\n"                                                       \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                      \
+  ".balign 4\n"                                                      \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                 \
+  "991: .asciz \"stapsdt\"\n"                                        \
+  "992: .balign 4\n"                                                 \
+  "993: .8byte 990b\n"                                               \
+  ".8byte _.stapsdt.base\n"                                          \
+  ".8byte 0\n"                                                       \
+  ".asciz \"turbo_transformers\"\n"                                  \
+  ".asciz \"" probe "\"\n"                                           \
+  ".asciz \"" args "\"\n"                                            \
+  "994: .balign 4\n"                                                 \
+  ".popsection\n"                                                    \
+  ".ifndef _.stapsdt.base\n"                                         \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\","                \
+  ".stapsdt.base,comdat\n"                                           \
+  ".weak _.stapsdt.base\n"                                           \
+  ".hidden _.stapsdt.base\n"                                         \
+  "_.stapsdt.base: .space 1\n"                                       \
+  ".size _.stapsdt.base, 1\n"                                        \
+  ".popsection\n"                                                    \
+  ".endif\n"
+
+// Every argument is passed as a signed 64-bit integer.
+#define TT_USDT_ARG_(i, x) [a##i] "nor"((int64_t)(x))
+
+#define TT_USDT_PROBE3(probe, x0, x1, x2)                        \
+  __asm__ __volatile__(                                          \
+      TT_USDT_NOTE_(#probe, "-8@%[a0] -8@%[a1] -8@%[a2]")        \
+      :                                                          \
+      : TT_USDT_ARG_(0, x0), TT_USDT_ARG_(1, x1), TT_USDT_ARG_(2, x2))
+
+#define TT_USDT_PROBE5(probe, x0, x1, x2, x3, x4)                      \
+  __asm__ __volatile__(                                                \
+      TT_USDT_NOTE_(#probe,                                            \
+                    "-8@%[a0] -8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4]")    \
+      :                                                                \
+      : TT_USDT_ARG_(0, x0), TT_USDT_ARG_(1, x1), TT_USDT_ARG_(2, x2), \
+        TT_USDT_ARG_(3, x3), TT_USDT_ARG_(4, x4))
+#else
+#define TT_USDT_ENABLED 0
+#define TT_USDT_PROBE3(probe, x0, x1, x2) \
+  do {                                    \
+    (void)(x0);                           \
+    (void)(x1);                           \
+    (void)(x2);                           \
+  } while (0)
+#endif
+
+namespace turbo_transformers {
+namespace core {
+
+#if TT_USDT_ENABLED
+namespace details {
+struct TraceShape {
+  explicit TraceShape(const Tensor& tensor) {
+    size_t n_dim = tensor.is_null() ? 0 : tensor.n_dim();
+    for (size_t i = 0; i < 4; ++i) {
+      dims[i] = i < n_dim ? tensor.shape(i) : 0;
+    }
+  }
+  int64_t dims[4];
+};
+}  // namespace details
+
+// Fires kernel_entry when constructed and kernel_exit when destroyed.
+class KernelTrace {
+ public:
+  KernelTrace(const std::string& name, const Tensor& tensor)
+      : KernelTrace(name.c_str(), tensor) {}
+  KernelTrace(const char* name, const Tensor& tensor)
+      : name_(name), shape_(tensor) {
+    TT_USDT_PROBE5(kernel_entry, name_, shape_.dims[0], shape_.dims[1],
+                   shape_.dims[2], shape_.dims[3]);
+  }
+  ~KernelTrace() {
+    TT_USDT_PROBE5(kernel_exit, name_, shape_.dims[0], shape_.dims[1],
+                   shape_.dims[2], shape_.dims[3]);
+  }
+
+ private:
+  const char* name_;
+  details::TraceShape shape_;
+};
+
+// Fires layer_entry when constructed and layer_exit when destroyed.
+class LayerTrace {
+ public:
+  LayerTrace(const char* name, const Tensor& tensor)
+      : name_(name), shape_(tensor) {
+    TT_USDT_PROBE5(layer_entry, name_, shape_.dims[0], shape_.dims[1],
+                   shape_.dims[2], shape_.dims[3]);
+  }
+  ~LayerTrace() {
+    TT_USDT_PROBE5(layer_exit, name_, shape_.dims[0], shape_.dims[1],
+                   shape_.dims[2], shape_.dims[3]);
+  }
+
+ private:
+  const char* name_;
+  details::TraceShape shape_;
+};
+
+#define TT_TRACE_KERNEL(name, tensor) \
+  ::turbo_transformers::core::KernelTrace tt_kernel_trace_(name, tensor)
+#define TT_TRACE_LAYER(name, tensor) \
+  ::turbo_transformers::core::LayerTrace tt_layer_trace_(name, tensor)
+#else
+#define TT_TRACE_KERNEL(name, tensor) \
+  do {                                \
+  } while (0)
+#define TT_TRACE_LAYER(name, tensor) \
+  do {                               \
+  } while (0)
+#endif
+
+// A process wide id pairing request_begin with its request_end, starting
+// from 1 so that bpftrace scripts can test it.
+inline int64_t NextTraceRequestId() {
+  static std::atomic<int64_t> next_id{1};
+  return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+#define TT_TRACE_REQUEST_BEGIN(request_id, batch_size, seq_len) \
+  TT_USDT_PROBE3(request_begin, request_id, batch_size, seq_len)
+#define TT_TRACE_REQUEST_END(request_id, batch_size, seq_len) \
+  TT_USDT_PROBE3(request_end, request_id, batch_size, seq_len)
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -0,0 +1,60 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/trace.h"
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+static void TracedKernel(const Tensor& tensor) {
+  TT_TRACE_KERNEL("TracedKernel", tensor);
+}
+
+static void TracedLayer(const Tensor& tensor) {
+  TT_TRACE_LAYER("TracedLayer", tensor);
+}
+
+TEST_CASE("trace-probes-run-untraced") {
+  Tensor tensor(NewDLPackTensorT<float>({2, 3, 4}));
+  TracedKernel(tensor);
+  TracedLayer(tensor);
+  TracedKernel(Tensor(nullptr));
+  TT_TRACE_REQUEST_BEGIN(1, tensor.shape(0), tensor.shape(1));
+  TT_TRACE_REQUEST_END(1, tensor.shape(0), tensor.shape(1));
+}
+
+#if TT_USDT_ENABLED
+TEST_CASE("trace-probes-in-stapsdt-notes") {
+  std::ifstream exe("/proc/self/exe", std::ios::binary);
+  std::string binary((std::istreambuf_iterator<char>(exe)),
+                     std::istreambuf_iterator<char>());
+  // a note holds the provider, the probe name and the argument spec
+  REQUIRE(binary.find("stapsdt") != std::string::npos);
+  for (const char* probe :
+       {"kernel_entry", "kernel_exit", "layer_entry", "layer_exit",
+        "request_begin", "request_end"}) {
+    REQUIRE(binary.find(std::string("turbo_transformers") + '\0' + probe +
+                        '\0') != std::string::npos);
+  }
+}
+#endif
+
+}  // namespace core
+}  // namespace turbo_transformers
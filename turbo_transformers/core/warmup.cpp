@@ -0,0 +1,118 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/warmup.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+#include "loguru.hpp"
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/gemm_backend.h"
+
+namespace turbo_transformers {
+namespace core {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+}  // namespace
+
+void WarmupThreadPools() {
+  // every OpenMP thread does a little work so none is left to be created.
+  std::vector<double> sums(64, 0.);
+#pragma omp parallel for
+  for (int i = 0; i < static_cast<int>(sums.size()); ++i) {
+    for (int j = 0; j < 1024; ++j) {
+      sums[i] += j * 1e-3;
+    }
+  }
+  // a GEMM large enough for the BLAS library to split it among its threads,
+  // on the backends of the GEMM kernels.
+  const int64_t n = 256;
+  std::vector<float> a(n * n, 1.f), b(n * n, 1.f), c(n * n);
+  auto &registry = GemmBackendRegistry::GetInstance();
+  for (auto *call_site : {"MatMul", "BatchMatMul"}) {
+    registry.Select(call_site)->Sgemm(false, false, n, n, n, 1.f, a.data(), n,
+                                      b.data(), n, 0.f, c.data(), n);
+  }
+}
+
+bool LockProcessMemory() {
+  if (mlockall(MCL_CURRENT) != 0) {
+    LOG_S(WARNING) << "mlockall failed: " << std::strerror(errno)
+                   << ", the memory is left unlocked";
+    return false;
+  }
+  return true;
+}
+
+WarmupReport Warmup(
+    const std::vector<WarmupShape> &shapes,
+    const std::function<void(int64_t batch_size, int64_t seq_len)> &run,
+    const WarmupOptions &options) {
+  TT_ENFORCE_GE(options.dummy_runs, 0, "dummy_runs can not be negative");
+  WarmupReport report;
+#ifdef __GLIBC__
+  if (options.keep_heap) {
+    // the largest threshold glibc would reach by itself.
+    const int max_mmap_threshold = 32 * 1024 * 1024;
+    mallopt(M_MMAP_THRESHOLD, max_mmap_threshold);
+    mallopt(M_TRIM_THRESHOLD, 2 * max_mmap_threshold);
+  }
+#endif
+  auto start = Clock::now();
+  WarmupThreadPools();
+  report.thread_pools_ms = ElapsedMs(start);
+
+  std::vector<WarmupShape> sorted(shapes);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const WarmupShape &a, const WarmupShape &b) {
+                     return a.first * a.second > b.first * b.second;
+                   });
+  for (auto &shape : sorted) {
+    TT_ENFORCE(shape.first > 0 && shape.second > 0,
+               "the warm-up shape (%d, %d) is empty", shape.first,
+               shape.second);
+    for (int64_t i = 0; i < options.dummy_runs; ++i) {
+      start = Clock::now();
+      run(shape.first, shape.second);
+      report.run_ms.push_back(ElapsedMs(start));
+    }
+  }
+
+  if (options.lock_memory) {
+    report.memory_locked = LockProcessMemory();
+  }
+  return report;
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
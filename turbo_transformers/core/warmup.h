@@ -0,0 +1,71 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace turbo_transformers {
+namespace core {
+
+struct WarmupOptions {
+  // The dummy runs of every shape. The first run grows the workspaces and
+  // faults in their pages and the weights, the next ones find them warm.
+  int64_t dummy_runs{2};
+  // Keeps the large temporaries of the layers on the heap (glibc only): the
+  // heap is not shrunk and blocks are never mapped separately, so the
+  // requests reuse the pages faulted in by the warm-up instead of mapping
+  // and faulting in fresh ones. This sets M_MMAP_THRESHOLD to 32 MB and
+  // M_TRIM_THRESHOLD to 64 MB for the whole process, including the code of
+  // the host unrelated to this library, and freed memory then goes back to
+  // the system only through MemoryTrimmer or malloc_trim. Off by default.
+  bool keep_heap{false};
+  // Locks all the pages of the process in RAM once warm, so the weights and
+  // the workspaces are never paged out. Needs CAP_IPC_LOCK or a large enough
+  // RLIMIT_MEMLOCK, a refusal is logged and reported but not fatal.
+  bool lock_memory{false};
+};
+
+struct WarmupReport {
+  double thread_pools_ms{0.};
+  // the latency of every dummy run, in the order they ran.
+  std::vector<double> run_ms;
+  bool memory_locked{false};
+};
+
+// (batch_size, seq_len)
+using WarmupShape = std::pair<int64_t, int64_t>;
+
+// Starts the OpenMP threads and the threads of the BLAS library, which are
+// otherwise created by the first request.
+extern void WarmupThreadPools();
+
+// mlockall(MCL_CURRENT): the pages mapped now stay resident. Returns false if
+// the system refused.
+extern bool LockProcessMemory();
+
+// Prepares the process for predictable first-request latency. Warms up the
+// thread pools, then calls run(batch_size, seq_len) options.dummy_runs times
+// for each of shapes, the largest first so the workspaces grow only once,
+// and finally locks the memory if asked to. run should do a full inference
+// of the given shape with dummy inputs.
+extern WarmupReport Warmup(
+    const std::vector<WarmupShape> &shapes,
+    const std::function<void(int64_t batch_size, int64_t seq_len)> &run,
+    const WarmupOptions &options = WarmupOptions());
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -0,0 +1,47 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/core/warmup.h"
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace core {
+
+TEST_CASE("warmup-runs-largest-shape-first", "[warmup]") {
+  std::vector<WarmupShape> runs;
+  WarmupOptions options;
+  options.dummy_runs = 2;
+  auto report = Warmup({{1, 16}, {4, 128}, {2, 32}},
+                       [&](int64_t batch_size, int64_t seq_len) {
+                         runs.emplace_back(batch_size, seq_len);
+                       },
+                       options);
+  REQUIRE(runs == std::vector<WarmupShape>({{4, 128},
+                                            {4, 128},
+                                            {2, 32},
+                                            {2, 32},
+                                            {1, 16},
+                                            {1, 16}}));
+  REQUIRE(report.run_ms.size() == 6);
+  REQUIRE(report.thread_pools_ms >= 0.);
+  REQUIRE_FALSE(report.memory_locked);
+  // the process wide malloc settings are opt-in.
+  REQUIRE_FALSE(WarmupOptions().keep_heap);
+
+  REQUIRE_THROWS(Warmup({{0, 16}}, [](int64_t, int64_t) {}));
+}
+
+}  // namespace core
+}  // namespace turbo_transformers
@@ -12,12 +12,14 @@
 // See the AUTHORS file for names of contributors.
 
 #include "turbo_transformers/layers/addbias_act.h"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/activation.h"
 
 namespace turbo_transformers {
 namespace layers {
 
 void FusedAddBiasGELU::operator()(core::Tensor* output_tensor) const {
+  TT_TRACE_LAYER("FusedAddBiasGELU", *output_tensor);
   kernels::AddBiasAct<float, kernels::ActivationType::Gelu>(
       bias, output_tensor, "AddBiasAct");
 }
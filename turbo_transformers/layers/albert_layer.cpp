@@ -17,6 +17,7 @@
 
 #include "turbo_transformers/core/blas.h"
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/activation.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
@@ -31,6 +32,7 @@ namespace layers {
 void AlbertLayer::operator()(const core::Tensor& input_tensor,
                              core::Tensor* hidden_output,
                              core::Tensor* output_tensor) const {
+  TT_TRACE_LAYER("AlbertLayer", input_tensor);
   hidden_output->Reshape<float>(
       {input_tensor.shape(0), input_tensor.shape(1), dense_weight_.shape(1)},
       input_tensor.device_type(), input_tensor.device_id());
@@ -17,6 +17,7 @@
 
 #include "loguru.hpp"
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
@@ -30,6 +31,7 @@ void BertAttention::operator()(const core::Tensor& input_tensor,
                                const core::Tensor& attention_mask,
                                core::Tensor* output, core::Tensor* attn,
                                bool is_trans_weight) const {
+  TT_TRACE_LAYER("BertAttention", input_tensor);
   std::unordered_map<std::string, core::Tensor*> dummy{};
   core::Tensor* attn_ptr;
   if (attn == nullptr) {
@@ -14,6 +14,7 @@
 #include "turbo_transformers/layers/bert_embedding.h"
 
 #include "loguru.hpp"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #include "turbo_transformers/layers/kernels/embedding.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
@@ -25,6 +26,7 @@ void BERTEmbedding::operator()(const core::Tensor &input_ids,
                                const core::Tensor &position_ids,
                                const core::Tensor &token_type_ids,
                                core::Tensor *output_tensor) const {
+  TT_TRACE_LAYER("BERTEmbedding", input_ids);
   if (loguru::current_verbosity_cutoff() >= 3) {
     std::ostringstream os;
     os << ">>>>>>>>>>>> input_ids <<<<<<<<<<<<" << std::endl;
@@ -43,6 +43,9 @@ class BERTEmbedding {
                   const core::Tensor &token_type_ids,
                   core::Tensor *output) const;
 
+  int64_t vocab_size() const { return word_embedings_.shape(0); }
+  int64_t max_positions() const { return position_embeddings_.shape(0); }
+
  private:
   core::Tensor word_embedings_;
   core::Tensor position_embeddings_;
@@ -17,11 +17,16 @@
 
 #include "turbo_transformers/core/blas.h"
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/calibration.h"
 #include "turbo_transformers/layers/kernels/activation.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
 #include "turbo_transformers/layers/kernels/softmax.h"
 #include "turbo_transformers/layers/kernels/transpose.h"
+#include "turbo_transformers/layers/lora.h"
 #ifdef WITH_PERFTOOLS
 #include "turbo_transformers/core/profiler.h"
 #endif
@@ -31,35 +36,99 @@ namespace layers {
 
 void BertIntermediate::operator()(const core::Tensor& input_tensor,
                                   core::Tensor* output_tensor) const {
+  (*this)(input_tensor, output_tensor, nullptr);
+}
+
+void BertIntermediate::operator()(
+    const core::Tensor& input_tensor, core::Tensor* output_tensor,
+    kernels::QuantizedActivation* quantized_output) const {
+  TT_TRACE_LAYER("BertIntermediate", input_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile("BertIntermediate", input_tensor.device_type());
 #endif
   output_tensor->Reshape<float>(
-      {input_tensor.shape(0), input_tensor.shape(1), dense_weight_.shape(1)},
+      {input_tensor.shape(0), input_tensor.shape(1), out_dim()},
       input_tensor.device_type(), input_tensor.device_id(),
       "BertIntermediate/Reshape");
 
-  kernels::MatMul(input_tensor, false, dense_weight_, false, 1.0, output_tensor,
-                  0.0, "BertIntermediate/MatMul");
-  kernels::AddBiasAct<float, kernels::ActivationType::Gelu>(
-      dense_bias_, output_tensor, "BertIntermediate/AddBiasAct");
+  CollectActivation("intermediate.dense", input_tensor);
+  if (!pq_weight_.is_null()) {
+    kernels::PQMatMul(input_tensor, pq_weight_, output_tensor,
+                      "BertIntermediate/PQMatMul");
+  } else if (quantized_weight_.is_null()) {
+    kernels::MatMul(input_tensor, false, dense_weight_, false, 1.0,
+                    output_tensor, 0.0, "BertIntermediate/MatMul");
+  } else {
+    kernels::QuantizedMatMul(input_tensor, quantized_weight_, output_tensor,
+                             "BertIntermediate/QuantizedMatMul");
+  }
+  ApplyLoRA("intermediate.dense", input_tensor, output_tensor);
+  if (quantized_output != nullptr && output_scale_ > 0.f) {
+    quantized_output->scale = output_scale_;
+    kernels::AddBiasActQuantize<float, kernels::ActivationType::Gelu>(
+        dense_bias_, output_tensor, quantized_output,
+        "BertIntermediate/AddBiasActQuantize");
+  } else {
+    if (quantized_output != nullptr) {
+      quantized_output->scale = 0.f;
+    }
+    kernels::AddBiasAct<float, kernels::ActivationType::Gelu>(
+        dense_bias_, output_tensor, "BertIntermediate/AddBiasAct");
+  }
 #ifdef WITH_PERFTOOLS
   profile_ctx.end_profile("BertIntermediate", input_tensor.device_type());
 #endif
 }
 
+void BertIntermediate::SetPrecision(types::QuantType precision,
+                                    float input_scale) {
+  TT_ENFORCE(!is_pq(),
+             "BertIntermediate: the float weight was released for the PQ "
+             "weight");
+  if (precision == types::QuantType::kFloat32) {
+    quantized_weight_ = kernels::QuantizedWeight();
+  } else if (precision == types::QuantType::kInt8) {
+    kernels::QuantizeWeight(dense_weight_, false, &quantized_weight_,
+                            "BertIntermediate/QuantizeWeight");
+    quantized_weight_.input_scale = input_scale;
+  } else {
+    TT_THROW("BertIntermediate only supports Float32 and Int8 precision");
+  }
+}
+
+void BertIntermediate::SetPQWeight(kernels::PQWeight weight) {
+  TT_ENFORCE(weight.in_dim() == in_dim() && weight.out_dim() == out_dim(),
+             "BertIntermediate: the PQ weight (%d, %d) does not match (%d, %d)",
+             weight.in_dim(), weight.out_dim(), in_dim(), out_dim());
+  pq_weight_ = std::move(weight);
+  dense_weight_ = core::Tensor(nullptr);
+  quantized_weight_ = kernels::QuantizedWeight();
+}
+
+int64_t BertIntermediate::in_dim() const {
+  return is_pq() ? pq_weight_.in_dim() : dense_weight_.shape(0);
+}
+
+int64_t BertIntermediate::out_dim() const {
+  return is_pq() ? pq_weight_.out_dim() : dense_weight_.shape(1);
+}
+
 void BertIntermediate::EnforceShapeAndType() const {
-  TT_ENFORCE_EQ(dense_weight_.n_dim(), 2, "dense weight must be matrix");
+  if (!is_pq()) {
+    TT_ENFORCE_EQ(dense_weight_.n_dim(), 2, "dense weight must be matrix");
+  }
   TT_ENFORCE_EQ(dense_bias_.n_dim(), 1, "dense bias must be vector");
-  TT_ENFORCE_EQ(dense_weight_.shape(1), dense_bias_.shape(0),
-                "weight and bias shape mismatch %d, %d", dense_weight_.shape(1),
+  TT_ENFORCE_EQ(out_dim(), dense_bias_.shape(0),
+                "weight and bias shape mismatch %d, %d", out_dim(),
                 dense_bias_.shape(0));
 
   if (loguru::current_verbosity_cutoff() >= 3) {
     std::ostringstream os;
-    os << ">>>>>>>>>>>> query_weight <<<<<<<<<<<<" << std::endl;
-    dense_weight_.Print<float>(os);
+    if (!is_pq()) {
+      os << ">>>>>>>>>>>> query_weight <<<<<<<<<<<<" << std::endl;
+      dense_weight_.Print<float>(os);
+    }
     os << ">>>>>>>>>>>> query_bias <<<<<<<<<<<<" << std::endl;
     dense_bias_.Print<float>(os);
     LOG_S(3) << os.str();
@@ -15,6 +15,9 @@
 #include <memory>
 #include <utility>
 #include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/types.h"
 
 namespace turbo_transformers {
 namespace layers {
@@ -26,13 +29,43 @@ class BertIntermediate {
         dense_bias_(std::move(dense_bias)) {
     EnforceShapeAndType();
   }
+  // Runs on a product-quantized weight from the start, the float weight is
+  // never loaded.
+  BertIntermediate(kernels::PQWeight dense_weight, core::Tensor dense_bias)
+      : dense_weight_(nullptr),
+        dense_bias_(std::move(dense_bias)),
+        pq_weight_(std::move(dense_weight)) {
+    EnforceShapeAndType();
+  }
 
   void EnforceShapeAndType() const;
   void operator()(const core::Tensor& input_tensor, core::Tensor* output) const;
+  // Also quantizes output to int8 with the scale of SetOutputScale in the
+  // epilogue of the activation, for an int8 BertOutput. quantized_output is
+  // left null if no output scale is set.
+  void operator()(const core::Tensor& input_tensor, core::Tensor* output,
+                  kernels::QuantizedActivation* quantized_output) const;
+  // Runs the dense GEMM in kFloat32 or kInt8, the float weight is kept so the
+  // precision can be switched back. input_scale is the static int8 scale of
+  // the input found by calibration, 0 computes the range of each row. It
+  // throws once the module is product-quantized.
+  void SetPrecision(types::QuantType precision, float input_scale = 0.f);
+  // Runs the dense GEMM on a product-quantized weight, e.g. the codebooks and
+  // the codes of tools/train_pq_codebooks.py. The float and int8 weights are
+  // released, so the module stays product-quantized.
+  void SetPQWeight(kernels::PQWeight weight);
+  bool is_pq() const { return !pq_weight_.is_null(); }
+  void SetOutputScale(float scale) { output_scale_ = scale; }
 
  private:
+  int64_t in_dim() const;
+  int64_t out_dim() const;
+
   core::Tensor dense_weight_;
   core::Tensor dense_bias_;
+  kernels::QuantizedWeight quantized_weight_;
+  kernels::PQWeight pq_weight_;
+  float output_scale_{0.f};
 };
 
 }  // namespace layers
@@ -16,9 +16,14 @@
 #include <loguru.hpp>
 
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/calibration.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/lora.h"
 #ifdef WITH_PERFTOOLS
 #include "turbo_transformers/core/profiler.h"
 #endif
@@ -29,6 +34,14 @@ namespace layers {
 void BertOutput::operator()(const core::Tensor &hidden_states,
                             const core::Tensor &input_tensor,
                             core::Tensor *output_tensor) const {
+  (*this)(hidden_states, input_tensor, output_tensor, nullptr);
+}
+
+void BertOutput::operator()(
+    const core::Tensor &hidden_states, const core::Tensor &input_tensor,
+    core::Tensor *output_tensor,
+    const kernels::QuantizedActivation *quantized_hidden_states) const {
+  TT_TRACE_LAYER("BertOutput", hidden_states);
 #ifdef WITH_PERFTOOLS
   auto &profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile("BertOutput", input_tensor.device_type());
@@ -39,11 +52,25 @@ void BertOutput::operator()(const core::Tensor &hidden_states,
                 "BertOutput: The input_tensor and hidden_states should have "
                 "the same device type and device id.");
   output_tensor->Reshape<float>(
-      {hidden_states.shape(0), hidden_states.shape(1), dense_weight_.shape(1)},
+      {hidden_states.shape(0), hidden_states.shape(1), out_dim()},
       hidden_states.device_type(), hidden_states.device_id(),
       "BertOutput/Reshape");
-  kernels::MatMul(hidden_states, false, dense_weight_, false, 1.0,
-                  output_tensor, 0.0, "BertOutput/MatMul");
+  CollectActivation("output.dense", hidden_states);
+  if (!pq_weight_.is_null()) {
+    kernels::PQMatMul(hidden_states, pq_weight_, output_tensor,
+                      "BertOutput/PQMatMul");
+  } else if (quantized_weight_.is_null()) {
+    kernels::MatMul(hidden_states, false, dense_weight_, false, 1.0,
+                    output_tensor, 0.0, "BertOutput/MatMul");
+  } else if (quantized_hidden_states != nullptr &&
+             !quantized_hidden_states->is_null()) {
+    kernels::QuantizedMatMul(*quantized_hidden_states, quantized_weight_,
+                             output_tensor, "BertOutput/QuantizedMatMul");
+  } else {
+    kernels::QuantizedMatMul(hidden_states, quantized_weight_, output_tensor,
+                             "BertOutput/QuantizedMatMul");
+  }
+  ApplyLoRA("output.dense", hidden_states, output_tensor);
   kernels::AddBiasLayerNorm<float>(
       input_tensor, dense_bias_, layer_norm_weight_, layer_norm_bias_,
       output_tensor, 1e-12, "BertOutput/AddBiasLayerNorm");
@@ -52,11 +79,45 @@ void BertOutput::operator()(const core::Tensor &hidden_states,
 #endif
 }
 
+void BertOutput::SetPrecision(types::QuantType precision,
+                              float input_scale) {
+  TT_ENFORCE(!is_pq(),
+             "BertOutput: the float weight was released for the PQ weight");
+  if (precision == types::QuantType::kFloat32) {
+    quantized_weight_ = kernels::QuantizedWeight();
+  } else if (precision == types::QuantType::kInt8) {
+    kernels::QuantizeWeight(dense_weight_, false, &quantized_weight_,
+                            "BertOutput/QuantizeWeight");
+    quantized_weight_.input_scale = input_scale;
+  } else {
+    TT_THROW("BertOutput only supports Float32 and Int8 precision");
+  }
+}
+
+void BertOutput::SetPQWeight(kernels::PQWeight weight) {
+  TT_ENFORCE(weight.in_dim() == in_dim() && weight.out_dim() == out_dim(),
+             "BertOutput: the PQ weight (%d, %d) does not match (%d, %d)",
+             weight.in_dim(), weight.out_dim(), in_dim(), out_dim());
+  pq_weight_ = std::move(weight);
+  dense_weight_ = core::Tensor(nullptr);
+  quantized_weight_ = kernels::QuantizedWeight();
+}
+
+int64_t BertOutput::in_dim() const {
+  return is_pq() ? pq_weight_.in_dim() : dense_weight_.shape(0);
+}
+
+int64_t BertOutput::out_dim() const {
+  return is_pq() ? pq_weight_.out_dim() : dense_weight_.shape(1);
+}
+
 void BertOutput::EnforceShapeAndType() const {
   if (loguru::current_verbosity_cutoff() >= 3) {
     std::stringstream ss;
-    ss << "<<<<<<<< dense_weight_ <<<<<<<<<<";
-    dense_weight_.Print<float>(ss);
+    if (!is_pq()) {
+      ss << "<<<<<<<< dense_weight_ <<<<<<<<<<";
+      dense_weight_.Print<float>(ss);
+    }
     ss << "<<<<<<<< dense_bias <<<<<<<<<<";
     dense_bias_.Print<float>(ss);
     ss << "<<<<<<<< layer_norm_weight <<<<<<<<<<";
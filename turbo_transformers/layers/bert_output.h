@@ -15,6 +15,9 @@
 #include <memory>
 #include <utility>
 #include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/types.h"
 
 namespace turbo_transformers {
 namespace layers {
@@ -29,16 +32,50 @@ class BertOutput {
         layer_norm_bias_(std::move(layer_norm_bias)) {
     EnforceShapeAndType();
   }
+  // Runs on a product-quantized weight from the start, the float weight is
+  // never loaded.
+  BertOutput(kernels::PQWeight dense_weight, core::Tensor dense_bias,
+             core::Tensor layer_norm_weight, core::Tensor layer_norm_bias)
+      : dense_weight_(nullptr),
+        dense_bias_(std::move(dense_bias)),
+        layer_norm_weight_(std::move(layer_norm_weight)),
+        layer_norm_bias_(std::move(layer_norm_bias)),
+        pq_weight_(std::move(dense_weight)) {
+    EnforceShapeAndType();
+  }
   void EnforceShapeAndType() const;
 
   void operator()(const core::Tensor &hidden_states,
                   const core::Tensor &input_tensor, core::Tensor *output) const;
+  // The int8 GEMM reads quantized_hidden_states, hidden_states quantized by
+  // the epilogue of BertIntermediate, when it is not null.
+  void operator()(const core::Tensor &hidden_states,
+                  const core::Tensor &input_tensor, core::Tensor *output,
+                  const kernels::QuantizedActivation *quantized_hidden_states)
+      const;
+  // Runs the dense GEMM in kFloat32 or kInt8, the float weight is kept so the
+  // precision can be switched back. input_scale is the static int8 scale of
+  // the input found by calibration, 0 computes the range of each row. It
+  // throws once the module is product-quantized.
+  void SetPrecision(types::QuantType precision, float input_scale = 0.f);
+  // Runs the dense GEMM on a product-quantized weight, e.g. the codebooks and
+  // the codes of tools/train_pq_codebooks.py. The float and int8 weights are
+  // released, so the module stays product-quantized.
+  void SetPQWeight(kernels::PQWeight weight);
+  bool is_pq() const { return !pq_weight_.is_null(); }
+  // the static scale of the int8 input, 0 if there is none.
+  float input_scale() const { return quantized_weight_.input_scale; }
 
  private:
+  int64_t in_dim() const;
+  int64_t out_dim() const;
+
   core::Tensor dense_weight_;
   core::Tensor dense_bias_;
   core::Tensor layer_norm_weight_;
   core::Tensor layer_norm_bias_;
+  kernels::QuantizedWeight quantized_weight_;
+  kernels::PQWeight pq_weight_;
 };
 
 }  // namespace layers
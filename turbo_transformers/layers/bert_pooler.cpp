@@ -16,6 +16,7 @@
 #include <loguru.hpp>
 
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/activation.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
 
@@ -24,6 +25,7 @@ namespace layers {
 
 void BertPooler::operator()(const core::Tensor& input_tensor,
                             core::Tensor* output_tensor) const {
+  TT_TRACE_LAYER("BertPooler", input_tensor);
   TT_ENFORCE_EQ(input_tensor.n_dim(), 2, "input's dim should be 2, not %d",
                 input_tensor.n_dim());
   output_tensor->Reshape<float>({input_tensor.shape(0), dense_weight_.shape(0)},
@@ -0,0 +1,228 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/calibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+namespace {
+// the number of int8 levels of a non-negative value
+constexpr int64_t kNumLevels = 128;
+}  // namespace
+
+CalibrationMethod GetCalibrationMethod(const std::string& method) {
+  if (method == "MinMax") {
+    return CalibrationMethod::kMinMax;
+  } else if (method == "Percentile") {
+    return CalibrationMethod::kPercentile;
+  } else if (method == "Entropy") {
+    return CalibrationMethod::kEntropy;
+  }
+  TT_THROW(
+      "The calibration method(%s) is not in ['MinMax', 'Percentile', "
+      "'Entropy'].",
+      method);
+}
+
+ActivationHistogram::ActivationHistogram(int64_t n_bins) : bins_(n_bins, 0) {
+  TT_ENFORCE(n_bins >= kNumLevels && n_bins % 2 == 0,
+             "a histogram needs an even number of at least %d bins, not %d",
+             kNumLevels, n_bins);
+}
+
+void ActivationHistogram::Collect(const float* data, int64_t n) {
+  float batch_max = 0.f;
+  for (int64_t i = 0; i < n; ++i) {
+    batch_max = std::max(batch_max, std::fabs(data[i]));
+  }
+  count_ += n;
+  max_abs_ = std::max(max_abs_, batch_max);
+  if (range_ == 0.f) {
+    range_ = batch_max;
+  }
+  int64_t n_bins = bins_.size();
+  while (batch_max > range_) {
+    for (int64_t b = 0; b < n_bins / 2; ++b) {
+      bins_[b] = bins_[2 * b] + bins_[2 * b + 1];
+    }
+    std::fill(bins_.begin() + n_bins / 2, bins_.end(), 0);
+    range_ *= 2;
+  }
+  if (range_ == 0.f) {
+    bins_[0] += n;
+    return;
+  }
+  float inv_width = n_bins / range_;
+  for (int64_t i = 0; i < n; ++i) {
+    auto b = static_cast<int64_t>(std::fabs(data[i]) * inv_width);
+    ++bins_[std::min(b, n_bins - 1)];
+  }
+}
+
+float ActivationHistogram::Threshold(CalibrationMethod method,
+                                     double percentile) const {
+  if (count_ == 0 || range_ == 0.f) {
+    return 0.f;
+  }
+  switch (method) {
+    case CalibrationMethod::kMinMax:
+      return max_abs_;
+    case CalibrationMethod::kPercentile: {
+      TT_ENFORCE(percentile > 0 && percentile <= 100,
+                 "percentile %f is not in (0, 100]", percentile);
+      double target = percentile / 100. * count_;
+      int64_t cumulative = 0;
+      for (size_t b = 0; b < bins_.size(); ++b) {
+        cumulative += bins_[b];
+        if (cumulative >= target) {
+          return std::min(max_abs_, (b + 1) * bin_width());
+        }
+      }
+      return max_abs_;
+    }
+    case CalibrationMethod::kEntropy:
+      return EntropyThreshold();
+  }
+  TT_THROW("Unknown calibration method %d", static_cast<int>(method));
+}
+
+float ActivationHistogram::EntropyThreshold() const {
+  int64_t n_bins = bins_.size();
+  std::vector<double> p(n_bins), q(n_bins);
+  double best_divergence = std::numeric_limits<double>::max();
+  int64_t best_bins = n_bins;
+  for (int64_t i = kNumLevels; i <= n_bins; ++i) {
+    // the reference distribution clipped to the first i bins
+    double outliers = 0;
+    for (int64_t b = i; b < n_bins; ++b) {
+      outliers += bins_[b];
+    }
+    double p_sum = outliers;
+    for (int64_t b = 0; b < i; ++b) {
+      p[b] = bins_[b];
+      p_sum += bins_[b];
+    }
+    p[i - 1] += outliers;
+    if (p_sum == 0) {
+      continue;
+    }
+    // merge the i bins into kNumLevels levels and spread each level evenly
+    // over its non-empty bins
+    double q_sum = 0;
+    for (int64_t level = 0; level < kNumLevels; ++level) {
+      int64_t start = level * i / kNumLevels;
+      int64_t end = (level + 1) * i / kNumLevels;
+      double total = 0;
+      int64_t non_empty = 0;
+      for (int64_t b = start; b < end; ++b) {
+        total += bins_[b];
+        non_empty += bins_[b] != 0;
+      }
+      for (int64_t b = start; b < end; ++b) {
+        q[b] = bins_[b] != 0 ? total / non_empty : 0.;
+        q_sum += q[b];
+      }
+    }
+    if (q_sum == 0) {
+      continue;
+    }
+    double divergence = 0;
+    for (int64_t b = 0; b < i; ++b) {
+      if (p[b] == 0) {
+        continue;
+      }
+      double pb = p[b] / p_sum;
+      // a clipped bin may be empty in q, smooth it instead of an infinity
+      double qb = std::max(q[b] / q_sum, 1e-10);
+      divergence += pb * std::log(pb / qb);
+    }
+    if (divergence < best_divergence) {
+      best_divergence = divergence;
+      best_bins = i;
+    }
+  }
+  return std::min(max_abs_, best_bins * bin_width());
+}
+
+void Calibrator::Collect(const std::string& module,
+                         const core::Tensor& input) {
+  TT_ENFORCE(input.device_type() == kDLCPU, "calibration only supports CPU");
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = histograms_.find(module);
+  if (it == histograms_.end()) {
+    it = histograms_.emplace(module, ActivationHistogram(n_bins_)).first;
+  }
+  it->second.Collect(input.data<float>(), input.numel());
+}
+
+void Calibrator::ExportScales(CalibrationMethod method, PrecisionPlan* plan,
+                              double percentile) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (auto& entry : histograms_) {
+    float scale = entry.second.Scale(method, percentile);
+    if (scale > 0.f) {
+      plan->SetInputScale(entry.first, scale);
+    }
+  }
+}
+
+std::vector<std::string> Calibrator::modules() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::vector<std::string> names;
+  for (auto& entry : histograms_) {
+    names.push_back(entry.first);
+  }
+  return names;
+}
+
+const ActivationHistogram& Calibrator::histogram(
+    const std::string& module) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = histograms_.find(module);
+  TT_ENFORCE(it != histograms_.end(), "%s was not calibrated", module);
+  return it->second;
+}
+
+namespace {
+thread_local Calibrator* current_calibrator = nullptr;
+thread_local std::string current_prefix;
+}  // namespace
+
+CalibrationScope::CalibrationScope(Calibrator* calibrator, std::string prefix)
+    : prev_calibrator_(current_calibrator),
+      prev_prefix_(std::move(current_prefix)) {
+  current_calibrator = calibrator;
+  current_prefix = std::move(prefix);
+}
+
+CalibrationScope::~CalibrationScope() {
+  current_calibrator = prev_calibrator_;
+  current_prefix = std::move(prev_prefix_);
+}
+
+void CollectActivation(const char* module, const core::Tensor& input) {
+  if (current_calibrator != nullptr) {
+    current_calibrator->Collect(current_prefix + module, input);
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
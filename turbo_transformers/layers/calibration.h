@@ -0,0 +1,106 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/precision_plan.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// How the clipping threshold of an activation is chosen from its histogram,
+// the int8 scale is threshold / 127.
+// kMinMax: the largest absolute value, no clipping.
+// kPercentile: the given percentile of the absolute values.
+// kEntropy: the threshold minimizing the KL divergence between the clipped
+// distribution and its 128 level quantization.
+enum class CalibrationMethod { kMinMax = 0, kPercentile, kEntropy };
+
+// "MinMax", "Percentile" or "Entropy"
+CalibrationMethod GetCalibrationMethod(const std::string& method);
+
+// A histogram of the absolute values of an activation. The bins cover
+// [0, range), the range doubles, merging pairs of bins, when a larger value
+// is collected.
+class ActivationHistogram {
+ public:
+  explicit ActivationHistogram(int64_t n_bins = 2048);
+
+  void Collect(const float* data, int64_t n);
+  float Threshold(CalibrationMethod method, double percentile = 99.99) const;
+  float Scale(CalibrationMethod method, double percentile = 99.99) const {
+    return Threshold(method, percentile) / 127.f;
+  }
+
+  float max_abs() const { return max_abs_; }
+  int64_t count() const { return count_; }
+  const std::vector<int64_t>& bins() const { return bins_; }
+  float bin_width() const { return range_ / bins_.size(); }
+
+ private:
+  float EntropyThreshold() const;
+
+  std::vector<int64_t> bins_;
+  float range_{0.f};
+  float max_abs_{0.f};
+  int64_t count_{0};
+};
+
+// Collects the histograms of the inputs of the linear modules while sample
+// inputs run through a model in a CalibrationScope.
+class Calibrator {
+ public:
+  explicit Calibrator(int64_t n_bins = 2048) : n_bins_(n_bins) {}
+
+  void Collect(const std::string& module, const core::Tensor& input);
+
+  // Sets the static input scale of every collected module in plan, the plan
+  // is saved next to the weights and applied by the model loader.
+  void ExportScales(CalibrationMethod method, PrecisionPlan* plan,
+                    double percentile = 99.99) const;
+
+  std::vector<std::string> modules() const;
+  const ActivationHistogram& histogram(const std::string& module) const;
+
+ private:
+  int64_t n_bins_;
+  mutable std::mutex mutex_;
+  std::map<std::string, ActivationHistogram> histograms_;
+};
+
+// The layers run by this thread in the scope report the inputs of their
+// linear modules to calibrator, the module names are prefixed by prefix, e.g.
+// "encoder.layer.3.".
+class CalibrationScope {
+ public:
+  CalibrationScope(Calibrator* calibrator, std::string prefix);
+  ~CalibrationScope();
+
+ private:
+  Calibrator* prev_calibrator_;
+  std::string prev_prefix_;
+};
+
+// Called by the layers before the GEMM of module, a no-op outside of a
+// CalibrationScope.
+extern void CollectActivation(const char* module, const core::Tensor& input);
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,141 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/calibration.h"
+
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/bert_intermediate.h"
+#include "turbo_transformers/layers/bert_output.h"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+static double Cosine(const core::Tensor &a, const core::Tensor &b) {
+  double dot = 0, norm_a = 0, norm_b = 0;
+  for (int64_t i = 0; i < a.numel(); ++i) {
+    double x = a.data<float>()[i], y = b.data<float>()[i];
+    dot += x * y;
+    norm_a += x * x;
+    norm_b += y * y;
+  }
+  return dot / std::sqrt(norm_a * norm_b);
+}
+
+TEST_CASE("calibration-histogram") {
+  std::mt19937 gen(0);
+  std::normal_distribution<float> normal(0.f, 1.f);
+  std::vector<float> data(100000);
+  for (auto &x : data) {
+    x = normal(gen);
+  }
+  ActivationHistogram histogram(512);
+  // the second batch grows the range of the first one
+  histogram.Collect(data.data(), 1000);
+  data[5000] = 40.f;
+  histogram.Collect(data.data() + 1000, data.size() - 1000);
+  REQUIRE(histogram.count() == static_cast<int64_t>(data.size()));
+  auto &bins = histogram.bins();
+  REQUIRE(std::accumulate(bins.begin(), bins.end(), int64_t(0)) ==
+          histogram.count());
+
+  float min_max = histogram.Threshold(CalibrationMethod::kMinMax);
+  float percentile = histogram.Threshold(CalibrationMethod::kPercentile, 99.);
+  float entropy = histogram.Threshold(CalibrationMethod::kEntropy);
+  REQUIRE(min_max == 40.f);
+  // the 99th percentile of |N(0, 1)| is about 2.58
+  REQUIRE(percentile > 2.3f);
+  REQUIRE(percentile < 2.9f);
+  // the outlier is clipped
+  REQUIRE(entropy > 2.f);
+  REQUIRE(entropy < 20.f);
+  REQUIRE(histogram.Scale(CalibrationMethod::kMinMax) == Approx(40.f / 127));
+
+  REQUIRE(GetCalibrationMethod("Entropy") == CalibrationMethod::kEntropy);
+  REQUIRE_THROWS(GetCalibrationMethod("KL"));
+  REQUIRE(ActivationHistogram().Threshold(CalibrationMethod::kMinMax) == 0.f);
+}
+
+TEST_CASE("calibration-static-int8-bert") {
+  int64_t hidden_size = 64, intermediate_size = 256;
+  auto intermediate_weight = kernels::common::CreateTensorAndFillRandom<float>(
+      {hidden_size, intermediate_size}, kDLCPU, 0);
+  auto intermediate_bias = kernels::common::CreateTensorAndFillRandom<float>(
+      {intermediate_size}, kDLCPU, 0);
+  auto output_weight = kernels::common::CreateTensorAndFillRandom<float>(
+      {intermediate_size, hidden_size}, kDLCPU, 0);
+  auto output_bias = kernels::common::CreateTensorAndFillRandom<float>(
+      {hidden_size}, kDLCPU, 0);
+  auto gamma = kernels::common::CreateTensorAndFillRandom<float>(
+      {hidden_size}, kDLCPU, 0);
+  auto beta = kernels::common::CreateTensorAndFillRandom<float>({hidden_size},
+                                                               kDLCPU, 0);
+  BertIntermediate intermediate(std::move(intermediate_weight),
+                                std::move(intermediate_bias));
+  BertOutput output(std::move(output_weight), std::move(output_bias),
+                    std::move(gamma), std::move(beta));
+  auto input = kernels::common::CreateTensorAndFillRandom<float>(
+      {2, 5, hidden_size}, kDLCPU, 0);
+
+  Calibrator calibrator(256);
+  core::Tensor intermediate_out(nullptr), fp32_out(nullptr);
+  intermediate(input, &intermediate_out);
+  REQUIRE(calibrator.modules().empty());
+  {
+    CalibrationScope scope(&calibrator, "encoder.layer.0.");
+    intermediate(input, &intermediate_out);
+    output(intermediate_out, input, &fp32_out);
+  }
+  REQUIRE(calibrator.modules() ==
+          std::vector<std::string>{"encoder.layer.0.intermediate.dense",
+                                   "encoder.layer.0.output.dense"});
+  PrecisionPlan plan;
+  calibrator.ExportScales(CalibrationMethod::kMinMax, &plan);
+  float intermediate_scale =
+      plan.GetInputScale("encoder.layer.0.intermediate.dense");
+  float output_scale = plan.GetInputScale("encoder.layer.0.output.dense");
+  REQUIRE(output_scale ==
+          Approx(calibrator.histogram("encoder.layer.0.output.dense")
+                     .max_abs() /
+                 127));
+
+  intermediate.SetPrecision(types::QuantType::kInt8, intermediate_scale);
+  output.SetPrecision(types::QuantType::kInt8, output_scale);
+  intermediate.SetOutputScale(output.input_scale());
+  kernels::QuantizedActivation quantized;
+  core::Tensor static_out(nullptr), fused_out(nullptr);
+  intermediate(input, &intermediate_out);
+  output(intermediate_out, input, &static_out);
+  intermediate(input, &intermediate_out, &quantized);
+  REQUIRE(!quantized.is_null());
+  REQUIRE(quantized.scale == output_scale);
+  output(intermediate_out, input, &fused_out, &quantized);
+  REQUIRE(Cosine(static_out, fp32_out) > 0.999);
+  // the epilogue quantizes as the GEMM would
+  for (int64_t i = 0; i < fused_out.numel(); ++i) {
+    REQUIRE(std::abs(fused_out.data<float>()[i] -
+                     static_out.data<float>()[i]) < 1e-4);
+  }
+
+  intermediate.SetOutputScale(0.f);
+  intermediate(input, &intermediate_out, &quantized);
+  REQUIRE(quantized.is_null());
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,403 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/cost_model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <utility>
+
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/layer_norm.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#ifdef TT_WITH_CUDA
+#include "turbo_transformers/core/cuda_device_context.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+
+namespace {
+constexpr double kFloatBytes = sizeof(float);
+
+KernelCost Gemm(const std::string &name, double m, double k, double n,
+                double batch = 1) {
+  return {name, CostKind::kGemm, 2 * batch * m * k * n,
+          batch * (m * k + k * n + m * n) * kFloatBytes};
+}
+
+// A memory bound kernel reading and writing the given number of floats.
+KernelCost Memory(const std::string &name, double read, double written,
+                  double flops_per_element = 1) {
+  return {name, CostKind::kMemory, flops_per_element * written,
+          (read + written) * kFloatBytes};
+}
+
+// The linear least squares fit of y = intercept + slope * x.
+std::pair<double, double> FitLine(const std::vector<double> &x,
+                                  const std::vector<double> &y) {
+  double n = x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    sx += x[i];
+    sy += y[i];
+    sxx += x[i] * x[i];
+    sxy += x[i] * y[i];
+  }
+  double denom = n * sxx - sx * sx;
+  double slope = denom != 0 ? (n * sxy - sx * sy) / denom : 0;
+  double intercept = (sy - slope * sx) / n;
+  return {intercept, slope};
+}
+
+template <typename Func>
+double TimeIt(Func &&func, int n_step, DLDeviceType device) {
+  func();
+#ifdef TT_WITH_CUDA
+  if (device == kDLGPU) core::CUDADeviceContext::GetInstance().Wait();
+#endif
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_step; ++i) {
+    func();
+  }
+#ifdef TT_WITH_CUDA
+  if (device == kDLGPU) core::CUDADeviceContext::GetInstance().Wait();
+#endif
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_step;
+}
+
+}  // namespace
+
+namespace cost {
+
+LayerCost BertEmbedding(int64_t batch, int64_t seq_len, int64_t hidden_size) {
+  double n = batch * seq_len * hidden_size;
+  return {"BertEmbedding",
+          {Memory("LookupEmbedding/word", n, n),
+           Memory("LookupEmbedding/token_type", 2 * n, n),
+           Memory("LookupEmbedding/position", 2 * n, n),
+           Memory("LayerNorm", n, n, 8)},
+          n * kFloatBytes};
+}
+
+LayerCost PrepareBertMasks(int64_t batch, int64_t seq_len) {
+  // the int64 tensors count as two floats.
+  double n = batch * seq_len;
+  return {"PrepareBertMasks",
+          {Memory("PrepareBertMasks", 2 * n, 7 * n)},
+          7 * n * kFloatBytes};
+}
+
+LayerCost BertAttention(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                        int64_t num_heads) {
+  double tokens = batch * seq_len, h = hidden_size;
+  double head_size = h / num_heads;
+  double scores = batch * num_heads * seq_len * seq_len;
+  return {"BertAttention",
+          {Gemm("MatMul/qkv", tokens, h, 3 * h),
+           Memory("SplitAddBiasTransposeForScore", 3 * tokens * h,
+                  3 * tokens * h),
+           Gemm("BatchMatMul/scores", seq_len, head_size, seq_len,
+                batch * num_heads),
+           Memory("ApplyMaskAndSoftmax", scores, scores, 5),
+           Gemm("BatchMatMul/context", seq_len, seq_len, head_size,
+                batch * num_heads),
+           Memory("TransposeForScore", tokens * h, tokens * h),
+           Gemm("MatMul/output", tokens, h, h),
+           Memory("AddBiasLayerNorm", 2 * tokens * h, tokens * h, 10)},
+          (tokens * h * 7 + scores) * kFloatBytes};
+}
+
+LayerCost BertIntermediate(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                           int64_t intermediate_size) {
+  double tokens = batch * seq_len;
+  double n = tokens * intermediate_size;
+  return {"BertIntermediate",
+          {Gemm("MatMul", tokens, hidden_size, intermediate_size),
+           Memory("AddBiasAct/Gelu", n, n, 10)},
+          (tokens * hidden_size + n) * kFloatBytes};
+}
+
+LayerCost BertOutput(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                     int64_t intermediate_size) {
+  double tokens = batch * seq_len;
+  double n = tokens * hidden_size;
+  return {"BertOutput",
+          {Gemm("MatMul", tokens, intermediate_size, hidden_size),
+           Memory("AddBiasLayerNorm", 2 * n, n, 10)},
+          (tokens * intermediate_size + 2 * n) * kFloatBytes};
+}
+
+LayerCost BertPooler(int64_t batch, int64_t hidden_size) {
+  double n = batch * hidden_size;
+  return {"BertPooler",
+          {Gemm("MatMul", batch, hidden_size, hidden_size),
+           Memory("AddBiasAct/Tanh", n, n, 10)},
+          2 * n * kFloatBytes};
+}
+
+LayerCost SequencePool(int64_t batch, int64_t seq_len, int64_t hidden_size) {
+  double n = batch * seq_len * hidden_size;
+  return {"SequencePool",
+          {Memory("SeqPool", n, batch * hidden_size)},
+          (n + batch * hidden_size) * kFloatBytes};
+}
+
+LayerCost AlbertLayer(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                      int64_t intermediate_size) {
+  double tokens = batch * seq_len;
+  double n = tokens * hidden_size, ni = tokens * intermediate_size;
+  return {"AlbertLayer",
+          {Gemm("MatMul/dense", tokens, hidden_size, intermediate_size),
+           Memory("AddBiasAct/Gelu", ni, ni, 10),
+           Gemm("MatMul/dense_output", tokens, intermediate_size, hidden_size),
+           Memory("AddBiasLayerNorm", 2 * n, n, 10)},
+          (2 * n + ni) * kFloatBytes};
+}
+
+LayerCost MultiHeadedAttention(int64_t batch, int64_t query_len,
+                               int64_t key_len, int64_t hidden_size,
+                               int64_t num_heads, const std::string &attn_type,
+                               bool pre_layernorm) {
+  TT_ENFORCE(attn_type == "self" || attn_type == "context",
+             "attn_type should be self or context, not %s", attn_type);
+  double q_tokens = batch * query_len, k_tokens = batch * key_len;
+  double h = hidden_size, head_size = h / num_heads;
+  double scores = batch * num_heads * query_len * key_len;
+  LayerCost layer{"MultiHeadedAttention", {}, 0.};
+  auto &kernels = layer.kernels;
+  if (pre_layernorm) {
+    kernels.push_back(Memory("LayerNorm", 2 * q_tokens * h, q_tokens * h, 8));
+  }
+  if (attn_type == "self") {
+    kernels.push_back(Gemm("MatMul/qkv", q_tokens, h, 3 * h));
+    kernels.push_back(Memory("SplitAddBiasTransposeForScore", 3 * q_tokens * h,
+                             3 * q_tokens * h));
+    if (key_len > query_len) {
+      kernels.push_back(Memory("Concat", 2 * k_tokens * h, 2 * k_tokens * h));
+    }
+  } else {
+    kernels.push_back(Gemm("MatMul/q", q_tokens, h, h));
+    kernels.push_back(Gemm("MatMul/kv", k_tokens, h, 2 * h));
+    kernels.push_back(Memory("AddBiasTransposeForScore",
+                             q_tokens * h + 2 * k_tokens * h,
+                             q_tokens * h + 2 * k_tokens * h));
+  }
+  kernels.push_back(Gemm("BatchMatMul/scores", query_len, head_size, key_len,
+                         batch * num_heads));
+  kernels.push_back(Memory("ApplyMaskAndSoftmax", scores, scores, 5));
+  kernels.push_back(Gemm("BatchMatMul/context", query_len, key_len, head_size,
+                         batch * num_heads));
+  kernels.push_back(
+      Memory("TransposeForScore", q_tokens * h, q_tokens * h));
+  kernels.push_back(Gemm("MatMul/output", q_tokens, h, h));
+  kernels.push_back(Memory("AddBias", 2 * q_tokens * h, q_tokens * h));
+  layer.activation_bytes =
+      (5 * q_tokens * h + 2 * k_tokens * h + scores) * kFloatBytes;
+  return layer;
+}
+
+LayerCost PositionwiseFeedForward(int64_t batch, int64_t seq_len,
+                                  int64_t hidden_size,
+                                  int64_t intermediate_size) {
+  double tokens = batch * seq_len;
+  double n = tokens * hidden_size, ni = tokens * intermediate_size;
+  return {"PositionwiseFeedForward",
+          {Memory("Copy", n, n), Memory("LayerNorm", n, n, 8),
+           Gemm("MatMul/gemm0", tokens, hidden_size, intermediate_size),
+           Memory("AddBiasAct/Relu", ni, ni),
+           Gemm("MatMul/gemm1", tokens, intermediate_size, hidden_size),
+           Memory("AddInputBias", 2 * n, n)},
+          (3 * n + ni) * kFloatBytes};
+}
+
+LayerCost AddBiasAct(int64_t rows, int64_t cols) {
+  double n = rows * cols;
+  return {"AddBiasAct", {Memory("AddBiasAct", n, n, 10)}, n * kFloatBytes};
+}
+
+LayerCost AddBiasLayerNorm(int64_t rows, int64_t cols) {
+  double n = rows * cols;
+  return {"AddBiasLayerNorm",
+          {Memory("AddBiasLayerNorm", 2 * n, n, 10)},
+          2 * n * kFloatBytes};
+}
+
+LayerCost EmbeddingHead(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                        int64_t out_dim, bool has_projection) {
+  TT_ENFORCE(has_projection || out_dim == hidden_size,
+             "the output dim %d of a head without projection should be the "
+             "hidden size %d",
+             out_dim, hidden_size);
+  double n = batch * seq_len * hidden_size;
+  LayerCost layer{"EmbeddingHead",
+                  {Memory("MaskedSeqPool", n, batch * hidden_size)},
+                  (n + batch * (hidden_size + out_dim)) * kFloatBytes};
+  if (has_projection) {
+    layer.kernels.push_back(Gemm("MatMul", batch, hidden_size, out_dim));
+  }
+  layer.kernels.push_back(
+      Memory("NormalizeAndQuantize", batch * out_dim, batch * out_dim, 4));
+  return layer;
+}
+
+}  // namespace cost
+
+CostModel CostModel::Calibrate(DLDeviceType device, int n_step) {
+  using kernels::common::CreateTensorAndFillRandom;
+  std::vector<double> flops, gemm_seconds;
+  constexpr int64_t hidden = 768;
+  for (int64_t m : {16, 64, 256, 1024}) {
+    for (int64_t n : {hidden, 4 * hidden}) {
+      auto a = CreateTensorAndFillRandom<float>({m, hidden}, device, 0);
+      auto b = CreateTensorAndFillRandom<float>({hidden, n}, device, 0);
+      auto c = CreateTensorAndFillRandom<float>({m, n}, device, 0);
+      flops.push_back(2. * m * hidden * n);
+      gemm_seconds.push_back(TimeIt(
+          [&]() { kernels::MatMul(a, false, b, false, 1.0, &c, 0.0); },
+          n_step, device));
+    }
+  }
+
+  std::vector<double> bytes, memory_seconds;
+  for (int64_t rows : {16, 128, 1024, 4096}) {
+    auto out = CreateTensorAndFillRandom<float>({rows, hidden}, device, 0);
+    auto gamma = CreateTensorAndFillRandom<float>({hidden}, device, 0);
+    auto beta = CreateTensorAndFillRandom<float>({hidden}, device, 0);
+    bytes.push_back(2. * rows * hidden * kFloatBytes);
+    memory_seconds.push_back(
+        TimeIt([&]() { kernels::LayerNorm<float>(gamma, beta, &out); },
+               n_step, device));
+  }
+
+  CostCoefficients coefficients;
+  auto gemm_fit = FitLine(flops, gemm_seconds);
+  auto memory_fit = FitLine(bytes, memory_seconds);
+  // fall back to the best observed throughput if the timing is too noisy
+  // to fit a positive slope.
+  auto throughput = [](const std::pair<double, double> &fit,
+                       const std::vector<double> &x,
+                       const std::vector<double> &y) {
+    if (fit.second > 0) {
+      return 1. / fit.second;
+    }
+    double best = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      best = std::max(best, x[i] / y[i]);
+    }
+    return best;
+  };
+  coefficients.gemm_flops_per_second =
+      throughput(gemm_fit, flops, gemm_seconds);
+  coefficients.memory_bytes_per_second =
+      throughput(memory_fit, bytes, memory_seconds);
+  coefficients.kernel_overhead_seconds =
+      std::max(0., (gemm_fit.first + memory_fit.first) / 2);
+  return CostModel(coefficients);
+}
+
+void CostModel::Save(const std::string &filename) const {
+  std::ofstream os(filename);
+  TT_ENFORCE(os.good(), "Can not open %s", filename);
+  os << "gemm_flops_per_second " << coefficients_.gemm_flops_per_second
+     << "\n";
+  os << "memory_bytes_per_second " << coefficients_.memory_bytes_per_second
+     << "\n";
+  os << "kernel_overhead_seconds " << coefficients_.kernel_overhead_seconds
+     << "\n";
+}
+
+CostModel CostModel::Load(const std::string &filename) {
+  std::ifstream is(filename);
+  TT_ENFORCE(is.good(), "Can not open %s", filename);
+  CostCoefficients coefficients;
+  std::string key;
+  double value;
+  while (is >> key >> value) {
+    if (key == "gemm_flops_per_second") {
+      coefficients.gemm_flops_per_second = value;
+    } else if (key == "memory_bytes_per_second") {
+      coefficients.memory_bytes_per_second = value;
+    } else if (key == "kernel_overhead_seconds") {
+      coefficients.kernel_overhead_seconds = value;
+    } else {
+      TT_THROW("Unknown cost coefficient %s in %s", key, filename);
+    }
+  }
+  return CostModel(coefficients);
+}
+
+double CostModel::PredictLatency(const KernelCost &kernel) const {
+  double memory_time = kernel.bytes / coefficients_.memory_bytes_per_second;
+  double compute_time = kernel.kind == CostKind::kGemm
+                            ? kernel.flops / coefficients_.gemm_flops_per_second
+                            : 0.;
+  return coefficients_.kernel_overhead_seconds +
+         std::max(memory_time, compute_time);
+}
+
+CostReport CostModel::Predict(std::vector<LayerCost> layers,
+                              double weight_bytes) const {
+  CostReport report;
+  double max_activation = 0.;
+  for (auto &layer : layers) {
+    layer.latency = 0.;
+    for (auto &kernel : layer.kernels) {
+      layer.latency += PredictLatency(kernel);
+    }
+    report.latency += layer.latency;
+    max_activation = std::max(max_activation, layer.activation_bytes);
+  }
+  report.peak_bytes = weight_bytes + max_activation;
+  report.layers = std::move(layers);
+  return report;
+}
+
+CostReport CostModel::PredictBert(const BertCostConfig &config, int64_t batch,
+                                  int64_t seq_len) const {
+  const double h = config.hidden_size, i = config.intermediate_size;
+  std::vector<LayerCost> layers;
+  layers.push_back(cost::PrepareBertMasks(batch, seq_len));
+  layers.push_back(cost::BertEmbedding(batch, seq_len, config.hidden_size));
+  double weights =
+      (config.vocab_size + config.max_position + config.type_vocab_size) * h +
+      2 * h;
+  for (int64_t l = 0; l < config.num_layers; ++l) {
+    auto prefix = "encoder.layer." + std::to_string(l) + ".";
+    layers.push_back(cost::BertAttention(batch, seq_len, config.hidden_size,
+                                         config.num_heads));
+    layers.push_back(cost::BertIntermediate(
+        batch, seq_len, config.hidden_size, config.intermediate_size));
+    layers.push_back(cost::BertOutput(batch, seq_len, config.hidden_size,
+                                      config.intermediate_size));
+    for (auto it = layers.end() - 3; it != layers.end(); ++it) {
+      it->name = prefix + it->name;
+    }
+    // qkv, attention output and its layernorm, intermediate and output.
+    weights += 3 * h * h + 3 * h + h * h + h + 2 * h + h * i + i + i * h + h +
+               2 * h;
+  }
+  if (config.use_pooler) {
+    layers.push_back(cost::SequencePool(batch, seq_len, config.hidden_size));
+    layers.push_back(cost::BertPooler(batch, config.hidden_size));
+    weights += h * h + h;
+  }
+  return Predict(std::move(layers), weights * kFloatBytes);
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
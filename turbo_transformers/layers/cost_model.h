@@ -0,0 +1,130 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <dlpack/dlpack.h>
+
+#include <string>
+#include <vector>
+
+namespace turbo_transformers {
+namespace layers {
+
+// An analytical cost model predicting the latency and the peak memory of a
+// request before running it. Each layer in layers/ is described by the FLOPs
+// and the bytes moved by its kernels, and a kernel's latency is predicted by
+// the roofline of the machine coefficients, which are fitted by a
+// calibration run.
+enum class CostKind { kGemm = 0, kMemory };
+
+struct KernelCost {
+  std::string name;
+  CostKind kind;
+  double flops;
+  double bytes;
+};
+
+struct LayerCost {
+  std::string name;
+  std::vector<KernelCost> kernels;
+  // the bytes of the intermediate and output tensors the layer allocates.
+  double activation_bytes{0.};
+  // filled by CostModel::Predict.
+  double latency{0.};
+};
+
+struct CostReport {
+  std::vector<LayerCost> layers;
+  // seconds
+  double latency{0.};
+  // the weights plus the largest live activations of a layer.
+  double peak_bytes{0.};
+};
+
+struct CostCoefficients {
+  double gemm_flops_per_second{50e9};
+  double memory_bytes_per_second{10e9};
+  double kernel_overhead_seconds{2e-6};
+};
+
+// The shape of a BERT-like encoder.
+struct BertCostConfig {
+  int64_t num_layers{12};
+  int64_t hidden_size{768};
+  int64_t num_heads{12};
+  int64_t intermediate_size{3072};
+  int64_t vocab_size{30522};
+  int64_t max_position{512};
+  int64_t type_vocab_size{2};
+  bool use_pooler{false};
+};
+
+namespace cost {
+// The kernel level formulas of the layers, all shapes are in elements.
+LayerCost BertEmbedding(int64_t batch, int64_t seq_len, int64_t hidden_size);
+LayerCost PrepareBertMasks(int64_t batch, int64_t seq_len);
+LayerCost BertAttention(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                        int64_t num_heads);
+LayerCost BertIntermediate(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                           int64_t intermediate_size);
+LayerCost BertOutput(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                     int64_t intermediate_size);
+LayerCost BertPooler(int64_t batch, int64_t hidden_size);
+LayerCost SequencePool(int64_t batch, int64_t seq_len, int64_t hidden_size);
+LayerCost AlbertLayer(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                      int64_t intermediate_size);
+// attn_type is "self" or "context", key_len is the length of the memory for
+// "context" and of the cached plus the new keys for "self".
+LayerCost MultiHeadedAttention(int64_t batch, int64_t query_len,
+                               int64_t key_len, int64_t hidden_size,
+                               int64_t num_heads, const std::string &attn_type,
+                               bool pre_layernorm);
+LayerCost PositionwiseFeedForward(int64_t batch, int64_t seq_len,
+                                  int64_t hidden_size,
+                                  int64_t intermediate_size);
+LayerCost AddBiasAct(int64_t rows, int64_t cols);
+LayerCost AddBiasLayerNorm(int64_t rows, int64_t cols);
+// has_projection: whether the head has a dense weight, which is costed even
+// when square. Without one out_dim must be hidden_size.
+LayerCost EmbeddingHead(int64_t batch, int64_t seq_len, int64_t hidden_size,
+                        int64_t out_dim, bool has_projection);
+}  // namespace cost
+
+class CostModel {
+ public:
+  explicit CostModel(const CostCoefficients &coefficients = CostCoefficients())
+      : coefficients_(coefficients) {}
+
+  // Fits the coefficients by timing GEMMs and a memory bound kernel of a few
+  // shapes on the device. It takes about a second.
+  static CostModel Calibrate(DLDeviceType device = kDLCPU, int n_step = 5);
+
+  // The coefficients are stored as "key value" lines.
+  void Save(const std::string &filename) const;
+  static CostModel Load(const std::string &filename);
+
+  double PredictLatency(const KernelCost &kernel) const;
+
+  CostReport Predict(std::vector<LayerCost> layers, double weight_bytes) const;
+
+  CostReport PredictBert(const BertCostConfig &config, int64_t batch,
+                         int64_t seq_len) const;
+
+  const CostCoefficients &coefficients() const { return coefficients_; }
+
+ private:
+  CostCoefficients coefficients_;
+};
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,91 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/cost_model.h"
+
+#include <cstdio>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+
+TEST_CASE("cost_model-formulas") {
+  auto attention = cost::BertAttention(2, 10, 768, 12);
+  REQUIRE(attention.kernels.front().name == "MatMul/qkv");
+  REQUIRE(attention.kernels.front().flops == 2. * 20 * 768 * 3 * 768);
+  double flops = 0;
+  for (auto &kernel : attention.kernels) {
+    if (kernel.kind == CostKind::kGemm) flops += kernel.flops;
+  }
+  // qkv, scores, context and output projections.
+  REQUIRE(flops == 2. * 20 * 768 * 4 * 768 + 2 * 2. * 2 * 10 * 10 * 768);
+
+  auto context = cost::MultiHeadedAttention(2, 1, 30, 512, 8, "context", false);
+  auto self = cost::MultiHeadedAttention(2, 1, 30, 512, 8, "self", true);
+  REQUIRE(context.activation_bytes == self.activation_bytes);
+  REQUIRE_THROWS(cost::MultiHeadedAttention(2, 1, 30, 512, 8, "cross", false));
+
+  // a square projection is costed, as is the lack of one.
+  auto projected = cost::EmbeddingHead(2, 10, 768, 768, true);
+  auto pooled = cost::EmbeddingHead(2, 10, 768, 768, false);
+  REQUIRE(projected.kernels.size() == pooled.kernels.size() + 1);
+  REQUIRE(projected.kernels[1].flops == 2. * 2 * 768 * 768);
+  REQUIRE_THROWS(cost::EmbeddingHead(2, 10, 768, 256, false));
+}
+
+TEST_CASE("cost_model-predict") {
+  CostCoefficients coefficients;
+  coefficients.gemm_flops_per_second = 1e11;
+  coefficients.memory_bytes_per_second = 1e10;
+  coefficients.kernel_overhead_seconds = 1e-6;
+  CostModel model(coefficients);
+
+  KernelCost gemm{"gemm", CostKind::kGemm, 1e11, 1e9};
+  REQUIRE(model.PredictLatency(gemm) == Approx(1. + 1e-6));
+  KernelCost copy{"copy", CostKind::kMemory, 1e11, 1e9};
+  REQUIRE(model.PredictLatency(copy) == Approx(0.1 + 1e-6));
+
+  BertCostConfig config;
+  config.num_layers = 2;
+  auto small = model.PredictBert(config, 1, 16);
+  auto large = model.PredictBert(config, 8, 128);
+  REQUIRE(small.layers.size() == 2 + 3 * 2);
+  REQUIRE(small.layers.back().name == "encoder.layer.1.BertOutput");
+  REQUIRE(large.latency > small.latency);
+  REQUIRE(large.peak_bytes > small.peak_bytes);
+  double sum = 0;
+  for (auto &layer : large.layers) sum += layer.latency;
+  REQUIRE(sum == Approx(large.latency));
+  // the peak is at least the weights, about 4 * (23.8M + 2 * 7.1M) bytes.
+  REQUIRE(small.peak_bytes > 4 * 37e6);
+}
+
+TEST_CASE("cost_model-calibrate") {
+  auto model = CostModel::Calibrate(kDLCPU, 1);
+  REQUIRE(model.coefficients().gemm_flops_per_second > 0);
+  REQUIRE(model.coefficients().memory_bytes_per_second > 0);
+  REQUIRE(model.coefficients().kernel_overhead_seconds >= 0);
+
+  std::string filename = "cost_model_test_coefficients.txt";
+  model.Save(filename);
+  auto loaded = CostModel::Load(filename);
+  std::remove(filename.c_str());
+  REQUIRE(loaded.coefficients().gemm_flops_per_second ==
+          Approx(model.coefficients().gemm_flops_per_second));
+  REQUIRE(loaded.coefficients().kernel_overhead_seconds ==
+          Approx(model.coefficients().kernel_overhead_seconds));
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
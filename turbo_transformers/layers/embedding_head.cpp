@@ -0,0 +1,102 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/embedding_head.h"
+
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/kernels/embedding_output.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/seq_pool.h"
+#include "turbo_transformers/layers/kernels/utils.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+namespace {
+// The output formats of kernels::QuantizedBytes, int4 is a weight precision
+// only.
+types::QuantType GetOutputQuantType(const std::string &quant_type) {
+  if (quant_type == "Float32") {
+    return types::QuantType::kFloat32;
+  } else if (quant_type == "Float16") {
+    return types::QuantType::kFloat16;
+  } else if (quant_type == "Int8") {
+    return types::QuantType::kInt8;
+  } else if (quant_type == "Binary") {
+    return types::QuantType::kBinary;
+  }
+  TT_THROW(
+      "The output quant_type(%s) is not in ['Float32', 'Float16', 'Int8', "
+      "'Binary'].",
+      quant_type);
+}
+}  // namespace
+
+EmbeddingHead::EmbeddingHead(const std::string &pool_type,
+                             core::Tensor dense_weight, core::Tensor dense_bias,
+                             bool normalize, const std::string &quant_type)
+    : EmbeddingHead(kernels::GetPoolType(pool_type), std::move(dense_weight),
+                    std::move(dense_bias), normalize,
+                    GetOutputQuantType(quant_type)) {}
+
+void EmbeddingHead::operator()(const core::Tensor &input,
+                               const core::Tensor &attention_mask,
+                               core::Tensor *output) const {
+  TT_TRACE_LAYER("EmbeddingHead", input);
+  TT_ENFORCE_EQ(input.n_dim(), 3, "input's dim should be 3, not %d",
+                input.n_dim());
+  if (dense_weight_.is_null()) {
+    kernels::PoolNormalizeAndQuantize(input, attention_mask, pool_type_,
+                                      normalize_, quant_type_, output);
+    return;
+  }
+  TT_ENFORCE_EQ(input.shape(2), dense_weight_.shape(0),
+                "The hidden size(%d) should match the dense weight(%d)",
+                input.shape(2), dense_weight_.shape(0));
+  core::Tensor pooled(nullptr);
+  kernels::MaskedSeqPool(input, attention_mask, pool_type_, &pooled);
+  core::Tensor projected(nullptr);
+  projected.Reshape<float>({input.shape(0), dense_weight_.shape(1)},
+                           input.device_type(), input.device_id());
+  kernels::MatMul(pooled, false, dense_weight_, false, 1.0, &projected, 0.0);
+  if (!dense_bias_.is_null()) {
+    kernels::AddBias(dense_bias_, &projected);
+  }
+  kernels::NormalizeAndQuantize(projected, normalize_, quant_type_, output);
+}
+
+int64_t EmbeddingHead::output_bytes() const {
+  TT_ENFORCE(!dense_weight_.is_null(),
+             "The output size depends on the input without a projection");
+  return kernels::QuantizedBytes(dense_weight_.shape(1), quant_type_);
+}
+
+void EmbeddingHead::EnforceShapeAndType() const {
+  TT_ENFORCE(quant_type_ != types::QuantType::kInt4,
+             "Int4 is not an output format of the embedding head");
+  if (dense_weight_.is_null()) {
+    TT_ENFORCE(dense_bias_.is_null(),
+               "The dense bias requires a dense weight");
+    return;
+  }
+  TT_ENFORCE_EQ(dense_weight_.n_dim(), 2, "dense weight must be matrix");
+  if (!dense_bias_.is_null()) {
+    TT_ENFORCE_EQ(dense_bias_.n_dim(), 1, "dense bias must be vector");
+    TT_ENFORCE_EQ(dense_weight_.shape(1), dense_bias_.shape(0),
+                  "weight and bias shape mismatch %d, %d",
+                  dense_weight_.shape(1), dense_bias_.shape(0));
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
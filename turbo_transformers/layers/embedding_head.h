@@ -0,0 +1,66 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <string>
+#include <utility>
+
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/types.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// The output head of an embedding service. It pools the final hidden states
+// (mask-aware), optionally applies a dense projection, L2 normalizes and
+// quantizes the result into the bytes to store, see
+// kernels::QuantizedBytes for the layout of each quant type.
+// dense_weight has the shape (hidden, out_dim) and may be null to skip the
+// projection, dense_bias (out_dim) may be null as well.
+class EmbeddingHead {
+ public:
+  EmbeddingHead(const std::string &pool_type, core::Tensor dense_weight,
+                core::Tensor dense_bias, bool normalize,
+                const std::string &quant_type);
+
+  EmbeddingHead(types::PoolType pool_type, core::Tensor dense_weight,
+                core::Tensor dense_bias, bool normalize,
+                types::QuantType quant_type)
+      : pool_type_(pool_type),
+        dense_weight_(std::move(dense_weight)),
+        dense_bias_(std::move(dense_bias)),
+        normalize_(normalize),
+        quant_type_(quant_type) {
+    EnforceShapeAndType();
+  }
+
+  void EnforceShapeAndType() const;
+
+  // input: (batch, seq_len, hidden) float, attention_mask: (batch, seq_len)
+  // int64 or null, output: (batch, n_bytes) uint8.
+  void operator()(const core::Tensor &input,
+                  const core::Tensor &attention_mask,
+                  core::Tensor *output) const;
+
+  int64_t output_bytes() const;
+
+ private:
+  types::PoolType pool_type_;
+  core::Tensor dense_weight_;
+  core::Tensor dense_bias_;
+  bool normalize_;
+  types::QuantType quant_type_;
+};
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,143 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/generation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/trace.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+int64_t GenerateTokens(const DecodeStep &step, int64_t max_new_tokens,
+                       int64_t eos_token_id, const TokenCallback &on_token) {
+  int64_t n_emitted = 0;
+  int64_t request_id = core::NextTraceRequestId();
+  TT_TRACE_REQUEST_BEGIN(request_id, 1, max_new_tokens);
+  while (n_emitted < max_new_tokens) {
+    int64_t token = step(n_emitted);
+    ++n_emitted;
+    if (!on_token(token) || (eos_token_id >= 0 && token == eos_token_id)) {
+      break;
+    }
+  }
+  TT_TRACE_REQUEST_END(request_id, 1, n_emitted);
+  return n_emitted;
+}
+
+double StreamTiming::MeanInterTokenMs() const {
+  if (inter_token_ms.empty()) {
+    return 0.;
+  }
+  return std::accumulate(inter_token_ms.begin(), inter_token_ms.end(), 0.) /
+         inter_token_ms.size();
+}
+
+double StreamTiming::InterTokenPercentileMs(double percentile) const {
+  if (inter_token_ms.empty()) {
+    return 0.;
+  }
+  std::vector<double> sorted(inter_token_ms);
+  std::sort(sorted.begin(), sorted.end());
+  auto idx = static_cast<size_t>(std::ceil(percentile * sorted.size()));
+  return sorted[std::min(std::max<size_t>(idx, 1), sorted.size()) - 1];
+}
+
+TokenStream::~TokenStream() { Stop(); }
+
+void TokenStream::Start(DecodeStep step, int64_t max_new_tokens,
+                        int64_t eos_token_id) {
+  TT_ENFORCE(!worker_.joinable(), "the TokenStream is already started");
+  TT_ENFORCE_GT(capacity_, 0, "the capacity of a TokenStream must be > 0");
+  start_ = last_token_ = Clock::now();
+  worker_ = std::thread([this, step, max_new_tokens, eos_token_id]() {
+    std::exception_ptr error;
+    try {
+      GenerateTokens(step, max_new_tokens, eos_token_id,
+                     [this](int64_t token) { return Push(token); });
+    } catch (...) {
+      error = std::current_exception();
+    }
+    Finish(error);
+  });
+}
+
+bool TokenStream::Push(int64_t token) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return stopped_ || tokens_.size() < capacity_; });
+  if (stopped_) {
+    return false;
+  }
+  tokens_.push_back(token);
+  cv_.notify_all();
+  return true;
+}
+
+void TokenStream::Finish(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  done_ = true;
+  error_ = error;
+  cv_.notify_all();
+}
+
+bool TokenStream::Next(int64_t *token) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return stopped_ || done_ || !tokens_.empty(); });
+  if (stopped_) {
+    return false;
+  }
+  if (tokens_.empty()) {
+    if (error_) {
+      auto error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+    return false;
+  }
+  *token = tokens_.front();
+  tokens_.pop_front();
+  cv_.notify_all();
+
+  auto now = Clock::now();
+  auto elapsed = [](Clock::time_point begin, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+  };
+  if (n_received_ == 0) {
+    timing_.first_token_ms = elapsed(start_, now);
+  } else {
+    timing_.inter_token_ms.push_back(elapsed(last_token_, now));
+  }
+  timing_.total_ms = elapsed(start_, now);
+  last_token_ = now;
+  ++n_received_;
+  return true;
+}
+
+void TokenStream::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    cv_.notify_all();
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,106 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "turbo_transformers/core/macros.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// One step of a decoder: runs the model on the tokens emitted so far (kept in
+// the KV caches of the caller) and returns the next token, step counts from
+// 0.
+using DecodeStep = std::function<int64_t(int64_t step)>;
+
+// Receives each token as soon as it is decoded, returns false to stop the
+// generation early.
+using TokenCallback = std::function<bool(int64_t token)>;
+
+// The decoding loop. Calls step until max_new_tokens are emitted, step
+// returns eos_token_id (it is emitted as well) or on_token returns false.
+// Returns the number of emitted tokens. eos_token_id < 0 disables the eos
+// check.
+extern int64_t GenerateTokens(const DecodeStep &step, int64_t max_new_tokens,
+                              int64_t eos_token_id,
+                              const TokenCallback &on_token);
+
+// The latencies seen by the consumer of a TokenStream, in milliseconds from
+// Start.
+struct StreamTiming {
+  double first_token_ms{0.};
+  double total_ms{0.};
+  std::vector<double> inter_token_ms;
+
+  double MeanInterTokenMs() const;
+  double InterTokenPercentileMs(double percentile) const;
+};
+
+// Runs GenerateTokens on a background thread and hands the tokens to the
+// consumer through a bounded channel, so the first token is available while
+// the rest of the sequence is still decoding. The decoding thread blocks
+// when the consumer falls capacity tokens behind. An exception thrown by the
+// step is rethrown by Next after the tokens before it were consumed.
+class TokenStream {
+ public:
+  explicit TokenStream(size_t capacity = 16) : capacity_(capacity) {}
+  ~TokenStream();
+
+  void Start(DecodeStep step, int64_t max_new_tokens,
+             int64_t eos_token_id = -1);
+
+  // Blocks until the next token is decoded. Returns false when the
+  // generation is done or stopped.
+  bool Next(int64_t *token);
+
+  // Early stop from the consumer. The decoding thread exits after its
+  // current step, Stop waits for it.
+  void Stop();
+
+  const StreamTiming &timing() const { return timing_; }
+
+ private:
+  bool Push(int64_t token);
+  void Finish(std::exception_ptr error);
+
+  using Clock = std::chrono::steady_clock;
+
+  size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<int64_t> tokens_;
+  bool done_{false};
+  bool stopped_{false};
+  std::exception_ptr error_;
+  std::thread worker_;
+
+  Clock::time_point start_;
+  Clock::time_point last_token_;
+  int64_t n_received_{0};
+  StreamTiming timing_;
+
+  DISABLE_COPY_AND_ASSIGN(TokenStream);
+};
+
+}  // namespace layers
+}  // namespace turbo_transformers
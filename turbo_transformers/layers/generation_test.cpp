@@ -0,0 +1,102 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/generation.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+
+TEST_CASE("generation-callback") {
+  std::vector<int64_t> tokens;
+  auto step = [](int64_t i) { return 10 + i; };
+  auto collect = [&](int64_t token) {
+    tokens.push_back(token);
+    return true;
+  };
+  REQUIRE(GenerateTokens(step, 5, -1, collect) == 5);
+  REQUIRE(tokens == std::vector<int64_t>{10, 11, 12, 13, 14});
+
+  tokens.clear();
+  REQUIRE(GenerateTokens(step, 5, 12, collect) == 3);
+  REQUIRE(tokens == std::vector<int64_t>{10, 11, 12});
+
+  tokens.clear();
+  REQUIRE(GenerateTokens(step, 5, -1,
+                         [&](int64_t token) {
+                           tokens.push_back(token);
+                           return tokens.size() < 2;
+                         }) == 2);
+  REQUIRE(tokens == std::vector<int64_t>{10, 11});
+}
+
+TEST_CASE("generation-stream") {
+  TokenStream stream(2);
+  stream.Start([](int64_t i) { return i * i; }, 100, 49);
+  std::vector<int64_t> tokens;
+  int64_t token;
+  while (stream.Next(&token)) {
+    tokens.push_back(token);
+  }
+  REQUIRE(tokens == std::vector<int64_t>{0, 1, 4, 9, 16, 25, 36, 49});
+  REQUIRE(stream.timing().inter_token_ms.size() == 7);
+  REQUIRE(stream.timing().first_token_ms <= stream.timing().total_ms);
+  REQUIRE(stream.timing().InterTokenPercentileMs(1.) >=
+          stream.timing().MeanInterTokenMs());
+  REQUIRE_THROWS(stream.Start([](int64_t i) { return i; }, 1));
+}
+
+TEST_CASE("generation-stream-early-stop") {
+  std::atomic<int64_t> n_steps(0);
+  TokenStream stream(1);
+  stream.Start(
+      [&](int64_t i) {
+        ++n_steps;
+        return i;
+      },
+      1000000);
+  int64_t token;
+  REQUIRE(stream.Next(&token));
+  REQUIRE(token == 0);
+  stream.Stop();
+  REQUIRE_FALSE(stream.Next(&token));
+  // the decoding thread is blocked on the full channel, at most one step
+  // decoded behind it
+  REQUIRE(n_steps.load() <= 3);
+}
+
+TEST_CASE("generation-stream-error") {
+  TokenStream stream;
+  stream.Start(
+      [](int64_t i) -> int64_t {
+        if (i == 2) {
+          throw std::runtime_error("step failed");
+        }
+        return i;
+      },
+      10);
+  int64_t token;
+  REQUIRE(stream.Next(&token));
+  REQUIRE(stream.Next(&token));
+  REQUIRE(token == 1);
+  REQUIRE_THROWS_WITH(stream.Next(&token), "step failed");
+  REQUIRE_FALSE(stream.Next(&token));
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
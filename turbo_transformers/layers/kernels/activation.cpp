@@ -12,6 +12,10 @@
 // See the AUTHORS file for names of contributors.
 #include "turbo_transformers/layers/kernels/activation.h"
 
+#include <vector>
+
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_device_context.h"
 #include "turbo_transformers/layers/kernels/gpu_activation_kernel.h"
@@ -27,13 +31,13 @@ namespace kernels {
 namespace {
 template <typename T, ActivationType ActType>
 void CPUAddBiasActKernel(const T *bias, int64_t batch_size, int64_t feature_dim,
-                         T *out);
+                         T *out, int8_t *quantized, float quantize_scale);
 
 template <>
-void CPUAddBiasActKernel<float, ActivationType::Gelu>(const float *bias,
-                                                      int64_t batch_size,
-                                                      int64_t feature_dim,
-                                                      float *out) {
+void CPUAddBiasActKernel<float, ActivationType::Gelu>(
+    const float *bias, int64_t batch_size, int64_t feature_dim, float *out,
+    int8_t *quantized, float quantize_scale) {
+  auto backend = core::GemmBackendRegistry::GetInstance().Select("Tanh");
   core::Tensor temp_tensor(nullptr);
   auto *buff =
       temp_tensor.Reshape<float>({batch_size * feature_dim}, kDLCPU, 0);
@@ -45,20 +49,25 @@ void CPUAddBiasActKernel<float, ActivationType::Gelu>(const float *bias,
       float tmp_ = out[j] + bias[k++];
       buff[j] = (0.7978845608028654f * (tmp_ + 0.044715f * tmp_ * tmp_ * tmp_));
     }
-    vsTanh(feature_dim, &buff[i * feature_dim], &buff[i * feature_dim]);
+    backend->Tanh(feature_dim, &buff[i * feature_dim],
+                  &buff[i * feature_dim]);
     k = 0;
 #pragma omp simd
     for (int64_t j = feature_dim * i; j < feature_dim * (i + 1); ++j) {
       out[j] = (out[j] + bias[k++]) * 0.5f * (1.0f + buff[j]);
     }
+    if (quantized != nullptr) {
+      QuantizeActivation(&out[i * feature_dim], feature_dim, quantize_scale,
+                         &quantized[i * feature_dim]);
+    }
   }
 }
 
 template <>
-void CPUAddBiasActKernel<float, ActivationType::Tanh>(const float *bias,
-                                                      int64_t batch_size,
-                                                      int64_t feature_dim,
-                                                      float *out) {
+void CPUAddBiasActKernel<float, ActivationType::Tanh>(
+    const float *bias, int64_t batch_size, int64_t feature_dim, float *out,
+    int8_t *quantized, float quantize_scale) {
+  auto backend = core::GemmBackendRegistry::GetInstance().Select("Tanh");
 #pragma omp parallel for
   for (int64_t i = 0; i < batch_size; ++i) {
     int64_t k = 0;
@@ -66,15 +75,18 @@ void CPUAddBiasActKernel<float, ActivationType::Tanh>(const float *bias,
     for (int64_t j = feature_dim * i; j < feature_dim * (i + 1); ++j) {
       out[j] = out[j] + bias[k++];
     }
-    vsTanh(feature_dim, &out[i * feature_dim], &out[i * feature_dim]);
+    backend->Tanh(feature_dim, &out[i * feature_dim], &out[i * feature_dim]);
+    if (quantized != nullptr) {
+      QuantizeActivation(&out[i * feature_dim], feature_dim, quantize_scale,
+                         &quantized[i * feature_dim]);
+    }
   }
 }
 
 template <>
-void CPUAddBiasActKernel<float, ActivationType::Relu>(const float *bias,
-                                                      int64_t batch_size,
-                                                      int64_t feature_dim,
-                                                      float *out) {
+void CPUAddBiasActKernel<float, ActivationType::Relu>(
+    const float *bias, int64_t batch_size, int64_t feature_dim, float *out,
+    int8_t *quantized, float quantize_scale) {
 #pragma omp parallel for
   for (int64_t i = 0; i < batch_size; ++i) {
     int64_t k = 0;
@@ -83,6 +95,10 @@ void CPUAddBiasActKernel<float, ActivationType::Relu>(const float *bias,
       out[j] = out[j] + bias[k++];
       out[j] = out[j] > 0. ? out[j] : 0.;
     }
+    if (quantized != nullptr) {
+      QuantizeActivation(&out[i * feature_dim], feature_dim, quantize_scale,
+                         &quantized[i * feature_dim]);
+    }
   }
 }
 }  // namespace
@@ -90,6 +106,7 @@ void CPUAddBiasActKernel<float, ActivationType::Relu>(const float *bias,
 template <typename T, ActivationType ActType>
 void AddBiasAct(const core::Tensor &bias_tensor, core::Tensor *out_tensor,
                 const std::string name) {
+  TT_TRACE_KERNEL(name, *out_tensor);
 #ifdef WITH_PERFTOOLS
   auto &profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, bias_tensor.device_type());
@@ -102,7 +119,7 @@ void AddBiasAct(const core::Tensor &bias_tensor, core::Tensor *out_tensor,
 
   if (out_tensor->device_type() == kDLCPU &&
       bias_tensor.device_type() == kDLCPU) {
-    CPUAddBiasActKernel<T, ActType>(bias, m, n, out);
+    CPUAddBiasActKernel<T, ActType>(bias, m, n, out, nullptr, 0.f);
   } else if (out_tensor->device_type() == kDLGPU &&
              bias_tensor.device_type() == kDLGPU) {
 #ifdef TT_WITH_CUDA
@@ -118,6 +135,36 @@ void AddBiasAct(const core::Tensor &bias_tensor, core::Tensor *out_tensor,
 #endif
 }
 
+template <typename T, ActivationType ActType>
+void AddBiasActQuantize(const core::Tensor &bias_tensor,
+                        core::Tensor *out_tensor,
+                        QuantizedActivation *quantized_out,
+                        const std::string name) {
+  TT_TRACE_KERNEL(name, *out_tensor);
+#ifdef WITH_PERFTOOLS
+  auto &profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, bias_tensor.device_type());
+#endif
+  TT_ENFORCE(out_tensor->device_type() == kDLCPU &&
+                 bias_tensor.device_type() == kDLCPU,
+             "AddBiasActQuantize only supports CPU");
+  TT_ENFORCE_GT(quantized_out->scale, 0.f, "the quantize scale is not set");
+  int64_t n = out_tensor->shape(-1);
+  int64_t m = out_tensor->numel() / n;
+  std::vector<int64_t> shape(out_tensor->n_dim());
+  for (size_t i = 0; i < shape.size(); ++i) {
+    shape[i] = out_tensor->shape(i);
+  }
+  auto *quantized = quantized_out->data.Reshape<int8_t>(
+      shape, kDLCPU, 0, name + "/quantized/Reshape");
+  CPUAddBiasActKernel<T, ActType>(bias_tensor.data<T>(), m, n,
+                                  out_tensor->mutableData<T>(), quantized,
+                                  quantized_out->scale);
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, bias_tensor.device_type());
+#endif
+}
+
 template void AddBiasAct<float, ActivationType::Tanh>(
     const core::Tensor &bias_tensor, core::Tensor *out_tensor,
     const std::string name);
@@ -130,6 +177,18 @@ template void AddBiasAct<float, ActivationType::Relu>(
     const core::Tensor &bias_tensor, core::Tensor *out_tensor,
     const std::string name);
 
+template void AddBiasActQuantize<float, ActivationType::Tanh>(
+    const core::Tensor &bias_tensor, core::Tensor *out_tensor,
+    QuantizedActivation *quantized_out, const std::string name);
+
+template void AddBiasActQuantize<float, ActivationType::Gelu>(
+    const core::Tensor &bias_tensor, core::Tensor *out_tensor,
+    QuantizedActivation *quantized_out, const std::string name);
+
+template void AddBiasActQuantize<float, ActivationType::Relu>(
+    const core::Tensor &bias_tensor, core::Tensor *out_tensor,
+    QuantizedActivation *quantized_out, const std::string name);
+
 }  // namespace kernels
 }  // namespace layers
 }  // namespace turbo_transformers
@@ -13,6 +13,7 @@
 
 #pragma once
 #include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
 #include "turbo_transformers/layers/types.h"
 
 namespace turbo_transformers {
@@ -24,6 +25,14 @@ template <typename T, ActivationType ActType>
 void AddBiasAct(const core::Tensor& bias, core::Tensor* out,
                 const std::string name = "AddBiasAct");
 
+// AddBiasAct whose epilogue also quantizes each row of out with
+// quantized_out->scale into quantized_out->data, for the int8 GEMM reading
+// out next. CPU only.
+template <typename T, ActivationType ActType>
+void AddBiasActQuantize(const core::Tensor& bias, core::Tensor* out,
+                        QuantizedActivation* quantized_out,
+                        const std::string name = "AddBiasActQuantize");
+
 }  // namespace kernels
 }  // namespace layers
 }  // namespace turbo_transformers
@@ -13,6 +13,7 @@
 #include "turbo_transformers/layers/kernels/embedding.h"
 
 #include "common.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_device_context.h"
 #include "turbo_transformers/layers/kernels/gpu_embedding_kernel.h"
@@ -30,6 +31,7 @@ void LookupEmbedding(core::Tensor *out_tensor,
                      const core::Tensor &embedding_table,
                      const core::Tensor &ids_tensor,
                      const std::string name) {
+  TT_TRACE_KERNEL(name, ids_tensor);
 #ifdef WITH_PERFTOOLS
   auto &profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, ids_tensor.device_type());
@@ -53,8 +55,14 @@ void LookupEmbedding(core::Tensor *out_tensor,
   auto hidden_size = embedding_table.shape(1);
   auto vocab_size = embedding_table.shape(0);
   if (out_tensor->device_type() == kDLCPU) {
+#ifdef WITH_PERFTOOLS
+    core::ParallelRegionProfile region(name);
+#endif
 #pragma omp parallel for
     for (int64_t i = 0; i < num_ids; ++i) {
+#ifdef WITH_PERFTOOLS
+      core::ParallelChunkProfile chunk(&region);
+#endif
       int64_t id = ids[i];
       TT_ENFORCE_LT(id, vocab_size, "embedding id out of index");
       auto dst = out + i * hidden_size;
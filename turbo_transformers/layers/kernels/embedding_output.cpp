@@ -0,0 +1,277 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/kernels/embedding_output.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "turbo_transformers/core/half.h"
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+void PoolRow(const float* in, const int64_t* mask, int64_t seq_len,
+             int64_t hidden_size, types::PoolType pool_type, float* out) {
+  auto valid = [mask](int64_t t) { return mask == nullptr || mask[t] != 0; };
+  switch (pool_type) {
+    case types::PoolType::kFirst:
+      std::copy(in, in + hidden_size, out);
+      break;
+    case types::PoolType::kLast: {
+      int64_t last = seq_len - 1;
+      while (last >= 0 && !valid(last)) {
+        --last;
+      }
+      if (last < 0) {
+        std::fill(out, out + hidden_size, 0.f);
+      } else {
+        std::copy(in + last * hidden_size, in + (last + 1) * hidden_size, out);
+      }
+      break;
+    }
+    case types::PoolType::kMean: {
+      std::fill(out, out + hidden_size, 0.f);
+      int64_t count = 0;
+      for (int64_t t = 0; t < seq_len; ++t) {
+        if (!valid(t)) continue;
+        const float* token = in + t * hidden_size;
+#pragma omp simd
+        for (int64_t i = 0; i < hidden_size; ++i) {
+          out[i] += token[i];
+        }
+        ++count;
+      }
+      float scale = count > 0 ? 1.f / count : 0.f;
+#pragma omp simd
+      for (int64_t i = 0; i < hidden_size; ++i) {
+        out[i] *= scale;
+      }
+      break;
+    }
+    case types::PoolType::kMax: {
+      std::fill(out, out + hidden_size, std::numeric_limits<float>::lowest());
+      bool any = false;
+      for (int64_t t = 0; t < seq_len; ++t) {
+        if (!valid(t)) continue;
+        const float* token = in + t * hidden_size;
+#pragma omp simd
+        for (int64_t i = 0; i < hidden_size; ++i) {
+          out[i] = std::max(out[i], token[i]);
+        }
+        any = true;
+      }
+      if (!any) {
+        std::fill(out, out + hidden_size, 0.f);
+      }
+      break;
+    }
+    default:
+      TT_THROW("The pool type is not supported");
+  }
+}
+
+void NormalizeQuantizeRow(const float* in, int64_t dim, bool normalize,
+                          types::QuantType quant_type, uint8_t* out) {
+  float scale = 1.f;
+  if (normalize) {
+    float sum = 0.f;
+#pragma omp simd reduction(+ : sum)
+    for (int64_t i = 0; i < dim; ++i) {
+      sum += in[i] * in[i];
+    }
+    scale = sum > 0.f ? 1.f / std::sqrt(sum) : 1.f;
+  }
+  switch (quant_type) {
+    case types::QuantType::kFloat32: {
+      auto* dst = reinterpret_cast<float*>(out);
+#pragma omp simd
+      for (int64_t i = 0; i < dim; ++i) {
+        dst[i] = in[i] * scale;
+      }
+      break;
+    }
+    case types::QuantType::kFloat16: {
+      auto* dst = reinterpret_cast<core::Half*>(out);
+      for (int64_t i = 0; i < dim; ++i) {
+        dst[i] = core::Half(in[i] * scale);
+      }
+      break;
+    }
+    case types::QuantType::kInt8: {
+      float max_abs = 0.f;
+#pragma omp simd reduction(max : max_abs)
+      for (int64_t i = 0; i < dim; ++i) {
+        max_abs = std::max(max_abs, std::abs(in[i]));
+      }
+      float q_scale = max_abs > 0.f ? max_abs * scale / 127.f : 1.f;
+      std::memcpy(out, &q_scale, sizeof(float));
+      auto* dst = reinterpret_cast<int8_t*>(out + sizeof(float));
+      float inv = scale / q_scale;
+#pragma omp simd
+      for (int64_t i = 0; i < dim; ++i) {
+        dst[i] = static_cast<int8_t>(std::nearbyint(in[i] * inv));
+      }
+      break;
+    }
+    case types::QuantType::kBinary: {
+      // the sign does not depend on the normalization.
+      int64_t n_bytes = (dim + 7) / 8;
+      for (int64_t b = 0; b < n_bytes; ++b) {
+        uint8_t byte = 0;
+        for (int64_t i = b * 8; i < std::min(dim, b * 8 + 8); ++i) {
+          byte |= static_cast<uint8_t>(in[i] > 0.f) << (7 - i % 8);
+        }
+        out[b] = byte;
+      }
+      break;
+    }
+    default:
+      TT_THROW("The quant type is not supported");
+  }
+}
+
+const int64_t* MaskData(const core::Tensor& mask, int64_t batch_size,
+                        int64_t seq_len) {
+  if (mask.is_null()) {
+    return nullptr;
+  }
+  TT_ENFORCE_EQ(mask.numel(), batch_size * seq_len,
+                "The mask should have the shape (batch, seq_len)");
+  return mask.data<int64_t>();
+}
+
+}  // namespace
+
+int64_t QuantizedBytes(int64_t dim, types::QuantType quant_type) {
+  switch (quant_type) {
+    case types::QuantType::kFloat32:
+      return dim * sizeof(float);
+    case types::QuantType::kFloat16:
+      return dim * sizeof(core::Half);
+    case types::QuantType::kInt8:
+      return sizeof(float) + dim;
+    case types::QuantType::kBinary:
+      return (dim + 7) / 8;
+    default:
+      TT_THROW("The quant type is not supported");
+  }
+}
+
+void MaskedSeqPool(const core::Tensor& input, const core::Tensor& mask,
+                   types::PoolType pool_type, core::Tensor* output,
+                   const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE_EQ(input.n_dim(), 3, "The input of MaskedSeqPool should be 3D");
+  TT_ENFORCE_EQ(input.device_type(), kDLCPU,
+                "MaskedSeqPool only supports CPU tensors");
+  auto batch_size = input.shape(0);
+  auto seq_len = input.shape(1);
+  auto hidden_size = input.shape(2);
+  const int64_t* mask_ptr = MaskData(mask, batch_size, seq_len);
+  const float* in = input.data<float>();
+  float* out = output->Reshape<float>({batch_size, hidden_size}, kDLCPU, 0);
+#pragma omp parallel for
+  for (int64_t b = 0; b < batch_size; ++b) {
+    PoolRow(in + b * seq_len * hidden_size,
+            mask_ptr == nullptr ? nullptr : mask_ptr + b * seq_len, seq_len,
+            hidden_size, pool_type, out + b * hidden_size);
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+void NormalizeAndQuantize(const core::Tensor& input, bool normalize,
+                          types::QuantType quant_type, core::Tensor* output,
+                          const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE_EQ(input.n_dim(), 2,
+                "The input of NormalizeAndQuantize should be 2D");
+  TT_ENFORCE_EQ(input.device_type(), kDLCPU,
+                "NormalizeAndQuantize only supports CPU tensors");
+  auto batch_size = input.shape(0);
+  auto dim = input.shape(1);
+  auto n_bytes = QuantizedBytes(dim, quant_type);
+  const float* in = input.data<float>();
+  uint8_t* out = output->Reshape<uint8_t>({batch_size, n_bytes}, kDLCPU, 0);
+#pragma omp parallel for
+  for (int64_t b = 0; b < batch_size; ++b) {
+    NormalizeQuantizeRow(in + b * dim, dim, normalize, quant_type,
+                         out + b * n_bytes);
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+void PoolNormalizeAndQuantize(const core::Tensor& input,
+                              const core::Tensor& mask,
+                              types::PoolType pool_type, bool normalize,
+                              types::QuantType quant_type, core::Tensor* output,
+                              const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE_EQ(input.n_dim(), 3,
+                "The input of PoolNormalizeAndQuantize should be 3D");
+  TT_ENFORCE_EQ(input.device_type(), kDLCPU,
+                "PoolNormalizeAndQuantize only supports CPU tensors");
+  auto batch_size = input.shape(0);
+  auto seq_len = input.shape(1);
+  auto hidden_size = input.shape(2);
+  auto n_bytes = QuantizedBytes(hidden_size, quant_type);
+  const int64_t* mask_ptr = MaskData(mask, batch_size, seq_len);
+  const float* in = input.data<float>();
+  uint8_t* out = output->Reshape<uint8_t>({batch_size, n_bytes}, kDLCPU, 0);
+#pragma omp parallel
+  {
+    // the pooled row stays in cache between pooling and quantization.
+    std::vector<float> pooled(hidden_size);
+#pragma omp for
+    for (int64_t b = 0; b < batch_size; ++b) {
+      PoolRow(in + b * seq_len * hidden_size,
+              mask_ptr == nullptr ? nullptr : mask_ptr + b * seq_len, seq_len,
+              hidden_size, pool_type, pooled.data());
+      NormalizeQuantizeRow(pooled.data(), hidden_size, normalize, quant_type,
+                           out + b * n_bytes);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,56 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/types.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// The byte layout of a quantized vector of dim elements.
+// kFloat32: dim float values.
+// kFloat16: dim IEEE half values.
+// kInt8: a float scale followed by dim int8 values, x = scale * q.
+// kBinary: ceil(dim / 8) bytes, bit 7 - (i % 8) of byte i / 8 is set if
+// x[i] > 0, the same order as numpy.packbits.
+extern int64_t QuantizedBytes(int64_t dim, types::QuantType quant_type);
+
+// Pools input (batch, seq_len, hidden) into output (batch, hidden) with the
+// padding tokens excluded. mask (batch, seq_len) int64 marks the valid tokens
+// with 1, a null mask means all tokens are valid. kFirst takes the first
+// token and kLast the last valid token. kMean, kMax and kLast give zeros for
+// a row without a valid token.
+extern void MaskedSeqPool(const core::Tensor& input, const core::Tensor& mask,
+                          types::PoolType pool_type, core::Tensor* output,
+                          const std::string name = "MaskedSeqPool");
+
+// Optionally L2 normalizes each row of input (batch, dim) and writes it as
+// quantized bytes into output (batch, QuantizedBytes(dim)) uint8.
+extern void NormalizeAndQuantize(
+    const core::Tensor& input, bool normalize, types::QuantType quant_type,
+    core::Tensor* output, const std::string name = "NormalizeAndQuantize");
+
+// MaskedSeqPool followed by NormalizeAndQuantize in a single pass over the
+// hidden states, without the intermediate pooled tensor.
+extern void PoolNormalizeAndQuantize(
+    const core::Tensor& input, const core::Tensor& mask,
+    types::PoolType pool_type, bool normalize, types::QuantType quant_type,
+    core::Tensor* output, const std::string name = "PoolNormalizeAndQuantize");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,138 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/kernels/embedding_output.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/half.h"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+TEST_CASE("embedding-output-masked-pool-test") {
+  constexpr int64_t batch_size = 2, seq_len = 3, hidden = 2;
+  auto input = common::CreateTensor<float>({batch_size, seq_len, hidden},
+                                           kDLCPU, 0);
+  for (int i = 0; i < input.numel(); ++i) {
+    input.mutableData<float>()[i] = i;
+  }
+  // the second sequence has a padding token at the end.
+  auto mask = common::CreateTensorAndFillConstant<int64_t>(
+      {batch_size, seq_len}, kDLCPU, 0, 1);
+  mask.mutableData<int64_t>()[5] = 0;
+
+  core::Tensor output(nullptr);
+  MaskedSeqPool(input, mask, types::PoolType::kMean, &output);
+  REQUIRE(output.data<float>()[0] == 2.f);
+  REQUIRE(output.data<float>()[1] == 3.f);
+  REQUIRE(output.data<float>()[2] == 7.f);
+  REQUIRE(output.data<float>()[3] == 8.f);
+
+  MaskedSeqPool(input, mask, types::PoolType::kLast, &output);
+  REQUIRE(output.data<float>()[0] == 4.f);
+  REQUIRE(output.data<float>()[2] == 8.f);
+
+  MaskedSeqPool(input, mask, types::PoolType::kMax, &output);
+  REQUIRE(output.data<float>()[3] == 9.f);
+
+  // a row without a valid token pools to zeros.
+  std::fill(mask.mutableData<int64_t>() + seq_len,
+            mask.mutableData<int64_t>() + 2 * seq_len, 0);
+  for (auto pool_type : {types::PoolType::kMean, types::PoolType::kLast,
+                         types::PoolType::kMax}) {
+    MaskedSeqPool(input, mask, pool_type, &output);
+    REQUIRE(output.data<float>()[2] == 0.f);
+    REQUIRE(output.data<float>()[3] == 0.f);
+  }
+}
+
+TEST_CASE("embedding-output-quantize-test") {
+  constexpr int64_t batch_size = 3, seq_len = 5, dim = 19;
+  auto input = common::CreateTensorAndFillRandom<float>(
+      {batch_size, seq_len, dim}, kDLCPU, 0);
+  for (int i = 0; i < input.numel(); i += 3) {
+    input.mutableData<float>()[i] -= 1.f;
+  }
+  core::Tensor pooled(nullptr);
+  MaskedSeqPool(input, core::Tensor(nullptr), types::PoolType::kMean, &pooled);
+  std::vector<float> ref(pooled.numel());
+  for (int64_t b = 0; b < batch_size; ++b) {
+    const float* row = pooled.data<float>() + b * dim;
+    float norm = 0.f;
+    for (int64_t i = 0; i < dim; ++i) {
+      norm += row[i] * row[i];
+    }
+    for (int64_t i = 0; i < dim; ++i) {
+      ref[b * dim + i] = row[i] / std::sqrt(norm);
+    }
+  }
+
+  for (auto quant_type :
+       {types::QuantType::kFloat32, types::QuantType::kFloat16,
+        types::QuantType::kInt8, types::QuantType::kBinary}) {
+    core::Tensor fused(nullptr), unfused(nullptr);
+    PoolNormalizeAndQuantize(input, core::Tensor(nullptr),
+                             types::PoolType::kMean, true, quant_type, &fused);
+    NormalizeAndQuantize(pooled, true, quant_type, &unfused);
+    int64_t n_bytes = QuantizedBytes(dim, quant_type);
+    REQUIRE(fused.shape(0) == batch_size);
+    REQUIRE(fused.shape(1) == n_bytes);
+    REQUIRE(std::memcmp(fused.data<uint8_t>(), unfused.data<uint8_t>(),
+                        batch_size * n_bytes) == 0);
+
+    for (int64_t b = 0; b < batch_size; ++b) {
+      const uint8_t* row = fused.data<uint8_t>() + b * n_bytes;
+      for (int64_t i = 0; i < dim; ++i) {
+        float expected = ref[b * dim + i];
+        switch (quant_type) {
+          case types::QuantType::kFloat32: {
+            float value = reinterpret_cast<const float*>(row)[i];
+            REQUIRE(std::abs(value - expected) < 1e-5);
+            break;
+          }
+          case types::QuantType::kFloat16: {
+            float value = reinterpret_cast<const core::Half*>(row)[i];
+            REQUIRE(std::abs(value - expected) < 1e-3);
+            break;
+          }
+          case types::QuantType::kInt8: {
+            float scale;
+            std::memcpy(&scale, row, sizeof(float));
+            auto q = reinterpret_cast<const int8_t*>(row + sizeof(float))[i];
+            REQUIRE(std::abs(q * scale - expected) <= scale / 2 + 1e-6);
+            break;
+          }
+          case types::QuantType::kBinary: {
+            bool bit = (row[i / 8] >> (7 - i % 8)) & 1;
+            REQUIRE(bit == (expected > 0.f));
+            break;
+          }
+          default:
+            FAIL("not an embedding output format");
+        }
+      }
+    }
+  }
+  // int4 is a weight precision only.
+  REQUIRE_THROWS(QuantizedBytes(dim, types::QuantType::kInt4));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
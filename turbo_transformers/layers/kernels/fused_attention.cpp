@@ -0,0 +1,399 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/fused_attention.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+// The query rows of a tile share the keys they multiply. Smaller tiles skip
+// more of the masked triangle, larger ones make larger GEMMs.
+constexpr int64_t kCausalTileRows = 32;
+// The keys of a decode chunk, its k and v rows stay in the L2 cache and long
+// caches still split in enough chunks to occupy the threads.
+constexpr int64_t kDecodeChunkKeys = 128;
+
+// The additive mask row of (batch, query), nullptr without a mask. The mask
+// has 1 or q_len rows of k_len per batch, whatever its rank.
+const float* MaskRow(const core::Tensor& att_mask, int64_t batch,
+                     int64_t query, int64_t k_len) {
+  if (att_mask.is_null()) {
+    return nullptr;
+  }
+  int64_t rows = att_mask.numel() / (att_mask.shape(0) * k_len);
+  return att_mask.data<float>() +
+         (batch * rows + (rows == 1 ? 0 : query)) * k_len;
+}
+// dots[i] = q . k_i of the 4 consecutive key rows k_0 ... k_3 at k.
+void DotFourKeys(const float* q, const float* k, int64_t size_per_head,
+                 float* dots) {
+#if defined(__AVX2__) && defined(__FMA__)
+  if (size_per_head % 8 == 0) {
+    __m256 acc[4];
+    for (int i = 0; i < 4; ++i) {
+      acc[i] = _mm256_setzero_ps();
+    }
+    for (int64_t d = 0; d < size_per_head; d += 8) {
+      __m256 q_vec = _mm256_loadu_ps(q + d);
+      for (int i = 0; i < 4; ++i) {
+        acc[i] = _mm256_fmadd_ps(
+            q_vec, _mm256_loadu_ps(k + i * size_per_head + d), acc[i]);
+      }
+    }
+    // the lanes of the 4 sums, then their two halves
+    __m256 sums = _mm256_hadd_ps(_mm256_hadd_ps(acc[0], acc[1]),
+                                 _mm256_hadd_ps(acc[2], acc[3]));
+    _mm_storeu_ps(dots, _mm_add_ps(_mm256_castps256_ps128(sums),
+                                   _mm256_extractf128_ps(sums, 1)));
+    return;
+  }
+#endif
+  for (int i = 0; i < 4; ++i) {
+    const float* k_row = k + i * size_per_head;
+    float dot = 0;
+#pragma omp simd reduction(+ : dot)
+    for (int64_t d = 0; d < size_per_head; ++d) {
+      dot += q[d] * k_row[d];
+    }
+    dots[i] = dot;
+  }
+}
+
+// acc += sum_j p[j] * v_j over the n consecutive value rows at v.
+void AccumulateRows(const float* p, const float* v, int64_t n,
+                    int64_t size_per_head, float* acc) {
+#if defined(__AVX2__) && defined(__FMA__)
+  if (size_per_head % 32 == 0) {
+    // 32 columns stay in registers for all the rows
+    for (int64_t d = 0; d < size_per_head; d += 32) {
+      __m256 sums[4];
+      for (int i = 0; i < 4; ++i) {
+        sums[i] = _mm256_loadu_ps(acc + d + 8 * i);
+      }
+      for (int64_t j = 0; j < n; ++j) {
+        __m256 weight = _mm256_set1_ps(p[j]);
+        const float* v_row = v + j * size_per_head + d;
+        for (int i = 0; i < 4; ++i) {
+          sums[i] = _mm256_fmadd_ps(weight, _mm256_loadu_ps(v_row + 8 * i),
+                                    sums[i]);
+        }
+      }
+      for (int i = 0; i < 4; ++i) {
+        _mm256_storeu_ps(acc + d + 8 * i, sums[i]);
+      }
+    }
+    return;
+  }
+#endif
+  for (int64_t j = 0; j < n; ++j) {
+    const float* v_row = v + j * size_per_head;
+#pragma omp simd
+    for (int64_t d = 0; d < size_per_head; ++d) {
+      acc[d] += p[j] * v_row[d];
+    }
+  }
+}
+}  // namespace
+
+void CausalAttention(const core::Tensor& q, const core::Tensor& k,
+                     const core::Tensor& v, const core::Tensor& att_mask,
+                     float scale, core::Tensor* att_score,
+                     core::Tensor* context, const std::string& name) {
+  TT_TRACE_KERNEL(name, q);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, q.device_type());
+#endif
+  TT_ENFORCE(q.device_type() == kDLCPU && k.device_type() == kDLCPU &&
+                 v.device_type() == kDLCPU,
+             "CausalAttention only supports CPU");
+  TT_ENFORCE(q.n_dim() == 4 && k.n_dim() == 4 && v.n_dim() == 4,
+             "q, k and v should be (batch, heads, len, size_per_head)");
+  auto batch_size = q.shape(0), num_heads = q.shape(1), q_len = q.shape(2),
+       size_per_head = q.shape(3);
+  auto num_kv_heads = k.shape(1), k_len = k.shape(2);
+  TT_ENFORCE(k.shape(0) == batch_size && k.shape(3) == size_per_head &&
+                 v.numel() == k.numel(),
+             "k and v should be (batch, kv_heads, k_len, size_per_head)");
+  TT_ENFORCE(num_kv_heads > 0 && num_heads % num_kv_heads == 0,
+             "%d heads are not groups of %d kv heads", num_heads,
+             num_kv_heads);
+  TT_ENFORCE(k_len >= q_len,
+             "the %d queries should be the last of the %d positions", q_len,
+             k_len);
+  if (!att_mask.is_null()) {
+    int64_t rows = att_mask.numel() / (batch_size * k_len);
+    TT_ENFORCE(att_mask.device_type() == kDLCPU &&
+                   att_mask.shape(0) == batch_size &&
+                   att_mask.shape(-1) == k_len &&
+                   (rows == 1 || rows == q_len) &&
+                   att_mask.numel() == batch_size * rows * k_len,
+               "att_mask should be (batch, 1, k_len) or (batch, q_len, "
+               "k_len), possibly with a head dim of 1");
+  }
+  int64_t group = num_heads / num_kv_heads;
+  int64_t offset = k_len - q_len;
+
+  auto* q_ptr = q.data<float>();
+  auto* k_ptr = k.data<float>();
+  auto* v_ptr = v.data<float>();
+  auto* scores = att_score->Reshape<float>(
+      {batch_size, num_heads, q_len, k_len}, kDLCPU, 0, name + "/Reshape");
+  auto* out = context->Reshape<float>(
+      {batch_size, num_heads, q_len, size_per_head}, kDLCPU, 0,
+      name + "/Reshape");
+
+  auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+  int64_t batch = batch_size * num_heads;
+  std::vector<const float*> a_array(batch), b_array(batch);
+  std::vector<float*> c_array(batch);
+  for (int64_t row_begin = 0; row_begin < q_len; row_begin += kCausalTileRows) {
+    int64_t rows = std::min(kCausalTileRows, q_len - row_begin);
+    // the keys visible to the last query of the tile
+    int64_t n_keys = offset + row_begin + rows;
+
+    // scores = scale * q * k^T of the tile, written in place in att_score
+    for (int64_t i = 0; i < batch; ++i) {
+      int64_t kv_head = i / num_heads * num_kv_heads + i % num_heads / group;
+      a_array[i] = q_ptr + (i * q_len + row_begin) * size_per_head;
+      b_array[i] = k_ptr + kv_head * k_len * size_per_head;
+      c_array[i] = scores + (i * q_len + row_begin) * k_len;
+    }
+    backend->SgemmBatch(false, true, rows, n_keys, size_per_head, scale,
+                        a_array.data(), size_per_head, b_array.data(),
+                        size_per_head, 0.f, c_array.data(), k_len, batch);
+
+#pragma omp parallel for
+    for (int64_t r = 0; r < batch * rows; ++r) {
+      int64_t i = r / rows, query = row_begin + r % rows;
+      float* row = scores + (i * q_len + query) * k_len;
+      const float* mask =
+          MaskRow(att_mask, i / num_heads, query, k_len);
+      int64_t visible = offset + query + 1;
+      if (mask != nullptr) {
+#pragma omp simd
+        for (int64_t j = 0; j < visible; ++j) {
+          row[j] += mask[j];
+        }
+      }
+      float max_val = std::numeric_limits<float>::lowest();
+#pragma omp simd reduction(max : max_val)
+      for (int64_t j = 0; j < visible; ++j) {
+        max_val = std::max(max_val, row[j]);
+      }
+      float sum = 0;
+      for (int64_t j = 0; j < visible; ++j) {
+        row[j] = std::exp(row[j] - max_val);
+        sum += row[j];
+      }
+      float coef = 1.f / sum;
+#pragma omp simd
+      for (int64_t j = 0; j < visible; ++j) {
+        row[j] *= coef;
+      }
+      // the future keys, including those the tile GEMMs computed
+      std::fill(row + visible, row + k_len, 0.f);
+    }
+
+    // context = scores * v of the tile
+    for (int64_t i = 0; i < batch; ++i) {
+      int64_t kv_head = i / num_heads * num_kv_heads + i % num_heads / group;
+      a_array[i] = c_array[i];
+      b_array[i] = v_ptr + kv_head * k_len * size_per_head;
+      c_array[i] = out + (i * q_len + row_begin) * size_per_head;
+    }
+    backend->SgemmBatch(false, false, rows, size_per_head, n_keys, 1.f,
+                        a_array.data(), k_len, b_array.data(), size_per_head,
+                        0.f, c_array.data(), size_per_head, batch);
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, q.device_type());
+#endif
+}
+
+void DecodeAttention(const core::Tensor& q, const core::Tensor& k,
+                     const core::Tensor& v, const core::Tensor& att_mask,
+                     float scale, core::Tensor* att_score,
+                     core::Tensor* context, const std::string& name) {
+  TT_TRACE_KERNEL(name, q);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, q.device_type());
+#endif
+  TT_ENFORCE(q.device_type() == kDLCPU && k.device_type() == kDLCPU &&
+                 v.device_type() == kDLCPU,
+             "DecodeAttention only supports CPU");
+  TT_ENFORCE(q.n_dim() == 4 && k.n_dim() == 4 && v.n_dim() == 4,
+             "q, k and v should be (batch, heads, len, size_per_head)");
+  TT_ENFORCE_EQ(q.shape(2), 1, "DecodeAttention takes a single query");
+  auto batch_size = q.shape(0), num_heads = q.shape(1),
+       size_per_head = q.shape(3);
+  auto num_kv_heads = k.shape(1), k_len = k.shape(2);
+  TT_ENFORCE(k.shape(0) == batch_size && k.shape(3) == size_per_head &&
+                 v.numel() == k.numel(),
+             "k and v should be (batch, kv_heads, k_len, size_per_head)");
+  TT_ENFORCE(num_kv_heads > 0 && num_heads % num_kv_heads == 0,
+             "%d heads are not groups of %d kv heads", num_heads,
+             num_kv_heads);
+  const float* mask_ptr = nullptr;
+  if (!att_mask.is_null()) {
+    TT_ENFORCE(att_mask.device_type() == kDLCPU &&
+                   att_mask.numel() == batch_size * k_len,
+               "att_mask should be (batch, 1, k_len)");
+    mask_ptr = att_mask.data<float>();
+  }
+  int64_t group = num_heads / num_kv_heads;
+  int64_t num_chunks = (k_len + kDecodeChunkKeys - 1) / kDecodeChunkKeys;
+
+  auto* q_ptr = q.data<float>();
+  auto* k_ptr = k.data<float>();
+  auto* v_ptr = v.data<float>();
+  auto* scores = att_score->Reshape<float>({batch_size, num_heads, 1, k_len},
+                                           kDLCPU, 0, name + "/Reshape");
+  auto* out = context->Reshape<float>(
+      {batch_size, num_heads, 1, size_per_head}, kDLCPU, 0,
+      name + "/Reshape");
+
+  // every (head, chunk) keeps its max, the sum of its exponentials and its
+  // unnormalized context
+  int64_t part_size = size_per_head + 2;
+  core::Tensor parts_tensor(nullptr);
+  auto* parts = parts_tensor.Reshape<float>(
+      {batch_size * num_heads * num_chunks, part_size}, kDLCPU, 0,
+      name + "/Reshape");
+#pragma omp parallel for
+  for (int64_t item = 0; item < batch_size * num_kv_heads * num_chunks;
+       ++item) {
+    int64_t kv_head = item / num_chunks, chunk = item % num_chunks;
+    int64_t batch = kv_head / num_kv_heads;
+    int64_t begin = chunk * kDecodeChunkKeys;
+    int64_t end = std::min(begin + kDecodeChunkKeys, k_len);
+    const float* k_rows = k_ptr + kv_head * k_len * size_per_head;
+    const float* v_rows = v_ptr + kv_head * k_len * size_per_head;
+    const float* mask =
+        mask_ptr == nullptr ? nullptr : mask_ptr + batch * k_len;
+    // the query heads of the group, head = kv_head * group + g
+    int64_t first_head = kv_head * group;
+
+    for (int64_t g = 0; g < group; ++g) {
+      const float* q_row = q_ptr + (first_head + g) * size_per_head;
+      float* row = scores + (first_head + g) * k_len;
+      // 4 keys per pass over q
+      int64_t j = begin;
+      for (; j + 4 <= end; j += 4) {
+        DotFourKeys(q_row, k_rows + j * size_per_head, size_per_head,
+                    row + j);
+      }
+      for (; j < end; ++j) {
+        const float* k_row = k_rows + j * size_per_head;
+        float dot = 0;
+#pragma omp simd reduction(+ : dot)
+        for (int64_t d = 0; d < size_per_head; ++d) {
+          dot += q_row[d] * k_row[d];
+        }
+        row[j] = dot;
+      }
+      if (mask != nullptr) {
+#pragma omp simd
+        for (j = begin; j < end; ++j) {
+          row[j] = row[j] * scale + mask[j];
+        }
+      } else {
+#pragma omp simd
+        for (j = begin; j < end; ++j) {
+          row[j] *= scale;
+        }
+      }
+      float max_val = std::numeric_limits<float>::lowest();
+#pragma omp simd reduction(max : max_val)
+      for (j = begin; j < end; ++j) {
+        max_val = std::max(max_val, row[j]);
+      }
+#pragma omp simd
+      for (j = begin; j < end; ++j) {
+        row[j] = std::exp(row[j] - max_val);
+      }
+      float sum = 0;
+#pragma omp simd reduction(+ : sum)
+      for (j = begin; j < end; ++j) {
+        sum += row[j];
+      }
+      float* part = parts + ((first_head + g) * num_chunks + chunk) * part_size;
+      part[0] = max_val;
+      part[1] = sum;
+      std::fill(part + 2, part + part_size, 0.f);
+    }
+    // the v rows of the chunk stay cached for the heads of the group
+    for (int64_t g = 0; g < group; ++g) {
+      AccumulateRows(
+          scores + (first_head + g) * k_len + begin,
+          v_rows + begin * size_per_head, end - begin, size_per_head,
+          parts + ((first_head + g) * num_chunks + chunk) * part_size + 2);
+    }
+  }
+
+  // rescale the chunks of every head to the global max and sum
+#pragma omp parallel for
+  for (int64_t head = 0; head < batch_size * num_heads; ++head) {
+    const float* head_parts = parts + head * num_chunks * part_size;
+    float max_val = std::numeric_limits<float>::lowest();
+    for (int64_t c = 0; c < num_chunks; ++c) {
+      max_val = std::max(max_val, head_parts[c * part_size]);
+    }
+    float sum = 0;
+    for (int64_t c = 0; c < num_chunks; ++c) {
+      sum += head_parts[c * part_size + 1] *
+             std::exp(head_parts[c * part_size] - max_val);
+    }
+    float* row = scores + head * k_len;
+    float* dst = out + head * size_per_head;
+    std::fill(dst, dst + size_per_head, 0.f);
+    for (int64_t c = 0; c < num_chunks; ++c) {
+      const float* part = head_parts + c * part_size;
+      float coef = std::exp(part[0] - max_val) / sum;
+#pragma omp simd
+      for (int64_t d = 0; d < size_per_head; ++d) {
+        dst[d] += coef * part[d + 2];
+      }
+      int64_t end = std::min((c + 1) * kDecodeChunkKeys, k_len);
+#pragma omp simd
+      for (int64_t j = c * kDecodeChunkKeys; j < end; ++j) {
+        row[j] *= coef;
+      }
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, q.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
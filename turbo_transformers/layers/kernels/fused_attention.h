@@ -0,0 +1,64 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// Causal attention: the query i, the last q_len of the k_len positions,
+// attends the keys 0 ... k_len - q_len + i only. The causal mask is implicit
+// and the scores and contexts are computed in row tiles over the keys up to
+// the end of the tile, skipping the masked upper triangle.
+// q: (batch_size, num_heads, q_len, size_per_head)
+// k, v: (batch_size, num_kv_heads, k_len, size_per_head), num_heads a
+// multiple of num_kv_heads (grouped-query attention).
+// att_mask: the additive padding mask, (batch_size, 1, k_len),
+// (batch_size, q_len, k_len), the same with a head dim of 1, e.g.
+// (batch_size, 1, q_len, k_len), or empty.
+// att_score: (batch_size, num_heads, q_len, k_len) probabilities, 0 above
+// the diagonal.
+// context: (batch_size, num_heads, q_len, size_per_head)
+void CausalAttention(const core::Tensor& q, const core::Tensor& k,
+                     const core::Tensor& v, const core::Tensor& att_mask,
+                     float scale, core::Tensor* att_score,
+                     core::Tensor* context,
+                     const std::string& name = "CausalAttention");
+
+// Single-query attention of a decoding step, the query attends all k_len
+// keys. The keys of every (batch, kv head) are split in chunks processed in
+// parallel: a chunk reads its k and v rows once for all the queries of the
+// group, and accumulates the v rows weighted by the softmax local to it.
+// The chunk maxima and sums are merged at the end (online softmax), so no
+// (q_len x k_len) GEMM nor pointer array is set up.
+// q: (batch_size, num_heads, 1, size_per_head)
+// k, v: (batch_size, num_kv_heads, k_len, size_per_head), num_heads a
+// multiple of num_kv_heads.
+// att_mask: the additive mask, batch_size * k_len values ((batch_size, 1,
+// k_len) or (batch_size, k_len)) or empty.
+// att_score: (batch_size, num_heads, 1, k_len) probabilities.
+// context: (batch_size, num_heads, 1, size_per_head)
+void DecodeAttention(const core::Tensor& q, const core::Tensor& k,
+                     const core::Tensor& v, const core::Tensor& att_mask,
+                     float scale, core::Tensor* att_score,
+                     core::Tensor* context,
+                     const std::string& name = "DecodeAttention");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
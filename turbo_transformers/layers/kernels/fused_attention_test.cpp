@@ -0,0 +1,187 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/fused_attention.h"
+
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/softmax.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+// k or v with every kv head repeated for the query heads of its group.
+core::Tensor RepeatKVHeads(const core::Tensor& kv, int64_t group) {
+  auto batch_size = kv.shape(0), num_kv_heads = kv.shape(1),
+       len = kv.shape(2), size_per_head = kv.shape(3);
+  core::Tensor out(nullptr);
+  auto* dst = out.Reshape<float>(
+      {batch_size, num_kv_heads * group, len, size_per_head}, kDLCPU, 0);
+  int64_t head_size = len * size_per_head;
+  int64_t num_heads = num_kv_heads * group;
+  for (int64_t i = 0; i < batch_size * num_heads; ++i) {
+    int64_t src_head = i / num_heads * num_kv_heads + i % num_heads / group;
+    std::copy(kv.data<float>() + src_head * head_size,
+              kv.data<float>() + (src_head + 1) * head_size,
+              dst + i * head_size);
+  }
+  return out;
+}
+}  // namespace
+
+TEST_CASE("fused-attention-causal-cpu") {
+  constexpr int64_t batch_size = 2, num_heads = 4, size_per_head = 16;
+  // (q_len, k_len, num_kv_heads), past keys when k_len > q_len.
+  std::vector<std::vector<int64_t>> cases{{1, 1, 4},   {5, 5, 4},
+                                          {33, 33, 2}, {70, 70, 1},
+                                          {40, 47, 4}, {3, 100, 2}};
+  for (auto& c : cases) {
+    int64_t q_len = c[0], k_len = c[1], num_kv_heads = c[2];
+    for (bool padding : {false, true}) {
+      auto q = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_heads, q_len, size_per_head}, kDLCPU, 0);
+      auto k = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_kv_heads, k_len, size_per_head}, kDLCPU, 0);
+      auto v = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_kv_heads, k_len, size_per_head}, kDLCPU, 0);
+      float scale = 1.f / std::sqrt(static_cast<float>(size_per_head));
+      // the last position of the second sequence is padding, no query
+      // attends padding only.
+      padding = padding && k_len > 1;
+      core::Tensor padding_mask(nullptr);
+      if (padding) {
+        auto* mask = padding_mask.Reshape<float>({batch_size, 1, k_len},
+                                                 kDLCPU, 0);
+        std::fill(mask, mask + batch_size * k_len, 0.f);
+        mask[2 * k_len - 1] = -1e18f;
+      }
+
+      core::Tensor score(nullptr), context(nullptr);
+      CausalAttention(q, k, v, padding_mask, scale, &score, &context);
+
+      // the dense attention with the explicit causal mask
+      core::Tensor mask(nullptr), expected_score(nullptr), expected(nullptr);
+      auto* mask_ptr =
+          mask.Reshape<float>({batch_size, q_len, k_len}, kDLCPU, 0);
+      for (int64_t b = 0; b < batch_size; ++b) {
+        for (int64_t i = 0; i < q_len; ++i) {
+          for (int64_t j = 0; j < k_len; ++j) {
+            float value = j > k_len - q_len + i ? -1e18f : 0.f;
+            if (padding && b == 1 && j == k_len - 1) {
+              value = -1e18f;
+            }
+            mask_ptr[(b * q_len + i) * k_len + j] = value;
+          }
+        }
+      }
+      auto full_k = RepeatKVHeads(k, num_heads / num_kv_heads);
+      auto full_v = RepeatKVHeads(v, num_heads / num_kv_heads);
+      expected_score.Reshape<float>({batch_size, num_heads, q_len, k_len},
+                                    kDLCPU, 0);
+      BatchMatMul(q, false, full_k, true, scale, &expected_score, 0.f);
+      ApplyMaskAndSoftmax(&expected_score, mask, 1.f);
+      expected.Reshape<float>({batch_size, num_heads, q_len, size_per_head},
+                              kDLCPU, 0);
+      BatchMatMul(expected_score, false, full_v, false, 1.f, &expected, 0.f);
+
+      REQUIRE(score.numel() == expected_score.numel());
+      for (int64_t i = 0; i < score.numel(); ++i) {
+        REQUIRE(std::abs(score.data<float>()[i] -
+                         expected_score.data<float>()[i]) < 1e-5);
+      }
+      REQUIRE(context.numel() == expected.numel());
+      for (int64_t i = 0; i < context.numel(); ++i) {
+        REQUIRE(std::abs(context.data<float>()[i] -
+                         expected.data<float>()[i]) < 1e-4);
+      }
+
+      // the per query mask of rank 4, (batch_size, 1, q_len, k_len).
+      core::Tensor mask4(nullptr);
+      std::copy(mask_ptr, mask_ptr + mask.numel(),
+                mask4.Reshape<float>({batch_size, 1, q_len, k_len}, kDLCPU,
+                                     0));
+      CausalAttention(q, k, v, mask4, scale, &score, &context);
+      for (int64_t i = 0; i < context.numel(); ++i) {
+        REQUIRE(std::abs(context.data<float>()[i] -
+                         expected.data<float>()[i]) < 1e-4);
+      }
+    }
+  }
+}
+
+TEST_CASE("fused-attention-decode-cpu") {
+  constexpr int64_t batch_size = 2, num_heads = 4, size_per_head = 32;
+  // (k_len, num_kv_heads), one and several chunks of keys.
+  std::vector<std::vector<int64_t>> cases{
+      {1, 4}, {7, 2}, {128, 4}, {129, 1}, {300, 2}, {1000, 4}};
+  for (auto& c : cases) {
+    int64_t k_len = c[0], num_kv_heads = c[1];
+    for (bool padding : {false, true}) {
+      auto q = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_heads, 1, size_per_head}, kDLCPU, 0);
+      auto k = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_kv_heads, k_len, size_per_head}, kDLCPU, 0);
+      auto v = common::CreateTensorAndFillRandom<float>(
+          {batch_size, num_kv_heads, k_len, size_per_head}, kDLCPU, 0);
+      float scale = 1.f / std::sqrt(static_cast<float>(size_per_head));
+      // the second sequence is left padded by its first 130 positions at
+      // most, whole chunks of keys are masked.
+      padding = padding && k_len > 1;
+      core::Tensor mask(nullptr);
+      if (padding) {
+        auto* mask_ptr = mask.Reshape<float>({batch_size, 1, k_len}, kDLCPU,
+                                             0);
+        std::fill(mask_ptr, mask_ptr + batch_size * k_len, 0.f);
+        std::fill(mask_ptr + k_len,
+                  mask_ptr + k_len + std::min<int64_t>(130, k_len - 1),
+                  -1e18f);
+      }
+
+      core::Tensor score(nullptr), context(nullptr);
+      DecodeAttention(q, k, v, mask, scale, &score, &context);
+
+      core::Tensor expected_score(nullptr), expected(nullptr);
+      auto full_k = RepeatKVHeads(k, num_heads / num_kv_heads);
+      auto full_v = RepeatKVHeads(v, num_heads / num_kv_heads);
+      expected_score.Reshape<float>({batch_size, num_heads, 1, k_len}, kDLCPU,
+                                    0);
+      BatchMatMul(q, false, full_k, true, scale, &expected_score, 0.f);
+      ApplyMaskAndSoftmax(&expected_score, mask, 1.f);
+      expected.Reshape<float>({batch_size, num_heads, 1, size_per_head},
+                              kDLCPU, 0);
+      BatchMatMul(expected_score, false, full_v, false, 1.f, &expected, 0.f);
+
+      REQUIRE(score.numel() == expected_score.numel());
+      for (int64_t i = 0; i < score.numel(); ++i) {
+        REQUIRE(std::abs(score.data<float>()[i] -
+                         expected_score.data<float>()[i]) < 1e-5);
+      }
+      REQUIRE(context.numel() == expected.numel());
+      for (int64_t i = 0; i < context.numel(); ++i) {
+        REQUIRE(std::abs(context.data<float>()[i] -
+                         expected.data<float>()[i]) < 1e-4);
+      }
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,310 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/int4_mat_mul.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/half.h"
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+// The inputs of more rows dequantize the weight and run a float GEMM.
+constexpr int64_t kMaxGemvRows = 8;
+// The rows a GEMV pass reads the weight for.
+constexpr int64_t kGemvBlockRows = 4;
+// The outputs dequantized at once by the GEMM path.
+constexpr int64_t kDequantizeCols = 128;
+
+// Quantizes the n weights of a group, stride apart in src, to nibbles in
+// [0, 15] written to q, and returns the scale and the zero point.
+void QuantizeGroup(const float* src, int64_t n, int64_t stride, uint8_t* q,
+                   float* scale, float* zero) {
+  // the range includes 0, so the zero point is an integer in [0, 15].
+  float min_value = 0.f, max_value = 0.f;
+  for (int64_t i = 0; i < n; ++i) {
+    min_value = std::min(min_value, src[i * stride]);
+    max_value = std::max(max_value, src[i * stride]);
+  }
+  // the scale is stored in fp16, the dequantization uses the rounded one.
+  float s = static_cast<float>(core::Half((max_value - min_value) / 15.f));
+  if (s <= 0.f) {
+    s = 1.f;
+  }
+  float z = std::min(15.f, std::max(0.f, std::nearbyint(-min_value / s)));
+  for (int64_t i = 0; i < n; ++i) {
+    float v = std::nearbyint(src[i * stride] / s + z);
+    q[i] = static_cast<uint8_t>(std::min(15.f, std::max(0.f, v)));
+  }
+  *scale = s;
+  *zero = z;
+}
+
+// Fills dst (n_cols, in_dim) with the float rows [j0, j0 + n_cols) of the
+// weight.
+void Dequantize(const Int4Weight& weight, int64_t j0, int64_t n_cols,
+                float* dst) {
+  int64_t in_dim = weight.in_dim(), group_size = weight.group_size;
+  int64_t n_groups = in_dim / group_size;
+  auto* packed = weight.weight.data<uint8_t>();
+  auto* scales = weight.scales.data<core::Half>();
+  auto* zeros = weight.zeros.data<core::Half>();
+#pragma omp parallel for
+  for (int64_t c = 0; c < n_cols; ++c) {
+    int64_t j = j0 + c;
+    for (int64_t g = 0; g < n_groups; ++g) {
+      float s = scales[j * n_groups + g];
+      float z = zeros[j * n_groups + g];
+      for (int64_t i = g * group_size; i < (g + 1) * group_size; i += 2) {
+        uint8_t byte = packed[j * in_dim / 2 + i / 2];
+        dst[c * in_dim + i] = ((byte & 0x0F) - z) * s;
+        dst[c * in_dim + i + 1] = ((byte >> 4) - z) * s;
+      }
+    }
+  }
+}
+
+// y[r][j] for kRows rows of x and the output j, given the sums of every
+// group of the rows in x_sums (kRows, n_groups):
+//   sum_g scale_g * (dot(x_g, q_g) - zero_g * sum(x_g))
+template <int64_t kRows>
+void Int4Dot(const float* x, const float* x_sums, const Int4Weight& weight,
+             int64_t j, float* y, int64_t ldy) {
+  int64_t in_dim = weight.in_dim(), group_size = weight.group_size;
+  int64_t n_groups = in_dim / group_size;
+  auto* packed = weight.weight.data<uint8_t>() + j * in_dim / 2;
+  auto* scales = weight.scales.data<core::Half>() + j * n_groups;
+  auto* zeros = weight.zeros.data<core::Half>() + j * n_groups;
+  float corrections[kRows] = {0.f};
+#if defined(__AVX2__) && defined(__FMA__)
+  const __m128i low_mask = _mm_set1_epi8(0x0F);
+  __m256 acc[kRows];
+  for (int64_t r = 0; r < kRows; ++r) {
+    acc[r] = _mm256_setzero_ps();
+  }
+  for (int64_t g = 0; g < n_groups; ++g) {
+    __m256 group_acc[kRows];
+    for (int64_t r = 0; r < kRows; ++r) {
+      group_acc[r] = _mm256_setzero_ps();
+    }
+    for (int64_t i = g * group_size; i < (g + 1) * group_size; i += 32) {
+      // 16 bytes are 32 nibbles, interleaving the low and the high nibbles
+      // restores the order of the input channels.
+      __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + i / 2));
+      __m128i lo = _mm_and_si128(bytes, low_mask);
+      __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask);
+      __m128i q0 = _mm_unpacklo_epi8(lo, hi);
+      __m128i q1 = _mm_unpackhi_epi8(lo, hi);
+      __m256 w[4] = {
+          _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q0)),
+          _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(q0, 8))),
+          _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q1)),
+          _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(q1, 8)))};
+      for (int64_t r = 0; r < kRows; ++r) {
+        const float* xr = x + r * in_dim + i;
+        for (int k = 0; k < 4; ++k) {
+          group_acc[r] = _mm256_fmadd_ps(_mm256_loadu_ps(xr + 8 * k), w[k],
+                                         group_acc[r]);
+        }
+      }
+    }
+    float s = scales[g], z = zeros[g];
+    __m256 vs = _mm256_set1_ps(s);
+    for (int64_t r = 0; r < kRows; ++r) {
+      acc[r] = _mm256_fmadd_ps(group_acc[r], vs, acc[r]);
+      corrections[r] += s * z * x_sums[r * n_groups + g];
+    }
+  }
+  for (int64_t r = 0; r < kRows; ++r) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc[r]),
+                            _mm256_extractf128_ps(acc[r], 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    y[r * ldy] = _mm_cvtss_f32(sum) - corrections[r];
+  }
+#else
+  float acc[kRows] = {0.f};
+  for (int64_t g = 0; g < n_groups; ++g) {
+    float group_acc[kRows] = {0.f};
+    for (int64_t i = g * group_size; i < (g + 1) * group_size; i += 2) {
+      uint8_t byte = packed[i / 2];
+      for (int64_t r = 0; r < kRows; ++r) {
+        group_acc[r] += x[r * in_dim + i] * (byte & 0x0F) +
+                        x[r * in_dim + i + 1] * (byte >> 4);
+      }
+    }
+    float s = scales[g], z = zeros[g];
+    for (int64_t r = 0; r < kRows; ++r) {
+      acc[r] += group_acc[r] * s;
+      corrections[r] += s * z * x_sums[r * n_groups + g];
+    }
+  }
+  for (int64_t r = 0; r < kRows; ++r) {
+    y[r * ldy] = acc[r] - corrections[r];
+  }
+#endif
+}
+
+void Int4Gemv(const float* x, int64_t rows, const Int4Weight& weight,
+              float* y) {
+  int64_t in_dim = weight.in_dim(), out_dim = weight.out_dim();
+  int64_t n_groups = in_dim / weight.group_size;
+  std::vector<float> x_sums(rows * n_groups);
+  for (int64_t r = 0; r < rows; ++r) {
+    for (int64_t g = 0; g < n_groups; ++g) {
+      auto* begin = x + r * in_dim + g * weight.group_size;
+      x_sums[r * n_groups + g] =
+          std::accumulate(begin, begin + weight.group_size, 0.f);
+    }
+  }
+#pragma omp parallel for
+  for (int64_t j = 0; j < out_dim; ++j) {
+    for (int64_t r = 0; r < rows; r += kGemvBlockRows) {
+      auto* xr = x + r * in_dim;
+      auto* sums = x_sums.data() + r * n_groups;
+      switch (std::min(kGemvBlockRows, rows - r)) {
+        case 4:
+          Int4Dot<4>(xr, sums, weight, j, y + r * out_dim + j, out_dim);
+          break;
+        case 3:
+          Int4Dot<3>(xr, sums, weight, j, y + r * out_dim + j, out_dim);
+          break;
+        case 2:
+          Int4Dot<2>(xr, sums, weight, j, y + r * out_dim + j, out_dim);
+          break;
+        default:
+          Int4Dot<1>(xr, sums, weight, j, y + r * out_dim + j, out_dim);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int64_t DefaultInt4GroupSize(int64_t in_dim) {
+  for (int64_t group_size : {128, 64, 32}) {
+    if (in_dim % group_size == 0) {
+      return group_size;
+    }
+  }
+  return 0;
+}
+
+void QuantizeWeightInt4(const core::Tensor& weight, bool trans_weight,
+                        int64_t group_size, Int4Weight* quantized,
+                        const std::string name) {
+  TT_TRACE_KERNEL(name, weight);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, weight.device_type());
+#endif
+  TT_ENFORCE(weight.device_type() == kDLCPU,
+             "QuantizeWeightInt4 only supports CPU");
+  TT_ENFORCE_EQ(weight.n_dim(), 2, "weight must be a matrix");
+  int64_t in_dim = trans_weight ? weight.shape(1) : weight.shape(0);
+  int64_t out_dim = trans_weight ? weight.shape(0) : weight.shape(1);
+  TT_ENFORCE(group_size > 0 && group_size % 32 == 0 &&
+                 in_dim % group_size == 0,
+             "the group size %d must be a multiple of 32 dividing %d",
+             group_size, in_dim);
+  int64_t n_groups = in_dim / group_size;
+  auto* src = weight.data<float>();
+  auto* packed = quantized->weight.Reshape<uint8_t>(
+      {out_dim, in_dim / 2}, kDLCPU, 0, name + "/weight");
+  auto* scales = quantized->scales.Reshape<core::Half>(
+      {out_dim, n_groups}, kDLCPU, 0, name + "/scales");
+  auto* zeros = quantized->zeros.Reshape<core::Half>(
+      {out_dim, n_groups}, kDLCPU, 0, name + "/zeros");
+  quantized->group_size = group_size;
+#pragma omp parallel for
+  for (int64_t j = 0; j < out_dim; ++j) {
+    std::vector<uint8_t> q(group_size);
+    for (int64_t g = 0; g < n_groups; ++g) {
+      int64_t i0 = g * group_size;
+      float scale, zero;
+      if (trans_weight) {
+        QuantizeGroup(src + j * in_dim + i0, group_size, 1, q.data(), &scale,
+                      &zero);
+      } else {
+        QuantizeGroup(src + i0 * out_dim + j, group_size, out_dim, q.data(),
+                      &scale, &zero);
+      }
+      scales[j * n_groups + g] = core::Half(scale);
+      zeros[j * n_groups + g] = core::Half(zero);
+      for (int64_t i = 0; i < group_size; i += 2) {
+        packed[j * in_dim / 2 + (i0 + i) / 2] =
+            static_cast<uint8_t>(q[i] | (q[i + 1] << 4));
+      }
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, weight.device_type());
+#endif
+}
+
+void Int4MatMul(const core::Tensor& input, const Int4Weight& weight,
+                core::Tensor* output, const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE(input.device_type() == kDLCPU && output->device_type() == kDLCPU,
+             "Int4MatMul only supports CPU");
+  TT_ENFORCE(!weight.is_null(), "Int4MatMul needs a quantized weight");
+  int64_t in_dim = weight.in_dim();
+  int64_t out_dim = weight.out_dim();
+  TT_ENFORCE_EQ(input.shape(-1), in_dim, "input has %d features, weight %d",
+                input.shape(-1), in_dim);
+  int64_t rows = input.numel() / in_dim;
+  TT_ENFORCE_EQ(output->numel(), rows * out_dim, "output shape mismatch");
+  auto* x = input.data<float>();
+  auto* y = output->mutableData<float>();
+  if (rows <= kMaxGemvRows) {
+    Int4Gemv(x, rows, weight, y);
+  } else {
+    static thread_local std::vector<float> block;
+    block.resize(kDequantizeCols * in_dim);
+    auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+    for (int64_t j0 = 0; j0 < out_dim; j0 += kDequantizeCols) {
+      int64_t n_cols = std::min(kDequantizeCols, out_dim - j0);
+      Dequantize(weight, j0, n_cols, block.data());
+      backend->Sgemm(false, true, rows, n_cols, in_dim, 1.f, x, in_dim,
+                     block.data(), in_dim, 0.f, y + j0, out_dim);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,66 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// A weight-only int4 copy of a float weight, for the GEMMs of small batches
+// which are bound by the bandwidth of the weights. The input channels of an
+// output are quantized asymmetrically in groups of group_size, and the
+// weight stays 4-bit in memory, it is dequantized by the GEMM kernel.
+// weight: (out_dim, in_dim / 2) uint8, byte k of a row holds input channel
+// 2k in its low nibble and 2k + 1 in its high nibble.
+// scales, zeros: (out_dim, in_dim / group_size) core::Half,
+// weight_fp32[j][i] ~= (q[j][i] - zeros[j][g]) * scales[j][g], g = i /
+// group_size, the zero points are integers in [0, 15].
+struct Int4Weight {
+  core::Tensor weight{nullptr};
+  core::Tensor scales{nullptr};
+  core::Tensor zeros{nullptr};
+  int64_t group_size{0};
+
+  bool is_null() const { return weight.is_null(); }
+  int64_t in_dim() const { return weight.shape(1) * 2; }
+  int64_t out_dim() const { return weight.shape(0); }
+};
+
+// The largest of 128, 64 and 32 dividing in_dim, 0 if none does.
+int64_t DefaultInt4GroupSize(int64_t in_dim);
+
+// Quantizes a float weight to int4, group_size must be a multiple of 32
+// dividing in_dim.
+// weight: (in_dim, out_dim) float, or (out_dim, in_dim) when trans_weight, the
+// same layout MatMul takes as its second operand.
+void QuantizeWeightInt4(const core::Tensor& weight, bool trans_weight,
+                        int64_t group_size, Int4Weight* quantized,
+                        const std::string name = "QuantizeWeightInt4");
+
+// output = input * dequantize(weight)
+// input: (..., in_dim) float, output: numel = rows * out_dim float, reshaped
+// by the caller. Up to a few rows, a GEMV kernel dequantizes the weight in
+// registers and the input stays float. Larger inputs dequantize blocks of
+// the weight and run the float GEMM of the backend of name on them.
+void Int4MatMul(const core::Tensor& input, const Int4Weight& weight,
+                core::Tensor* output, const std::string name = "Int4MatMul");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
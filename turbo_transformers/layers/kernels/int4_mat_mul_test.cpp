@@ -0,0 +1,92 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/int4_mat_mul.h"
+
+#include <cmath>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/core/half.h"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// the float weight (in_dim, out_dim) the int4 one stands for.
+static core::Tensor Dequantized(const Int4Weight& quantized) {
+  int64_t in_dim = quantized.in_dim(), out_dim = quantized.out_dim();
+  int64_t n_groups = in_dim / quantized.group_size;
+  auto weight = common::CreateTensor<float>({in_dim, out_dim}, kDLCPU, 0);
+  for (int64_t j = 0; j < out_dim; ++j) {
+    for (int64_t i = 0; i < in_dim; ++i) {
+      uint8_t byte = quantized.weight.data<uint8_t>()[j * in_dim / 2 + i / 2];
+      int q = i % 2 == 0 ? byte & 0x0F : byte >> 4;
+      int64_t g = j * n_groups + i / quantized.group_size;
+      float scale = quantized.scales.data<core::Half>()[g];
+      float zero = quantized.zeros.data<core::Half>()[g];
+      weight.mutableData<float>()[i * out_dim + j] = (q - zero) * scale;
+    }
+  }
+  return weight;
+}
+
+TEST_CASE("int4-matmul-cpu") {
+  int64_t in_dim = 192, out_dim = 40;
+  REQUIRE(DefaultInt4GroupSize(in_dim) == 64);
+  REQUIRE(DefaultInt4GroupSize(100) == 0);
+  for (bool trans_weight : {false, true}) {
+    auto weight =
+        trans_weight
+            ? common::CreateTensorAndFillRandom<float>({out_dim, in_dim},
+                                                       kDLCPU, 0)
+            : common::CreateTensorAndFillRandom<float>({in_dim, out_dim},
+                                                       kDLCPU, 0);
+    Int4Weight quantized;
+    REQUIRE_THROWS(QuantizeWeightInt4(weight, trans_weight, 48, &quantized));
+    QuantizeWeightInt4(weight, trans_weight, 64, &quantized);
+    REQUIRE(quantized.in_dim() == in_dim);
+    REQUIRE(quantized.out_dim() == out_dim);
+    auto dequantized = Dequantized(quantized);
+
+    // the GEMV rows and the dequantizing GEMM
+    for (int64_t rows : {1, 3, 6, 20}) {
+      auto input =
+          common::CreateTensorAndFillRandom<float>({rows, in_dim}, kDLCPU, 0);
+      auto expected = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      auto exact = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      auto output = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      MatMul(input, false, dequantized, false, 1.0, &expected, 0.0);
+      MatMul(input, false, weight, trans_weight, 1.0, &exact, 0.0);
+      Int4MatMul(input, quantized, &output);
+
+      double dot = 0, norm_y = 0, norm_e = 0;
+      for (int64_t i = 0; i < output.numel(); ++i) {
+        float y = output.data<float>()[i], e = expected.data<float>()[i];
+        REQUIRE(std::abs(y - e) < 1e-3 * (1 + std::abs(e)));
+        float x = exact.data<float>()[i];
+        dot += y * x;
+        norm_y += y * y;
+        norm_e += x * x;
+      }
+      // the accuracy of 4 bits against the float weight
+      REQUIRE(dot / std::sqrt(norm_y * norm_e) > 0.99);
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -15,6 +15,7 @@
 
 #include "common.h"
 #include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_device_context.h"
 #include "turbo_transformers/layers/kernels/common.h"
@@ -32,6 +33,7 @@ namespace kernels {
 template <typename T>
 void LayerNorm(const core::Tensor& gamma, const core::Tensor& beta,
                core::Tensor* out_tensor, T eps, const std::string name) {
+  TT_TRACE_KERNEL(name, *out_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, out_tensor->device_type());
@@ -50,8 +52,14 @@ void LayerNorm(const core::Tensor& gamma, const core::Tensor& beta,
   const auto beta_ptr = beta.data<T>();
 
   if (out_tensor->device_type() == kDLCPU) {
+#ifdef WITH_PERFTOOLS
+    core::ParallelRegionProfile region(name);
+#endif
 #pragma omp parallel for
     for (int64_t batch_idx = 0; batch_idx < batch_size; ++batch_idx) {
+#ifdef WITH_PERFTOOLS
+      core::ParallelChunkProfile chunk(&region);
+#endif
       T mean = 0;
       T var = 0;
       auto start_idx = batch_idx * feature_dim;
@@ -101,6 +109,7 @@ void AddBiasLayerNorm(const core::Tensor& input_tensor,
                       const core::Tensor& gamma_tensor,
                       const core::Tensor& beta_tensor, core::Tensor* out_tensor,
                       T eps, const std::string name) {
+  TT_TRACE_KERNEL(name, input_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input_tensor.device_type());
@@ -140,8 +149,14 @@ void AddBiasLayerNorm(const core::Tensor& input_tensor,
   TT_ENFORCE(common::is_same_shape(input_tensor, *out_tensor),
              "The shape of the input_tensor and out_tensor is not equal.");
   if (input_tensor.device_type() == kDLCPU) {
+#ifdef WITH_PERFTOOLS
+    core::ParallelRegionProfile region(name);
+#endif
 #pragma omp parallel for
     for (int64_t batch_idx = 0; batch_idx < m; ++batch_idx) {
+#ifdef WITH_PERFTOOLS
+      core::ParallelChunkProfile chunk(&region);
+#endif
       T mean = 0;
       T var = 0;
 #pragma omp simd reduction(+ : mean, var)
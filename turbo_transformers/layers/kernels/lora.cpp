@@ -0,0 +1,110 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/lora.h"
+
+#include <cstring>
+
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+void GroupedLoRA(const core::Tensor& input, const core::Tensor& row_adapter,
+                 const std::vector<const core::Tensor*>& lora_a,
+                 const std::vector<const core::Tensor*>& lora_b,
+                 const std::vector<float>& scales, core::Tensor* output,
+                 const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE(input.device_type() == kDLCPU && output->device_type() == kDLCPU,
+             "GroupedLoRA only supports CPU");
+  int64_t in_dim = input.shape(-1);
+  int64_t rows = input.numel() / in_dim;
+  TT_ENFORCE_EQ(row_adapter.numel(), rows,
+                "row_adapter has %d rows, the input has %d",
+                row_adapter.numel(), rows);
+  TT_ENFORCE_EQ(output->numel() % rows, 0, "output shape mismatch");
+  int64_t out_dim = output->numel() / rows;
+  int64_t n_adapters = lora_a.size();
+  TT_ENFORCE(lora_b.size() == lora_a.size() && scales.size() == lora_a.size(),
+             "lora_a, lora_b and scales must have the same size");
+
+  // bucket the rows by adapter
+  std::vector<std::vector<int64_t>> adapter_rows(n_adapters);
+  auto* adapter_ids = row_adapter.data<int64_t>();
+  for (int64_t r = 0; r < rows; ++r) {
+    auto a = adapter_ids[r];
+    TT_ENFORCE_LT(a, n_adapters, "row %d uses adapter %d of %d", r, a,
+                  n_adapters);
+    if (a >= 0 && lora_a[a] != nullptr) {
+      adapter_rows[a].push_back(r);
+    }
+  }
+
+  auto* x = input.data<float>();
+  auto* y = output->mutableData<float>();
+  core::Tensor gathered(nullptr), low_rank(nullptr), delta(nullptr);
+  for (int64_t a = 0; a < n_adapters; ++a) {
+    auto& row_ids = adapter_rows[a];
+    if (row_ids.empty()) {
+      continue;
+    }
+    auto& weight_a = *lora_a[a];
+    auto& weight_b = *lora_b[a];
+    TT_ENFORCE_EQ(weight_a.shape(0), in_dim, "lora_a of adapter %d mismatch",
+                  a);
+    TT_ENFORCE_EQ(weight_b.shape(0), weight_a.shape(1),
+                  "rank of adapter %d mismatch", a);
+    TT_ENFORCE_EQ(weight_b.shape(1), out_dim, "lora_b of adapter %d mismatch",
+                  a);
+    int64_t n = row_ids.size();
+    auto* g = gathered.Reshape<float>({n, in_dim}, kDLCPU, 0);
+#pragma omp parallel for
+    for (int64_t i = 0; i < n; ++i) {
+      std::memcpy(g + i * in_dim, x + row_ids[i] * in_dim,
+                  in_dim * sizeof(float));
+    }
+    low_rank.Reshape<float>({n, weight_a.shape(1)}, kDLCPU, 0);
+    MatMul(gathered, false, weight_a, false, 1.0, &low_rank, 0.0,
+           name + "/xA");
+    auto* d = delta.Reshape<float>({n, out_dim}, kDLCPU, 0);
+    MatMul(low_rank, false, weight_b, false, scales[a], &delta, 0.0,
+           name + "/xAB");
+#pragma omp parallel for
+    for (int64_t i = 0; i < n; ++i) {
+      auto* dst = y + row_ids[i] * out_dim;
+      auto* src = d + i * out_dim;
+#pragma omp simd
+      for (int64_t j = 0; j < out_dim; ++j) {
+        dst[j] += src[j];
+      }
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
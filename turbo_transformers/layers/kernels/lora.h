@@ -0,0 +1,45 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <string>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// Adds the low-rank adapter (LoRA) delta of each row to the output of a base
+// GEMM that was computed once for the rows of all adapters:
+//   output[r] += scales[a] * input[r] * lora_a[a] * lora_b[a],
+//   a = row_adapter[r]
+// input: (..., in_dim) float, a row is a vector of in_dim.
+// output: the base GEMM output of the same rows, numel = rows * out_dim.
+// row_adapter: (rows) int64 on CPU, a negative adapter leaves the row as is.
+// lora_a[a]: (in_dim, rank_a) float, lora_b[a]: (rank_a, out_dim) float, a
+// null lora_a[a] skips adapter a.
+// The rows of an adapter are gathered into a dense block, so an adapter costs
+// two small GEMMs however its rows are spread over the batch, and the deltas
+// are scattered back.
+void GroupedLoRA(const core::Tensor& input, const core::Tensor& row_adapter,
+                 const std::vector<const core::Tensor*>& lora_a,
+                 const std::vector<const core::Tensor*>& lora_b,
+                 const std::vector<float>& scales, core::Tensor* output,
+                 const std::string name = "GroupedLoRA");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
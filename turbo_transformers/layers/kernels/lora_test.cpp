@@ -0,0 +1,90 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/lora.h"
+
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+TEST_CASE("lora-grouped-cpu") {
+  int64_t batch_size = 3, seq_len = 5, in_dim = 16, out_dim = 24;
+  std::vector<int64_t> ranks{4, 2, 8};
+  auto input = common::CreateTensorAndFillRandom<float>(
+      {batch_size, seq_len, in_dim}, kDLCPU, 0);
+  auto output = common::CreateTensorAndFillRandom<float>(
+      {batch_size, seq_len, out_dim}, kDLCPU, 0);
+  std::vector<float> base(output.data<float>(),
+                          output.data<float>() + output.numel());
+
+  std::vector<core::Tensor> a_tensors, b_tensors;
+  for (auto rank : ranks) {
+    a_tensors.emplace_back(
+        common::CreateTensorAndFillRandom<float>({in_dim, rank}, kDLCPU, 0));
+    b_tensors.emplace_back(
+        common::CreateTensorAndFillRandom<float>({rank, out_dim}, kDLCPU, 0));
+  }
+  // adapter 1 has no weights for this projection
+  std::vector<const core::Tensor*> lora_a{&a_tensors[0], nullptr,
+                                          &a_tensors[2]};
+  std::vector<const core::Tensor*> lora_b{&b_tensors[0], nullptr,
+                                          &b_tensors[2]};
+  std::vector<float> scales{0.5f, 1.f, 2.f};
+
+  // rows of sequences 0 and 2 use adapter 2 and 0, sequence 1 mixes all.
+  core::Tensor row_adapter(nullptr);
+  auto* ids = row_adapter.Reshape<int64_t>({batch_size * seq_len}, kDLCPU, 0);
+  std::vector<int64_t> id_list{2, 2, 2, 2, 2, -1, 1, 0, 2, -1,
+                               0, 0, 0, 0, 0};
+  std::copy(id_list.begin(), id_list.end(), ids);
+
+  GroupedLoRA(input, row_adapter, lora_a, lora_b, scales, &output);
+
+  auto* x = input.data<float>();
+  auto* y = output.data<float>();
+  for (int64_t r = 0; r < batch_size * seq_len; ++r) {
+    auto a = id_list[r];
+    for (int64_t j = 0; j < out_dim; ++j) {
+      float expected = base[r * out_dim + j];
+      if (a >= 0 && lora_a[a] != nullptr) {
+        auto rank = ranks[a];
+        float delta = 0.f;
+        for (int64_t k = 0; k < rank; ++k) {
+          float xa = 0.f;
+          for (int64_t i = 0; i < in_dim; ++i) {
+            xa += x[r * in_dim + i] * a_tensors[a].data<float>()[i * rank + k];
+          }
+          delta += xa * b_tensors[a].data<float>()[k * out_dim + j];
+        }
+        expected += scales[a] * delta;
+      }
+      REQUIRE(std::abs(y[r * out_dim + j] - expected) < 1e-4);
+    }
+  }
+
+  id_list[3] = 3;
+  std::copy(id_list.begin(), id_list.end(), ids);
+  REQUIRE_THROWS(
+      GroupedLoRA(input, row_adapter, lora_a, lora_b, scales, &output));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
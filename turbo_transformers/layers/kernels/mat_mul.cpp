@@ -14,6 +14,8 @@
 #include "mat_mul.h"
 
 #include "common.h"
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include <cuda.h>
 
@@ -30,6 +32,7 @@ namespace kernels {
 void MatMul(const core::Tensor& A, bool a_trans, const core::Tensor& B,
             bool b_trans, float alpha, core::Tensor* out, float beta,
             const std::string name) {
+  TT_TRACE_KERNEL(name, A);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, A.device_type());
@@ -52,16 +55,13 @@ void MatMul(const core::Tensor& A, bool a_trans, const core::Tensor& B,
 
   if (A.device_type() == kDLCPU && B.device_type() == kDLCPU &&
       out->device_type() == kDLCPU) {
-    CBLAS_TRANSPOSE transA = a_trans ? CblasTrans : CblasNoTrans;
-    CBLAS_TRANSPOSE transB = b_trans ? CblasTrans : CblasNoTrans;
-
-    int lda = (transA == CblasNoTrans) ? K_a : M;
-    int ldb = (transB == CblasNoTrans) ? N : K_a;
+    int lda = a_trans ? M : K_a;
+    int ldb = b_trans ? K_a : N;
     int ldc = N;
 
-    cblas_sgemm(CblasRowMajor, transA, transB, M, N, K_a, alpha,
-                A.data<float>(), lda, B.data<float>(), ldb, beta,
-                out->mutableData<float>(), ldc);
+    auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+    backend->Sgemm(a_trans, b_trans, M, N, K_a, alpha, A.data<float>(), lda,
+                   B.data<float>(), ldb, beta, out->mutableData<float>(), ldc);
   } else if (A.device_type() == kDLGPU && B.device_type() == kDLGPU &&
              out->device_type() == kDLGPU) {
 #ifdef TT_WITH_CUDA
@@ -112,6 +112,7 @@ void MatMul(const core::Tensor& A, bool a_trans, const core::Tensor& B,
 void BatchMatMul(const core::Tensor& A, bool a_trans, const core::Tensor& B,
                  bool b_trans, float alpha, core::Tensor* C, float beta,
                  const std::string name) {
+  TT_TRACE_KERNEL(name, A);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, A.device_type());
@@ -172,15 +173,14 @@ void BatchMatMul(const core::Tensor& A, bool a_trans, const core::Tensor& B,
       B_array[i] = b_ptr + i * offsetB;
       C_array[i] = c_ptr + i * offsetC;
     }
-    auto transA = a_trans ? CblasTrans : CblasNoTrans;
-    auto transB = b_trans ? CblasTrans : CblasNoTrans;
-    int lda = (transA == CblasNoTrans) ? K_a : M;
-    int ldb = (transB == CblasNoTrans) ? N : K_a;
+    int lda = a_trans ? M : K_a;
+    int ldb = b_trans ? K_a : N;
     int ldc = N;
 
-    cblas_sgemm_batch(CblasRowMajor, &transA, &transB, &M, &N, &K_a, &alpha,
-                      A_array.get(), &lda, B_array.get(), &ldb, &beta,
-                      C_array.get(), &ldc, 1, &a_batch_size);
+    auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+    backend->SgemmBatch(a_trans, b_trans, M, N, K_a, alpha, A_array.get(), lda,
+                        B_array.get(), ldb, beta, C_array.get(), ldc,
+                        a_batch_size);
   } else if (A.device_type() == kDLGPU && B.device_type() == kDLGPU &&
              C->device_type() == kDLGPU) {
 #ifdef TT_WITH_CUDA
@@ -0,0 +1,291 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/kernels/maxsim.h"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+// The number of document tokens converted to float at once. A tile of 16
+// tokens with hidden size 128 takes 8KB, so the tile and the query stay in
+// L1/L2 while all the query tokens are scored against it.
+constexpr int64_t kDocTokenTile = 16;
+
+// Converts a document token to float and quantizes it back.
+template <typename T>
+struct TokenCodec;
+
+template <>
+struct TokenCodec<core::Half> {
+  static void Encode(const float* src, int64_t n, core::Half* dst,
+                     float* scale) {
+    *scale = 1.f;
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = core::Half(src[i]);
+    }
+  }
+
+  static void Decode(const core::Half* src, int64_t n, float scale,
+                     float* dst) {
+    int64_t i = 0;
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8) {
+      __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+};
+
+template <>
+struct TokenCodec<int8_t> {
+  static void Encode(const float* src, int64_t n, int8_t* dst, float* scale) {
+    float max_abs = 0.f;
+#pragma omp simd reduction(max : max_abs)
+    for (int64_t i = 0; i < n; ++i) {
+      max_abs = std::max(max_abs, std::abs(src[i]));
+    }
+    *scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+    float inv_scale = 1.f / *scale;
+#pragma omp simd
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<int8_t>(std::nearbyint(src[i] * inv_scale));
+    }
+  }
+
+  static void Decode(const int8_t* src, int64_t n, float scale, float* dst) {
+#pragma omp simd
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = src[i] * scale;
+    }
+  }
+};
+
+}  // namespace
+
+template <typename T>
+void PackDocTokens(const core::Tensor& input, const core::Tensor& mask,
+                   bool normalize, core::Tensor* docs, core::Tensor* scales,
+                   core::Tensor* doc_lengths, const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE_EQ(input.n_dim(), 3, "The input of PackDocTokens should be 3D");
+  TT_ENFORCE_EQ(input.device_type(), kDLCPU,
+                "PackDocTokens only supports CPU tensors");
+  auto batch_size = input.shape(0);
+  auto seq_len = input.shape(1);
+  auto hidden_size = input.shape(2);
+  const int64_t* mask_ptr = nullptr;
+  if (!mask.is_null()) {
+    TT_ENFORCE_EQ(mask.numel(), batch_size * seq_len,
+                  "The mask should have the shape (batch, seq_len)");
+    mask_ptr = mask.data<int64_t>();
+  }
+
+  const float* in_ptr = input.data<float>();
+  T* docs_ptr = docs->Reshape<T>({batch_size, seq_len, hidden_size}, kDLCPU, 0);
+  float* scales_ptr = scales->Reshape<float>({batch_size, seq_len}, kDLCPU, 0);
+  int64_t* lengths_ptr = doc_lengths->Reshape<int64_t>({batch_size}, kDLCPU, 0);
+
+#pragma omp parallel for
+  for (int64_t b = 0; b < batch_size; ++b) {
+    std::vector<float> token(hidden_size);
+    int64_t length = 0;
+    for (int64_t t = 0; t < seq_len; ++t) {
+      if (mask_ptr != nullptr && mask_ptr[b * seq_len + t] == 0) {
+        continue;
+      }
+      const float* src = in_ptr + (b * seq_len + t) * hidden_size;
+      float inv_norm = 1.f;
+      if (normalize) {
+        float sum = 0.f;
+#pragma omp simd reduction(+ : sum)
+        for (int64_t i = 0; i < hidden_size; ++i) {
+          sum += src[i] * src[i];
+        }
+        inv_norm = sum > 0.f ? 1.f / std::sqrt(sum) : 1.f;
+      }
+#pragma omp simd
+      for (int64_t i = 0; i < hidden_size; ++i) {
+        token[i] = src[i] * inv_norm;
+      }
+      int64_t dst = b * seq_len + length;
+      TokenCodec<T>::Encode(token.data(), hidden_size,
+                            docs_ptr + dst * hidden_size, scales_ptr + dst);
+      ++length;
+    }
+    // the padding tokens are never read by MaxSim, but keep them defined.
+    std::fill(docs_ptr + (b * seq_len + length) * hidden_size,
+              docs_ptr + (b + 1) * seq_len * hidden_size, T(0));
+    std::fill(scales_ptr + b * seq_len + length,
+              scales_ptr + (b + 1) * seq_len, 1.f);
+    lengths_ptr[b] = length;
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+template <typename T>
+void MaxSim(const core::Tensor& query, const core::Tensor& query_mask,
+            const core::Tensor& docs, const core::Tensor& scales,
+            const core::Tensor& doc_lengths, core::Tensor* scores,
+            const std::string name) {
+  TT_TRACE_KERNEL(name, query);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, docs.device_type());
+#endif
+  TT_ENFORCE_EQ(query.n_dim(), 2, "The query of MaxSim should be 2D");
+  TT_ENFORCE_EQ(docs.n_dim(), 3, "The docs of MaxSim should be 3D");
+  TT_ENFORCE_EQ(docs.device_type(), kDLCPU, "MaxSim only supports CPU tensors");
+  auto q_len = query.shape(0);
+  auto hidden_size = query.shape(1);
+  auto n_docs = docs.shape(0);
+  auto doc_len = docs.shape(1);
+  TT_ENFORCE_EQ(docs.shape(2), hidden_size,
+                "The hidden size of docs(%d) and query(%d) should be equal",
+                docs.shape(2), hidden_size);
+
+  if (!query_mask.is_null()) {
+    TT_ENFORCE(query_mask.IsType<int64_t>(),
+               "The query mask of MaxSim should be int64");
+    TT_ENFORCE_EQ(query_mask.numel(), q_len,
+                  "The query mask of MaxSim has %d values for %d tokens",
+                  query_mask.numel(), q_len);
+  }
+
+  // filter the masked query tokens once, they don't contribute to any score.
+  const float* q_ptr = query.data<float>();
+  std::vector<const float*> q_tokens;
+  for (int64_t q = 0; q < q_len; ++q) {
+    if (query_mask.is_null() || query_mask.data<int64_t>()[q] != 0) {
+      q_tokens.push_back(q_ptr + q * hidden_size);
+    }
+  }
+  int64_t n_q = q_tokens.size();
+
+  const T* docs_ptr = docs.data<T>();
+  const float* scales_ptr = nullptr;
+  if (std::is_same<T, int8_t>::value) {
+    TT_ENFORCE_EQ(scales.numel(), n_docs * doc_len,
+                  "The scales should have the shape (n_docs, doc_len)");
+    scales_ptr = scales.data<float>();
+  }
+  const int64_t* lengths_ptr =
+      doc_lengths.is_null() ? nullptr : doc_lengths.data<int64_t>();
+  float* out = scores->Reshape<float>({n_docs}, kDLCPU, 0);
+
+#pragma omp parallel
+  {
+    std::vector<float> tile(kDocTokenTile * hidden_size);
+    std::vector<float> max_sim(n_q);
+    // the candidates have different lengths, so balance them dynamically.
+#pragma omp for schedule(dynamic, 4)
+    for (int64_t d = 0; d < n_docs; ++d) {
+      int64_t length = lengths_ptr == nullptr
+                           ? doc_len
+                           : std::min(lengths_ptr[d], doc_len);
+      if (length <= 0 || n_q == 0) {
+        out[d] = 0.f;
+        continue;
+      }
+      std::fill(max_sim.begin(), max_sim.end(),
+                std::numeric_limits<float>::lowest());
+      const T* doc = docs_ptr + d * doc_len * hidden_size;
+      for (int64_t t0 = 0; t0 < length; t0 += kDocTokenTile) {
+        int64_t tile_len = std::min(kDocTokenTile, length - t0);
+        for (int64_t t = 0; t < tile_len; ++t) {
+          float scale =
+              scales_ptr == nullptr ? 1.f : scales_ptr[d * doc_len + t0 + t];
+          TokenCodec<T>::Decode(doc + (t0 + t) * hidden_size, hidden_size,
+                                scale, tile.data() + t * hidden_size);
+        }
+        for (int64_t q = 0; q < n_q; ++q) {
+          const float* q_token = q_tokens[q];
+          float best = max_sim[q];
+          for (int64_t t = 0; t < tile_len; ++t) {
+            const float* d_token = tile.data() + t * hidden_size;
+            float dot = 0.f;
+#pragma omp simd reduction(+ : dot)
+            for (int64_t i = 0; i < hidden_size; ++i) {
+              dot += q_token[i] * d_token[i];
+            }
+            best = std::max(best, dot);
+          }
+          max_sim[q] = best;
+        }
+      }
+      float sum = 0.f;
+      for (int64_t q = 0; q < n_q; ++q) {
+        sum += max_sim[q];
+      }
+      out[d] = sum;
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, docs.device_type());
+#endif
+}
+
+template void PackDocTokens<core::Half>(const core::Tensor& input,
+                                        const core::Tensor& mask,
+                                        bool normalize, core::Tensor* docs,
+                                        core::Tensor* scales,
+                                        core::Tensor* doc_lengths,
+                                        const std::string name);
+template void PackDocTokens<int8_t>(const core::Tensor& input,
+                                    const core::Tensor& mask, bool normalize,
+                                    core::Tensor* docs, core::Tensor* scales,
+                                    core::Tensor* doc_lengths,
+                                    const std::string name);
+
+template void MaxSim<core::Half>(const core::Tensor& query,
+                                 const core::Tensor& query_mask,
+                                 const core::Tensor& docs,
+                                 const core::Tensor& scales,
+                                 const core::Tensor& doc_lengths,
+                                 core::Tensor* scores, const std::string name);
+template void MaxSim<int8_t>(const core::Tensor& query,
+                             const core::Tensor& query_mask,
+                             const core::Tensor& docs,
+                             const core::Tensor& scales,
+                             const core::Tensor& doc_lengths,
+                             core::Tensor* scores, const std::string name);
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
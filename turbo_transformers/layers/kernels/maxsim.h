@@ -0,0 +1,54 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#pragma once
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// Packs the per-token encoder outputs into document token matrices for the
+// late interaction scoring.
+// input: (batch, seq_len, hidden) float, the un-pooled hidden states.
+// mask: (batch, seq_len) int64, 1 marks a valid token. A null mask keeps all
+// tokens.
+// The valid tokens of each document are moved to the front of docs
+// (batch, seq_len, hidden) and are optionally L2 normalized. T is core::Half
+// or int8_t. scales is resized to (batch, seq_len); for int8_t, each token is
+// quantized symmetrically with its own scale stored there, for core::Half
+// every scale is 1.
+// doc_lengths (batch) int64 records the number of valid tokens.
+template <typename T>
+void PackDocTokens(const core::Tensor& input, const core::Tensor& mask,
+                   bool normalize, core::Tensor* docs, core::Tensor* scales,
+                   core::Tensor* doc_lengths,
+                   const std::string name = "PackDocTokens");
+
+// scores[d] = sum over the valid query tokens q of
+//             max over t < doc_lengths[d] of <query[q], docs[d, t]>
+// query: (q_len, hidden) float, query_mask: (q_len) int64 or null.
+// docs: (n_docs, doc_len, hidden) T, scales: (n_docs, doc_len) float for
+// int8_t docs, doc_lengths: (n_docs) int64 or null for full length documents.
+// scores: (n_docs) float.
+template <typename T>
+void MaxSim(const core::Tensor& query, const core::Tensor& query_mask,
+            const core::Tensor& docs, const core::Tensor& scales,
+            const core::Tensor& doc_lengths, core::Tensor* scores,
+            const std::string name = "MaxSim");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,132 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+#include "turbo_transformers/layers/kernels/maxsim.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// the float reference of MaxSim over the un-packed encoder output.
+static std::vector<float> MaxSimReference(const core::Tensor& query,
+                                          const core::Tensor& hidden,
+                                          const core::Tensor& mask) {
+  auto q_len = query.shape(0);
+  auto batch_size = hidden.shape(0);
+  auto seq_len = hidden.shape(1);
+  auto hidden_size = hidden.shape(2);
+  std::vector<float> scores(batch_size, 0.f);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t q = 0; q < q_len; ++q) {
+      float best = std::numeric_limits<float>::lowest();
+      for (int64_t t = 0; t < seq_len; ++t) {
+        if (mask.data<int64_t>()[b * seq_len + t] == 0) continue;
+        float dot = 0.f;
+        for (int64_t i = 0; i < hidden_size; ++i) {
+          dot += query.data<float>()[q * hidden_size + i] *
+                 hidden.data<float>()[(b * seq_len + t) * hidden_size + i];
+        }
+        best = std::max(best, dot);
+      }
+      scores[b] += best;
+    }
+  }
+  return scores;
+}
+
+template <typename T>
+static void MaxSimTestHelper(float tolerance) {
+  constexpr int64_t q_len = 8, batch_size = 5, seq_len = 37, hidden = 64;
+  auto query =
+      common::CreateTensorAndFillRandom<float>({q_len, hidden}, kDLCPU, 0);
+  auto encoder_out = common::CreateTensorAndFillRandom<float>(
+      {batch_size, seq_len, hidden}, kDLCPU, 0);
+  auto mask = common::CreateTensor<int64_t>({batch_size, seq_len}, kDLCPU, 0);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t t = 0; t < seq_len; ++t) {
+      // variable lengths and a masked token in the middle.
+      mask.mutableData<int64_t>()[b * seq_len + t] =
+          (t < seq_len - 5 * b && t != 3) ? 1 : 0;
+    }
+  }
+
+  core::Tensor docs(nullptr), scales(nullptr), lengths(nullptr);
+  PackDocTokens<T>(encoder_out, mask, false, &docs, &scales, &lengths);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    REQUIRE(lengths.data<int64_t>()[b] == seq_len - 5 * b - 1);
+  }
+
+  core::Tensor scores(nullptr);
+  MaxSim<T>(query, core::Tensor(nullptr), docs, scales, lengths, &scores);
+  REQUIRE(scores.numel() == batch_size);
+  auto ref = MaxSimReference(query, encoder_out, mask);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    REQUIRE(std::abs(scores.data<float>()[b] - ref[b]) <= tolerance * ref[b]);
+  }
+}
+
+TEST_CASE("maxsim-cpu-fp16-test") { MaxSimTestHelper<core::Half>(1e-3); }
+
+TEST_CASE("maxsim-cpu-int8-test") { MaxSimTestHelper<int8_t>(3e-2); }
+
+TEST_CASE("maxsim-cpu-query-mask-test") {
+  constexpr int64_t q_len = 4, n_docs = 3, doc_len = 20, hidden = 16;
+  auto query =
+      common::CreateTensorAndFillRandom<float>({q_len, hidden}, kDLCPU, 0);
+  auto encoder_out = common::CreateTensorAndFillRandom<float>(
+      {n_docs, doc_len, hidden}, kDLCPU, 0);
+  core::Tensor docs(nullptr), scales(nullptr), lengths(nullptr);
+  PackDocTokens<core::Half>(encoder_out, core::Tensor(nullptr), true, &docs,
+                            &scales, &lengths);
+
+  auto query_mask = common::CreateTensorAndFillConstant<int64_t>(
+      {q_len}, kDLCPU, 0, 0);
+  core::Tensor scores(nullptr);
+  MaxSim<core::Half>(query, query_mask, docs, scales, lengths, &scores);
+  for (int64_t d = 0; d < n_docs; ++d) {
+    REQUIRE(scores.data<float>()[d] == 0.f);
+  }
+
+  // normalized document tokens bound each max similarity by the query norm.
+  query_mask.mutableData<int64_t>()[1] = 1;
+  MaxSim<core::Half>(query, query_mask, docs, scales, lengths, &scores);
+  float norm = 0.f;
+  for (int64_t i = 0; i < hidden; ++i) {
+    norm += query.data<float>()[hidden + i] * query.data<float>()[hidden + i];
+  }
+  for (int64_t d = 0; d < n_docs; ++d) {
+    REQUIRE(scores.data<float>()[d] <= std::sqrt(norm) * (1 + 1e-3));
+    REQUIRE(scores.data<float>()[d] > 0.f);
+  }
+
+  // a mask of another length or type than the query tokens.
+  auto short_mask = common::CreateTensorAndFillConstant<int64_t>(
+      {q_len - 1}, kDLCPU, 0, 1);
+  REQUIRE_THROWS(MaxSim<core::Half>(query, short_mask, docs, scales, lengths,
+                                    &scores));
+  auto float_mask =
+      common::CreateTensorAndFillConstant<float>({q_len}, kDLCPU, 0, 1.f);
+  REQUIRE_THROWS(MaxSim<core::Half>(query, float_mask, docs, scales, lengths,
+                                    &scores));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
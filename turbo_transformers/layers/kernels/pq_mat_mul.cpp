@@ -0,0 +1,290 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+// The inputs of more rows decode the weight and run a float GEMM.
+constexpr int64_t kMaxLookupRows = 8;
+// The outputs a thread sums the lookups of at once, their accumulators of
+// every row stay in L1.
+constexpr int64_t kLookupCols = 256;
+// The outputs decoded at once by the GEMM path.
+constexpr int64_t kDecodeCols = 128;
+
+// The index of the centroid (n_centroids, sub_dim) nearest to point.
+int64_t NearestCentroid(const float* point, const float* centroids,
+                        int64_t n_centroids, int64_t sub_dim) {
+  int64_t best = 0;
+  float best_dist = std::numeric_limits<float>::max();
+  for (int64_t c = 0; c < n_centroids; ++c) {
+    float dist = 0.f;
+    for (int64_t t = 0; t < sub_dim; ++t) {
+      float d = point[t] - centroids[c * sub_dim + t];
+      dist += d * d;
+    }
+    if (dist < best_dist) {
+      best_dist = dist;
+      best = c;
+    }
+  }
+  return best;
+}
+
+// luts: (rows, n_subspaces, n_centroids), the dot products of the sub-vectors
+// of every row of x with the centroids of their subspace.
+void BuildLookupTables(const float* x, int64_t rows, const PQWeight& weight,
+                       float* luts) {
+  int64_t n_subspaces = weight.n_subspaces(), sub_dim = weight.sub_dim();
+  int64_t n_centroids = weight.n_centroids(), in_dim = weight.in_dim();
+  auto* codebooks = weight.codebooks.data<float>();
+#pragma omp parallel for
+  for (int64_t s = 0; s < n_subspaces; ++s) {
+    for (int64_t r = 0; r < rows; ++r) {
+      float* lut = luts + (r * n_subspaces + s) * n_centroids;
+      std::fill(lut, lut + n_centroids, 0.f);
+      for (int64_t t = 0; t < sub_dim; ++t) {
+        float xv = x[r * in_dim + s * sub_dim + t];
+        const float* centroids = codebooks + (s * sub_dim + t) * n_centroids;
+        for (int64_t c = 0; c < n_centroids; ++c) {
+          lut[c] += xv * centroids[c];
+        }
+      }
+    }
+  }
+}
+
+// y[r][j] = sum_s luts[r][s][codes[s][j]]
+void LookupSum(const float* luts, int64_t rows, const PQWeight& weight,
+               float* y) {
+  int64_t n_subspaces = weight.n_subspaces(), out_dim = weight.out_dim();
+  int64_t n_centroids = weight.n_centroids();
+  auto* codes = weight.codes.data<uint8_t>();
+  int64_t n_blocks = (out_dim + kLookupCols - 1) / kLookupCols;
+#pragma omp parallel for
+  for (int64_t b = 0; b < n_blocks; ++b) {
+    int64_t j0 = b * kLookupCols;
+    int64_t n_cols = std::min(kLookupCols, out_dim - j0);
+    alignas(32) float acc[kMaxLookupRows * kLookupCols] = {0.f};
+    for (int64_t s = 0; s < n_subspaces; ++s) {
+      const uint8_t* code = codes + s * out_dim + j0;
+      for (int64_t r = 0; r < rows; ++r) {
+        const float* lut = luts + (r * n_subspaces + s) * n_centroids;
+        float* acc_r = acc + r * kLookupCols;
+        int64_t j = 0;
+#ifdef __AVX2__
+        for (; j + 8 <= n_cols; j += 8) {
+          __m256i idx = _mm256_cvtepu8_epi32(
+              _mm_loadl_epi64(reinterpret_cast<const __m128i*>(code + j)));
+          __m256 sum = _mm256_add_ps(_mm256_load_ps(acc_r + j),
+                                     _mm256_i32gather_ps(lut, idx, 4));
+          _mm256_store_ps(acc_r + j, sum);
+        }
+#endif
+        for (; j < n_cols; ++j) {
+          acc_r[j] += lut[code[j]];
+        }
+      }
+    }
+    for (int64_t r = 0; r < rows; ++r) {
+      std::copy(acc + r * kLookupCols, acc + r * kLookupCols + n_cols,
+                y + r * out_dim + j0);
+    }
+  }
+}
+
+// Fills dst (n_cols, in_dim) with the float rows [j0, j0 + n_cols) of the
+// transposed weight.
+void Decode(const PQWeight& weight, int64_t j0, int64_t n_cols, float* dst) {
+  int64_t n_subspaces = weight.n_subspaces(), sub_dim = weight.sub_dim();
+  int64_t n_centroids = weight.n_centroids(), in_dim = weight.in_dim();
+  int64_t out_dim = weight.out_dim();
+  auto* codebooks = weight.codebooks.data<float>();
+  auto* codes = weight.codes.data<uint8_t>();
+#pragma omp parallel for
+  for (int64_t c = 0; c < n_cols; ++c) {
+    for (int64_t s = 0; s < n_subspaces; ++s) {
+      uint8_t code = codes[s * out_dim + j0 + c];
+      for (int64_t t = 0; t < sub_dim; ++t) {
+        dst[c * in_dim + s * sub_dim + t] =
+            codebooks[(s * sub_dim + t) * n_centroids + code];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+PQWeight MakePQWeight(core::Tensor codebooks, core::Tensor codes) {
+  TT_ENFORCE(codebooks.device_type() == kDLCPU && codes.device_type() == kDLCPU,
+             "PQMatMul only supports CPU");
+  TT_ENFORCE_EQ(codebooks.n_dim(), 3,
+                "codebooks must be (n_subspaces, sub_dim, n_centroids)");
+  TT_ENFORCE_EQ(codes.n_dim(), 2, "codes must be (n_subspaces, out_dim)");
+  TT_ENFORCE_EQ(codebooks.shape(0), codes.shape(0),
+                "codebooks have %d subspaces, codes %d", codebooks.shape(0),
+                codes.shape(0));
+  TT_ENFORCE(codebooks.shape(2) > 0 && codebooks.shape(2) <= 256,
+             "%d centroids do not fit uint8 codes", codebooks.shape(2));
+  // checks the data types.
+  codebooks.data<float>();
+  codes.data<uint8_t>();
+  PQWeight weight;
+  weight.codebooks = std::move(codebooks);
+  weight.codes = std::move(codes);
+  return weight;
+}
+
+void TrainWeightPQ(const core::Tensor& weight, bool trans_weight,
+                   int64_t sub_dim, int64_t n_centroids, int64_t n_iters,
+                   PQWeight* quantized, const std::string name) {
+  TT_TRACE_KERNEL(name, weight);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, weight.device_type());
+#endif
+  TT_ENFORCE(weight.device_type() == kDLCPU, "TrainWeightPQ only supports CPU");
+  TT_ENFORCE_EQ(weight.n_dim(), 2, "weight must be a matrix");
+  int64_t in_dim = trans_weight ? weight.shape(1) : weight.shape(0);
+  int64_t out_dim = trans_weight ? weight.shape(0) : weight.shape(1);
+  TT_ENFORCE(sub_dim > 0 && in_dim % sub_dim == 0,
+             "the sub-vectors of %d channels do not divide %d", sub_dim,
+             in_dim);
+  TT_ENFORCE(n_centroids > 0 && n_centroids <= 256 && n_centroids <= out_dim,
+             "%d centroids must be at most 256 and %d", n_centroids, out_dim);
+  int64_t n_subspaces = in_dim / sub_dim;
+  auto* src = weight.data<float>();
+  auto* codebooks = quantized->codebooks.Reshape<float>(
+      {n_subspaces, sub_dim, n_centroids}, kDLCPU, 0, name + "/codebooks");
+  auto* codes = quantized->codes.Reshape<uint8_t>({n_subspaces, out_dim},
+                                                  kDLCPU, 0, name + "/codes");
+#pragma omp parallel for
+  for (int64_t s = 0; s < n_subspaces; ++s) {
+    // the sub-vectors (out_dim, sub_dim) of the outputs.
+    std::vector<float> points(out_dim * sub_dim);
+    for (int64_t j = 0; j < out_dim; ++j) {
+      for (int64_t t = 0; t < sub_dim; ++t) {
+        int64_t i = s * sub_dim + t;
+        points[j * sub_dim + t] =
+            trans_weight ? src[j * in_dim + i] : src[i * out_dim + j];
+      }
+    }
+    // starts from outputs evenly spread over the weight, so the training is
+    // deterministic.
+    std::vector<float> centroids(n_centroids * sub_dim);
+    for (int64_t c = 0; c < n_centroids; ++c) {
+      std::copy_n(points.begin() + c * out_dim / n_centroids * sub_dim,
+                  sub_dim, centroids.begin() + c * sub_dim);
+    }
+    std::vector<int64_t> assignment(out_dim);
+    std::vector<float> sums(n_centroids * sub_dim);
+    std::vector<int64_t> counts(n_centroids);
+    for (int64_t iter = 0;; ++iter) {
+      for (int64_t j = 0; j < out_dim; ++j) {
+        assignment[j] = NearestCentroid(points.data() + j * sub_dim,
+                                        centroids.data(), n_centroids, sub_dim);
+      }
+      if (iter == n_iters) {
+        break;
+      }
+      std::fill(sums.begin(), sums.end(), 0.f);
+      std::fill(counts.begin(), counts.end(), 0);
+      for (int64_t j = 0; j < out_dim; ++j) {
+        ++counts[assignment[j]];
+        for (int64_t t = 0; t < sub_dim; ++t) {
+          sums[assignment[j] * sub_dim + t] += points[j * sub_dim + t];
+        }
+      }
+      // an empty cluster keeps its centroid.
+      for (int64_t c = 0; c < n_centroids; ++c) {
+        for (int64_t t = 0; counts[c] > 0 && t < sub_dim; ++t) {
+          centroids[c * sub_dim + t] = sums[c * sub_dim + t] / counts[c];
+        }
+      }
+    }
+    for (int64_t c = 0; c < n_centroids; ++c) {
+      for (int64_t t = 0; t < sub_dim; ++t) {
+        codebooks[(s * sub_dim + t) * n_centroids + c] =
+            centroids[c * sub_dim + t];
+      }
+    }
+    for (int64_t j = 0; j < out_dim; ++j) {
+      codes[s * out_dim + j] = static_cast<uint8_t>(assignment[j]);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, weight.device_type());
+#endif
+}
+
+void PQMatMul(const core::Tensor& input, const PQWeight& weight,
+              core::Tensor* output, const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE(input.device_type() == kDLCPU && output->device_type() == kDLCPU,
+             "PQMatMul only supports CPU");
+  TT_ENFORCE(!weight.is_null(), "PQMatMul needs a quantized weight");
+  int64_t in_dim = weight.in_dim();
+  int64_t out_dim = weight.out_dim();
+  TT_ENFORCE_EQ(input.shape(-1), in_dim, "input has %d features, weight %d",
+                input.shape(-1), in_dim);
+  int64_t rows = input.numel() / in_dim;
+  TT_ENFORCE_EQ(output->numel(), rows * out_dim, "output shape mismatch");
+  auto* x = input.data<float>();
+  auto* y = output->mutableData<float>();
+  if (rows <= kMaxLookupRows) {
+    static thread_local std::vector<float> luts;
+    luts.resize(rows * weight.n_subspaces() * weight.n_centroids());
+    BuildLookupTables(x, rows, weight, luts.data());
+    LookupSum(luts.data(), rows, weight, y);
+  } else {
+    static thread_local std::vector<float> block;
+    block.resize(kDecodeCols * in_dim);
+    auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+    for (int64_t j0 = 0; j0 < out_dim; j0 += kDecodeCols) {
+      int64_t n_cols = std::min(kDecodeCols, out_dim - j0);
+      Decode(weight, j0, n_cols, block.data());
+      backend->Sgemm(false, true, rows, n_cols, in_dim, 1.f, x, in_dim,
+                     block.data(), in_dim, 0.f, y + j0, out_dim);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
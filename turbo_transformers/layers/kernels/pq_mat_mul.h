@@ -0,0 +1,73 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// A product-quantized copy of a float weight, the most compact precision for
+// the machines short of memory. The input channels are split into subspaces
+// of sub_dim channels, and the sub-vector of every output in a subspace is
+// replaced by the index of its nearest centroid in the codebook of the
+// subspace. With 4 channels a weight takes 2 bits, plus the codebooks of
+// in_dim * n_centroids floats, so a few centroids keep them small.
+// codebooks: (n_subspaces, sub_dim, n_centroids) float, centroid c of
+// subspace s is codebooks[s, :, c].
+// codes: (n_subspaces, out_dim) uint8,
+// weight_fp32[s * sub_dim + t][j] ~= codebooks[s][t][codes[s][j]].
+struct PQWeight {
+  core::Tensor codebooks{nullptr};
+  core::Tensor codes{nullptr};
+
+  bool is_null() const { return codes.is_null(); }
+  int64_t n_subspaces() const { return codes.shape(0); }
+  int64_t sub_dim() const { return codebooks.shape(1); }
+  int64_t n_centroids() const { return codebooks.shape(2); }
+  int64_t in_dim() const { return n_subspaces() * sub_dim(); }
+  int64_t out_dim() const { return codes.shape(1); }
+};
+
+// Builds a PQWeight from the codebooks and the codes trained offline, e.g. by
+// tools/train_pq_codebooks.py, and checks their shapes.
+PQWeight MakePQWeight(core::Tensor codebooks, core::Tensor codes);
+
+// Trains the codebooks of a float weight by n_iters k-means iterations in
+// every subspace and encodes it. sub_dim must divide in_dim, n_centroids is
+// at most 256 and out_dim.
+// weight: (in_dim, out_dim) float, or (out_dim, in_dim) when trans_weight, the
+// same layout MatMul takes as its second operand.
+void TrainWeightPQ(const core::Tensor& weight, bool trans_weight,
+                   int64_t sub_dim, int64_t n_centroids, int64_t n_iters,
+                   PQWeight* quantized,
+                   const std::string name = "TrainWeightPQ");
+
+// output = input * decode(weight)
+// input: (..., in_dim) float, output: numel = rows * out_dim float, reshaped
+// by the caller. Up to a few rows, the dot products of every sub-vector of a
+// row with the centroids of its subspace are computed once into a lookup
+// table, and an output is the sum of the entries its codes select, so only
+// the codes are read. Larger inputs decode blocks of the weight and run the
+// float GEMM of the backend of name on them.
+void PQMatMul(const core::Tensor& input, const PQWeight& weight,
+              core::Tensor* output, const std::string name = "PQMatMul");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
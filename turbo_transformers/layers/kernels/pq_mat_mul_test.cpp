@@ -0,0 +1,117 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+
+#include <cmath>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// the float weight (in_dim, out_dim) the product-quantized one stands for.
+static core::Tensor Decoded(const PQWeight& quantized) {
+  int64_t in_dim = quantized.in_dim(), out_dim = quantized.out_dim();
+  int64_t sub_dim = quantized.sub_dim();
+  int64_t n_centroids = quantized.n_centroids();
+  auto weight = common::CreateTensor<float>({in_dim, out_dim}, kDLCPU, 0);
+  for (int64_t i = 0; i < in_dim; ++i) {
+    for (int64_t j = 0; j < out_dim; ++j) {
+      uint8_t code = quantized.codes.data<uint8_t>()[i / sub_dim * out_dim + j];
+      weight.mutableData<float>()[i * out_dim + j] =
+          quantized.codebooks.data<float>()[i * n_centroids + code];
+    }
+  }
+  return weight;
+}
+
+TEST_CASE("pq-matmul-cpu") {
+  int64_t in_dim = 96, out_dim = 300;
+  for (bool trans_weight : {false, true}) {
+    auto weight =
+        trans_weight
+            ? common::CreateTensorAndFillRandom<float>({out_dim, in_dim},
+                                                       kDLCPU, 0)
+            : common::CreateTensorAndFillRandom<float>({in_dim, out_dim},
+                                                       kDLCPU, 0);
+    for (int64_t i = 0; i < weight.numel(); ++i) {
+      weight.mutableData<float>()[i] -= 0.5f;
+    }
+    PQWeight quantized;
+    REQUIRE_THROWS(TrainWeightPQ(weight, trans_weight, 5, 64, 4, &quantized));
+    REQUIRE_THROWS(TrainWeightPQ(weight, trans_weight, 4, 512, 4, &quantized));
+    TrainWeightPQ(weight, trans_weight, 2, 256, 8, &quantized);
+    REQUIRE(quantized.in_dim() == in_dim);
+    REQUIRE(quantized.out_dim() == out_dim);
+    REQUIRE(quantized.n_subspaces() == 48);
+    auto decoded = Decoded(quantized);
+
+    // the lookup tables and the decoding GEMM
+    for (int64_t rows : {1, 3, 8, 20}) {
+      auto input =
+          common::CreateTensorAndFillRandom<float>({rows, in_dim}, kDLCPU, 0);
+      auto expected = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      auto exact = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      auto output = common::CreateTensor<float>({rows, out_dim}, kDLCPU, 0);
+      MatMul(input, false, decoded, false, 1.0, &expected, 0.0);
+      MatMul(input, false, weight, trans_weight, 1.0, &exact, 0.0);
+      PQMatMul(input, quantized, &output);
+
+      double dot = 0, norm_y = 0, norm_e = 0;
+      for (int64_t i = 0; i < output.numel(); ++i) {
+        float y = output.data<float>()[i], e = expected.data<float>()[i];
+        REQUIRE(std::abs(y - e) < 1e-3 * (1 + std::abs(e)));
+        float x = exact.data<float>()[i];
+        dot += y * x;
+        norm_y += y * y;
+        norm_e += x * x;
+      }
+      // the accuracy of 256 centroids for the pairs of channels
+      REQUIRE(dot / std::sqrt(norm_y * norm_e) > 0.95);
+    }
+  }
+}
+
+TEST_CASE("pq-matmul-offline-codebooks") {
+  // codebooks and codes trained offline, 2 subspaces of 2 channels.
+  auto codebooks = common::CreateTensor<float>({2, 2, 3}, kDLCPU, 0);
+  auto codes = common::CreateTensor<uint8_t>({2, 2}, kDLCPU, 0);
+  float centroids[] = {1, 2, 3, 4, 5, 6, -1, -2, -3, -4, -5, -6};
+  uint8_t indices[] = {0, 2, 1, 1};
+  std::copy(centroids, centroids + 12, codebooks.mutableData<float>());
+  std::copy(indices, indices + 4, codes.mutableData<uint8_t>());
+  REQUIRE_THROWS(
+      MakePQWeight(common::CreateTensor<float>({3, 2, 3}, kDLCPU, 0),
+                   common::CreateTensor<uint8_t>({2, 2}, kDLCPU, 0)));
+  auto quantized = MakePQWeight(std::move(codebooks), std::move(codes));
+  REQUIRE(quantized.in_dim() == 4);
+  REQUIRE(quantized.out_dim() == 2);
+
+  auto input = common::CreateTensor<float>({1, 4}, kDLCPU, 0);
+  float x[] = {1, 1, 1, 2};
+  std::copy(x, x + 4, input.mutableData<float>());
+  auto output = common::CreateTensor<float>({1, 2}, kDLCPU, 0);
+  PQMatMul(input, quantized, &output);
+  // the columns are (1, 4, -2, -5) and (3, 6, -2, -5).
+  REQUIRE(output.data<float>()[0] == Approx(1 + 4 - 2 - 10));
+  REQUIRE(output.data<float>()[1] == Approx(3 + 6 - 2 - 10));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,297 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+
+// Quantizes n floats symmetrically to [-127, 127] and returns the scale.
+float QuantizeRow(const float* src, int64_t n, int64_t stride, int8_t* dst) {
+  float max_abs = 0.f;
+  for (int64_t i = 0; i < n; ++i) {
+    max_abs = std::max(max_abs, std::fabs(src[i * stride]));
+  }
+  float scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+  float inv_scale = 1.f / scale;
+  for (int64_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<int8_t>(std::nearbyint(src[i * stride] * inv_scale));
+  }
+  return scale;
+}
+
+// sums[r][c] = dot(a[r], b[c]) for kRows rows of a, lda bytes apart, and
+// kNumCols rows of b, ldb bytes apart, each of n int8.
+constexpr int64_t kNumCols = 4;
+template <int64_t kRows>
+void DotInt8Block(const int8_t* a, int64_t lda, const int8_t* b, int64_t ldb,
+                  int64_t n, int32_t (*sums)[kNumCols]) {
+  int64_t i = 0;
+  for (int64_t r = 0; r < kRows; ++r) {
+    for (int64_t c = 0; c < kNumCols; ++c) {
+      sums[r][c] = 0;
+    }
+  }
+#ifdef __AVX2__
+  // maddubs multiplies unsigned by signed bytes, so the sign of a moves onto b.
+  // Neither operand is -128, so a pair of products fits in int16.
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[kRows][kNumCols];
+  for (int64_t r = 0; r < kRows; ++r) {
+    for (int64_t c = 0; c < kNumCols; ++c) {
+      acc[r][c] = _mm256_setzero_si256();
+    }
+  }
+  for (; i + 32 <= n; i += 32) {
+    __m256i va[kRows], abs_a[kRows];
+    for (int64_t r = 0; r < kRows; ++r) {
+      va[r] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(a + r * lda + i));
+      abs_a[r] = _mm256_sign_epi8(va[r], va[r]);
+    }
+    for (int64_t c = 0; c < kNumCols; ++c) {
+      __m256i vb = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(b + c * ldb + i));
+      for (int64_t r = 0; r < kRows; ++r) {
+        __m256i prod =
+            _mm256_maddubs_epi16(abs_a[r], _mm256_sign_epi8(vb, va[r]));
+        acc[r][c] = _mm256_add_epi32(acc[r][c], _mm256_madd_epi16(prod, ones));
+      }
+    }
+  }
+  for (int64_t r = 0; r < kRows; ++r) {
+    for (int64_t c = 0; c < kNumCols; ++c) {
+      __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc[r][c]),
+                                     _mm256_extracti128_si256(acc[r][c], 1));
+      acc128 = _mm_hadd_epi32(acc128, acc128);
+      acc128 = _mm_hadd_epi32(acc128, acc128);
+      sums[r][c] = _mm_cvtsi128_si32(acc128);
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    for (int64_t r = 0; r < kRows; ++r) {
+      for (int64_t c = 0; c < kNumCols; ++c) {
+        sums[r][c] += static_cast<int32_t>(a[r * lda + i]) * b[c * ldb + i];
+      }
+    }
+  }
+}
+
+// The int32 sums of a tile of kRowTile input rows by kPanelCols weight rows
+// are accumulated over slices of kDepthTile features. A slice of the panel,
+// at most 128KB, stays in L2 while every row pair of the tile is multiplied
+// by it, and the slice of a row pair stays in L1 for all the columns of the
+// panel. Each slice ends in a horizontal reduction of the SIMD sums, so the
+// slices are long, the BERT sizes take a single one.
+constexpr int64_t kRowTile = 16;
+constexpr int64_t kPanelCols = 8 * kNumCols;
+constexpr int64_t kDepthTile = 4096;
+
+// y = dequantize(qx) * dequantize(weight), the scale of row r of qx is
+// x_scales[r * x_scale_stride].
+void Int8Gemm(const int8_t* qx, const float* x_scales, int64_t x_scale_stride,
+              int64_t rows, const QuantizedWeight& weight, float* y) {
+  int64_t in_dim = weight.in_dim();
+  int64_t out_dim = weight.out_dim();
+  auto* qw = weight.weight.data<int8_t>();
+  auto* w_scales = weight.scales.data<float>();
+  // The panels of a row tile are adjacent tasks, so the threads sharing an
+  // activation tile run at the same time. A single row still splits into
+  // out_dim / kPanelCols tasks.
+  int64_t n_row_tiles = (rows + kRowTile - 1) / kRowTile;
+  int64_t n_panels = (out_dim + kPanelCols - 1) / kPanelCols;
+#pragma omp parallel for
+  for (int64_t task = 0; task < n_row_tiles * n_panels; ++task) {
+    int64_t r0 = task / n_panels * kRowTile;
+    int64_t j0 = task % n_panels * kPanelCols;
+    int64_t n_rows = std::min(kRowTile, rows - r0);
+    int64_t n_cols = std::min(kPanelCols, out_dim - j0);
+    // the last out_dim % kNumCols columns are left to a scalar loop
+    int64_t n_block_cols = n_cols / kNumCols * kNumCols;
+    int32_t acc[kRowTile][kPanelCols] = {};
+    for (int64_t k0 = 0; k0 < in_dim; k0 += kDepthTile) {
+      int64_t depth = std::min(kDepthTile, in_dim - k0);
+      for (int64_t r = 0; r < n_rows; r += 2) {
+        int64_t pair = std::min<int64_t>(2, n_rows - r);
+        auto* a = qx + (r0 + r) * in_dim + k0;
+        for (int64_t c = 0; c < n_block_cols; c += kNumCols) {
+          auto* b = qw + (j0 + c) * in_dim + k0;
+          int32_t sums[2][kNumCols];
+          if (pair == 2) {
+            DotInt8Block<2>(a, in_dim, b, in_dim, depth, sums);
+          } else {
+            DotInt8Block<1>(a, in_dim, b, in_dim, depth, sums);
+          }
+          for (int64_t k = 0; k < pair; ++k) {
+            for (int64_t l = 0; l < kNumCols; ++l) {
+              acc[r + k][c + l] += sums[k][l];
+            }
+          }
+        }
+        for (int64_t c = n_block_cols; c < n_cols; ++c) {
+          auto* b = qw + (j0 + c) * in_dim + k0;
+          for (int64_t k = 0; k < pair; ++k) {
+            int32_t sum = 0;
+            for (int64_t i = 0; i < depth; ++i) {
+              sum += static_cast<int32_t>(a[k * in_dim + i]) * b[i];
+            }
+            acc[r + k][c] += sum;
+          }
+        }
+      }
+    }
+    for (int64_t r = 0; r < n_rows; ++r) {
+      float x_scale = x_scales[(r0 + r) * x_scale_stride];
+      float* y_row = y + (r0 + r) * out_dim + j0;
+      for (int64_t c = 0; c < n_cols; ++c) {
+        y_row[c] = acc[r][c] * x_scale * w_scales[j0 + c];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void QuantizeWeight(const core::Tensor& weight, bool trans_weight,
+                    QuantizedWeight* quantized, const std::string name) {
+  TT_TRACE_KERNEL(name, weight);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, weight.device_type());
+#endif
+  TT_ENFORCE(weight.device_type() == kDLCPU,
+             "QuantizeWeight only supports CPU");
+  TT_ENFORCE_EQ(weight.n_dim(), 2, "weight must be a matrix");
+  int64_t in_dim = trans_weight ? weight.shape(1) : weight.shape(0);
+  int64_t out_dim = trans_weight ? weight.shape(0) : weight.shape(1);
+  auto* src = weight.data<float>();
+  auto* dst = quantized->weight.Reshape<int8_t>({out_dim, in_dim}, kDLCPU, 0,
+                                                name + "/weight");
+  auto* scales =
+      quantized->scales.Reshape<float>({out_dim}, kDLCPU, 0, name + "/scales");
+#pragma omp parallel for
+  for (int64_t j = 0; j < out_dim; ++j) {
+    if (trans_weight) {
+      scales[j] = QuantizeRow(src + j * in_dim, in_dim, 1, dst + j * in_dim);
+    } else {
+      scales[j] = QuantizeRow(src + j, in_dim, out_dim, dst + j * in_dim);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, weight.device_type());
+#endif
+}
+
+void QuantizeActivation(const float* input, int64_t n, float scale,
+                        int8_t* output) {
+  float inv_scale = 1.f / scale;
+#pragma omp simd
+  for (int64_t i = 0; i < n; ++i) {
+    float q = std::nearbyint(input[i] * inv_scale);
+    output[i] = static_cast<int8_t>(std::min(127.f, std::max(-127.f, q)));
+  }
+}
+
+void QuantizedMatMul(const core::Tensor& input, const QuantizedWeight& weight,
+                     core::Tensor* output, const std::string name) {
+  TT_TRACE_KERNEL(name, input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input.device_type());
+#endif
+  TT_ENFORCE(input.device_type() == kDLCPU && output->device_type() == kDLCPU,
+             "QuantizedMatMul only supports CPU");
+  TT_ENFORCE(!weight.is_null(), "QuantizedMatMul needs a quantized weight");
+  int64_t in_dim = weight.in_dim();
+  int64_t out_dim = weight.out_dim();
+  TT_ENFORCE_EQ(input.shape(-1), in_dim, "input has %d features, weight %d",
+                input.shape(-1), in_dim);
+  int64_t rows = input.numel() / in_dim;
+  TT_ENFORCE_EQ(output->numel(), rows * out_dim, "output shape mismatch");
+
+  // call-local buffers, on CPU aligned heap blocks freed when the call
+  // returns, so no thread keeps scratch between calls
+  core::Tensor quantized_input(nullptr);
+  auto* qx = quantized_input.Reshape<int8_t>({rows, in_dim}, kDLCPU, 0,
+                                             name + "/quantized_input");
+  auto* x = input.data<float>();
+  if (weight.input_scale > 0.f) {
+    // a static scale needs no range reduction over the row
+    float input_scale = weight.input_scale;
+#pragma omp parallel for
+    for (int64_t r = 0; r < rows; ++r) {
+      QuantizeActivation(x + r * in_dim, in_dim, input_scale,
+                         qx + r * in_dim);
+    }
+    Int8Gemm(qx, &weight.input_scale, 0, rows, weight,
+             output->mutableData<float>());
+  } else {
+    core::Tensor input_scales(nullptr);
+    auto* x_scales = input_scales.Reshape<float>({rows}, kDLCPU, 0,
+                                                 name + "/input_scales");
+#pragma omp parallel for
+    for (int64_t r = 0; r < rows; ++r) {
+      x_scales[r] = QuantizeRow(x + r * in_dim, in_dim, 1, qx + r * in_dim);
+    }
+    Int8Gemm(qx, x_scales, 1, rows, weight, output->mutableData<float>());
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input.device_type());
+#endif
+}
+
+void QuantizedMatMul(const QuantizedActivation& input,
+                     const QuantizedWeight& weight, core::Tensor* output,
+                     const std::string name) {
+  TT_TRACE_KERNEL(name, input.data);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, output->device_type());
+#endif
+  TT_ENFORCE(!input.is_null(), "QuantizedMatMul needs a quantized input");
+  TT_ENFORCE(!weight.is_null(), "QuantizedMatMul needs a quantized weight");
+  TT_ENFORCE(output->device_type() == kDLCPU,
+             "QuantizedMatMul only supports CPU");
+  int64_t in_dim = weight.in_dim();
+  TT_ENFORCE_EQ(input.data.shape(-1), in_dim,
+                "input has %d features, weight %d", input.data.shape(-1),
+                in_dim);
+  int64_t rows = input.data.numel() / in_dim;
+  TT_ENFORCE_EQ(output->numel(), rows * weight.out_dim(),
+                "output shape mismatch");
+  Int8Gemm(input.data.data<int8_t>(), &input.scale, 0, rows, weight,
+           output->mutableData<float>());
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, output->device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,79 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// An int8 copy of a float weight, quantized symmetrically per output channel.
+// weight: (out_dim, in_dim) int8, a row holds the input weights of one output.
+// scales: (out_dim) float, weight_fp32[j][i] ~= weight[j][i] * scales[j].
+// input_scale: the static scale of the input found by calibration, 0 quantizes
+// each input row with the scale of its own range.
+struct QuantizedWeight {
+  core::Tensor weight{nullptr};
+  core::Tensor scales{nullptr};
+  float input_scale{0.f};
+
+  bool is_null() const { return weight.is_null(); }
+  int64_t in_dim() const { return weight.shape(1); }
+  int64_t out_dim() const { return weight.shape(0); }
+};
+
+// An activation quantized to int8 with a static scale by the epilogue of the
+// kernel producing it, so the int8 GEMM consuming it skips the quantization.
+// data: (..., in_dim) int8, activation_fp32 ~= data * scale.
+struct QuantizedActivation {
+  core::Tensor data{nullptr};
+  float scale{0.f};
+
+  bool is_null() const { return data.is_null() || scale <= 0.f; }
+};
+
+// Quantizes n floats with a static scale, clamping to [-127, 127]. The
+// epilogues of other kernels call it on the rows they just wrote.
+void QuantizeActivation(const float* input, int64_t n, float scale,
+                        int8_t* output);
+
+// Quantizes a float weight to int8.
+// weight: (in_dim, out_dim) float, or (out_dim, in_dim) when trans_weight, the
+// same layout MatMul takes as its second operand.
+void QuantizeWeight(const core::Tensor& weight, bool trans_weight,
+                    QuantizedWeight* quantized,
+                    const std::string name = "QuantizeWeight");
+
+// output = input * dequantize(weight)
+// input: (..., in_dim) float, quantized to int8 with weight.input_scale or
+// else with a scale per row, before the int8 dot products, which accumulate
+// in int32.
+// output: numel = rows * out_dim float, reshaped by the caller.
+// It is written for the few rows of online inference, a large batch may run
+// faster in float, which the precision planner measures per module.
+void QuantizedMatMul(const core::Tensor& input, const QuantizedWeight& weight,
+                     core::Tensor* output,
+                     const std::string name = "QuantizedMatMul");
+
+// output = dequantize(input) * dequantize(weight)
+void QuantizedMatMul(const QuantizedActivation& input,
+                     const QuantizedWeight& weight, core::Tensor* output,
+                     const std::string name = "QuantizedMatMul");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,76 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+TEST_CASE("quantized-matmul-cpu") {
+  // in_dim is not a multiple of the SIMD width to cover the tail, the second
+  // shape spans several row tiles, depth slices and a partial column block.
+  for (auto shape : std::vector<std::vector<int64_t>>{{2, 7, 100, 48},
+                                                      {3, 13, 4200, 75}}) {
+    int64_t batch_size = shape[0], seq_len = shape[1], in_dim = shape[2],
+            out_dim = shape[3];
+    for (bool trans_weight : {false, true}) {
+      auto input = common::CreateTensorAndFillRandom<float>(
+          {batch_size, seq_len, in_dim}, kDLCPU, 0);
+      auto weight =
+          trans_weight
+              ? common::CreateTensorAndFillRandom<float>({out_dim, in_dim},
+                                                         kDLCPU, 0)
+              : common::CreateTensorAndFillRandom<float>({in_dim, out_dim},
+                                                         kDLCPU, 0);
+      auto expected = common::CreateTensor<float>(
+          {batch_size, seq_len, out_dim}, kDLCPU, 0);
+      auto output = common::CreateTensor<float>({batch_size, seq_len, out_dim},
+                                                kDLCPU, 0);
+      MatMul(input, false, weight, trans_weight, 1.0, &expected, 0.0);
+
+      QuantizedWeight quantized;
+      QuantizeWeight(weight, trans_weight, &quantized);
+      REQUIRE(quantized.in_dim() == in_dim);
+      REQUIRE(quantized.out_dim() == out_dim);
+      QuantizedMatMul(input, quantized, &output);
+
+      double dot = 0, norm_y = 0, norm_e = 0;
+      for (int64_t i = 0; i < output.numel(); ++i) {
+        float y = output.data<float>()[i], e = expected.data<float>()[i];
+        REQUIRE(std::abs(y - e) < 2e-2 * (1 + std::abs(e)));
+        dot += y * e;
+        norm_y += y * y;
+        norm_e += e * e;
+      }
+      REQUIRE(dot / std::sqrt(norm_y * norm_e) > 0.999);
+    }
+  }
+
+  auto input = common::CreateTensor<float>({3, 64}, kDLCPU, 0);
+  auto output = common::CreateTensor<float>({3, 8}, kDLCPU, 0);
+  QuantizedWeight empty;
+  REQUIRE_THROWS(QuantizedMatMul(input, empty, &output));
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
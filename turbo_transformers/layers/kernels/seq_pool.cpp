@@ -21,7 +21,9 @@
 #include <limits>
 #include <unordered_map>
 
+#include "turbo_transformers/core/copy_engine.h"
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
 
 namespace turbo_transformers {
 namespace layers {
@@ -97,33 +99,26 @@ void SeqPoolWithIdx(const core::Tensor& input, int64_t idx,
   const T* in_ptr = input.data<T>();
   T* out_ptr = output->mutableData<T>();
   int64_t stride = seq_len * hidden_size;
+  core::MemcpyFlag flag;
   if (input.device_type() == kDLCPU) {
-#pragma omp parallel for
-    for (int64_t i = 0; i < batch_size; ++i) {
-      const T* sub_in_ptr = in_ptr + i * stride + idx * hidden_size;
-      T* sub_out_ptr = out_ptr + i * hidden_size;
-      core::Memcpy(sub_out_ptr, sub_in_ptr, hidden_size * sizeof(T),
-                   core::MemcpyFlag::kCPU2CPU);
-    }
+    flag = core::MemcpyFlag::kCPU2CPU;
   } else if (input.device_type() == kDLGPU) {
-#ifdef TT_WITH_CUDA
-    for (int64_t i = 0; i < batch_size; ++i) {
-      const T* sub_in_ptr = in_ptr + i * stride + idx * hidden_size;
-      T* sub_out_ptr = out_ptr + i * hidden_size;
-      core::Memcpy(sub_out_ptr, sub_in_ptr, hidden_size * sizeof(T),
-                   core::MemcpyFlag::kGPU2GPU);
-    }
-#endif
+    flag = core::MemcpyFlag::kGPU2GPU;
   } else {
     TT_THROW("device_type %d is not supported for SeqPoolWithIdx",
              input.device_type());
   }
+  // the idx-th row of every sequence, one strided copy.
+  core::Memcpy2D(out_ptr, hidden_size * sizeof(T),
+                 in_ptr + idx * hidden_size, stride * sizeof(T),
+                 hidden_size * sizeof(T), batch_size, flag);
 }
 }  // namespace
 
 template <typename T>
 void SeqPool(const core::Tensor& input, layers::types::PoolType pool_type,
              core::Tensor* output) {
+  TT_TRACE_KERNEL("SeqPool", input);
   TT_ENFORCE_EQ(input.n_dim(), 3,
                 "The input's dim should be 3, but the input's dim is %d",
                 input.n_dim());
@@ -0,0 +1,47 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/seq_pool.h"
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+TEST_CASE("seq-pool-cpu-first-last") {
+  constexpr int64_t batch_size = 3, seq_len = 5, hidden_size = 7;
+  core::Tensor input(core::NewDLPackTensorT<float>(
+      {batch_size, seq_len, hidden_size}, kDLCPU, 0));
+  for (int i = 0; i < input.numel(); ++i) {
+    input.mutableData<float>()[i] = i;
+  }
+  core::Tensor first(nullptr), last(nullptr);
+  SeqPool<float>(input, types::PoolType::kFirst, &first);
+  SeqPool<float>(input, types::PoolType::kLast, &last);
+  REQUIRE(first.shape(0) == batch_size);
+  REQUIRE(first.shape(1) == hidden_size);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t h = 0; h < hidden_size; ++h) {
+      REQUIRE(first.data<float>()[b * hidden_size + h] ==
+              (b * seq_len) * hidden_size + h);
+      REQUIRE(last.data<float>()[b * hidden_size + h] ==
+              (b * seq_len + seq_len - 1) * hidden_size + h);
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
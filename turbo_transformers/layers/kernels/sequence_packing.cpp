@@ -0,0 +1,217 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/sequence_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "turbo_transformers/core/gemm_backend.h"
+#include "turbo_transformers/core/trace.h"
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+namespace {
+void EnforceSegments(const core::Tensor& segments, int64_t n_rows,
+                     int64_t row_len) {
+  TT_ENFORCE(segments.device_type() == kDLCPU && segments.n_dim() == 2 &&
+                 segments.shape(1) == 3,
+             "segments should be a (n_sequences, 3) tensor on CPU");
+  auto* segment = segments.data<int64_t>();
+  for (int64_t i = 0; i < segments.shape(0); ++i, segment += 3) {
+    TT_ENFORCE(segment[0] >= 0 && segment[0] < n_rows && segment[1] >= 0 &&
+                   segment[2] > 0 && segment[1] + segment[2] <= row_len,
+               "sequence %d is out of the packed rows", i);
+  }
+}
+}  // namespace
+
+void BuildBlockDiagonalMask(const core::Tensor& segments, int64_t n_rows,
+                            int64_t row_len, core::Tensor* mask,
+                            const std::string name) {
+  TT_TRACE_KERNEL(name, segments);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, kDLCPU);
+#endif
+  EnforceSegments(segments, n_rows, row_len);
+  auto* mask_ptr =
+      mask->Reshape<float>({n_rows, 1, row_len, row_len}, kDLCPU, 0);
+  std::fill(mask_ptr, mask_ptr + mask->numel(), -10000.f);
+  auto* segment = segments.data<int64_t>();
+  for (int64_t i = 0; i < segments.shape(0); ++i, segment += 3) {
+    auto* block = mask_ptr + (segment[0] * row_len + segment[1]) * row_len +
+                  segment[1];
+    for (int64_t r = 0; r < segment[2]; ++r, block += row_len) {
+      std::fill(block, block + segment[2], 0.f);
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, kDLCPU);
+#endif
+}
+
+void BlockDiagonalAttention(const core::Tensor& q, const core::Tensor& k,
+                            const core::Tensor& v, const core::Tensor& segments,
+                            float scale, core::Tensor* context,
+                            const std::string name) {
+  TT_TRACE_KERNEL(name, q);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, q.device_type());
+#endif
+  TT_ENFORCE(q.device_type() == kDLCPU && k.device_type() == kDLCPU &&
+                 v.device_type() == kDLCPU,
+             "BlockDiagonalAttention only supports CPU");
+  TT_ENFORCE_EQ(q.n_dim(), 4, "q should be (rows, heads, row_len, size)");
+  auto n_rows = q.shape(0), num_heads = q.shape(1), row_len = q.shape(2),
+       size_per_head = q.shape(3);
+  TT_ENFORCE(k.numel() == q.numel() && v.numel() == q.numel(),
+             "q, k and v should have the same shape");
+  EnforceSegments(segments, n_rows, row_len);
+
+  auto* q_ptr = q.data<float>();
+  auto* k_ptr = k.data<float>();
+  auto* v_ptr = v.data<float>();
+  auto* out = context->Reshape<float>(
+      {n_rows, num_heads, row_len, size_per_head}, kDLCPU, 0);
+  std::fill(out, out + context->numel(), 0.f);
+
+  // the sequences of each length, and the offset of their scores
+  std::map<int64_t, std::vector<int64_t>> lengths;
+  auto* segment_ptr = segments.data<int64_t>();
+  int64_t n_sequences = segments.shape(0);
+  for (int64_t i = 0; i < n_sequences; ++i) {
+    lengths[segment_ptr[3 * i + 2]].push_back(i);
+  }
+  int64_t n_scores = 0;
+  for (int64_t i = 0; i < n_sequences; ++i) {
+    n_scores += num_heads * segment_ptr[3 * i + 2] * segment_ptr[3 * i + 2];
+  }
+  std::vector<float> scores(n_scores);
+
+  auto backend = core::GemmBackendRegistry::GetInstance().Select(name);
+  float* group_scores = scores.data();
+  std::vector<const float*> a_array, b_array;
+  std::vector<float*> c_array;
+  for (auto& group : lengths) {
+    int64_t len = group.first;
+    int64_t batch = group.second.size() * num_heads;
+    a_array.resize(batch);
+    b_array.resize(batch);
+    c_array.resize(batch);
+    int64_t j = 0;
+    for (auto i : group.second) {
+      auto* segment = segment_ptr + 3 * i;
+      for (int64_t h = 0; h < num_heads; ++h, ++j) {
+        int64_t offset =
+            ((segment[0] * num_heads + h) * row_len + segment[1]) *
+            size_per_head;
+        a_array[j] = q_ptr + offset;
+        b_array[j] = k_ptr + offset;
+        c_array[j] = group_scores + j * len * len;
+      }
+    }
+    // scores = scale * q * k^T of every block
+    backend->SgemmBatch(false, true, len, len, size_per_head, scale,
+                        a_array.data(), size_per_head, b_array.data(),
+                        size_per_head, 0.f, c_array.data(), len, batch);
+
+    int64_t n_score_rows = batch * len;
+#pragma omp parallel for
+    for (int64_t r = 0; r < n_score_rows; ++r) {
+      float* row = group_scores + r * len;
+      float max_val = std::numeric_limits<float>::lowest();
+      for (int64_t c = 0; c < len; ++c) {
+        max_val = std::max(max_val, row[c]);
+      }
+      float sum = 0;
+      for (int64_t c = 0; c < len; ++c) {
+        row[c] = std::exp(row[c] - max_val);
+        sum += row[c];
+      }
+      float coef = 1.f / sum;
+      for (int64_t c = 0; c < len; ++c) {
+        row[c] *= coef;
+      }
+    }
+
+    // context = scores * v of every block
+    j = 0;
+    for (auto i : group.second) {
+      auto* segment = segment_ptr + 3 * i;
+      for (int64_t h = 0; h < num_heads; ++h, ++j) {
+        int64_t offset =
+            ((segment[0] * num_heads + h) * row_len + segment[1]) *
+            size_per_head;
+        a_array[j] = c_array[j];
+        b_array[j] = v_ptr + offset;
+        c_array[j] = out + offset;
+      }
+    }
+    backend->SgemmBatch(false, false, len, size_per_head, len, 1.f,
+                        a_array.data(), len, b_array.data(), size_per_head,
+                        0.f, c_array.data(), size_per_head, batch);
+    group_scores += batch * len * len;
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, q.device_type());
+#endif
+}
+
+void UnpackSequences(const core::Tensor& packed, const core::Tensor& segments,
+                     int64_t max_len, core::Tensor* output,
+                     const std::string name) {
+  TT_TRACE_KERNEL(name, packed);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, packed.device_type());
+#endif
+  TT_ENFORCE(packed.device_type() == kDLCPU,
+             "UnpackSequences only supports CPU");
+  TT_ENFORCE_EQ(packed.n_dim(), 3, "packed should be (rows, row_len, hidden)");
+  auto row_len = packed.shape(1), hidden_size = packed.shape(2);
+  EnforceSegments(segments, packed.shape(0), row_len);
+  int64_t n_sequences = segments.shape(0);
+  auto* in = packed.data<float>();
+  auto* out = output->Reshape<float>({n_sequences, max_len, hidden_size},
+                                     kDLCPU, 0);
+  auto* segment_ptr = segments.data<int64_t>();
+#pragma omp parallel for
+  for (int64_t i = 0; i < n_sequences; ++i) {
+    auto* segment = segment_ptr + 3 * i;
+    int64_t len = std::min(segment[2], max_len);
+    auto* dst = out + i * max_len * hidden_size;
+    std::memcpy(dst,
+                in + (segment[0] * row_len + segment[1]) * hidden_size,
+                len * hidden_size * sizeof(float));
+    std::fill(dst + len * hidden_size, dst + max_len * hidden_size, 0.f);
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, packed.device_type());
+#endif
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
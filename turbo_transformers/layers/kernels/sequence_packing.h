@@ -0,0 +1,55 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <string>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+// Kernels of the sequences packed end to end into the rows of a batch, see
+// layers::SequencePacking. segments: (n_sequences, 3) int64 on CPU, the
+// (row, offset, length) of each sequence in the packed rows.
+
+// Builds the block diagonal attention mask of the packed rows for
+// ApplyMaskAndSoftmax: mask (n_rows, 1, row_len, row_len) float, 0 where a
+// token attends to a token of its own sequence and -10000 elsewhere.
+void BuildBlockDiagonalMask(const core::Tensor& segments, int64_t n_rows,
+                            int64_t row_len, core::Tensor* mask,
+                            const std::string name = "BuildBlockDiagonalMask");
+
+// The self attention of the packed rows restricted to the diagonal blocks:
+// every sequence attends to itself only, and the off-diagonal blocks are
+// never computed.
+//   context = softmax(scale * q * k^T) * v
+// q, k, v: (n_rows, num_heads, row_len, size_per_head) float.
+// context: of the same shape, 0 at the positions left out of all sequences.
+// The sequences of the same length run in one batched GEMM.
+void BlockDiagonalAttention(const core::Tensor& q, const core::Tensor& k,
+                            const core::Tensor& v, const core::Tensor& segments,
+                            float scale, core::Tensor* context,
+                            const std::string name = "BlockDiagonalAttention");
+
+// Copies the tokens of every sequence from packed (n_rows, row_len, hidden)
+// to output (n_sequences, max_len, hidden), padded with 0.
+void UnpackSequences(const core::Tensor& packed, const core::Tensor& segments,
+                     int64_t max_len, core::Tensor* output,
+                     const std::string name = "UnpackSequences");
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
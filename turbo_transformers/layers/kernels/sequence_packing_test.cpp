@@ -0,0 +1,111 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/kernels/sequence_packing.h"
+
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/softmax.h"
+
+namespace turbo_transformers {
+namespace layers {
+namespace kernels {
+
+static core::Tensor MakeSegments(const std::vector<int64_t>& values) {
+  core::Tensor segments(nullptr);
+  auto* ptr = segments.Reshape<int64_t>(
+      {static_cast<int64_t>(values.size() / 3), 3}, kDLCPU, 0);
+  std::copy(values.begin(), values.end(), ptr);
+  return segments;
+}
+
+TEST_CASE("sequence-packing-block-diagonal-attention-cpu") {
+  int64_t n_rows = 2, num_heads = 3, row_len = 9, size_per_head = 8;
+  // (row, offset, length), the last position of each row is padding
+  auto segments = MakeSegments({0, 0, 3, 0, 3, 5, 1, 0, 3, 1, 3, 2, 1, 5, 3});
+  auto q = common::CreateTensorAndFillRandom<float>(
+      {n_rows, num_heads, row_len, size_per_head}, kDLCPU, 0);
+  auto k = common::CreateTensorAndFillRandom<float>(
+      {n_rows, num_heads, row_len, size_per_head}, kDLCPU, 0);
+  auto v = common::CreateTensorAndFillRandom<float>(
+      {n_rows, num_heads, row_len, size_per_head}, kDLCPU, 0);
+  float scale = 1.f / std::sqrt(static_cast<float>(size_per_head));
+
+  core::Tensor context(nullptr);
+  BlockDiagonalAttention(q, k, v, segments, scale, &context);
+
+  // the dense attention with the block diagonal mask
+  core::Tensor mask(nullptr), scores(nullptr), expected(nullptr);
+  BuildBlockDiagonalMask(segments, n_rows, row_len, &mask);
+  scores.Reshape<float>({n_rows, num_heads, row_len, row_len}, kDLCPU, 0);
+  BatchMatMul(q, false, k, true, scale, &scores, 0.f);
+  ApplyMaskAndSoftmax(&scores, mask, 1.f);
+  expected.Reshape<float>({n_rows, num_heads, row_len, size_per_head}, kDLCPU,
+                          0);
+  BatchMatMul(scores, false, v, false, 1.f, &expected, 0.f);
+
+  REQUIRE(context.numel() == expected.numel());
+  for (int64_t r = 0; r < n_rows; ++r) {
+    for (int64_t h = 0; h < num_heads; ++h) {
+      for (int64_t t = 0; t < row_len; ++t) {
+        bool padding = t == row_len - 1;
+        for (int64_t d = 0; d < size_per_head; ++d) {
+          auto i = ((r * num_heads + h) * row_len + t) * size_per_head + d;
+          if (padding) {
+            REQUIRE(context.data<float>()[i] == 0.f);
+          } else {
+            REQUIRE(std::abs(context.data<float>()[i] -
+                             expected.data<float>()[i]) < 1e-4);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("sequence-packing-unpack-cpu") {
+  int64_t n_rows = 2, row_len = 6, hidden_size = 4, max_len = 4;
+  auto segments = MakeSegments({1, 0, 4, 0, 2, 3, 0, 0, 2});
+  core::Tensor packed(nullptr), output(nullptr);
+  auto* in = packed.Reshape<float>({n_rows, row_len, hidden_size}, kDLCPU, 0);
+  for (int64_t i = 0; i < packed.numel(); ++i) {
+    in[i] = static_cast<float>(i);
+  }
+  UnpackSequences(packed, segments, max_len, &output);
+  REQUIRE(output.shape(0) == 3);
+  REQUIRE(output.shape(1) == max_len);
+  auto* out = output.data<float>();
+  std::vector<std::vector<int64_t>> tokens{{1, 0, 4}, {0, 2, 3}, {0, 0, 2}};
+  for (int64_t s = 0; s < 3; ++s) {
+    for (int64_t t = 0; t < max_len; ++t) {
+      for (int64_t j = 0; j < hidden_size; ++j) {
+        float expected =
+            t < tokens[s][2]
+                ? in[((tokens[s][0] * row_len) + tokens[s][1] + t) *
+                         hidden_size +
+                     j]
+                : 0.f;
+        REQUIRE(out[(s * max_len + t) * hidden_size + j] == expected);
+      }
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -15,10 +15,15 @@
 
 #include <cmath>
 #include <numeric>
+
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_device_context.h"
 #include "turbo_transformers/layers/kernels/gpu_softmax_kernel.h"
 #endif
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
 
 namespace turbo_transformers {
 namespace layers {
@@ -27,11 +32,17 @@ namespace kernels {
 // nullptr is2D is used to distinguish the two scenarios.
 void SoftmaxMask(float* qk_buf, const float* attr_mask, int64_t batch_size,
                  int64_t head_num, int64_t from_seq_len, int64_t to_seq_len,
-                 float scale, bool is2D = true) {
+                 float scale, bool is2D, const std::string& name) {
   int64_t M = batch_size * head_num * from_seq_len;
   int64_t N = to_seq_len;
+#ifdef WITH_PERFTOOLS
+  core::ParallelRegionProfile region(name);
+#endif
 #pragma omp parallel for
   for (int64_t i = 0; i < M; ++i) {
+#ifdef WITH_PERFTOOLS
+    core::ParallelChunkProfile chunk(&region);
+#endif
     auto* qk_buf_ptr = qk_buf + i * N;
     if (attr_mask != nullptr) {
       const float* attr_mask_ptr;
@@ -82,6 +93,7 @@ void SoftmaxMask(float* qk_buf, const float* attr_mask, int64_t batch_size,
 
 void ApplyMaskAndSoftmax(core::Tensor* inout, const core::Tensor& att_mask,
                          float scale, const std::string name) {
+  TT_TRACE_KERNEL(name, *inout);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, inout->device_type());
@@ -106,7 +118,7 @@ void ApplyMaskAndSoftmax(core::Tensor* inout, const core::Tensor& att_mask,
   }
   if (inout->device_type() == kDLCPU) {
     SoftmaxMask(inout->mutableData<float>(), att_mask_data, batch_size,
-                num_att_heads, from_seq_len, to_seq_len, scale, is_2D);
+                num_att_heads, from_seq_len, to_seq_len, scale, is_2D, name);
   } else if (inout->device_type() == kDLGPU) {
 #ifdef TT_WITH_CUDA
     auto& cuda_ctx = core::CUDADeviceContext::GetInstance();
@@ -17,6 +17,7 @@
 
 #include "common.h"
 #include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/core/cuda_device_context.h"
 #include "turbo_transformers/layers/kernels/gpu_transpose_kernel.h"
@@ -79,6 +80,7 @@ static void TransposeForScoreImpl(float* output, const float* input,
 
 void TransposeForScore(core::Tensor* output, const core::Tensor& input,
                        const std::string name) {
+  TT_TRACE_KERNEL(name, input);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input.device_type());
@@ -116,6 +118,7 @@ void TransposeForScore(core::Tensor* output, const core::Tensor& input,
 void AddBiasTransposeForScore(const core::Tensor& input,
                               const core::Tensor& bias, core::Tensor* output,
                               const std::string name) {
+  TT_TRACE_KERNEL(name, input);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input.device_type());
@@ -151,6 +154,7 @@ void SplitAddBiasTransposeForScore(core::Tensor* output_tensor,
                                    const core::Tensor& input_tensor,
                                    const core::Tensor& bias_tensor,
                                    const std::string name) {
+  TT_TRACE_KERNEL(name, input_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input_tensor.device_type());
@@ -233,6 +237,7 @@ void SplitAddBiasTransposeForScore(const core::Tensor& input_tensor,
                                    core::Tensor& k_out_tensor,
                                    core::Tensor& v_out_tensor,
                                    const std::string name) {
+  TT_TRACE_KERNEL(name, input_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input_tensor.device_type());
@@ -330,6 +335,84 @@ void SplitAddBiasTransposeForScore(const core::Tensor& input_tensor,
 #endif
 }
 
+void GroupedSplitAddBiasTransposeForScore(const core::Tensor& input_tensor,
+                                          const core::Tensor& bias_tensor,
+                                          core::Tensor& q_out_tensor,
+                                          core::Tensor& k_out_tensor,
+                                          core::Tensor& v_out_tensor,
+                                          const std::string name) {
+  TT_TRACE_KERNEL(name, input_tensor);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile(name, input_tensor.device_type());
+#endif
+  TT_ENFORCE_EQ(input_tensor.n_dim(), 3,
+                "input_tensor should be (batch_size, seq_length, (q_heads + 2 "
+                "* kv_heads) * size_per_head)");
+  TT_ENFORCE_EQ(q_out_tensor.n_dim(), 4,
+                "q_out should be (batch_size, q_heads, seq_length, "
+                "size_per_head)");
+  auto batch_size = input_tensor.shape(0);
+  auto seq_length = input_tensor.shape(1);
+  auto q_heads = q_out_tensor.shape(1);
+  auto kv_heads = k_out_tensor.shape(1);
+  auto width = q_out_tensor.shape(3);
+  auto row_size = (q_heads + 2 * kv_heads) * width;
+  TT_ENFORCE_EQ(input_tensor.shape(2), row_size,
+                "the projections of %d q heads and %d kv heads of %d should "
+                "be %d wide",
+                q_heads, kv_heads, width, row_size);
+  TT_ENFORCE_EQ(bias_tensor.numel(), row_size,
+                "bias_tensor should have %d elements", row_size);
+  auto kv_numel = batch_size * kv_heads * seq_length * width;
+  TT_ENFORCE(k_out_tensor.numel() == kv_numel &&
+                 v_out_tensor.numel() == kv_numel,
+             "k_out and v_out should be (batch_size, kv_heads, seq_length, "
+             "size_per_head)");
+  TT_ENFORCE(input_tensor.device_type() == kDLCPU &&
+                 bias_tensor.device_type() == kDLCPU &&
+                 q_out_tensor.device_type() == kDLCPU,
+             "GroupedSplitAddBiasTransposeForScore only supports CPU");
+
+  auto input = input_tensor.data<float>();
+  auto bias = bias_tensor.data<float>();
+  float* outs[3] = {q_out_tensor.mutableData<float>(),
+                    k_out_tensor.mutableData<float>(),
+                    v_out_tensor.mutableData<float>()};
+  // the heads of q, k and v in a row of the input
+  const int64_t heads_of[3] = {q_heads, kv_heads, kv_heads};
+  const int64_t head_offset[3] = {0, q_heads, q_heads + kv_heads};
+  auto total_heads = q_heads + 2 * kv_heads;
+#pragma omp parallel for
+  for (int64_t idx = 0; idx < batch_size * seq_length * total_heads; ++idx) {
+    auto batch_idx = idx / (seq_length * total_heads);
+    auto seq_idx = idx / total_heads % seq_length;
+    auto row_head = idx % total_heads;
+    int weight_idx = 2;
+    if (row_head < q_heads) {
+      weight_idx = 0;
+    } else if (row_head < q_heads + kv_heads) {
+      weight_idx = 1;
+    }
+    auto head_idx = row_head - head_offset[weight_idx];
+    auto n_heads = heads_of[weight_idx];
+    const float* src_ptr = input +
+                           (batch_idx * seq_length + seq_idx) * row_size +
+                           row_head * width;
+    const float* bias_ptr = bias + row_head * width;
+    float* dst_ptr =
+        outs[weight_idx] +
+        ((batch_idx * n_heads + head_idx) * seq_length + seq_idx) * width;
+#pragma omp simd
+    for (int64_t width_idx = 0; width_idx < width; ++width_idx) {
+      dst_ptr[width_idx] = src_ptr[width_idx] + bias_ptr[width_idx];
+    }
+  }
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile(name, input_tensor.device_type());
+#endif
+}
+
 }  // namespace kernels
 }  // namespace layers
 }  // namespace turbo_transformers
@@ -58,6 +58,17 @@ extern void SplitAddBiasTransposeForScore(
     core::Tensor& q_out, core::Tensor& k_out, core::Tensor& v_out,
     const std::string name = "SplitAddBiasTransposeForScore");
 
+// The split of grouped-query attention, whose k and v have fewer heads than q.
+// input: (batch_size, seq_length, (q_heads + 2 * kv_heads) * size_per_head),
+// the q, k and v projections side by side.
+// bias: ((q_heads + 2 * kv_heads) * size_per_head)
+// q_out: (batch_size, q_heads, seq_length, size_per_head)
+// k_out, v_out: (batch_size, kv_heads, seq_length, size_per_head)
+extern void GroupedSplitAddBiasTransposeForScore(
+    const core::Tensor& input_tensor, const core::Tensor& bias_tensor,
+    core::Tensor& q_out, core::Tensor& k_out, core::Tensor& v_out,
+    const std::string name = "GroupedSplitAddBiasTransposeForScore");
+
 }  // namespace kernels
 }  // namespace layers
 }  // namespace turbo_transformers
@@ -14,6 +14,8 @@
 #include "utils.h"
 
 #include "common.h"
+#include "turbo_transformers/core/copy_engine.h"
+#include "turbo_transformers/core/trace.h"
 #ifdef TT_WITH_CUDA
 #include <cuda.h>
 
@@ -32,6 +34,7 @@ namespace kernels {
 template <typename T>
 void Concat(const core::Tensor& t1, const core::Tensor& t2, size_t dim,
             core::Tensor* output, const std::string name) {
+  TT_TRACE_KERNEL(name, t1);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, t1.device_type());
@@ -75,21 +78,15 @@ void Concat(const core::Tensor& t1, const core::Tensor& t2, size_t dim,
                  low_dim, cuda_ctx.stream(), output->mutableData<T>());
 #endif
   } else if (t1.device_type() == kDLCPU) {
-#pragma omp parallel for
-    for (int64_t i = 0; i < high_dim; ++i) {
-      for (int64_t j = 0; j < t1_size; ++j) {
-        core::Copy(
-            t1.data<T>() + (i * t1_size + j) * low_dim, low_dim,
-            t1.device_type(), output->device_type(),
-            output->mutableData<T>() + (i * (t1_size + t2_size) + j) * low_dim);
-      }
-      for (int64_t j = 0; j < t2_size; ++j) {
-        core::Copy(t2.data<T>() + (i * t2_size + j) * low_dim, low_dim,
-                   t1.device_type(), output->device_type(),
-                   output->mutableData<T>() +
-                       (i * (t1_size + t2_size) + t1_size + j) * low_dim);
-      }
-    }
+    // each of t1 and t2 is a strided copy of high_dim rows into output.
+    size_t out_pitch = (t1_size + t2_size) * low_dim * sizeof(T);
+    core::Memcpy2D(output->mutableData<T>(), out_pitch, t1.data<T>(),
+                   t1_size * low_dim * sizeof(T), t1_size * low_dim * sizeof(T),
+                   high_dim, core::MemcpyFlag::kCPU2CPU);
+    core::Memcpy2D(output->mutableData<T>() + t1_size * low_dim, out_pitch,
+                   t2.data<T>(), t2_size * low_dim * sizeof(T),
+                   t2_size * low_dim * sizeof(T), high_dim,
+                   core::MemcpyFlag::kCPU2CPU);
   }
 #ifdef WITH_PERFTOOLS
   profile_ctx.end_profile(name, t1.device_type());
@@ -102,6 +99,7 @@ template void Concat<float>(const core::Tensor& t1, const core::Tensor& t2,
 
 void AddBias(const core::Tensor& bias, core::Tensor* output,
              const std::string name) {
+  TT_TRACE_KERNEL(name, bias);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, bias.device_type());
@@ -134,6 +132,7 @@ void AddBias(const core::Tensor& bias, core::Tensor* output,
 void AddInputBias(const core::Tensor& input1, const core::Tensor& input2,
                   const core::Tensor& bias, core::Tensor* output,
                   const std::string name) {
+  TT_TRACE_KERNEL(name, input1);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile(name, input1.device_type());
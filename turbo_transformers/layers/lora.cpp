@@ -0,0 +1,166 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/lora.h"
+
+#include "turbo_transformers/layers/kernels/lora.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+void LoRAAdapter::Add(const std::string &module, core::Tensor a,
+                      core::Tensor b, float scale) {
+  TT_ENFORCE_EQ(a.n_dim(), 2, "lora a of %s must be a matrix", module);
+  TT_ENFORCE_EQ(b.n_dim(), 2, "lora b of %s must be a matrix", module);
+  TT_ENFORCE_EQ(a.shape(1), b.shape(0), "the ranks of %s mismatch", module);
+  TT_ENFORCE(weights_.count(module) == 0, "%s is added twice", module);
+  bytes_ += (a.numel() + b.numel()) * sizeof(float);
+  weights_.emplace(module, LoRAWeights{std::move(a), std::move(b), scale});
+}
+
+const LoRAWeights *LoRAAdapter::Find(const std::string &module) const {
+  auto it = weights_.find(module);
+  return it == weights_.end() ? nullptr : &it->second;
+}
+
+std::shared_ptr<const LoRAAdapter> LoRAAdapterCache::Get(
+    const std::string &name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->second;
+    }
+  }
+  // load without the lock, the other adapters are still served meanwhile.
+  std::shared_ptr<const LoRAAdapter> adapter = loader_(name);
+  TT_ENFORCE(adapter != nullptr, "can not load adapter %s", name);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(name);
+  if (it != index_.end()) {  // loaded by another thread meanwhile
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+  lru_.emplace_front(name, adapter);
+  index_[name] = lru_.begin();
+  bytes_ += adapter->bytes();
+  while (bytes_ > capacity_bytes_ && lru_.size() > 1) {
+    auto &victim = lru_.back();
+    bytes_ -= victim.second->bytes();
+    index_.erase(victim.first);
+    lru_.pop_back();
+  }
+  return adapter;
+}
+
+void LoRAAdapterCache::Evict(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(name);
+  if (it != index_.end()) {
+    bytes_ -= it->second->second->bytes();
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+}
+
+bool LoRAAdapterCache::Contains(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.count(name) != 0;
+}
+
+size_t LoRAAdapterCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lru_.size();
+}
+
+size_t LoRAAdapterCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+LoRABatch::LoRABatch(LoRAAdapterCache *cache,
+                     const std::vector<std::string> &adapter_names) {
+  std::unordered_map<std::string, int64_t> ids;
+  for (auto &name : adapter_names) {
+    if (name.empty()) {
+      sequence_adapter_.push_back(-1);
+      continue;
+    }
+    auto it = ids.find(name);
+    if (it == ids.end()) {
+      it = ids.emplace(name, adapters_.size()).first;
+      adapters_.emplace_back(cache->Get(name));
+    }
+    sequence_adapter_.push_back(it->second);
+  }
+}
+
+void LoRABatch::Apply(const std::string &module, const core::Tensor &input,
+                      core::Tensor *output) const {
+  std::vector<const core::Tensor *> lora_a, lora_b;
+  std::vector<float> scales;
+  bool any = false;
+  for (auto &adapter : adapters_) {
+    auto *weights = adapter->Find(module);
+    lora_a.push_back(weights ? &weights->a : nullptr);
+    lora_b.push_back(weights ? &weights->b : nullptr);
+    scales.push_back(weights ? weights->scale : 0.f);
+    any = any || weights != nullptr;
+  }
+  if (!any) {
+    return;
+  }
+
+  int64_t n_sequences = sequence_adapter_.size();
+  int64_t rows = input.numel() / input.shape(-1);
+  TT_ENFORCE_EQ(rows % n_sequences, 0,
+                "%d rows can not be split over %d sequences", rows,
+                n_sequences);
+  int64_t rows_per_sequence = rows / n_sequences;
+  core::Tensor row_adapter(nullptr);
+  auto *ids = row_adapter.Reshape<int64_t>({rows}, kDLCPU, 0);
+  for (int64_t r = 0; r < rows; ++r) {
+    ids[r] = sequence_adapter_[r / rows_per_sequence];
+  }
+  kernels::GroupedLoRA(input, row_adapter, lora_a, lora_b, scales, output,
+                       "LoRA/" + module);
+}
+
+namespace {
+thread_local const LoRABatch *current_batch = nullptr;
+thread_local std::string current_prefix;
+}  // namespace
+
+LoRAScope::LoRAScope(const LoRABatch *batch, std::string prefix)
+    : prev_batch_(current_batch), prev_prefix_(std::move(current_prefix)) {
+  current_batch = batch;
+  current_prefix = std::move(prefix);
+}
+
+LoRAScope::~LoRAScope() {
+  current_batch = prev_batch_;
+  current_prefix = std::move(prev_prefix_);
+}
+
+void ApplyLoRA(const char *module, const core::Tensor &input,
+               core::Tensor *output) {
+  if (current_batch != nullptr) {
+    current_batch->Apply(current_prefix + module, input, output);
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
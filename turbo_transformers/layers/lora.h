@@ -0,0 +1,123 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// The low-rank update of one projection: W + scale * a * b, where a is
+// (in_dim, rank) and b is (rank, out_dim).
+struct LoRAWeights {
+  core::Tensor a;
+  core::Tensor b;
+  float scale;
+};
+
+// The adapters of one fine-tune, keyed by the projection they adapt, e.g.
+// "encoder.layer.0.attention.qkv". The q, k and v adapters of a fused qkv
+// projection are stored as one adapter of rank 3r: a = [a_q, a_k, a_v] and b
+// is block diagonal.
+class LoRAAdapter {
+ public:
+  void Add(const std::string &module, core::Tensor a, core::Tensor b,
+           float scale);
+
+  const LoRAWeights *Find(const std::string &module) const;
+
+  size_t bytes() const { return bytes_; }
+
+ private:
+  std::unordered_map<std::string, LoRAWeights> weights_;
+  size_t bytes_{0};
+};
+
+// Keeps the recently used adapters in memory, at most capacity_bytes of them.
+// A missing adapter is loaded by the loader on demand and the least recently
+// used ones are evicted. An evicted adapter stays alive until the batches
+// using it are done.
+class LoRAAdapterCache {
+ public:
+  using Loader =
+      std::function<std::shared_ptr<LoRAAdapter>(const std::string &name)>;
+
+  LoRAAdapterCache(Loader loader, size_t capacity_bytes)
+      : loader_(std::move(loader)), capacity_bytes_(capacity_bytes) {}
+
+  std::shared_ptr<const LoRAAdapter> Get(const std::string &name);
+
+  void Evict(const std::string &name);
+  bool Contains(const std::string &name) const;
+  size_t size() const;
+  size_t bytes() const;
+
+ private:
+  using Entry = std::pair<std::string, std::shared_ptr<const LoRAAdapter>>;
+
+  Loader loader_;
+  size_t capacity_bytes_;
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_;  // the most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t bytes_{0};
+};
+
+// The adapters of a batch, sequence i uses adapter adapter_names[i] or the
+// base model if its name is empty. The base GEMMs run once for the whole
+// batch and Apply adds the per-row adapter deltas.
+class LoRABatch {
+ public:
+  LoRABatch(LoRAAdapterCache *cache,
+            const std::vector<std::string> &adapter_names);
+
+  // input and output are the input and the output of the base GEMM of
+  // module, their rows are split evenly over the sequences of the batch.
+  void Apply(const std::string &module, const core::Tensor &input,
+             core::Tensor *output) const;
+
+ private:
+  std::vector<std::shared_ptr<const LoRAAdapter>> adapters_;
+  std::vector<int64_t> sequence_adapter_;
+};
+
+// The layers run by this thread in the scope add the deltas of batch, their
+// projection names are prefixed by prefix, e.g. "encoder.layer.3.".
+class LoRAScope {
+ public:
+  LoRAScope(const LoRABatch *batch, std::string prefix);
+  ~LoRAScope();
+
+ private:
+  const LoRABatch *prev_batch_;
+  std::string prev_prefix_;
+};
+
+// Called by the layers after the base GEMM of module, a no-op outside of a
+// LoRAScope.
+extern void ApplyLoRA(const char *module, const core::Tensor &input,
+                      core::Tensor *output);
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,126 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/lora.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/bert_intermediate.h"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+static core::Tensor Random(std::initializer_list<int64_t> shape) {
+  return kernels::common::CreateTensorAndFillRandom<float>(shape, kDLCPU, 0);
+}
+
+static core::Tensor Clone(const core::Tensor &tensor) {
+  core::Tensor result(nullptr);
+  std::vector<int64_t> shape(&tensor.shape(0),
+                             &tensor.shape(0) + tensor.n_dim());
+  result.Reshape<float>(shape, kDLCPU, 0);
+  std::memcpy(result.mutableData<float>(), tensor.data<float>(),
+              tensor.numel() * sizeof(float));
+  return result;
+}
+
+TEST_CASE("lora-adapter-cache") {
+  int n_loads = 0;
+  auto loader = [&](const std::string &name) {
+    ++n_loads;
+    auto adapter = std::make_shared<LoRAAdapter>();
+    adapter->Add("intermediate.dense", Random({8, 2}), Random({2, 16}), 1.f);
+    return adapter;
+  };
+  size_t adapter_bytes = (8 * 2 + 2 * 16) * sizeof(float);
+  LoRAAdapterCache cache(loader, 2 * adapter_bytes);
+
+  auto a = cache.Get("a");
+  REQUIRE(a->bytes() == adapter_bytes);
+  REQUIRE(a->Find("intermediate.dense") != nullptr);
+  REQUIRE(a->Find("output.dense") == nullptr);
+  REQUIRE(cache.Get("a") == a);
+  cache.Get("b");
+  REQUIRE(n_loads == 2);
+  cache.Get("a");  // b is the least recently used now
+  cache.Get("c");
+  REQUIRE(n_loads == 3);
+  REQUIRE(cache.size() == 2);
+  REQUIRE(cache.bytes() == 2 * adapter_bytes);
+  REQUIRE(cache.Contains("a"));
+  REQUIRE_FALSE(cache.Contains("b"));
+  cache.Evict("a");
+  REQUIRE_FALSE(cache.Contains("a"));
+  // the evicted adapter is still usable by its holders
+  REQUIRE(a->Find("intermediate.dense") != nullptr);
+}
+
+TEST_CASE("lora-batch-bert-intermediate") {
+  int64_t batch_size = 3, seq_len = 4, hidden = 8, ffn = 16, rank = 2;
+  auto weight = Random({hidden, ffn});
+  auto bias = Random({ffn});
+  auto lora_a = Random({hidden, rank});
+  auto lora_b = Random({rank, ffn});
+  float scale = 0.5f;
+
+  LoRAAdapterCache cache(
+      [&](const std::string &name) {
+        auto adapter = std::make_shared<LoRAAdapter>();
+        adapter->Add("encoder.layer.0.intermediate.dense", Clone(lora_a),
+                     Clone(lora_b), scale);
+        return adapter;
+      },
+      1 << 20);
+
+  auto input = Random({batch_size, seq_len, hidden});
+  core::Tensor output(nullptr);
+  BertIntermediate base(Clone(weight), Clone(bias));
+  // sequence 0 and 2 use the adapter, 1 the base model
+  LoRABatch batch(&cache, {"customer", "", "customer"});
+  {
+    LoRAScope scope(&batch, "encoder.layer.0.");
+    base(input, &output);
+  }
+
+  // the adapter merged into the weight
+  auto merged_weight = Clone(weight);
+  auto *w = merged_weight.mutableData<float>();
+  for (int64_t i = 0; i < hidden; ++i) {
+    for (int64_t j = 0; j < ffn; ++j) {
+      for (int64_t k = 0; k < rank; ++k) {
+        w[i * ffn + j] += scale * lora_a.data<float>()[i * rank + k] *
+                          lora_b.data<float>()[k * ffn + j];
+      }
+    }
+  }
+  BertIntermediate merged(std::move(merged_weight), Clone(bias));
+  core::Tensor base_output(nullptr), merged_output(nullptr);
+  base(input, &base_output);
+  merged(input, &merged_output);
+
+  int64_t sequence_numel = seq_len * ffn;
+  for (int64_t b = 0; b < batch_size; ++b) {
+    auto &expected = b == 1 ? base_output : merged_output;
+    for (int64_t i = b * sequence_numel; i < (b + 1) * sequence_numel; ++i) {
+      REQUIRE(std::abs(output.data<float>()[i] - expected.data<float>()[i]) <
+              1e-4);
+    }
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -15,12 +15,19 @@
 
 #include "loguru.hpp"
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/calibration.h"
 #include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/fused_attention.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/kernels/sequence_packing.h"
 #include "turbo_transformers/layers/kernels/softmax.h"
 #include "turbo_transformers/layers/kernels/transpose.h"
 #include "turbo_transformers/layers/kernels/utils.h"
+#include "turbo_transformers/layers/lora.h"
+#include "turbo_transformers/layers/sequence_packing.h"
 
 #ifdef WITH_PERFTOOLS
 #include "turbo_transformers/core/profiler.h"
@@ -37,7 +44,8 @@ void MultiHeadedAttention::operator()(
     const std::string& attn_type, core::Tensor* output, core::Tensor* att_score,
     std::unordered_map<std::string, core::Tensor*> layer_cache,
     bool pre_layernorm, bool post_layernorm, bool post_add_input,
-    bool is_trans_weight) const {
+    bool is_trans_weight, bool is_causal) const {
+  TT_TRACE_LAYER("MultiHeadedAttention", query_tensor);
 #ifdef WITH_PERFTOOLS
   auto& profile_ctx = core::Profiler::GetInstance();
   profile_ctx.start_profile("MultiHeadedAttention_" + attn_type,
@@ -71,9 +79,13 @@ void MultiHeadedAttention::operator()(
   } else {
     TT_THROW("attn_type should be context or self.");
   }
+  TT_ENFORCE(!is_causal || attn_type == "self",
+             "Only self attention can be causal");
 
   auto hidden_size = query_tensor.shape(2);
   auto size_per_head = hidden_size / num_attention_heads_;
+  // the k and v projections and caches have num_kv_heads_ heads.
+  auto kv_size = num_kv_heads_ * size_per_head;
   auto devtype = query_tensor.device_type();
   auto devid = query_tensor.device_id();
 
@@ -151,9 +163,9 @@ void MultiHeadedAttention::operator()(
       v_ptr = layer_cache["memory_values"];
       k_ptr = layer_cache["memory_keys"];
     } else {
-      v_out1.Reshape<float>({batch_size, key_seq_length, hidden_size}, devtype,
+      v_out1.Reshape<float>({batch_size, key_seq_length, kv_size}, devtype,
                             devid, "context/gemm1/v_out1/Reshape");
-      k_out1.Reshape<float>({batch_size, key_seq_length, hidden_size}, devtype,
+      k_out1.Reshape<float>({batch_size, key_seq_length, kv_size}, devtype,
                             devid, "context/gemm2/k_out1/Reshape");
 
       kernels::MatMul(key_tensor, false, k_weight_, is_trans_weight, 1.0,
@@ -161,18 +173,18 @@ void MultiHeadedAttention::operator()(
       kernels::MatMul(value_tensor, false, v_weight_, is_trans_weight, 1.0,
                       &v_out1, 0.0, "context/gemm2");
       v_out1.Reshape<float>(
-          {batch_size, key_seq_length, num_attention_heads_, size_per_head},
-          devtype, devid, "context/gemm1/v_out1/Reshape");
+          {batch_size, key_seq_length, num_kv_heads_, size_per_head}, devtype,
+          devid, "context/gemm1/v_out1/Reshape");
       k_out1.Reshape<float>(
-          {batch_size, key_seq_length, num_attention_heads_, size_per_head},
-          devtype, devid, "context/gemm2/k_out1/Reshape");
+          {batch_size, key_seq_length, num_kv_heads_, size_per_head}, devtype,
+          devid, "context/gemm2/k_out1/Reshape");
 
       if (layer_cache_not_none) {
         layer_cache["memory_keys"]->Reshape<float>(
-            {batch_size, num_attention_heads_, key_seq_length, size_per_head},
+            {batch_size, num_kv_heads_, key_seq_length, size_per_head},
             devtype, devid, "context/keys/AddBiasTransposeForScore/Reshape");
         layer_cache["memory_values"]->Reshape<float>(
-            {batch_size, num_attention_heads_, key_seq_length, size_per_head},
+            {batch_size, num_kv_heads_, key_seq_length, size_per_head},
             devtype, devid, "context/values/AddBiasTransposeForScore/reshape");
         kernels::AddBiasTransposeForScore(
             v_out1, v_bias_, layer_cache["memory_values"],
@@ -184,10 +196,10 @@ void MultiHeadedAttention::operator()(
         k_ptr = layer_cache["memory_keys"];
       } else {
         v_out2.Reshape<float>(
-            {batch_size, num_attention_heads_, key_seq_length, size_per_head},
+            {batch_size, num_kv_heads_, key_seq_length, size_per_head},
             devtype, devid, "context/values/AddBiasTransposeForScore/Reshape");
         k_out2.Reshape<float>(
-            {batch_size, num_attention_heads_, key_seq_length, size_per_head},
+            {batch_size, num_kv_heads_, key_seq_length, size_per_head},
             devtype, devid, "context/keys/AddBiasTransposeForScore/Reshape");
         kernels::AddBiasTransposeForScore(
             v_out1, v_bias_, &v_out2,
@@ -199,8 +211,15 @@ void MultiHeadedAttention::operator()(
       }
     }  // else
   } else if (attn_type == "self") {
-    qkv_out1.Reshape<float>({batch_size, query_seq_length, 3, hidden_size},
-                            devtype, devid, "self/qkv_out1/Reshape");
+    bool grouped = num_kv_heads_ != num_attention_heads_;
+    if (grouped) {
+      qkv_out1.Reshape<float>(
+          {batch_size, query_seq_length, hidden_size + 2 * kv_size}, devtype,
+          devid, "self/qkv_out1/Reshape");
+    } else {
+      qkv_out1.Reshape<float>({batch_size, query_seq_length, 3, hidden_size},
+                              devtype, devid, "self/qkv_out1/Reshape");
+    }
     if (pre_layernorm) {
       core::Tensor layernormed_query(nullptr);
       layernormed_query.Reshape<float>(
@@ -209,25 +228,52 @@ void MultiHeadedAttention::operator()(
       core::Copy<float>(query_tensor, layernormed_query, "self/layernorm/Copy");
       kernels::LayerNorm<float>(layernorm_gamma_, layernorm_beta_,
                                 &layernormed_query, 1e-6);
-      kernels::MatMul(layernormed_query, false, qkv_weight_, is_trans_weight,
-                      1.0, &qkv_out1, 0.0, "self/gemm012_fused");
+      CollectActivation("attention.qkv", layernormed_query);
+      if (!int4_qkv_weight_.is_null()) {
+        kernels::Int4MatMul(layernormed_query, int4_qkv_weight_, &qkv_out1,
+                            "self/gemm012_fused_int4");
+      } else if (quantized_qkv_weight_.is_null()) {
+        kernels::MatMul(layernormed_query, false, qkv_weight_,
+                        is_trans_weight, 1.0, &qkv_out1, 0.0,
+                        "self/gemm012_fused");
+      } else {
+        kernels::QuantizedMatMul(layernormed_query, quantized_qkv_weight_,
+                                 &qkv_out1, "self/gemm012_fused_int8");
+      }
+      ApplyLoRA("attention.qkv", layernormed_query, &qkv_out1);
     } else {
-      kernels::MatMul(query_tensor, false, qkv_weight_, is_trans_weight, 1.0,
-                      &qkv_out1, 0.0, "self/gemm012_fused");
+      CollectActivation("attention.qkv", query_tensor);
+      if (!int4_qkv_weight_.is_null()) {
+        kernels::Int4MatMul(query_tensor, int4_qkv_weight_, &qkv_out1,
+                            "self/gemm012_fused_int4");
+      } else if (quantized_qkv_weight_.is_null()) {
+        kernels::MatMul(query_tensor, false, qkv_weight_, is_trans_weight, 1.0,
+                        &qkv_out1, 0.0, "self/gemm012_fused");
+      } else {
+        kernels::QuantizedMatMul(query_tensor, quantized_qkv_weight_,
+                                 &qkv_out1, "self/gemm012_fused_int8");
+      }
+      ApplyLoRA("attention.qkv", query_tensor, &qkv_out1);
     }
     q_out.Reshape<float>(
         {batch_size, num_attention_heads_, query_seq_length, size_per_head},
         devtype, devid, "self/q/Reshape");
     k_out.Reshape<float>(
-        {batch_size, num_attention_heads_, query_seq_length, size_per_head},
-        devtype, devid, "self/k/Reshape");
+        {batch_size, num_kv_heads_, query_seq_length, size_per_head}, devtype,
+        devid, "self/k/Reshape");
     v_out.Reshape<float>(
-        {batch_size, num_attention_heads_, query_seq_length, size_per_head},
-        devtype, devid, "self/v/Reshape");
+        {batch_size, num_kv_heads_, query_seq_length, size_per_head}, devtype,
+        devid, "self/v/Reshape");
 
-    kernels::SplitAddBiasTransposeForScore(
-        qkv_out1, qkv_bias_, q_out, k_out, v_out,
-        "self/SplitAddBiasTransposeForScore");
+    if (grouped) {
+      kernels::GroupedSplitAddBiasTransposeForScore(
+          qkv_out1, qkv_bias_, q_out, k_out, v_out,
+          "self/GroupedSplitAddBiasTransposeForScore");
+    } else {
+      kernels::SplitAddBiasTransposeForScore(
+          qkv_out1, qkv_bias_, q_out, k_out, v_out,
+          "self/SplitAddBiasTransposeForScore");
+    }
     q_ptr = &q_out;
     if (self_keys_not_none) {
       kernels::Concat<float>(*layer_cache["self_keys"], k_out, 2, &k_out2,
@@ -245,11 +291,11 @@ void MultiHeadedAttention::operator()(
     }
     if (layer_cache_not_none) {
       layer_cache["self_keys"]->Reshape<float>(
-          {batch_size, num_attention_heads_, k_ptr->shape(2), size_per_head},
-          devtype, devid, "self/self_key/Reshape");
+          {batch_size, num_kv_heads_, k_ptr->shape(2), size_per_head}, devtype,
+          devid, "self/self_key/Reshape");
       layer_cache["self_values"]->Reshape<float>(
-          {batch_size, num_attention_heads_, v_ptr->shape(2), size_per_head},
-          devtype, devid, "self/self_value/Reshape");
+          {batch_size, num_kv_heads_, v_ptr->shape(2), size_per_head}, devtype,
+          devid, "self/self_value/Reshape");
 
       core::Copy<float>(*k_ptr, *layer_cache["self_keys"],
                         "self/self_key/Copy");
@@ -262,30 +308,75 @@ void MultiHeadedAttention::operator()(
   // 2) Calculate and scale scores.
   key_seq_length = k_ptr->shape(
       2);  // update for self type attn, since it will concat with cache.
-  att_score->Reshape<float>(
-      {batch_size, num_attention_heads_, query_seq_length,
-       key_seq_length},  // query_seq_length = from_seq_Len
-      devtype, devid, "batch_gemm3/Reshape");
-
   const float scaler = 1.0f / std::sqrt(static_cast<float>(size_per_head));
-  kernels::BatchMatMul(*q_ptr, false, *k_ptr, true, scaler, att_score, 0.0,
-                       "batch_gemm3");  //(B, num_head, q_len, k_len)
-  // mask = mask.unsqueeze(1)  # [B, 1, 1, T_values]
-  // scores = scores.masked_fill(mask, -1e18)
-  // attn = self.softmax(scores).to(query.dtype)
-  kernels::ApplyMaskAndSoftmax(
-      att_score,
-      attention_mask,  //(B, q_len, k_len) or (B, 1, k_len)
-      1.0, "ApplyMaskAndSoftmax");
-
-  // context_original = torch.matmul(drop_attn, value)
   core::Tensor context_layer(nullptr);
-  context_layer.Reshape<float>(
-      {batch_size, num_attention_heads_, query_seq_length, size_per_head},
-      devtype, devid, "ApplyMaskAndSoftmax/Reshape");
+  auto* packing = CurrentPacking();
+  if (packing != nullptr && attn_type == "self" && !self_keys_not_none &&
+      devtype == kDLCPU) {
+    // the rows pack several sequences, attend within each of them only and
+    // leave att_score untouched
+    TT_ENFORCE(packing->n_rows() == batch_size &&
+                   packing->row_len() == query_seq_length,
+               "The input does not match the packing of the scope");
+    TT_ENFORCE_EQ(num_kv_heads_, num_attention_heads_,
+                  "Sequence packing does not support grouped-query attention");
+    TT_ENFORCE(!is_causal,
+               "Sequence packing does not support causal attention");
+    kernels::BlockDiagonalAttention(*q_ptr, *k_ptr, *v_ptr,
+                                    packing->segments(), scaler,
+                                    &context_layer, "BlockDiagonalAttention");
+  } else if (query_seq_length == 1 && devtype == kDLCPU) {
+    // a decoding step, its single query attends all the keys, the causal
+    // mask included.
+    kernels::DecodeAttention(*q_ptr, *k_ptr, *v_ptr, attention_mask, scaler,
+                             att_score, &context_layer, "DecodeAttention");
+  } else if (is_causal) {
+    TT_ENFORCE(devtype == kDLCPU, "Causal attention only supports CPU");
+    kernels::CausalAttention(*q_ptr, *k_ptr, *v_ptr, attention_mask, scaler,
+                             att_score, &context_layer, "CausalAttention");
+  } else {
+    // The query heads h of a group share the kv head h / group. Viewed as
+    // (B, num_kv_heads, group * q_len, ...) the group is the rows of one GEMM
+    // against its kv head, so k and v are not replicated.
+    int64_t group = num_attention_heads_ / num_kv_heads_;
+    q_ptr->Reshape<float>(
+        {batch_size, num_kv_heads_, group * query_seq_length, size_per_head},
+        devtype, devid, "batch_gemm3/q/Reshape");
+    att_score->Reshape<float>(
+        {batch_size, num_kv_heads_, group * query_seq_length, key_seq_length},
+        devtype, devid, "batch_gemm3/Reshape");
+
+    kernels::BatchMatMul(*q_ptr, false, *k_ptr, true, scaler, att_score, 0.0,
+                         "batch_gemm3");  //(B, num_head, q_len, k_len)
+    att_score->Reshape<float>(
+        {batch_size, num_attention_heads_, query_seq_length,
+         key_seq_length},  // query_seq_length = from_seq_Len
+        devtype, devid, "ApplyMaskAndSoftmax/att_score/Reshape");
+    // mask = mask.unsqueeze(1)  # [B, 1, 1, T_values]
+    // scores = scores.masked_fill(mask, -1e18)
+    // attn = self.softmax(scores).to(query.dtype)
+    kernels::ApplyMaskAndSoftmax(
+        att_score,
+        attention_mask,  //(B, q_len, k_len) or (B, 1, k_len)
+        1.0, "ApplyMaskAndSoftmax");
 
-  kernels::BatchMatMul(*att_score, false, *v_ptr, false, 1.0, &context_layer,
-                       0.0, "batch_gemm4");
+    // context_original = torch.matmul(drop_attn, value)
+    att_score->Reshape<float>(
+        {batch_size, num_kv_heads_, group * query_seq_length, key_seq_length},
+        devtype, devid, "batch_gemm4/att_score/Reshape");
+    context_layer.Reshape<float>(
+        {batch_size, num_kv_heads_, group * query_seq_length, size_per_head},
+        devtype, devid, "ApplyMaskAndSoftmax/Reshape");
+
+    kernels::BatchMatMul(*att_score, false, *v_ptr, false, 1.0,
+                         &context_layer, 0.0, "batch_gemm4");
+    att_score->Reshape<float>(
+        {batch_size, num_attention_heads_, query_seq_length, key_seq_length},
+        devtype, devid, "batch_gemm4/att_score/Reshape");
+    context_layer.Reshape<float>(
+        {batch_size, num_attention_heads_, query_seq_length, size_per_head},
+        devtype, devid, "batch_gemm4/Reshape");
+  }
   // context = unshape(context_original)
   core::Tensor self_attr_out(nullptr);
 
@@ -298,8 +389,18 @@ void MultiHeadedAttention::operator()(
   output->Reshape<float>({batch_size, query_seq_length, hidden_size}, devtype,
                          devid, "gemm5/Reshape");
 
-  kernels::MatMul(self_attr_out, false, dense_weight_, is_trans_weight, 1.0,
-                  output, 0.0, "gemm5");
+  CollectActivation("attention.output.dense", self_attr_out);
+  if (!int4_dense_weight_.is_null()) {
+    kernels::Int4MatMul(self_attr_out, int4_dense_weight_, output,
+                        "gemm5_int4");
+  } else if (quantized_dense_weight_.is_null()) {
+    kernels::MatMul(self_attr_out, false, dense_weight_, is_trans_weight, 1.0,
+                    output, 0.0, "gemm5");
+  } else {
+    kernels::QuantizedMatMul(self_attr_out, quantized_dense_weight_, output,
+                             "gemm5_int8");
+  }
+  ApplyLoRA("attention.output.dense", self_attr_out, output);
 
   if (false == post_add_input) {
     if (false == post_layernorm) {
@@ -321,7 +422,58 @@ void MultiHeadedAttention::operator()(
 #endif
 }
 
+void MultiHeadedAttention::SetPrecision(const std::string& projection,
+                                        types::QuantType precision,
+                                        bool is_trans_weight,
+                                        float input_scale) {
+  kernels::QuantizedWeight* quantized;
+  kernels::Int4Weight* int4;
+  core::Tensor* weight;
+  if (projection == "qkv") {
+    quantized = &quantized_qkv_weight_;
+    int4 = &int4_qkv_weight_;
+    weight = &qkv_weight_;
+  } else if (projection == "dense") {
+    quantized = &quantized_dense_weight_;
+    int4 = &int4_dense_weight_;
+    weight = &dense_weight_;
+  } else {
+    TT_THROW("projection (%s) is not in ['qkv', 'dense']", projection);
+  }
+  if (!int4->is_null()) {
+    // the float weight was released when it was quantized to int4
+    TT_ENFORCE(precision == types::QuantType::kInt4,
+               "the %s weight is Int4, its float weight was released",
+               projection);
+    return;
+  }
+  *quantized = kernels::QuantizedWeight();
+  if (precision == types::QuantType::kFloat32) {
+    return;
+  }
+  TT_ENFORCE(!weight->is_null(), "the %s weight is empty", projection);
+  if (precision == types::QuantType::kInt8) {
+    kernels::QuantizeWeight(*weight, is_trans_weight, quantized,
+                            "MultiHeadedAttention/QuantizeWeight");
+    quantized->input_scale = input_scale;
+  } else if (precision == types::QuantType::kInt4) {
+    int64_t in_dim = is_trans_weight ? weight->shape(1) : weight->shape(0);
+    kernels::QuantizeWeightInt4(*weight, is_trans_weight,
+                                kernels::DefaultInt4GroupSize(in_dim), int4,
+                                "MultiHeadedAttention/QuantizeWeightInt4");
+    *weight = core::Tensor(nullptr);
+  } else {
+    TT_THROW(
+        "MultiHeadedAttention only supports Float32, Int8 and Int4 "
+        "precision");
+  }
+}
+
 void MultiHeadedAttention::EnforceShapeAndType() const {
+  TT_ENFORCE(num_kv_heads_ > 0 && num_attention_heads_ % num_kv_heads_ == 0,
+             "num_attention_heads (%d) should be a multiple of num_kv_heads "
+             "(%d)",
+             num_attention_heads_, num_kv_heads_);
   if (loguru::current_verbosity_cutoff() >= 3) {
     std::ostringstream os;
     os << ">>>>>>>>>>>> qkv_weight_ <<<<<<<<<<<<" << std::endl;
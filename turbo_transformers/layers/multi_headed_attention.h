@@ -14,14 +14,24 @@
 #pragma once
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 #include <utility>
 #include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/int4_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/types.h"
 
 namespace turbo_transformers {
 namespace layers {
 
+// num_kv_heads < num_attention_heads is multi-query (1) or grouped-query
+// attention: k and v have num_kv_heads heads, each shared by a group of
+// num_attention_heads / num_kv_heads consecutive query heads, and so have the
+// layer caches. k_weight and v_weight are (hidden_size, num_kv_heads *
+// size_per_head) and qkv_weight is the q, k and v weights side by side.
+// 0 is one kv head per query head.
 class MultiHeadedAttention {
  public:
   MultiHeadedAttention(core::Tensor k_weight, core::Tensor k_bias,
@@ -29,7 +39,7 @@ class MultiHeadedAttention {
                        core::Tensor q_weight, core::Tensor q_bias,
                        core::Tensor dense_weight, core::Tensor dense_bias,
                        core::Tensor qkv_weight, core::Tensor qkv_bias,
-                       int64_t num_attention_heads)
+                       int64_t num_attention_heads, int64_t num_kv_heads = 0)
       : k_weight_(std::move(k_weight)),  //(768, 768)
         k_bias_(std::move(k_bias)),
         v_weight_(std::move(v_weight)),  //(768, 768)
@@ -42,7 +52,8 @@ class MultiHeadedAttention {
         qkv_bias_(std::move(qkv_bias)),
         layernorm_gamma_(nullptr),
         layernorm_beta_(nullptr),
-        num_attention_heads_(num_attention_heads) {
+        num_attention_heads_(num_attention_heads),
+        num_kv_heads_(num_kv_heads > 0 ? num_kv_heads : num_attention_heads) {
     EnforceShapeAndType();
   }
 
@@ -53,7 +64,7 @@ class MultiHeadedAttention {
                        core::Tensor qkv_weight, core::Tensor qkv_bias,
                        core::Tensor layernorm_gamma,
                        core::Tensor layernorm_beta,
-                       int64_t num_attention_heads)
+                       int64_t num_attention_heads, int64_t num_kv_heads = 0)
       : k_weight_(std::move(k_weight)),  //(768, 768)
         k_bias_(std::move(k_bias)),
         v_weight_(std::move(v_weight)),  //(768, 768)
@@ -66,11 +77,16 @@ class MultiHeadedAttention {
         qkv_bias_(std::move(qkv_bias)),
         layernorm_gamma_(std::move(layernorm_gamma)),
         layernorm_beta_(std::move(layernorm_beta)),
-        num_attention_heads_(num_attention_heads) {
+        num_attention_heads_(num_attention_heads),
+        num_kv_heads_(num_kv_heads > 0 ? num_kv_heads : num_attention_heads) {
     EnforceShapeAndType();
   }
   void EnforceShapeAndType() const;
 
+  // is_causal ("self" attention, CPU) masks the future positions without an
+  // attention_mask and skips their scores: the query i of query_seq_len
+  // attends the cached keys and its own first i + 1 positions.
+  // attention_mask then only needs the padding, (B, 1, k_len).
   void operator()(const core::Tensor& key_tensor,
                   const core::Tensor& value_tensor,
                   const core::Tensor& query_tensor,
@@ -79,8 +95,17 @@ class MultiHeadedAttention {
                   core::Tensor* att_score,
                   std::unordered_map<std::string, core::Tensor*> layer_cache,
                   bool pre_layernorm = false, bool post_layernorm = false,
-                  bool post_add_input = false,
-                  bool is_trans_weight = false) const;
+                  bool post_add_input = false, bool is_trans_weight = false,
+                  bool is_causal = false) const;
+
+  // Runs the GEMM of a projection in kFloat32, kInt8 or kInt4 (weight-only,
+  // for small batches). projection is "qkv", the fused projection of "self"
+  // attention, or "dense", the output projection. is_trans_weight must match
+  // the one passed to operator(). input_scale is the static int8 scale of the
+  // input found by calibration, 0 computes the range of each row. kInt4
+  // releases the float weight, the projection then stays kInt4.
+  void SetPrecision(const std::string& projection, types::QuantType precision,
+                    bool is_trans_weight = false, float input_scale = 0.f);
 
  private:
   core::Tensor k_weight_;
@@ -99,7 +124,13 @@ class MultiHeadedAttention {
   core::Tensor layernorm_gamma_;
   core::Tensor layernorm_beta_;
 
+  kernels::QuantizedWeight quantized_qkv_weight_;
+  kernels::QuantizedWeight quantized_dense_weight_;
+  kernels::Int4Weight int4_qkv_weight_;
+  kernels::Int4Weight int4_dense_weight_;
+
   int64_t num_attention_heads_;
+  int64_t num_kv_heads_;
 };
 
 }  // namespace layers
@@ -0,0 +1,312 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/multi_headed_attention.h"
+
+#include <cmath>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+namespace {
+core::Tensor FromVector(const std::vector<float>& values,
+                        std::vector<int64_t> shape) {
+  core::Tensor tensor(core::NewDLPackTensorT<float>(shape, kDLCPU, 0));
+  std::copy(values.begin(), values.end(), tensor.mutableData<float>());
+  return tensor;
+}
+
+std::vector<float> RandomVector(int64_t n) {
+  std::vector<float> values(n);
+  for (auto& v : values) {
+    v = (std::rand() % 1000) / 1000.f - 0.5f;
+  }
+  return values;
+}
+
+std::vector<float> ToVector(const core::Tensor& tensor) {
+  return std::vector<float>(tensor.data<float>(),
+                            tensor.data<float>() + tensor.numel());
+}
+
+// A grouped-query attention and the same attention with every kv head
+// replicated to the query heads of its group.
+struct GroupedAndFull {
+  GroupedAndFull(int64_t hidden, int64_t n_heads, int64_t n_kv_heads) {
+    int64_t size_per_head = hidden / n_heads;
+    int64_t kv_size = n_kv_heads * size_per_head;
+    int64_t group = n_heads / n_kv_heads;
+    auto q_w = RandomVector(hidden * hidden), q_b = RandomVector(hidden);
+    auto k_w = RandomVector(hidden * kv_size), k_b = RandomVector(kv_size);
+    auto v_w = RandomVector(hidden * kv_size), v_b = RandomVector(kv_size);
+    auto dense_w = RandomVector(hidden * hidden);
+    auto dense_b = RandomVector(hidden);
+    // (hidden, out) weights, the columns of the query head h are those of
+    // the kv head h / group.
+    auto replicate = [&](const std::vector<float>& w, int64_t rows) {
+      std::vector<float> full(rows * hidden);
+      for (int64_t r = 0; r < rows; ++r) {
+        for (int64_t h = 0; h < n_heads; ++h) {
+          for (int64_t d = 0; d < size_per_head; ++d) {
+            full[r * hidden + h * size_per_head + d] =
+                w[r * kv_size + h / group * size_per_head + d];
+          }
+        }
+      }
+      return full;
+    };
+    auto full_k_w = replicate(k_w, hidden), full_v_w = replicate(v_w, hidden);
+    auto full_k_b = replicate(k_b, 1), full_v_b = replicate(v_b, 1);
+    auto fuse = [&](const std::vector<float>& k, const std::vector<float>& v,
+                    int64_t kv_cols) {
+      int64_t cols = hidden + 2 * kv_cols;
+      std::vector<float> fused(hidden * cols);
+      for (int64_t r = 0; r < hidden; ++r) {
+        std::copy(q_w.begin() + r * hidden, q_w.begin() + (r + 1) * hidden,
+                  fused.begin() + r * cols);
+        std::copy(k.begin() + r * kv_cols, k.begin() + (r + 1) * kv_cols,
+                  fused.begin() + r * cols + hidden);
+        std::copy(v.begin() + r * kv_cols, v.begin() + (r + 1) * kv_cols,
+                  fused.begin() + r * cols + hidden + kv_cols);
+      }
+      return fused;
+    };
+    auto concat = [](std::vector<float> a, const std::vector<float>& b,
+                     const std::vector<float>& c) {
+      a.insert(a.end(), b.begin(), b.end());
+      a.insert(a.end(), c.begin(), c.end());
+      return a;
+    };
+    grouped.reset(new MultiHeadedAttention(
+        FromVector(k_w, {hidden, kv_size}), FromVector(k_b, {kv_size}),
+        FromVector(v_w, {hidden, kv_size}), FromVector(v_b, {kv_size}),
+        FromVector(q_w, {hidden, hidden}), FromVector(q_b, {hidden}),
+        FromVector(dense_w, {hidden, hidden}), FromVector(dense_b, {hidden}),
+        FromVector(fuse(k_w, v_w, kv_size), {hidden, hidden + 2 * kv_size}),
+        FromVector(concat(q_b, k_b, v_b), {hidden + 2 * kv_size}), n_heads,
+        n_kv_heads));
+    full.reset(new MultiHeadedAttention(
+        FromVector(full_k_w, {hidden, hidden}), FromVector(full_k_b, {hidden}),
+        FromVector(full_v_w, {hidden, hidden}), FromVector(full_v_b, {hidden}),
+        FromVector(q_w, {hidden, hidden}), FromVector(q_b, {hidden}),
+        FromVector(dense_w, {hidden, hidden}), FromVector(dense_b, {hidden}),
+        FromVector(fuse(full_k_w, full_v_w, hidden), {hidden, 3 * hidden}),
+        FromVector(concat(q_b, full_k_b, full_v_b), {3 * hidden}), n_heads));
+  }
+  std::unique_ptr<MultiHeadedAttention> grouped, full;
+};
+
+void RequireClose(const core::Tensor& a, const core::Tensor& b) {
+  REQUIRE(a.numel() == b.numel());
+  auto x = ToVector(a), y = ToVector(b);
+  for (size_t i = 0; i < x.size(); ++i) {
+    REQUIRE(std::abs(x[i] - y[i]) < 1e-4);
+  }
+}
+}  // namespace
+
+TEST_CASE("multi-headed-attention-grouped-query-self") {
+  constexpr int64_t hidden = 64, n_heads = 8, batch_size = 2;
+  for (int64_t n_kv_heads : {1, 2, 4}) {
+    GroupedAndFull attn(hidden, n_heads, n_kv_heads);
+    core::Tensor grouped_keys(nullptr), grouped_values(nullptr);
+    core::Tensor full_keys(nullptr), full_values(nullptr);
+    // a prompt of 5 tokens, then 3 decode steps over the caches.
+    for (int64_t step = 0; step < 4; ++step) {
+      int64_t len = step == 0 ? 5 : 1;
+      auto input = FromVector(RandomVector(batch_size * len * hidden),
+                              {batch_size, len, hidden});
+      core::Tensor grouped_out(nullptr), grouped_score(nullptr);
+      core::Tensor full_out(nullptr), full_score(nullptr);
+      (*attn.grouped)(input, input, input, core::Tensor(nullptr), "self",
+                      &grouped_out, &grouped_score,
+                      {{"self_keys", &grouped_keys},
+                       {"self_values", &grouped_values}});
+      (*attn.full)(input, input, input, core::Tensor(nullptr), "self",
+                   &full_out, &full_score,
+                   {{"self_keys", &full_keys}, {"self_values", &full_values}});
+      RequireClose(grouped_out, full_out);
+      RequireClose(grouped_score, full_score);
+      REQUIRE(grouped_score.shape(1) == n_heads);
+      // the caches hold the kv heads only.
+      int64_t cached = 5 + step;
+      REQUIRE(grouped_keys.shape(1) == n_kv_heads);
+      REQUIRE(grouped_keys.shape(2) == cached);
+      REQUIRE(grouped_values.numel() ==
+              batch_size * n_kv_heads * cached * (hidden / n_heads));
+    }
+  }
+}
+
+TEST_CASE("multi-headed-attention-grouped-query-context") {
+  constexpr int64_t hidden = 64, n_heads = 8, n_kv_heads = 2, batch_size = 3;
+  constexpr int64_t q_len = 4, k_len = 7;
+  GroupedAndFull attn(hidden, n_heads, n_kv_heads);
+  auto query = FromVector(RandomVector(batch_size * q_len * hidden),
+                          {batch_size, q_len, hidden});
+  auto memory = FromVector(RandomVector(batch_size * k_len * hidden),
+                           {batch_size, k_len, hidden});
+  // the last 2 positions of the first memory bank are padding.
+  std::vector<float> mask(batch_size * k_len, 0.f);
+  mask[k_len - 1] = mask[k_len - 2] = -1e18f;
+  auto mask_tensor = FromVector(mask, {batch_size, 1, k_len});
+  core::Tensor memory_keys(nullptr), memory_values(nullptr);
+  core::Tensor grouped_out(nullptr), grouped_score(nullptr);
+  core::Tensor full_out(nullptr), full_score(nullptr);
+  (*attn.grouped)(memory, memory, query, mask_tensor, "context", &grouped_out,
+                  &grouped_score,
+                  {{"memory_keys", &memory_keys},
+                   {"memory_values", &memory_values}});
+  (*attn.full)(memory, memory, query, mask_tensor, "context", &full_out,
+               &full_score, {});
+  RequireClose(grouped_out, full_out);
+  RequireClose(grouped_score, full_score);
+  REQUIRE(memory_keys.shape(1) == n_kv_heads);
+
+  // the next step reads the memory caches.
+  (*attn.grouped)(memory, memory, query, mask_tensor, "context", &grouped_out,
+                  &grouped_score,
+                  {{"memory_keys", &memory_keys},
+                   {"memory_values", &memory_values}});
+  RequireClose(grouped_out, full_out);
+
+  REQUIRE_THROWS(GroupedAndFull(hidden, n_heads, 3));
+}
+
+TEST_CASE("multi-headed-attention-causal-self") {
+  constexpr int64_t hidden = 64, n_heads = 8, n_kv_heads = 2, batch_size = 2;
+  GroupedAndFull attn(hidden, n_heads, n_kv_heads);
+  core::Tensor causal_keys(nullptr), causal_values(nullptr);
+  core::Tensor masked_keys(nullptr), masked_values(nullptr);
+  // a prompt of 37 tokens in two chunks, the second over the cache of the
+  // first.
+  int64_t cached = 0;
+  for (int64_t len : {30, 7}) {
+    int64_t k_len = cached + len;
+    auto input = FromVector(RandomVector(batch_size * len * hidden),
+                            {batch_size, len, hidden});
+    // the first token of the second sequence is padding.
+    std::vector<float> padding(batch_size * k_len, 0.f), mask;
+    padding[k_len] = -1e18f;
+    for (int64_t b = 0; b < batch_size; ++b) {
+      for (int64_t i = 0; i < len; ++i) {
+        for (int64_t j = 0; j < k_len; ++j) {
+          mask.push_back(j > cached + i ? -1e18f : padding[b * k_len + j]);
+        }
+      }
+    }
+    core::Tensor causal_out(nullptr), causal_score(nullptr);
+    core::Tensor masked_out(nullptr), masked_score(nullptr);
+    (*attn.grouped)(input, input, input,
+                    FromVector(padding, {batch_size, 1, k_len}), "self",
+                    &causal_out, &causal_score,
+                    {{"self_keys", &causal_keys},
+                     {"self_values", &causal_values}},
+                    false, false, false, false, true);
+    (*attn.full)(input, input, input,
+                 FromVector(mask, {batch_size, len, k_len}), "self",
+                 &masked_out, &masked_score,
+                 {{"self_keys", &masked_keys},
+                  {"self_values", &masked_values}});
+    // the padded query attends padding only, the two masks differ there.
+    auto x = ToVector(causal_out), y = ToVector(masked_out);
+    size_t padded_row = len * hidden;
+    for (size_t i = 0; i < x.size(); ++i) {
+      if (cached == 0 && i >= padded_row && i < padded_row + hidden) {
+        continue;
+      }
+      REQUIRE(std::abs(x[i] - y[i]) < 1e-4);
+    }
+    REQUIRE(causal_score.shape(2) == len);
+    REQUIRE(causal_score.shape(3) == k_len);
+    REQUIRE(causal_keys.shape(2) == k_len);
+    cached = k_len;
+  }
+  auto input = FromVector(RandomVector(2 * hidden), {1, 2, hidden});
+  core::Tensor out(nullptr), score(nullptr);
+  REQUIRE_THROWS((*attn.grouped)(input, input, input, core::Tensor(nullptr),
+                                 "context", &out, &score, {}, false, false,
+                                 false, false, true));
+}
+
+TEST_CASE("multi-headed-attention-decode-step") {
+  constexpr int64_t hidden = 64, n_heads = 8, n_kv_heads = 2, batch_size = 2;
+  constexpr int64_t prompt_len = 200;
+  GroupedAndFull attn(hidden, n_heads, n_kv_heads);
+  auto tokens = RandomVector(batch_size * (prompt_len + 1) * hidden);
+  // the first 3 positions of the second sequence are padding.
+  std::vector<float> padding(batch_size * (prompt_len + 1), 0.f);
+  for (int64_t j = 0; j < 3; ++j) {
+    padding[prompt_len + 1 + j] = -1e18f;
+  }
+  auto rows = [&](int64_t begin, int64_t end) {
+    std::vector<float> out;
+    for (int64_t b = 0; b < batch_size; ++b) {
+      auto* seq = &tokens[b * (prompt_len + 1) * hidden];
+      out.insert(out.end(), seq + begin * hidden, seq + end * hidden);
+    }
+    return FromVector(out, {batch_size, end - begin, hidden});
+  };
+  auto padding_of = [&](int64_t len) {
+    std::vector<float> out;
+    for (int64_t b = 0; b < batch_size; ++b) {
+      auto* seq = &padding[b * (prompt_len + 1)];
+      out.insert(out.end(), seq, seq + len);
+    }
+    return FromVector(out, {batch_size, 1, len});
+  };
+
+  // the prompt, then its last token as a decoding step over the caches.
+  core::Tensor keys(nullptr), values(nullptr), out(nullptr), score(nullptr);
+  auto prompt = rows(0, prompt_len);
+  (*attn.grouped)(prompt, prompt, prompt, padding_of(prompt_len), "self", &out,
+                  &score, {{"self_keys", &keys}, {"self_values", &values}},
+                  false, false, false, false, true);
+  auto step = rows(prompt_len, prompt_len + 1);
+  (*attn.grouped)(step, step, step, padding_of(prompt_len + 1), "self", &out,
+                  &score, {{"self_keys", &keys}, {"self_values", &values}});
+  REQUIRE(out.shape(1) == 1);
+  REQUIRE(score.shape(3) == prompt_len + 1);
+
+  // the last row of the whole sequence through the masked dense attention
+  std::vector<float> mask;
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t i = 0; i <= prompt_len; ++i) {
+      for (int64_t j = 0; j <= prompt_len; ++j) {
+        mask.push_back(j > i ? -1e18f
+                             : padding[b * (prompt_len + 1) + j]);
+      }
+    }
+  }
+  auto all = rows(0, prompt_len + 1);
+  core::Tensor full_out(nullptr), full_score(nullptr);
+  (*attn.full)(all, all, all,
+               FromVector(mask, {batch_size, prompt_len + 1, prompt_len + 1}),
+               "self", &full_out, &full_score, {});
+  auto x = ToVector(out), y = ToVector(full_out);
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t d = 0; d < hidden; ++d) {
+      REQUIRE(std::abs(x[b * hidden + d] -
+                       y[(b * (prompt_len + 1) + prompt_len) * hidden + d]) <
+              1e-4);
+    }
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
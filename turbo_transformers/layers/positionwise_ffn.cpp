@@ -16,11 +16,13 @@
 #include <loguru.hpp>
 
 #include "turbo_transformers/core/memory.h"
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/activation.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #include "turbo_transformers/layers/kernels/layer_norm.h"
 #include "turbo_transformers/layers/kernels/mat_mul.h"
 #include "turbo_transformers/layers/kernels/utils.h"
+#include "turbo_transformers/layers/lora.h"
 #ifdef WITH_PERFTOOLS
 #include "turbo_transformers/core/profiler.h"
 #endif
@@ -31,11 +33,17 @@ namespace layers {
 void PositionwiseFeedForward::operator()(const core::Tensor& input_tensor,
                                          core::Tensor* output_tensor,
                                          bool is_trans_weight) const {
-  auto d_ff =
-      is_trans_weight ? dense_weight_1_.shape(0) : dense_weight_1_.shape(1);
-
-  auto model_dim_weight =
-      is_trans_weight ? dense_weight_1_.shape(1) : dense_weight_1_.shape(0);
+  TT_TRACE_LAYER("PositionwiseFeedForward", input_tensor);
+  int64_t d_ff, model_dim_weight;
+  if (!int4_weight_1_.is_null()) {
+    d_ff = int4_weight_1_.out_dim();
+    model_dim_weight = int4_weight_1_.in_dim();
+  } else {
+    d_ff = is_trans_weight ? dense_weight_1_.shape(0)
+                           : dense_weight_1_.shape(1);
+    model_dim_weight = is_trans_weight ? dense_weight_1_.shape(1)
+                                       : dense_weight_1_.shape(0);
+  }
   auto model_dim = input_tensor.shape(2);
 
   TT_ENFORCE_EQ(
@@ -62,18 +70,75 @@ void PositionwiseFeedForward::operator()(const core::Tensor& input_tensor,
                                 devId, "FFN/Reshape");
   kernels::LayerNorm<float>(layer_norm_weight_, layer_norm_bias_,
                             &input_tensor_copy, 1e-12, "FFN/LayerNorm");
-  kernels::MatMul(input_tensor_copy, false, dense_weight_1_, is_trans_weight,
-                  1.0,  // input (b*seq, model) X dense_weight_1_ (model_dim,
-                        // d_ff) -> temp_tensor (B*seq, d_ff)
-                  &temp_tensor, 0.0, "FFN/gemm0");
+  if (!int4_weight_1_.is_null()) {
+    kernels::Int4MatMul(input_tensor_copy, int4_weight_1_, &temp_tensor,
+                        "FFN/gemm0_int4");
+  } else if (!quantized_weight_1_.is_null()) {
+    kernels::QuantizedMatMul(input_tensor_copy, quantized_weight_1_,
+                             &temp_tensor, "FFN/gemm0_int8");
+  } else {
+    kernels::MatMul(input_tensor_copy, false, dense_weight_1_,
+                    is_trans_weight,
+                    1.0,  // input (b*seq, model) X dense_weight_1_ (model_dim,
+                          // d_ff) -> temp_tensor (B*seq, d_ff)
+                    &temp_tensor, 0.0, "FFN/gemm0");
+  }
+  ApplyLoRA("feed_forward.w_1", input_tensor_copy, &temp_tensor);
   kernels::AddBiasAct<float, types::ActivationType::Relu>(
       dense_bias_1_, &temp_tensor, "FFN/AddBiasAct");
-  kernels::MatMul(temp_tensor, false, dense_weight_2_, is_trans_weight, 1.0,
-                  &input_tensor_copy, 0.0, "FFN/gemm1");
+  if (!int4_weight_2_.is_null()) {
+    kernels::Int4MatMul(temp_tensor, int4_weight_2_, &input_tensor_copy,
+                        "FFN/gemm1_int4");
+  } else if (!quantized_weight_2_.is_null()) {
+    kernels::QuantizedMatMul(temp_tensor, quantized_weight_2_,
+                             &input_tensor_copy, "FFN/gemm1_int8");
+  } else {
+    kernels::MatMul(temp_tensor, false, dense_weight_2_, is_trans_weight, 1.0,
+                    &input_tensor_copy, 0.0, "FFN/gemm1");
+  }
+  ApplyLoRA("feed_forward.w_2", temp_tensor, &input_tensor_copy);
   kernels::AddInputBias(input_tensor, input_tensor_copy, dense_bias_2_,
                         output_tensor, "FFN/AddInputBias");
 }
 
+void PositionwiseFeedForward::SetPrecision(types::QuantType precision,
+                                           bool is_trans_weight) {
+  if (!int4_weight_1_.is_null()) {
+    // the float weights were released when they were quantized to int4
+    TT_ENFORCE(precision == types::QuantType::kInt4,
+               "the FFN weights are Int4, their float weights were released");
+    return;
+  }
+  quantized_weight_1_ = kernels::QuantizedWeight();
+  quantized_weight_2_ = kernels::QuantizedWeight();
+  if (precision == types::QuantType::kFloat32) {
+    return;
+  }
+  if (precision == types::QuantType::kInt8) {
+    kernels::QuantizeWeight(dense_weight_1_, is_trans_weight,
+                            &quantized_weight_1_, "FFN/QuantizeWeight");
+    kernels::QuantizeWeight(dense_weight_2_, is_trans_weight,
+                            &quantized_weight_2_, "FFN/QuantizeWeight");
+  } else if (precision == types::QuantType::kInt4) {
+    int64_t in_dim_1 = is_trans_weight ? dense_weight_1_.shape(1)
+                                       : dense_weight_1_.shape(0);
+    int64_t in_dim_2 = is_trans_weight ? dense_weight_2_.shape(1)
+                                       : dense_weight_2_.shape(0);
+    kernels::QuantizeWeightInt4(dense_weight_1_, is_trans_weight,
+                                kernels::DefaultInt4GroupSize(in_dim_1),
+                                &int4_weight_1_, "FFN/QuantizeWeightInt4");
+    kernels::QuantizeWeightInt4(dense_weight_2_, is_trans_weight,
+                                kernels::DefaultInt4GroupSize(in_dim_2),
+                                &int4_weight_2_, "FFN/QuantizeWeightInt4");
+    dense_weight_1_ = core::Tensor(nullptr);
+    dense_weight_2_ = core::Tensor(nullptr);
+  } else {
+    TT_THROW(
+        "PositionwiseFeedForward only supports Float32, Int8 and Int4 "
+        "precision");
+  }
+}
+
 void PositionwiseFeedForward::EnforceShapeAndType() const {}
 
 }  // namespace layers
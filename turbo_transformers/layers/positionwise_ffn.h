@@ -15,6 +15,9 @@
 #include <memory>
 #include <utility>
 #include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/kernels/int4_mat_mul.h"
+#include "turbo_transformers/layers/kernels/quantized_mat_mul.h"
+#include "turbo_transformers/layers/types.h"
 
 namespace turbo_transformers {
 namespace layers {
@@ -42,6 +45,12 @@ class PositionwiseFeedForward {
   void operator()(const core::Tensor &input_tensor, core::Tensor *output,
                   bool is_trans_weight = true) const;
 
+  // Runs both GEMMs in kFloat32, kInt8 or kInt4 (weight-only, for the small
+  // batches of decoding). is_trans_weight must match the one passed to
+  // operator(). kInt4 releases the float weights, the module then stays
+  // kInt4.
+  void SetPrecision(types::QuantType precision, bool is_trans_weight = true);
+
  private:
   core::Tensor dense_weight_1_;
   core::Tensor dense_bias_1_;
@@ -49,6 +58,11 @@ class PositionwiseFeedForward {
   core::Tensor dense_bias_2_;
   core::Tensor layer_norm_weight_;
   core::Tensor layer_norm_bias_;
+
+  kernels::QuantizedWeight quantized_weight_1_;
+  kernels::QuantizedWeight quantized_weight_2_;
+  kernels::Int4Weight int4_weight_1_;
+  kernels::Int4Weight int4_weight_2_;
 };
 
 }  // namespace layers
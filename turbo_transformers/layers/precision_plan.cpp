@@ -0,0 +1,115 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/precision_plan.h"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+const char* GetQuantTypeName(types::QuantType quant_type) {
+  switch (quant_type) {
+    case types::QuantType::kFloat32:
+      return "Float32";
+    case types::QuantType::kFloat16:
+      return "Float16";
+    case types::QuantType::kInt8:
+      return "Int8";
+    case types::QuantType::kBinary:
+      return "Binary";
+    case types::QuantType::kInt4:
+      return "Int4";
+  }
+  TT_THROW("Unknown quant type %d", static_cast<int>(quant_type));
+}
+
+types::QuantType GetQuantType(const std::string& precision) {
+  if (precision == "Float32") {
+    return types::QuantType::kFloat32;
+  } else if (precision == "Int8") {
+    return types::QuantType::kInt8;
+  } else if (precision == "Int4") {
+    return types::QuantType::kInt4;
+  }
+  TT_THROW("The precision(%s) is not in ['Float32', 'Int8', 'Int4'].",
+           precision);
+}
+
+void PrecisionPlan::Set(const std::string& module,
+                        types::QuantType precision) {
+  entries_[module] = precision;
+}
+
+types::QuantType PrecisionPlan::Get(const std::string& module) const {
+  auto it = entries_.find(module);
+  return it == entries_.end() ? types::QuantType::kFloat32 : it->second;
+}
+
+void PrecisionPlan::SetInputScale(const std::string& module, float scale) {
+  input_scales_[module] = scale;
+}
+
+float PrecisionPlan::GetInputScale(const std::string& module) const {
+  auto it = input_scales_.find(module);
+  return it == input_scales_.end() ? 0.f : it->second;
+}
+
+void PrecisionPlan::Save(const std::string& filename) const {
+  std::ofstream os(filename);
+  TT_ENFORCE(os.good(), "Can not open %s", filename);
+  os.precision(9);
+  std::set<std::string> modules;
+  for (auto& entry : entries_) {
+    modules.insert(entry.first);
+  }
+  for (auto& entry : input_scales_) {
+    modules.insert(entry.first);
+  }
+  for (auto& module : modules) {
+    os << module << " " << GetQuantTypeName(Get(module));
+    auto it = input_scales_.find(module);
+    if (it != input_scales_.end()) {
+      os << " " << it->second;
+    }
+    os << "\n";
+  }
+}
+
+PrecisionPlan PrecisionPlan::Load(const std::string& filename) {
+  std::ifstream is(filename);
+  TT_ENFORCE(is.good(), "Can not open %s", filename);
+  PrecisionPlan plan;
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream fields(line);
+    std::string module, precision;
+    if (!(fields >> module >> precision)) {
+      continue;
+    }
+    plan.Set(module, GetQuantType(precision));
+    float scale;
+    if (fields >> scale) {
+      plan.SetInputScale(module, scale);
+    }
+  }
+  return plan;
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
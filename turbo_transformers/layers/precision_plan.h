@@ -0,0 +1,62 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <map>
+#include <string>
+
+#include "turbo_transformers/layers/types.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// The precision of each linear module of a model, chosen offline by the
+// precision planner (turbo_transformers/layers/precision_planner.py) and
+// applied by the model loader. A module is named by its parameter prefix,
+// e.g. "encoder.layer.3.intermediate.dense", modules not in the plan keep
+// kFloat32.
+class PrecisionPlan {
+ public:
+  void Set(const std::string& module, types::QuantType precision);
+  types::QuantType Get(const std::string& module) const;
+  const std::map<std::string, types::QuantType>& entries() const {
+    return entries_;
+  }
+
+  // The static int8 scale of the input of a module, found by calibration
+  // (layers/calibration.h). 0, the default, quantizes the input dynamically.
+  void SetInputScale(const std::string& module, float scale);
+  float GetInputScale(const std::string& module) const;
+  const std::map<std::string, float>& input_scales() const {
+    return input_scales_;
+  }
+
+  // The plan is stored as "module precision [input_scale]" lines, the
+  // precision is one of Float32, Int8 and Int4, see GetQuantType.
+  void Save(const std::string& filename) const;
+  static PrecisionPlan Load(const std::string& filename);
+
+ private:
+  std::map<std::string, types::QuantType> entries_;
+  std::map<std::string, float> input_scales_;
+};
+
+const char* GetQuantTypeName(types::QuantType quant_type);
+// Parses the precision of a linear module, "Float32", "Int8" or "Int4", the
+// ones SetPrecision of the modules accepts. Int4 is weight-only and taken by
+// MultiHeadedAttention and PositionwiseFeedForward only.
+types::QuantType GetQuantType(const std::string& precision);
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,186 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/precision_plan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/bert_intermediate.h"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/pq_mat_mul.h"
+#include "turbo_transformers/layers/multi_headed_attention.h"
+#include "turbo_transformers/layers/positionwise_ffn.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+TEST_CASE("precision_plan-save-load") {
+  PrecisionPlan plan;
+  plan.Set("encoder.layer.0.intermediate.dense", types::QuantType::kInt8);
+  plan.Set("encoder.layer.0.output.dense", types::QuantType::kFloat32);
+  std::string filename = "precision_plan_test.txt";
+  plan.Save(filename);
+  auto loaded = PrecisionPlan::Load(filename);
+  std::remove(filename.c_str());
+  REQUIRE(loaded.entries() == plan.entries());
+  REQUIRE(loaded.Get("encoder.layer.0.intermediate.dense") ==
+          types::QuantType::kInt8);
+  REQUIRE(loaded.Get("encoder.layer.1.intermediate.dense") ==
+          types::QuantType::kFloat32);
+}
+
+TEST_CASE("precision_plan-bert-intermediate-int8") {
+  int64_t hidden_size = 64, intermediate_size = 256;
+  auto weight = kernels::common::CreateTensorAndFillRandom<float>(
+      {hidden_size, intermediate_size}, kDLCPU, 0);
+  auto bias = kernels::common::CreateTensorAndFillRandom<float>(
+      {intermediate_size}, kDLCPU, 0);
+  BertIntermediate intermediate(std::move(weight), std::move(bias));
+  auto input = kernels::common::CreateTensorAndFillRandom<float>(
+      {2, 5, hidden_size}, kDLCPU, 0);
+
+  core::Tensor fp32_output(nullptr), int8_output(nullptr);
+  intermediate(input, &fp32_output);
+  intermediate.SetPrecision(types::QuantType::kInt8);
+  intermediate(input, &int8_output);
+  REQUIRE(int8_output.numel() == fp32_output.numel());
+  double dot = 0, norm_a = 0, norm_b = 0;
+  for (int64_t i = 0; i < fp32_output.numel(); ++i) {
+    double a = fp32_output.data<float>()[i], b = int8_output.data<float>()[i];
+    dot += a * b;
+    norm_a += a * a;
+    norm_b += b * b;
+  }
+  REQUIRE(dot / std::sqrt(norm_a * norm_b) > 0.999);
+
+  intermediate.SetPrecision(types::QuantType::kFloat32);
+  intermediate(input, &int8_output);
+  for (int64_t i = 0; i < fp32_output.numel(); ++i) {
+    REQUIRE(int8_output.data<float>()[i] == fp32_output.data<float>()[i]);
+  }
+  REQUIRE_THROWS(intermediate.SetPrecision(types::QuantType::kBinary));
+}
+
+static double Cosine(const core::Tensor &a, const core::Tensor &b) {
+  double dot = 0, norm_a = 0, norm_b = 0;
+  for (int64_t i = 0; i < a.numel(); ++i) {
+    double x = a.data<float>()[i], y = b.data<float>()[i];
+    dot += x * y;
+    norm_a += x * x;
+    norm_b += y * y;
+  }
+  return dot / std::sqrt(norm_a * norm_b);
+}
+
+template <typename T>
+static core::Tensor CopyTensor(const core::Tensor &tensor) {
+  std::vector<int64_t> shape;
+  for (size_t i = 0; i < tensor.n_dim(); ++i) {
+    shape.push_back(tensor.shape(i));
+  }
+  core::Tensor result(nullptr);
+  std::copy(tensor.data<T>(), tensor.data<T>() + tensor.numel(),
+            result.Reshape<T>(shape, kDLCPU, 0));
+  return result;
+}
+
+TEST_CASE("precision_plan-bert-intermediate-pq") {
+  int64_t hidden_size = 64, intermediate_size = 256;
+  auto weight = kernels::common::CreateTensorAndFillRandom<float>(
+      {hidden_size, intermediate_size}, kDLCPU, 0);
+  auto bias = kernels::common::CreateTensorAndFillRandom<float>(
+      {intermediate_size}, kDLCPU, 0);
+  kernels::PQWeight pq_weight;
+  kernels::TrainWeightPQ(weight, false, 4, 16, 10, &pq_weight);
+  kernels::PQWeight pq_copy = kernels::MakePQWeight(
+      CopyTensor<float>(pq_weight.codebooks),
+      CopyTensor<uint8_t>(pq_weight.codes));
+  auto input = kernels::common::CreateTensorAndFillRandom<float>(
+      {2, 5, hidden_size}, kDLCPU, 0);
+
+  BertIntermediate intermediate(std::move(weight), CopyTensor<float>(bias));
+  core::Tensor fp32_output(nullptr), pq_output(nullptr),
+      loaded_output(nullptr);
+  intermediate(input, &fp32_output);
+  intermediate.SetPQWeight(std::move(pq_weight));
+  REQUIRE(intermediate.is_pq());
+  intermediate(input, &pq_output);
+  REQUIRE(Cosine(fp32_output, pq_output) > 0.9);
+  // the float weight is gone
+  REQUIRE_THROWS(intermediate.SetPrecision(types::QuantType::kFloat32));
+
+  // built on the PQ weight without a float weight
+  BertIntermediate loaded(std::move(pq_copy), std::move(bias));
+  REQUIRE(loaded.is_pq());
+  loaded(input, &loaded_output);
+  for (int64_t i = 0; i < pq_output.numel(); ++i) {
+    REQUIRE(loaded_output.data<float>()[i] == pq_output.data<float>()[i]);
+  }
+  REQUIRE_THROWS(loaded.SetPrecision(types::QuantType::kInt8));
+}
+
+TEST_CASE("precision_plan-decoder-int4") {
+  int64_t hidden = 128, d_ff = 256, heads = 4;
+  auto random = [](std::initializer_list<int64_t> shape) {
+    return kernels::common::CreateTensorAndFillRandom<float>(shape, kDLCPU,
+                                                             0);
+  };
+  MultiHeadedAttention attention(
+      random({hidden, hidden}), random({hidden}), random({hidden, hidden}),
+      random({hidden}), random({hidden, hidden}), random({hidden}),
+      random({hidden, hidden}), random({hidden}), random({hidden, 3 * hidden}),
+      random({3 * hidden}), random({hidden}), random({hidden}), heads);
+  PositionwiseFeedForward ffn(random({hidden, d_ff}), random({d_ff}),
+                              random({d_ff, hidden}), random({hidden}),
+                              random({hidden}), random({hidden}));
+  // a decoding step of two sequences
+  auto input = random({2, 1, hidden});
+  core::Tensor mask(nullptr), att_score(nullptr);
+  core::Tensor fp32_attention(nullptr), int4_attention(nullptr);
+  core::Tensor fp32_output(nullptr), int4_output(nullptr);
+  attention(input, input, input, mask, "self", &fp32_attention, &att_score, {},
+            true, false, true);
+  ffn(fp32_attention, &fp32_output, false);
+
+  attention.SetPrecision("qkv", types::QuantType::kInt4);
+  attention.SetPrecision("dense", types::QuantType::kInt4);
+  ffn.SetPrecision(types::QuantType::kInt4, false);
+  attention(input, input, input, mask, "self", &int4_attention, &att_score, {},
+            true, false, true);
+  ffn(int4_attention, &int4_output, false);
+  REQUIRE(Cosine(fp32_attention, int4_attention) > 0.99);
+  REQUIRE(Cosine(fp32_output, int4_output) > 0.99);
+
+  // the float weights were released, the modules stay int4.
+  REQUIRE_THROWS(ffn.SetPrecision(types::QuantType::kFloat32, false));
+  REQUIRE_THROWS(attention.SetPrecision("dense", types::QuantType::kInt8));
+  ffn.SetPrecision(types::QuantType::kInt4, false);
+  ffn(fp32_attention, &int4_output, false);
+  REQUIRE(Cosine(fp32_output, int4_output) > 0.99);
+
+  PositionwiseFeedForward fp32_ffn(random({hidden, d_ff}), random({d_ff}),
+                                   random({d_ff, hidden}), random({hidden}),
+                                   random({hidden}), random({hidden}));
+  REQUIRE_THROWS(fp32_ffn.SetPrecision(types::QuantType::kBinary, false));
+  REQUIRE(GetQuantType("Int4") == types::QuantType::kInt4);
+  REQUIRE_THROWS(GetQuantType("Binary"));
+  REQUIRE(std::string(GetQuantTypeName(types::QuantType::kInt4)) == "Int4");
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
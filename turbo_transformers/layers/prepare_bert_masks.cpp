@@ -13,6 +13,7 @@
 
 #include "prepare_bert_masks.h"
 
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/common.h"
 #ifdef TT_WITH_CUDA
 #include "turbo_transformers/layers/kernels/gpu_utils.h"
@@ -26,6 +27,7 @@ void PrepareBertMasks::operator()(const core::Tensor& inputs,
                                   core::Tensor* seq_type,
                                   core::Tensor* position_ids,
                                   core::Tensor* extended_attention_mask) const {
+  TT_TRACE_LAYER("PrepareBertMasks", inputs);
   if (position_ids->is_null()) {
     auto pos_ids_ptr = position_ids->Reshape<int64_t>(
         {inputs.shape(0), inputs.shape(1)}, inputs.device_type(),
@@ -0,0 +1,131 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/sequence_packing.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "turbo_transformers/core/enforce.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+SequencePacking::SequencePacking(const std::vector<int64_t>& lengths,
+                                 int64_t row_len)
+    : row_len_(row_len) {
+  int64_t n_sequences = lengths.size();
+  TT_ENFORCE_GT(n_sequences, 0, "nothing to pack");
+  for (auto length : lengths) {
+    TT_ENFORCE_GT(length, 0, "can not pack an empty sequence");
+    row_len_ = std::max(row_len_, length);
+  }
+  std::vector<int64_t> order(n_sequences);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](int64_t a, int64_t b) {
+    return lengths[a] > lengths[b];
+  });
+
+  auto* segments =
+      segments_.Reshape<int64_t>({n_sequences, 3}, kDLCPU, 0, "Packing");
+  std::vector<int64_t> row_used;
+  for (auto i : order) {
+    size_t r = 0;
+    while (r < row_used.size() && row_used[r] + lengths[i] > row_len_) {
+      ++r;
+    }
+    if (r == row_used.size()) {
+      row_used.push_back(0);
+    }
+    segments[3 * i] = r;
+    segments[3 * i + 1] = row_used[r];
+    segments[3 * i + 2] = lengths[i];
+    row_used[r] += lengths[i];
+  }
+  n_rows_ = row_used.size();
+}
+
+double SequencePacking::fill_ratio() const {
+  int64_t tokens = 0;
+  for (int64_t i = 0; i < n_sequences(); ++i) {
+    tokens += length(i);
+  }
+  return static_cast<double>(tokens) / (n_rows_ * row_len_);
+}
+
+template <typename T>
+void SequencePacking::Pack(const std::vector<std::vector<T>>& values,
+                           T pad_value, T* out) const {
+  TT_ENFORCE_EQ(static_cast<int64_t>(values.size()), n_sequences(),
+                "Pack needs the values of every sequence");
+  std::vector<const T*> views(values.size());
+  for (int64_t i = 0; i < n_sequences(); ++i) {
+    TT_ENFORCE_EQ(static_cast<int64_t>(values[i].size()), length(i),
+                  "sequence %d has %d values for %d tokens", i,
+                  values[i].size(), length(i));
+    views[i] = values[i].data();
+  }
+  Pack(views, pad_value, out);
+}
+
+template <typename T>
+void SequencePacking::Pack(const std::vector<const T*>& values, T pad_value,
+                           T* out) const {
+  TT_ENFORCE_EQ(static_cast<int64_t>(values.size()), n_sequences(),
+                "Pack needs the values of every sequence");
+  std::fill(out, out + n_rows_ * row_len_, pad_value);
+  for (int64_t i = 0; i < n_sequences(); ++i) {
+    std::copy(values[i], values[i] + length(i),
+              out + row(i) * row_len_ + offset(i));
+  }
+}
+
+template void SequencePacking::Pack<int64_t>(
+    const std::vector<std::vector<int64_t>>& values, int64_t pad_value,
+    int64_t* out) const;
+template void SequencePacking::Pack<int64_t>(
+    const std::vector<const int64_t*>& values, int64_t pad_value,
+    int64_t* out) const;
+
+void SequencePacking::PackPositionIds(int64_t* out) const {
+  std::fill(out, out + n_rows_ * row_len_, 0);
+  for (int64_t i = 0; i < n_sequences(); ++i) {
+    std::iota(out + row(i) * row_len_ + offset(i),
+              out + row(i) * row_len_ + offset(i) + length(i), 0);
+  }
+}
+
+void SequencePacking::PackMask(int64_t* out) const {
+  std::fill(out, out + n_rows_ * row_len_, 0);
+  for (int64_t i = 0; i < n_sequences(); ++i) {
+    auto* begin = out + row(i) * row_len_ + offset(i);
+    std::fill(begin, begin + length(i), 1);
+  }
+}
+
+namespace {
+thread_local const SequencePacking* current_packing = nullptr;
+}  // namespace
+
+PackingScope::PackingScope(const SequencePacking* packing)
+    : prev_packing_(current_packing) {
+  current_packing = packing;
+}
+
+PackingScope::~PackingScope() { current_packing = prev_packing_; }
+
+const SequencePacking* CurrentPacking() { return current_packing; }
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,85 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// Packs short sequences end to end into rows of row_len tokens, so that a
+// batch of short sequences runs as a few dense rows instead of rows mostly
+// made of padding. The sequences are placed by first-fit decreasing: the
+// longest first, each into the first row with room for it. row_len is raised
+// to the longest sequence if needed.
+class SequencePacking {
+ public:
+  SequencePacking(const std::vector<int64_t>& lengths, int64_t row_len);
+
+  int64_t n_rows() const { return n_rows_; }
+  int64_t row_len() const { return row_len_; }
+  int64_t n_sequences() const { return segments_.shape(0); }
+  int64_t row(int64_t i) const { return segment(i)[0]; }
+  int64_t offset(int64_t i) const { return segment(i)[1]; }
+  int64_t length(int64_t i) const { return segment(i)[2]; }
+  // The share of the packed tokens which are not padding.
+  double fill_ratio() const;
+
+  // (n_sequences, 3) int64 on CPU, the (row, offset, length) of every
+  // sequence, as taken by the kernels of kernels/sequence_packing.h.
+  const core::Tensor& segments() const { return segments_; }
+
+  // Writes values[i], the per token values of sequence i, at its place in
+  // the (n_rows, row_len) out, and pad_value at the padding.
+  template <typename T>
+  void Pack(const std::vector<std::vector<T>>& values, T pad_value,
+            T* out) const;
+  // The same with values[i] pointing to the length(i) values of sequence i,
+  // e.g. read in place from a buffer the caller does not own.
+  template <typename T>
+  void Pack(const std::vector<const T*>& values, T pad_value, T* out) const;
+  // The position ids of the tokens, restarting from 0 at every sequence.
+  void PackPositionIds(int64_t* out) const;
+  // 1 for the tokens of the sequences and 0 for the padding.
+  void PackMask(int64_t* out) const;
+
+ private:
+  const int64_t* segment(int64_t i) const {
+    return segments_.data<int64_t>() + 3 * i;
+  }
+
+  int64_t row_len_;
+  int64_t n_rows_{0};
+  core::Tensor segments_{nullptr};
+};
+
+// The self attention run by this thread in the scope attends within the
+// sequences of packing only, skipping the off-diagonal blocks of the rows.
+class PackingScope {
+ public:
+  explicit PackingScope(const SequencePacking* packing);
+  ~PackingScope();
+
+ private:
+  const SequencePacking* prev_packing_;
+};
+
+// The packing of the current PackingScope, nullptr outside of one.
+extern const SequencePacking* CurrentPacking();
+
+}  // namespace layers
+}  // namespace turbo_transformers
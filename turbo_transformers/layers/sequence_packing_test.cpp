@@ -0,0 +1,108 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/sequence_packing.h"
+
+#include <cmath>
+
+#include "catch2/catch.hpp"
+#include "turbo_transformers/layers/kernels/common.h"
+#include "turbo_transformers/layers/kernels/sequence_packing.h"
+#include "turbo_transformers/layers/multi_headed_attention.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+static core::Tensor Random(std::initializer_list<int64_t> shape) {
+  return kernels::common::CreateTensorAndFillRandom<float>(shape, kDLCPU, 0);
+}
+
+TEST_CASE("sequence-packing-first-fit-decreasing") {
+  SequencePacking packing({3, 7, 2, 5, 4}, 10);
+  REQUIRE(packing.n_rows() == 3);
+  REQUIRE(packing.row_len() == 10);
+  // 7 -> row 0, 5 -> row 1, 4 -> row 1, 3 -> row 0, 2 -> row 2
+  std::vector<int64_t> rows = {0, 0, 2, 1, 1};
+  std::vector<int64_t> offsets = {7, 0, 0, 0, 5};
+  for (int64_t i = 0; i < packing.n_sequences(); ++i) {
+    REQUIRE(packing.row(i) == rows[i]);
+    REQUIRE(packing.offset(i) == offsets[i]);
+  }
+  REQUIRE(packing.fill_ratio() == Approx(21. / 30.));
+
+  // a sequence longer than the rows widens them
+  SequencePacking wide({12, 3}, 8);
+  REQUIRE(wide.row_len() == 12);
+  REQUIRE(wide.n_rows() == 2);
+  REQUIRE_THROWS(SequencePacking({3, 0}, 8));
+}
+
+TEST_CASE("sequence-packing-pack") {
+  SequencePacking packing({2, 3, 1}, 4);
+  REQUIRE(packing.n_rows() == 2);
+  std::vector<int64_t> ids(packing.n_rows() * packing.row_len());
+  packing.Pack<int64_t>({{1, 2}, {3, 4, 5}, {6}}, -1, ids.data());
+  REQUIRE(ids == std::vector<int64_t>({3, 4, 5, 6, 1, 2, -1, -1}));
+  packing.PackPositionIds(ids.data());
+  REQUIRE(ids == std::vector<int64_t>({0, 1, 2, 0, 0, 1, 0, 0}));
+  packing.PackMask(ids.data());
+  REQUIRE(ids == std::vector<int64_t>({1, 1, 1, 1, 1, 1, 0, 0}));
+  REQUIRE_THROWS(packing.Pack<int64_t>({{1, 2}, {3}, {6}}, 0, ids.data()));
+
+  REQUIRE(CurrentPacking() == nullptr);
+  {
+    PackingScope scope(&packing);
+    REQUIRE(CurrentPacking() == &packing);
+  }
+  REQUIRE(CurrentPacking() == nullptr);
+}
+
+TEST_CASE("sequence-packing-self-attention") {
+  int64_t hidden = 32, heads = 4;
+  MultiHeadedAttention attention(
+      Random({hidden, hidden}), Random({hidden}), Random({hidden, hidden}),
+      Random({hidden}), Random({hidden, hidden}), Random({hidden}),
+      Random({hidden, hidden}), Random({hidden}), Random({hidden, 3 * hidden}),
+      Random({3 * hidden}), Random({hidden}), Random({hidden}), heads);
+  SequencePacking packing({5, 9, 3, 3, 7, 2}, 12);
+  int64_t n_rows = packing.n_rows(), row_len = packing.row_len();
+  auto input = Random({n_rows, row_len, hidden});
+
+  // the dense attention of the rows under the block diagonal mask
+  core::Tensor mask(nullptr), att_score(nullptr), expected(nullptr);
+  kernels::BuildBlockDiagonalMask(packing.segments(), n_rows, row_len, &mask);
+  attention(input, input, input, mask, "self", &expected, &att_score, {},
+            true, false, true);
+
+  core::Tensor no_mask(nullptr), output(nullptr);
+  {
+    PackingScope scope(&packing);
+    attention(input, input, input, no_mask, "self", &output, &att_score, {},
+              true, false, true);
+  }
+  // the padding is left out of both
+  for (int64_t i = 0; i < packing.n_sequences(); ++i) {
+    for (int64_t t = 0; t < packing.length(i); ++t) {
+      int64_t base =
+          (packing.row(i) * row_len + packing.offset(i) + t) * hidden;
+      for (int64_t j = 0; j < hidden; ++j) {
+        REQUIRE(std::fabs(output.data<float>()[base + j] -
+                          expected.data<float>()[base + j]) < 1e-3);
+      }
+    }
+  }
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
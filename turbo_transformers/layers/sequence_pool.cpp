@@ -13,6 +13,7 @@
 
 #include "turbo_transformers/layers/sequence_pool.h"
 
+#include "turbo_transformers/core/trace.h"
 #include "turbo_transformers/layers/kernels/seq_pool.h"
 
 namespace turbo_transformers {
@@ -20,6 +21,7 @@ namespace layers {
 
 void SequencePool::operator()(const core::Tensor &input,
                               core::Tensor *output) const {
+  TT_TRACE_LAYER("SequencePool", input);
   kernels::SeqPool<float>(input, pool_type_, output);
 }
 
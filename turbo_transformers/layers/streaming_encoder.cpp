@@ -0,0 +1,122 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+
+#include "turbo_transformers/layers/streaming_encoder.h"
+
+#include <utility>
+
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/tensor_copy.h"
+#include "turbo_transformers/core/trace.h"
+
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+
+namespace {
+
+// Drops all but the last n positions of cache (batch, heads, len, size), the
+// result is built in scratch and swapped in.
+void KeepLastPositions(int64_t n, core::Tensor* cache, core::Tensor* scratch) {
+  int64_t len = cache->shape(2);
+  if (len <= n) {
+    return;
+  }
+  int64_t n_blocks = cache->shape(0) * cache->shape(1);
+  int64_t size = cache->shape(3);
+  auto devtype = cache->device_type();
+  auto* dst = scratch->Reshape<float>(
+      {cache->shape(0), cache->shape(1), n, size}, devtype,
+      cache->device_id(), "StreamingEncoder/KeepLastPositions/Reshape");
+  const float* src = cache->data<float>() + (len - n) * size;
+  for (int64_t i = 0; i < n_blocks; ++i) {
+    core::Copy<float>(src + i * len * size, n * size, devtype, devtype,
+                      dst + i * n * size);
+  }
+  std::swap(*cache, *scratch);
+}
+
+}  // namespace
+
+int64_t StreamingEncoderState::n_cached() const {
+  if (keys_.empty() || keys_[0].is_null()) {
+    return 0;
+  }
+  return keys_[0].shape(2);
+}
+
+void StreamingEncoderState::Reset() {
+  keys_.clear();
+  values_.clear();
+  n_tokens_ = 0;
+}
+
+StreamingEncoder::StreamingEncoder(std::vector<TransformerEncoderLayer> layers,
+                                   int64_t left_context, bool is_trans_weight)
+    : layers_(std::move(layers)),
+      left_context_(left_context),
+      is_trans_weight_(is_trans_weight) {
+  TT_ENFORCE_GT(left_context_, 0, "the left context must be positive");
+  TT_ENFORCE(!layers_.empty(), "the streaming encoder has no layer");
+}
+
+void StreamingEncoder::operator()(const core::Tensor& chunk,
+                                  StreamingEncoderState* state,
+                                  core::Tensor* output) const {
+  TT_TRACE_LAYER("StreamingEncoder", chunk);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile("StreamingEncoder", chunk.device_type());
+#endif
+  TT_ENFORCE_EQ(chunk.n_dim(), 3, "the chunk should be (batch, len, hidden)");
+  if (state->keys_.empty()) {
+    for (size_t i = 0; i < layers_.size(); ++i) {
+      state->keys_.emplace_back(nullptr);
+      state->values_.emplace_back(nullptr);
+    }
+  }
+  TT_ENFORCE_EQ(state->keys_.size(), layers_.size(),
+                "the state belongs to an encoder of %d layers",
+                state->keys_.size());
+  if (state->n_cached() > 0) {
+    TT_ENFORCE_EQ(state->keys_[0].shape(0), chunk.shape(0),
+                  "the batch of streams changed, Reset the state first");
+  }
+
+  // the encoder attends to the whole cached context, no mask is needed.
+  core::Tensor mask(nullptr), hidden(nullptr);
+  const core::Tensor* input = &chunk;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    // the layers alternate between the output and hidden, the last one
+    // writes the output.
+    bool to_output = (layers_.size() - i) % 2 == 1;
+    core::Tensor* layer_output = to_output ? output : &hidden;
+    layers_[i](*input, mask, layer_output, is_trans_weight_, &state->keys_[i],
+               &state->values_[i]);
+    KeepLastPositions(left_context_, &state->keys_[i], &state->scratch_);
+    KeepLastPositions(left_context_, &state->values_[i], &state->scratch_);
+    input = layer_output;
+  }
+  state->n_tokens_ += chunk.shape(1);
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile("StreamingEncoder", chunk.device_type());
+#endif
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
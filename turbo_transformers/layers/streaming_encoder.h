@@ -0,0 +1,71 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/transformer_encoder.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// The cached left context of a batch of streams: the keys and values of the
+// last left_context tokens for every layer.
+class StreamingEncoderState {
+ public:
+  // the number of tokens encoded since the start or the last Reset.
+  int64_t n_tokens() const { return n_tokens_; }
+  // the number of cached tokens, at most the left context of the encoder.
+  int64_t n_cached() const;
+  // Drops the cache for a new batch of streams.
+  void Reset();
+
+ private:
+  friend class StreamingEncoder;
+  std::vector<core::Tensor> keys_;
+  std::vector<core::Tensor> values_;
+  core::Tensor scratch_{nullptr};
+  int64_t n_tokens_{0};
+};
+
+// Encodes streams chunk by chunk instead of the whole growing window. Every
+// layer attends to the tokens of the current chunk and to the keys and
+// values of at most left_context previous tokens, kept in the state, so the
+// cost of a chunk does not grow with the history. The output of a chunk is
+// final when returned, the following chunks do not change it.
+class StreamingEncoder {
+ public:
+  StreamingEncoder(std::vector<TransformerEncoderLayer> layers,
+                   int64_t left_context, bool is_trans_weight = false);
+
+  // chunk: (batch, chunk_len, hidden), the next chunk of each of the batch
+  // streams of state, the chunks of a batch have the same length.
+  // output: (batch, chunk_len, hidden).
+  void operator()(const core::Tensor& chunk, StreamingEncoderState* state,
+                  core::Tensor* output) const;
+
+  int64_t left_context() const { return left_context_; }
+
+ private:
+  std::vector<TransformerEncoderLayer> layers_;
+  int64_t left_context_;
+  bool is_trans_weight_;
+};
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,122 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+
+#include "turbo_transformers/layers/streaming_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <utility>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+
+// a fixed seed, so that the test does not depend on the run.
+static core::Tensor Random(std::initializer_list<int64_t> shape) {
+  static std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+  core::Tensor tensor(nullptr);
+  auto* data = tensor.Reshape<float>(shape, kDLCPU, 0);
+  for (int64_t i = 0; i < tensor.numel(); ++i) {
+    data[i] = dist(rng);
+  }
+  return tensor;
+}
+
+static TransformerEncoderLayer RandomLayer(int64_t hidden, int64_t heads,
+                                           int64_t d_ff) {
+  auto self_attention = std::make_shared<MultiHeadedAttention>(
+      Random({hidden, hidden}), Random({hidden}), Random({hidden, hidden}),
+      Random({hidden}), Random({hidden, hidden}), Random({hidden}),
+      Random({hidden, hidden}), Random({hidden}), Random({hidden, 3 * hidden}),
+      Random({3 * hidden}), Random({hidden}), Random({hidden}), heads);
+  auto feed_forward = std::make_shared<PositionwiseFeedForward>(
+      Random({hidden, d_ff}), Random({d_ff}), Random({d_ff, hidden}),
+      Random({hidden}), Random({hidden}), Random({hidden}));
+  return TransformerEncoderLayer(std::move(self_attention),
+                                 std::move(feed_forward));
+}
+
+TEST_CASE("streaming-encoder-left-context") {
+  int64_t batch = 2, hidden = 32, heads = 4, n_chunks = 5, chunk_len = 3;
+  int64_t left_context = 4, len = n_chunks * chunk_len;
+  std::vector<TransformerEncoderLayer> layers;
+  for (int i = 0; i < 2; ++i) {
+    layers.push_back(RandomLayer(hidden, heads, 64));
+  }
+  StreamingEncoder encoder(layers, left_context);
+  auto input = Random({batch, len, hidden});
+
+  // the whole sequence at once, a token of chunk c attends to the tokens of
+  // the chunks up to c which are at most left_context before chunk c.
+  core::Tensor mask(nullptr);
+  auto* mask_data =
+      mask.Reshape<float>({batch, 1, len, len}, kDLCPU, 0, "mask");
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t t = 0; t < len; ++t) {
+      int64_t chunk_begin = t / chunk_len * chunk_len;
+      for (int64_t s = 0; s < len; ++s) {
+        bool visible = s < chunk_begin + chunk_len &&
+                       s >= chunk_begin - left_context;
+        mask_data[(b * len + t) * len + s] = visible ? 0.f : -10000.f;
+      }
+    }
+  }
+  core::Tensor expected(nullptr), hidden_states(nullptr);
+  const core::Tensor* layer_input = &input;
+  for (auto& layer : layers) {
+    layer(*layer_input, mask, &expected);
+    hidden_states.Reshape<float>({batch, len, hidden}, kDLCPU, 0);
+    std::memcpy(hidden_states.mutableData<float>(), expected.data<float>(),
+                expected.numel() * sizeof(float));
+    layer_input = &hidden_states;
+  }
+
+  StreamingEncoderState state;
+  core::Tensor chunk(nullptr), output(nullptr);
+  for (int64_t c = 0; c < n_chunks; ++c) {
+    auto* chunk_data =
+        chunk.Reshape<float>({batch, chunk_len, hidden}, kDLCPU, 0);
+    for (int64_t b = 0; b < batch; ++b) {
+      std::memcpy(chunk_data + b * chunk_len * hidden,
+                  input.data<float>() + (b * len + c * chunk_len) * hidden,
+                  chunk_len * hidden * sizeof(float));
+    }
+    encoder(chunk, &state, &output);
+    REQUIRE(state.n_tokens() == (c + 1) * chunk_len);
+    REQUIRE(state.n_cached() == std::min((c + 1) * chunk_len, left_context));
+    for (int64_t b = 0; b < batch; ++b) {
+      for (int64_t i = 0; i < chunk_len * hidden; ++i) {
+        float streamed = output.data<float>()[b * chunk_len * hidden + i];
+        float full = expected.data<float>()[(b * len + c * chunk_len) * hidden +
+                                            i];
+        REQUIRE(std::fabs(streamed - full) <=
+                1e-4f * std::max(1.f, std::fabs(full)));
+      }
+    }
+  }
+
+  state.Reset();
+  REQUIRE(state.n_tokens() == 0);
+  REQUIRE(state.n_cached() == 0);
+  REQUIRE_THROWS(StreamingEncoder(layers, 0));
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
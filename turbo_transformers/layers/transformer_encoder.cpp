@@ -0,0 +1,129 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/transformer_encoder.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "turbo_transformers/core/enforce.h"
+#include "turbo_transformers/core/trace.h"
+#include "turbo_transformers/layers/kernels/layer_norm.h"
+
+#ifdef WITH_PERFTOOLS
+#include "turbo_transformers/core/profiler.h"
+#endif
+
+namespace turbo_transformers {
+namespace layers {
+
+TransformerEncoderLayer::TransformerEncoderLayer(
+    std::shared_ptr<MultiHeadedAttention> self_attention,
+    std::shared_ptr<PositionwiseFeedForward> feed_forward)
+    : self_attention_(std::move(self_attention)),
+      feed_forward_(std::move(feed_forward)) {
+  TT_ENFORCE(self_attention_ != nullptr && feed_forward_ != nullptr,
+             "a transformer encoder layer needs both of its modules");
+}
+
+void TransformerEncoderLayer::operator()(const core::Tensor& input,
+                                         const core::Tensor& mask,
+                                         core::Tensor* output,
+                                         bool is_trans_weight,
+                                         core::Tensor* keys,
+                                         core::Tensor* values) const {
+  TT_ENFORCE((keys == nullptr) == (values == nullptr),
+             "the keys and the values are cached together");
+  std::unordered_map<std::string, core::Tensor*> layer_cache;
+  if (keys != nullptr) {
+    layer_cache = {{"self_keys", keys}, {"self_values", values}};
+  }
+  core::Tensor attention_out(nullptr), att_score(nullptr);
+  (*self_attention_)(input, input, input, mask, "self", &attention_out,
+                     &att_score, layer_cache, true /* pre_layernorm */,
+                     false /* post_layernorm */, true /* post_add_input */,
+                     is_trans_weight);
+  (*feed_forward_)(attention_out, output, is_trans_weight);
+}
+
+TransformerEncoder::TransformerEncoder(
+    std::vector<TransformerEncoderLayer> layers,
+    core::Tensor layer_norm_weight, core::Tensor layer_norm_bias,
+    bool is_trans_weight)
+    : layers_(std::move(layers)),
+      layer_norm_weight_(std::move(layer_norm_weight)),
+      layer_norm_bias_(std::move(layer_norm_bias)),
+      is_trans_weight_(is_trans_weight) {
+  TT_ENFORCE(!layers_.empty(), "the transformer encoder has no layer");
+}
+
+void TransformerEncoder::operator()(const core::Tensor& input,
+                                    const core::Tensor& mask,
+                                    core::Tensor* output) const {
+  TT_TRACE_LAYER("TransformerEncoder", input);
+#ifdef WITH_PERFTOOLS
+  auto& profile_ctx = core::Profiler::GetInstance();
+  profile_ctx.start_profile("TransformerEncoder", input.device_type());
+#endif
+  TT_ENFORCE_EQ(input.n_dim(), 3,
+                "the input should be (batch, len, hidden), batch first");
+  // the layers alternate between the output and hidden, the last one writes
+  // the output.
+  core::Tensor hidden(nullptr);
+  const core::Tensor* layer_input = &input;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    bool to_output = (layers_.size() - i) % 2 == 1;
+    core::Tensor* layer_output = to_output ? output : &hidden;
+    layers_[i](*layer_input, mask, layer_output, is_trans_weight_);
+    layer_input = layer_output;
+  }
+  kernels::LayerNorm<float>(layer_norm_weight_, layer_norm_bias_, output,
+                            1e-6, "TransformerEncoder/LayerNorm");
+#ifdef WITH_PERFTOOLS
+  profile_ctx.end_profile("TransformerEncoder", input.device_type());
+#endif
+}
+
+TransformerEncoder TransformerEncoder::Load(const ParamLoader& load,
+                                            int64_t n_layers,
+                                            int64_t n_heads) {
+  TT_ENFORCE_GT(n_layers, 0, "the transformer encoder has no layer");
+  std::vector<TransformerEncoderLayer> layers;
+  for (int64_t i = 0; i < n_layers; ++i) {
+    auto prefix = "encoder.transformer." + std::to_string(i) + ".";
+    auto self_attn = prefix + "self_attn.";
+    // only the fused projection of the self attention is used.
+    auto attention = std::make_shared<MultiHeadedAttention>(
+        core::Tensor(nullptr), core::Tensor(nullptr), core::Tensor(nullptr),
+        core::Tensor(nullptr), core::Tensor(nullptr), core::Tensor(nullptr),
+        load(self_attn + "final_linear.weight"),
+        load(self_attn + "final_linear.bias"),
+        load(self_attn + "qkv.weight"), load(self_attn + "qkv.bias"),
+        load(prefix + "layer_norm.weight"), load(prefix + "layer_norm.bias"),
+        n_heads);
+    auto ffn = prefix + "feed_forward.";
+    auto feed_forward = std::make_shared<PositionwiseFeedForward>(
+        load(ffn + "w_1.weight"), load(ffn + "w_1.bias"),
+        load(ffn + "w_2.weight"), load(ffn + "w_2.bias"),
+        load(ffn + "layer_norm.weight"), load(ffn + "layer_norm.bias"));
+    layers.emplace_back(std::move(attention), std::move(feed_forward));
+  }
+  return TransformerEncoder(std::move(layers),
+                            load("encoder.layer_norm.weight"),
+                            load("encoder.layer_norm.bias"));
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
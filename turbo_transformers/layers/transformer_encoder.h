@@ -0,0 +1,93 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "turbo_transformers/core/tensor.h"
+#include "turbo_transformers/layers/multi_headed_attention.h"
+#include "turbo_transformers/layers/positionwise_ffn.h"
+
+namespace turbo_transformers {
+namespace layers {
+
+// The pre-norm TransformerEncoderLayer of OpenNMT: the self attention, which
+// owns the layer norm of its input and runs with pre_layernorm and
+// post_add_input, followed by the position-wise feed forward.
+class TransformerEncoderLayer {
+ public:
+  TransformerEncoderLayer(
+      std::shared_ptr<MultiHeadedAttention> self_attention,
+      std::shared_ptr<PositionwiseFeedForward> feed_forward);
+
+  // input, output: (batch, len, hidden). mask: (batch, 1, len), 0 at the
+  // tokens and -1e18 at the padding, or empty. keys and values, if not null,
+  // cache the self attention keys and values of the previous tokens, which
+  // the input also attends to, and receive those of the input appended, see
+  // StreamingEncoder.
+  void operator()(const core::Tensor& input, const core::Tensor& mask,
+                  core::Tensor* output, bool is_trans_weight = false,
+                  core::Tensor* keys = nullptr,
+                  core::Tensor* values = nullptr) const;
+
+ private:
+  std::shared_ptr<MultiHeadedAttention> self_attention_;
+  std::shared_ptr<PositionwiseFeedForward> feed_forward_;
+};
+
+// The encoder stack of the OpenNMT Transformer, from the embedded source to
+// the memory bank of the TransformerDecoder: the layers followed by the
+// final layer norm.
+class TransformerEncoder {
+ public:
+  TransformerEncoder(std::vector<TransformerEncoderLayer> layers,
+                     core::Tensor layer_norm_weight,
+                     core::Tensor layer_norm_bias,
+                     bool is_trans_weight = false);
+
+  // input: (batch, len, hidden), the embedded source, batch first.
+  // mask: (batch, 1, len), 0 at the tokens and -1e18 at the padding, or
+  // empty. output: (batch, len, hidden), batch first as the memory bank is
+  // consumed by the context attention of the decoder layers, so it is passed
+  // to them without a transpose.
+  void operator()(const core::Tensor& input, const core::Tensor& mask,
+                  core::Tensor* output) const;
+
+  int64_t n_layers() const { return static_cast<int64_t>(layers_.size()); }
+
+  // Returns the tensor of a parameter by name.
+  using ParamLoader = std::function<core::Tensor(const std::string& name)>;
+
+  // Builds the encoder from the parameters named as in the npz files of
+  // tools/convert_onmt_encoder_to_npz.py, e.g. from an npz in C++:
+  //   auto npz = cnpy::npz_load("encoder.npz");
+  //   loaders::NPZLoader params(loaders::NPZMapView("", &npz), kDLCPU);
+  //   auto encoder = TransformerEncoder::Load(
+  //       [&](const std::string& name) { return params[name]; }, 6, 8);
+  static TransformerEncoder Load(const ParamLoader& load, int64_t n_layers,
+                                 int64_t n_heads);
+
+ private:
+  std::vector<TransformerEncoderLayer> layers_;
+  core::Tensor layer_norm_weight_;
+  core::Tensor layer_norm_bias_;
+  bool is_trans_weight_;
+};
+
+}  // namespace layers
+}  // namespace turbo_transformers
@@ -0,0 +1,187 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.
+// All rights reserved.
+// Licensed under the BSD 3-Clause License (the "License"); you may
+// not use this file except in compliance with the License. You may
+// obtain a copy of the License at
+// https://opensource.org/licenses/BSD-3-Clause
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+// See the AUTHORS file for names of contributors.
+
+
+#include "turbo_transformers/layers/transformer_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+
+#include "catch2/catch.hpp"
+
+namespace turbo_transformers {
+namespace layers {
+
+static std::mt19937 rng(0);
+
+static float RandomValue() {
+  static std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+  return dist(rng);
+}
+
+static core::Tensor Random(std::initializer_list<int64_t> shape) {
+  core::Tensor tensor(nullptr);
+  auto* data = tensor.Reshape<float>(shape, kDLCPU, 0);
+  for (int64_t i = 0; i < tensor.numel(); ++i) {
+    data[i] = RandomValue();
+  }
+  return tensor;
+}
+
+static bool Near(float actual, float expected) {
+  return std::fabs(actual - expected) <=
+         1e-4f * std::max(1.f, std::fabs(expected));
+}
+
+static std::map<std::string, std::vector<float>> RandomParams(
+    int64_t n_layers, int64_t hidden, int64_t d_ff) {
+  std::map<std::string, std::vector<int64_t>> shapes{
+      {"self_attn.qkv.weight", {hidden, 3 * hidden}},
+      {"self_attn.qkv.bias", {3 * hidden}},
+      {"self_attn.final_linear.weight", {hidden, hidden}},
+      {"self_attn.final_linear.bias", {hidden}},
+      {"layer_norm.weight", {hidden}},
+      {"layer_norm.bias", {hidden}},
+      {"feed_forward.w_1.weight", {hidden, d_ff}},
+      {"feed_forward.w_1.bias", {d_ff}},
+      {"feed_forward.w_2.weight", {d_ff, hidden}},
+      {"feed_forward.w_2.bias", {hidden}},
+      {"feed_forward.layer_norm.weight", {hidden}},
+      {"feed_forward.layer_norm.bias", {hidden}}};
+  std::map<std::string, std::vector<float>> params;
+  auto add = [&](const std::string& name, int64_t numel) {
+    auto& values = params[name];
+    for (int64_t i = 0; i < numel; ++i) {
+      values.push_back(RandomValue());
+    }
+  };
+  for (int64_t i = 0; i < n_layers; ++i) {
+    for (auto& shape : shapes) {
+      int64_t numel = 1;
+      for (auto dim : shape.second) {
+        numel *= dim;
+      }
+      add("encoder.transformer." + std::to_string(i) + "." + shape.first,
+          numel);
+    }
+  }
+  add("encoder.layer_norm.weight", hidden);
+  add("encoder.layer_norm.bias", hidden);
+  return params;
+}
+
+static TransformerEncoder::ParamLoader MakeLoader(
+    const std::map<std::string, std::vector<float>>& params, int64_t hidden,
+    int64_t d_ff) {
+  return [&params, hidden, d_ff](const std::string& name) {
+    auto& values = params.at(name);
+    std::vector<int64_t> shape{static_cast<int64_t>(values.size())};
+    if (name.find("qkv.weight") != std::string::npos) {
+      shape = {hidden, 3 * hidden};
+    } else if (name.find("final_linear.weight") != std::string::npos) {
+      shape = {hidden, hidden};
+    } else if (name.find("w_1.weight") != std::string::npos) {
+      shape = {hidden, d_ff};
+    } else if (name.find("w_2.weight") != std::string::npos) {
+      shape = {d_ff, hidden};
+    }
+    core::Tensor tensor(nullptr);
+    tensor.Reshape<float>(shape, kDLCPU, 0);
+    std::memcpy(tensor.mutableData<float>(), values.data(),
+                values.size() * sizeof(float));
+    return tensor;
+  };
+}
+
+// The numerics are checked against OpenNMT's TransformerEncoder in
+// python/tests/encoder_transformer_encoder_test.py; here only the stacking
+// and the final layer norm are checked.
+TEST_CASE("transformer-encoder-layers") {
+  int64_t hidden = 32, heads = 4, d_ff = 64, batch = 2, len = 5;
+  auto input = Random({batch, len, hidden});
+  for (int64_t n_layers : {2, 3}) {
+    auto params = RandomParams(n_layers, hidden, d_ff);
+    params["encoder.layer_norm.weight"].assign(hidden, 1.f);
+    params["encoder.layer_norm.bias"].assign(hidden, 0.f);
+    auto encoder = TransformerEncoder::Load(MakeLoader(params, hidden, d_ff),
+                                            n_layers, heads);
+    REQUIRE(encoder.n_layers() == n_layers);
+    core::Tensor output(nullptr);
+    encoder(input, core::Tensor(nullptr), &output);
+    REQUIRE(output.shape(0) == batch);
+    REQUIRE(output.shape(1) == len);
+    REQUIRE(output.shape(2) == hidden);
+
+    // with a unit final layer norm every token is normalized
+    for (int64_t row = 0; row < batch * len; ++row) {
+      const float* values = output.data<float>() + row * hidden;
+      float mean = 0.f, variance = 0.f;
+      for (int64_t i = 0; i < hidden; ++i) {
+        mean += values[i];
+      }
+      mean /= hidden;
+      for (int64_t i = 0; i < hidden; ++i) {
+        variance += (values[i] - mean) * (values[i] - mean);
+      }
+      variance /= hidden;
+      REQUIRE(std::fabs(mean) < 1e-4f);
+      REQUIRE(Near(variance, 1.f));
+    }
+  }
+}
+
+TEST_CASE("transformer-encoder-padding") {
+  int64_t hidden = 32, heads = 4, d_ff = 64, n_layers = 2;
+  int64_t batch = 2, len = 5, short_len = 3;
+  auto params = RandomParams(n_layers, hidden, d_ff);
+  auto encoder = TransformerEncoder::Load(MakeLoader(params, hidden, d_ff),
+                                          n_layers, heads);
+  auto input = Random({batch, len, hidden});
+
+  // the second sequence is padded after short_len tokens.
+  core::Tensor mask(nullptr);
+  auto* mask_data = mask.Reshape<float>({batch, 1, len}, kDLCPU, 0);
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t t = 0; t < len; ++t) {
+      mask_data[b * len + t] = b == 1 && t >= short_len ? -1e18f : 0.f;
+    }
+  }
+  core::Tensor output(nullptr);
+  encoder(input, mask, &output);
+  REQUIRE(output.shape(0) == batch);
+  REQUIRE(output.shape(1) == len);
+  REQUIRE(output.shape(2) == hidden);
+
+  // the short sequence alone, without padding
+  core::Tensor alone(nullptr), alone_output(nullptr);
+  std::memcpy(alone.Reshape<float>({1, short_len, hidden}, kDLCPU, 0),
+              input.data<float>() + len * hidden,
+              short_len * hidden * sizeof(float));
+  encoder(alone, core::Tensor(nullptr), &alone_output);
+  for (int64_t i = 0; i < short_len * hidden; ++i) {
+    REQUIRE(Near(output.data<float>()[len * hidden + i],
+                 alone_output.data<float>()[i]));
+  }
+
+  REQUIRE_THROWS(TransformerEncoder::Load(
+      [](const std::string& name) -> core::Tensor {
+        TT_THROW("no parameter %s", name);
+      },
+      1, heads));
+}
+
+}  // namespace layers
+}  // namespace turbo_transformers
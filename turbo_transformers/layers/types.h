@@ -19,6 +19,7 @@ namespace types {
 enum class ReduceType { kMax = 0, kSum };
 enum class ActivationType { Gelu = 0, Tanh = 1, Relu = 2 };
 enum class PoolType { kMax = 0, kMean, kFirst, kLast };
+enum class QuantType { kFloat32 = 0, kFloat16, kInt8, kBinary, kInt4 };
 }  // namespace types
 }  // namespace layers
 }  // namespace turbo_transformers
@@ -16,8 +16,10 @@
 #include "loguru.hpp"
 #include "pybind11/pybind11.h"
 
+#include "turbo_transformers/core/allocator.h"
 #include "turbo_transformers/core/blas.h"
 #include "turbo_transformers/core/config.h"
+#include "turbo_transformers/core/gemm_backend.h"
 #include "turbo_transformers/core/profiler.h"
 #include "turbo_transformers/core/tensor.h"
 #include "turbo_transformers/layers/albert_layer.h"
@@ -26,10 +28,15 @@
 #include "turbo_transformers/layers/bert_intermediate.h"
 #include "turbo_transformers/layers/bert_output.h"
 #include "turbo_transformers/layers/bert_pooler.h"
+#include "turbo_transformers/layers/cost_model.h"
+#include "turbo_transformers/layers/embedding_head.h"
+#include "turbo_transformers/layers/generation.h"
 #include "turbo_transformers/layers/multi_headed_attention.h"
 #include "turbo_transformers/layers/positionwise_ffn.h"
+#include "turbo_transformers/layers/precision_plan.h"
 #include "turbo_transformers/layers/prepare_bert_masks.h"
 #include "turbo_transformers/layers/sequence_pool.h"
+#include "turbo_transformers/layers/transformer_encoder.h"
 #include "turbo_transformers/layers/addbias_act.h"
 #include "turbo_transformers/layers/addbias_layernorm.h"
 
@@ -51,6 +58,56 @@ static void DLPack_Capsule_Destructor(PyObject *data) {
   }
 }
 
+static void BindCostModel(py::module &m) {
+  py::class_<layers::CostCoefficients>(m, "CostCoefficients")
+      .def(py::init())
+      .def_readwrite("gemm_flops_per_second",
+                     &layers::CostCoefficients::gemm_flops_per_second)
+      .def_readwrite("memory_bytes_per_second",
+                     &layers::CostCoefficients::memory_bytes_per_second)
+      .def_readwrite("kernel_overhead_seconds",
+                     &layers::CostCoefficients::kernel_overhead_seconds);
+
+  py::class_<layers::BertCostConfig>(m, "BertCostConfig")
+      .def(py::init())
+      .def_readwrite("num_layers", &layers::BertCostConfig::num_layers)
+      .def_readwrite("hidden_size", &layers::BertCostConfig::hidden_size)
+      .def_readwrite("num_heads", &layers::BertCostConfig::num_heads)
+      .def_readwrite("intermediate_size",
+                     &layers::BertCostConfig::intermediate_size)
+      .def_readwrite("vocab_size", &layers::BertCostConfig::vocab_size)
+      .def_readwrite("max_position", &layers::BertCostConfig::max_position)
+      .def_readwrite("type_vocab_size",
+                     &layers::BertCostConfig::type_vocab_size)
+      .def_readwrite("use_pooler", &layers::BertCostConfig::use_pooler);
+
+  py::class_<layers::LayerCost>(m, "LayerCost")
+      .def_readonly("name", &layers::LayerCost::name)
+      .def_readonly("activation_bytes", &layers::LayerCost::activation_bytes)
+      .def_readonly("latency", &layers::LayerCost::latency);
+
+  py::class_<layers::CostReport>(m, "CostReport")
+      .def_readonly("layers", &layers::CostReport::layers)
+      .def_readonly("latency", &layers::CostReport::latency)
+      .def_readonly("peak_bytes", &layers::CostReport::peak_bytes);
+
+  py::class_<layers::CostModel>(m, "CostModel")
+      .def(py::init<const layers::CostCoefficients &>(),
+           py::arg("coefficients") = layers::CostCoefficients())
+      .def_static(
+          "calibrate",
+          [](bool use_gpu, int n_step) {
+            return layers::CostModel::Calibrate(use_gpu ? kDLGPU : kDLCPU,
+                                                n_step);
+          },
+          py::arg("use_gpu") = false, py::arg("n_step") = 5)
+      .def_static("load", &layers::CostModel::Load)
+      .def("save", &layers::CostModel::Save)
+      .def("predict_bert", &layers::CostModel::PredictBert)
+      .def_property_readonly("coefficients",
+                             &layers::CostModel::coefficients);
+}
+
 static void BindConfig(py::module &m) {
   py::enum_<core::BlasProvider>(m, "BlasProvider")
       .value("MKL", core::BlasProvider::MKL)
@@ -60,6 +117,74 @@ static void BindConfig(py::module &m) {
       .def("get_blas_provider", &core::GetBlasProvider);
 }
 
+// Deletes a TokenStream without the GIL, its decoding thread may be waiting
+// for the GIL to run a python step.
+struct TokenStreamDeleter {
+  void operator()(layers::TokenStream *stream) const {
+    py::gil_scoped_release release;
+    delete stream;
+  }
+};
+
+static void BindGeneration(py::module &m) {
+  py::class_<layers::TokenStream,
+             std::unique_ptr<layers::TokenStream, TokenStreamDeleter>>(
+      m, "TokenStream")
+      .def(py::init<size_t>(), py::arg("capacity") = 16)
+      .def(
+          "start",
+          [](layers::TokenStream &self, py::function step,
+             int64_t max_new_tokens, int64_t eos_token_id) {
+            // the step is called and released on the decoding thread
+            std::shared_ptr<py::function> func(
+                new py::function(std::move(step)), [](py::function *f) {
+                  py::gil_scoped_acquire acquire;
+                  delete f;
+                });
+            self.Start(
+                [func](int64_t i) {
+                  py::gil_scoped_acquire acquire;
+                  return (*func)(i).cast<int64_t>();
+                },
+                max_new_tokens, eos_token_id);
+          },
+          py::arg("step"), py::arg("max_new_tokens"),
+          py::arg("eos_token_id") = -1)
+      .def("__iter__",
+           [](layers::TokenStream &self) -> layers::TokenStream & {
+             return self;
+           },
+           py::return_value_policy::reference_internal)
+      .def("__next__",
+           [](layers::TokenStream &self) {
+             int64_t token;
+             bool has_next;
+             {
+               py::gil_scoped_release release;
+               has_next = self.Next(&token);
+             }
+             if (!has_next) {
+               throw py::stop_iteration();
+             }
+             return token;
+           })
+      .def("stop", &layers::TokenStream::Stop,
+           py::call_guard<py::gil_scoped_release>())
+      .def_property_readonly(
+          "first_token_ms",
+          [](layers::TokenStream &self) {
+            return self.timing().first_token_ms;
+          })
+      .def_property_readonly(
+          "inter_token_ms",
+          [](layers::TokenStream &self) {
+            return self.timing().inter_token_ms;
+          })
+      .def_property_readonly("total_ms", [](layers::TokenStream &self) {
+        return self.timing().total_ms;
+      });
+}
+
 PYBIND11_MODULE(turbo_transformers_cxx, m) {
   char *argv[] = {strdup("turbo_transformers_cxx"), nullptr};
   int argc = 1;
@@ -75,6 +200,52 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
   m.def("enable_perf", &core::EnableGperf);
   m.def("disable_perf", &core::DisableGperf);
   m.def("set_num_threads", &core::SetNumThreads);
+  m.def(
+      "trim_memory",
+      [](size_t keep_bytes) {
+        auto &allocator = core::Allocator::GetInstance();
+        allocator.Trim(kDLCPU, keep_bytes);
+        if (core::IsCompiledWithCUDA()) {
+          allocator.Trim(kDLGPU, keep_bytes);
+        }
+      },
+      py::arg("keep_bytes") = 0);
+  m.def("get_resident_memory_bytes", &core::GetResidentMemoryBytes);
+  m.def("list_gemm_backends",
+        []() { return core::GemmBackendRegistry::GetInstance().List(); });
+  m.def(
+      "load_gemm_backend",
+      [](const std::string &name, const std::string &library_path) {
+        core::GemmBackendRegistry::GetInstance().Load(name, library_path);
+      },
+      py::arg("name"), py::arg("library_path"));
+  m.def(
+      "set_gemm_backend",
+      [](const std::string &name, const std::string &call_site) {
+        auto &registry = core::GemmBackendRegistry::GetInstance();
+        if (call_site.empty()) {
+          registry.SetDefault(name);
+        } else {
+          registry.SetCallSite(call_site, name);
+        }
+      },
+      py::arg("name"), py::arg("call_site") = "");
+  m.def(
+      "get_gemm_backend",
+      [](const std::string &call_site) {
+        return core::GemmBackendRegistry::GetInstance()
+            .Select(call_site)
+            ->name();
+      },
+      py::arg("call_site") = "");
+  m.def(
+      "set_thread_gemm_backend",
+      [](const std::string &name) {
+        return core::GemmBackendRegistry::GetInstance().SetThreadBackend(name);
+      },
+      py::arg("name"));
+  BindCostModel(m);
+  BindGeneration(m);
 
   py::class_<core::Tensor>(m, "Tensor")
       .def_static("from_dlpack",
@@ -91,6 +262,9 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
       .def("n_dim", &core::Tensor::n_dim)
       .def("shape", &core::Tensor::shape)
       .def("float_data", &core::Tensor::data<float>)
+      .def("capacity", &core::Tensor::capacity)
+      .def("shrink_to_fit", &core::Tensor::ShrinkToFit,
+           py::arg("keep_numel") = 0)
       .def_static("create_empty", [] { return core::Tensor(nullptr); });
 
   py::class_<layers::BERTEmbedding>(m, "BERTEmbedding")
@@ -117,7 +291,17 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
             std::move(dense_bias), std::move(layer_norm_weight),
             std::move(layer_norm_bias), num_attention_heads);
       }))
-      .def("__call__", &layers::BertAttention::operator());
+      .def("__call__", &layers::BertAttention::operator())
+      .def(
+          "set_precision",
+          [](layers::BertAttention &self, const std::string &projection,
+             const std::string &precision, bool is_trans_weight,
+             float input_scale) {
+            self.SetPrecision(projection, layers::GetQuantType(precision),
+                              is_trans_weight, input_scale);
+          },
+          py::arg("projection"), py::arg("precision"),
+          py::arg("is_trans_weight") = false, py::arg("input_scale") = 0.f);
 
   py::class_<layers::MultiHeadedAttention>(m, "MultiHeadedAttention")
       .def(py::init(
@@ -152,7 +336,52 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
                 std::move(layernorm_gamma), std::move(layernorm_beta),
                 num_attention_heads);
           }))
-      .def("__call__", &layers::MultiHeadedAttention::operator());
+      // grouped-query attention, k and v of num_kv_heads heads.
+      .def(py::init(
+          [](core::Tensor &key_weight, core::Tensor &key_bias,
+             core::Tensor &value_weight, core::Tensor &value_bias,
+             core::Tensor &query_weight, core::Tensor &query_bias,
+             core::Tensor &dense_weight, core::Tensor &dense_bias,
+             core::Tensor &qkv_weight, core::Tensor &qkv_bias,
+             int num_attention_heads,
+             int num_kv_heads) -> layers::MultiHeadedAttention * {
+            return new layers::MultiHeadedAttention(
+                std::move(key_weight), std::move(key_bias),
+                std::move(value_weight), std::move(value_bias),
+                std::move(query_weight), std::move(query_bias),
+                std::move(dense_weight), std::move(dense_bias),
+                std::move(qkv_weight), std::move(qkv_bias),
+                num_attention_heads, num_kv_heads);
+          }))
+      .def(py::init(
+          [](core::Tensor &key_weight, core::Tensor &key_bias,
+             core::Tensor &value_weight, core::Tensor &value_bias,
+             core::Tensor &query_weight, core::Tensor &query_bias,
+             core::Tensor &dense_weight, core::Tensor &dense_bias,
+             core::Tensor &qkv_weight, core::Tensor &qkv_bias,
+             core::Tensor &layernorm_gamma, core::Tensor &layernorm_beta,
+             int num_attention_heads,
+             int num_kv_heads) -> layers::MultiHeadedAttention * {
+            return new layers::MultiHeadedAttention(
+                std::move(key_weight), std::move(key_bias),
+                std::move(value_weight), std::move(value_bias),
+                std::move(query_weight), std::move(query_bias),
+                std::move(dense_weight), std::move(dense_bias),
+                std::move(qkv_weight), std::move(qkv_bias),
+                std::move(layernorm_gamma), std::move(layernorm_beta),
+                num_attention_heads, num_kv_heads);
+          }))
+      .def("__call__", &layers::MultiHeadedAttention::operator())
+      .def(
+          "set_precision",
+          [](layers::MultiHeadedAttention &self, const std::string &projection,
+             const std::string &precision, bool is_trans_weight,
+             float input_scale) {
+            self.SetPrecision(projection, layers::GetQuantType(precision),
+                              is_trans_weight, input_scale);
+          },
+          py::arg("projection"), py::arg("precision"),
+          py::arg("is_trans_weight") = false, py::arg("input_scale") = 0.f);
 
   py::class_<layers::BertIntermediate>(m, "BertIntermediate")
       .def(py::init([](core::Tensor &dense_weight,
@@ -160,7 +389,16 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
         return new layers::BertIntermediate(std::move(dense_weight),
                                             std::move(dense_bias));
       }))
-      .def("__call__", &layers::BertIntermediate::operator());
+      .def("__call__",
+           py::overload_cast<const core::Tensor &, core::Tensor *>(
+               &layers::BertIntermediate::operator(), py::const_))
+      .def(
+          "set_precision",
+          [](layers::BertIntermediate &self, const std::string &precision,
+             float input_scale) {
+            self.SetPrecision(layers::GetQuantType(precision), input_scale);
+          },
+          py::arg("precision"), py::arg("input_scale") = 0.f);
 
   py::class_<layers::BertOutput>(m, "BertOutput")
       .def(py::init([](core::Tensor &dense_weight, core::Tensor &dense_bias,
@@ -170,7 +408,17 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
             std::move(dense_weight), std::move(dense_bias),
             std::move(layer_norm_weight), std::move(layer_norm_bias));
       }))
-      .def("__call__", &layers::BertOutput::operator());
+      .def("__call__",
+           py::overload_cast<const core::Tensor &, const core::Tensor &,
+                             core::Tensor *>(&layers::BertOutput::operator(),
+                                             py::const_))
+      .def(
+          "set_precision",
+          [](layers::BertOutput &self, const std::string &precision,
+             float input_scale) {
+            self.SetPrecision(layers::GetQuantType(precision), input_scale);
+          },
+          py::arg("precision"), py::arg("input_scale") = 0.f);
 
   py::class_<layers::SequencePool>(m, "SequencePool")
       .def(py::init([](const std::string &pool_type) -> layers::SequencePool * {
@@ -186,6 +434,16 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
       }))
       .def("__call__", &layers::BertPooler::operator());
 
+  py::class_<layers::EmbeddingHead>(m, "EmbeddingHead")
+      .def(py::init([](const std::string &pool_type, core::Tensor &dense_weight,
+                       core::Tensor &dense_bias, bool normalize,
+                       const std::string &quant_type) -> layers::EmbeddingHead * {
+        return new layers::EmbeddingHead(pool_type, std::move(dense_weight),
+                                         std::move(dense_bias), normalize,
+                                         quant_type);
+      }))
+      .def("__call__", &layers::EmbeddingHead::operator());
+
   py::class_<layers::PrepareBertMasks>(m, "PrepareBertMasks")
       .def(py::init())
       .def("__call__", &layers::PrepareBertMasks::operator());
@@ -214,7 +472,33 @@ PYBIND11_MODULE(turbo_transformers_cxx, m) {
             std::move(dense_weight_2), std::move(dense_bias_2),
             std::move(layer_norm_weight), std::move(layer_norm_bias));
       }))
-      .def("__call__", &layers::PositionwiseFeedForward::operator());
+      .def("__call__", &layers::PositionwiseFeedForward::operator())
+      .def(
+          "set_precision",
+          [](layers::PositionwiseFeedForward &self,
+             const std::string &precision, bool is_trans_weight) {
+            self.SetPrecision(layers::GetQuantType(precision),
+                              is_trans_weight);
+          },
+          py::arg("precision"), py::arg("is_trans_weight") = true);
+
+  py::class_<layers::TransformerEncoder>(m, "TransformerEncoder")
+      .def(py::init([](py::dict params, int64_t n_layers,
+                       int64_t n_heads) -> layers::TransformerEncoder * {
+             return new layers::TransformerEncoder(
+                 layers::TransformerEncoder::Load(
+                     [&](const std::string &name) {
+                       TT_ENFORCE(params.contains(name),
+                                  "no parameter %s of the encoder", name);
+                       return std::move(params[name.c_str()]
+                                            .cast<core::Tensor &>());
+                     },
+                     n_layers, n_heads));
+           }),
+           py::arg("params"), py::arg("n_layers"), py::arg("n_heads"))
+      .def("__call__", &layers::TransformerEncoder::operator())
+      .def_property_readonly("n_layers",
+                             &layers::TransformerEncoder::n_layers);
 
   py::class_<layers::FusedAddBiasGELU>(m, "FusedAddBiasGELU")
       .def(py::init([](core::Tensor &dense_bias) -> layers::FusedAddBiasGELU * {
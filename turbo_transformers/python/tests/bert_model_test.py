@@ -69,6 +69,14 @@ class TestBertModel(unittest.TestCase):
                            atol=1e-3,
                            rtol=1e-3))
 
+        timing = {}
+        self.turbo_model(input_ids, timing=timing)
+        self.assertEqual(len(timing['layer_ms']),
+                         self.cfg.num_hidden_layers)
+        stages = timing['prepare_ms'] + timing['embedding_ms'] + \
+            sum(timing['layer_ms']) + timing['pooling_ms']
+        self.assertGreaterEqual(timing['total_ms'], stages)
+
     def test_bert_model(self):
         if torch.cuda.is_available() and \
             turbo_transformers.config.is_compiled_with_cuda():
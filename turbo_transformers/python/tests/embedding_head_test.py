@@ -0,0 +1,69 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+import unittest
+import turbo_transformers
+import torch
+import numpy as np
+
+
+class TestEmbeddingHead(unittest.TestCase):
+    def setUp(self) -> None:
+        torch.set_grad_enabled(False)
+        torch.set_num_threads(1)
+        self.batch_size, self.seq_length, self.hidden_size = 3, 10, 64
+        self.input = torch.rand(self.batch_size, self.seq_length,
+                                self.hidden_size) - 0.5
+        self.mask = torch.ones(self.batch_size,
+                               self.seq_length,
+                               dtype=torch.int64)
+        self.mask[1, 6:] = 0
+        self.dense = torch.nn.Linear(self.hidden_size, 32)
+
+    def reference(self, dense):
+        mask = self.mask.unsqueeze(-1).float()
+        pooled = (self.input * mask).sum(1) / mask.sum(1)
+        if dense is not None:
+            pooled = dense(pooled)
+        return torch.nn.functional.normalize(pooled, dim=-1).numpy()
+
+    def check(self, dense):
+        ref = self.reference(dense)
+        dim = ref.shape[1]
+        for quant_type in ['Float32', 'Float16', 'Int8', 'Binary']:
+            head = turbo_transformers.EmbeddingHead.from_torch(
+                dense, quant_type=quant_type)
+            result = head(self.input, self.mask).numpy()
+            self.assertEqual(result.dtype, np.uint8)
+            if quant_type == 'Float32':
+                vec = result.view(np.float32)
+                self.assertTrue(np.max(np.abs(vec - ref)) < 1e-5)
+            elif quant_type == 'Float16':
+                vec = result.view(np.float16).astype(np.float32)
+                self.assertTrue(np.max(np.abs(vec - ref)) < 1e-3)
+            elif quant_type == 'Int8':
+                scale = result[:, :4].copy().view(np.float32)
+                vec = result[:, 4:].view(np.int8) * scale
+                self.assertTrue(np.max(np.abs(vec - ref)) <= np.max(scale))
+            else:
+                bits = np.packbits(ref > 0, axis=1)
+                self.assertTrue(np.array_equal(result, bits))
+                self.assertEqual(result.shape[1], (dim + 7) // 8)
+
+    def test_embedding_head(self):
+        self.check(None)
+        self.check(self.dense)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,131 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+import turbo_transformers
+
+import unittest
+import sys
+import torch
+import os
+
+from onmt.encoders.transformer import TransformerEncoder
+from onmt.modules import Embeddings
+
+sys.path.append(os.path.dirname(__file__))
+import test_helper
+
+fname = "tt_encoder_transformer_encoder.txt"
+
+
+def create_test(batch_size, src_length):
+    class TestEncoder(unittest.TestCase):
+        def init_data(self, use_cuda):
+            self.test_device = torch.device('cuda:0') if use_cuda else \
+                   torch.device('cpu:0')
+            if not use_cuda:
+                torch.set_num_threads(4)
+                turbo_transformers.set_num_threads(4)
+
+            torch.set_grad_enabled(False)
+            self.model_dim = 512
+            self.vocab_size = 1000
+            embeddings = Embeddings(word_vec_size=self.model_dim,
+                                    word_vocab_size=self.vocab_size,
+                                    word_padding_idx=1,
+                                    position_encoding=True)
+            self.onmt_encoder = TransformerEncoder(num_layers=2,
+                                                   d_model=self.model_dim,
+                                                   heads=8,
+                                                   d_ff=2048,
+                                                   dropout=0.,
+                                                   attention_dropout=0.,
+                                                   embeddings=embeddings,
+                                                   max_relative_positions=0)
+            self.onmt_encoder.eval()
+            if use_cuda:
+                self.onmt_encoder.to(self.test_device)
+            self.turbo_encoder = turbo_transformers.TransformerEncoder.from_onmt(
+                self.onmt_encoder)
+
+        def check_torch_and_turbo(self, use_cuda, num_iter=1):
+            deivce_type = "GPU" if use_cuda else "CPU"
+            info = f"\"({deivce_type}, {batch_size}, {src_length})\""
+
+            self.init_data(use_cuda=use_cuda)
+
+            src = torch.randint(2,
+                                self.vocab_size, (src_length, batch_size, 1),
+                                dtype=torch.long,
+                                device=self.test_device)
+            lengths = torch.randint(1,
+                                    src_length + 1, (batch_size, ),
+                                    dtype=torch.long,
+                                    device=self.test_device)
+            lengths[0] = src_length
+            for i in range(batch_size):
+                src[lengths[i]:, i, 0] = 1
+
+            onmt_model = lambda: self.onmt_encoder(src, lengths)
+            onmt_result, torch_qps, torch_time_consume = \
+                test_helper.run_model(onmt_model, use_cuda, num_iter)
+            _, onmt_memory_bank, _ = onmt_result
+            print(
+                f"ONMT Encoder {info} ",
+                f"{deivce_type} QPS, {torch_qps}, time, {torch_time_consume}")
+
+            turbo_model = lambda: self.turbo_encoder(src, lengths)
+            with turbo_transformers.pref_guard(info) as perf:
+                turbo_result, turbo_qps, turbo_time_consume = \
+                    test_helper.run_model(turbo_model, use_cuda, num_iter)
+            _, turbo_memory_bank, _ = turbo_result
+            print(
+                f"Turbo Encoder {info} ",
+                f"{deivce_type} QPS, {turbo_qps}, time, {turbo_time_consume}")
+
+            # padded positions of the memory bank are masked out downstream
+            for i in range(batch_size):
+                self.assertTrue(
+                    torch.max(
+                        torch.abs(onmt_memory_bank[:lengths[i], i] -
+                                  turbo_memory_bank[:lengths[i], i])) < (
+                                      1e-3 if use_cuda else 1e-4))
+
+            _, batch_first, _ = self.turbo_encoder(src,
+                                                   lengths,
+                                                   batch_first=True)
+            self.assertTrue(
+                torch.max(
+                    torch.abs(batch_first.transpose(0, 1) -
+                              turbo_memory_bank)) < 1e-6)
+
+            with open(fname, "a") as fh:
+                fh.write(f"{info} {torch_qps}, {turbo_qps}\n")
+
+        def test_encoder(self):
+            self.check_torch_and_turbo(use_cuda=False)
+            if torch.cuda.is_available() and \
+                turbo_transformers.config.is_compiled_with_cuda():
+                self.check_torch_and_turbo(use_cuda=True)
+
+    globals()[f"TestEncoder{batch_size}_{src_length}"] = TestEncoder
+
+
+with open(fname, "w") as fh:
+    fh.write(", torch, turbo_transformers\n")
+
+for batch_size in [1, 4]:
+    for src_length in [10, 40, 100]:
+        create_test(batch_size, src_length)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,88 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+
+import os
+import tempfile
+import unittest
+
+import torch
+from transformers.modeling_bert import BertModel, BertConfig
+import turbo_transformers
+
+
+class TestPrecisionPlanner(unittest.TestCase):
+    def setUp(self) -> None:
+        torch.set_grad_enabled(False)
+        torch.manual_seed(0)
+        self.cfg = BertConfig(num_hidden_layers=2,
+                              hidden_size=128,
+                              num_attention_heads=4,
+                              intermediate_size=512)
+        self.torch_model = BertModel(self.cfg)
+        self.torch_model.eval()
+        self.turbo_model = turbo_transformers.BertModel.from_torch(
+            self.torch_model, torch.device('cpu:0'), "turbo")
+        self.inputs = [
+            torch.randint(low=0,
+                          high=self.cfg.vocab_size - 1,
+                          size=(1, 32),
+                          dtype=torch.long) for _ in range(4)
+        ]
+
+    def test_plan_meets_budget(self):
+        reference = self.turbo_model(self.inputs[0])[0].clone()
+        budget = 0.99
+        plan = turbo_transformers.plan_precision(self.turbo_model,
+                                                 self.inputs,
+                                                 budget=budget)
+        names = [
+            name for name, _ in turbo_transformers.layers.precision_planner.
+            linear_modules(self.turbo_model)
+        ]
+        self.assertEqual(len(names), 4 * self.cfg.num_hidden_layers)
+        self.assertTrue(set(plan).issubset(names))
+        output = self.turbo_model(self.inputs[0])[0]
+        cosine = torch.nn.functional.cosine_similarity(output.flatten(),
+                                                       reference.flatten(),
+                                                       dim=0)
+        self.assertGreaterEqual(cosine.item(), budget - 1e-6)
+
+        # a plan applies to a fresh model in the same way
+        with tempfile.TemporaryDirectory() as tmp:
+            filename = os.path.join(tmp, 'bert.plan')
+            turbo_transformers.save_precision_plan(plan, filename)
+            self.assertEqual(turbo_transformers.load_precision_plan(filename),
+                             plan)
+        turbo_transformers.apply_precision_plan(self.turbo_model, {})
+        self.assertTrue(
+            torch.allclose(self.turbo_model(self.inputs[0])[0], reference))
+
+    def test_int8_layer(self):
+        names = dict(
+            turbo_transformers.layers.precision_planner.linear_modules(
+                self.turbo_model))
+        reference = self.turbo_model(self.inputs[0])[0].clone()
+        names['encoder.layer.0.intermediate.dense']('Int8')
+        output = self.turbo_model(self.inputs[0])[0]
+        self.assertFalse(torch.equal(output, reference))
+        cosine = torch.nn.functional.cosine_similarity(output.flatten(),
+                                                       reference.flatten(),
+                                                       dim=0)
+        self.assertGreater(cosine.item(), 0.99)
+        with self.assertRaises(Exception):
+            names['encoder.layer.0.output.dense']('Binary')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,70 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+
+import unittest
+import threading
+import turbo_transformers
+
+
+class TestTokenStream(unittest.TestCase):
+    def test_stream(self):
+        stream = turbo_transformers.generate_stream(lambda i: i * i,
+                                                    max_new_tokens=100,
+                                                    eos_token_id=49)
+        self.assertEqual(list(stream), [0, 1, 4, 9, 16, 25, 36, 49])
+        self.assertEqual(len(stream.inter_token_ms), 7)
+        self.assertTrue(stream.first_token_ms <= stream.total_ms)
+
+    def test_early_stop(self):
+        steps = []
+        stream = turbo_transformers.generate_stream(
+            lambda i: steps.append(i) or i, max_new_tokens=1000000,
+            capacity=1)
+        for token in stream:
+            if token == 3:
+                break
+        stream.stop()
+        self.assertTrue(len(steps) <= 6)
+        self.assertEqual(list(stream), [])
+
+    def test_releases_gil(self):
+        # the step waits for the consumer thread, which can only run if
+        # waiting for a token releases the GIL
+        event = threading.Event()
+
+        def step(i):
+            if i == 1:
+                self.assertTrue(event.wait(10))
+            return i
+
+        stream = turbo_transformers.generate_stream(step, max_new_tokens=3)
+        self.assertEqual(next(stream), 0)
+        threading.Timer(0.1, event.set).start()
+        self.assertEqual(list(stream), [1, 2])
+
+    def test_error(self):
+        def step(i):
+            if i == 2:
+                raise ValueError("step failed")
+            return i
+
+        stream = turbo_transformers.generate_stream(step, max_new_tokens=10)
+        self.assertEqual(next(stream), 0)
+        self.assertEqual(next(stream), 1)
+        with self.assertRaises(ValueError):
+            next(stream)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -12,15 +12,16 @@
 # See the AUTHORS file for names of contributors.
 
 from .modeling_bert import BertEmbeddings, BertIntermediate, BertOutput, BertAttention, BertLayer, SequencePool, \
-    BertEncoder, BertModel, PoolingType, BertPooler
+    BertEncoder, BertModel, PoolingType, BertPooler, EmbeddingHead
 from .qmodeling_bert import QBertIntermediate, QBertOutput, QBertLayer, QBertEncoder, QBertModel
 
 from .modeling_albert import AlbertEmbeddings, AlbertAttention, AlbertLayer, AlbertTransformer, AlbertModel
-from .modeling_decoder import MultiHeadedAttention, PositionwiseFeedForward, TransformerDecoderLayer, TransformerDecoder
+from .modeling_decoder import MultiHeadedAttention, PositionwiseFeedForward, TransformerDecoderLayer, TransformerDecoder, TransformerEncoder
 from .modeling_roberta import RobertaModel
 from .modeling_gpt2 import GPT2Model
 
 from .return_type import ReturnType
+from .precision_planner import plan_precision, apply_precision_plan, save_precision_plan, load_precision_plan
 
 __all__ = [
     'BertEmbeddings', 'BertIntermediate', 'BertOutput', 'BertAttention',
@@ -29,6 +30,9 @@ __all__ = [
     'PositionwiseFeedForward', 'AlbertLayer', 'AlbertEmbeddings',
     'AlbertAttention', 'AlbertTransformer', 'AlbertModel',
     'PositionwiseFeedForward', 'TransformerDecoderLayer', 'TransformerDecoder',
+    'TransformerEncoder',
     'RobertaModel', 'QBertIntermediate', 'QBertOutput', 'QBertLayer',
-    'QBertEncoder', 'QBertModel', 'GPT2Model'
+    'QBertEncoder', 'QBertModel', 'GPT2Model', 'EmbeddingHead',
+    'plan_precision', 'apply_precision_plan', 'save_precision_plan',
+    'load_precision_plan'
 ]
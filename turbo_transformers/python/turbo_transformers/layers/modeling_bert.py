@@ -19,7 +19,7 @@ except ImportError:
 from typing import Union, Optional, Sequence
 import torch
 from .return_type import convert_returns_as_type, ReturnType
-from .utils import try_convert, convert2tt_tensor, to_param_dict_convert_tt, to_param_dict, create_empty_if_none, AnyTensor
+from .utils import try_convert, convert2tt_tensor, to_param_dict_convert_tt, to_param_dict, create_empty_if_none, AnyTensor, StageTimer
 
 from transformers.modeling_bert import BertEmbeddings as TorchBertEmbeddings
 from transformers.modeling_bert import BertIntermediate as TorchBertIntermediate
@@ -37,7 +37,7 @@ import os
 __all__ = [
     'BertEmbeddings', 'BertIntermediate', 'BertOutput', 'BertAttention',
     'BertLayer', 'BertEncoder', 'SequencePool', 'BertModel', 'PoolingType',
-    'BertPooler'
+    'BertPooler', 'EmbeddingHead'
 ]
 
 
@@ -154,7 +154,7 @@ class BertAttention(cxx.BertAttention):
         """
         assert (head_mask is None)
         input_tensor = try_convert(input_tensor)
-        attention_mask = try_convert(create_empty_if_none(attention_mask))
+        attention_mask = create_empty_if_none(try_convert(attention_mask))
         context_layer = cxx.Tensor.create_empty()
         attn_probs = cxx.Tensor.create_empty()
         super(BertAttention,
@@ -266,10 +266,12 @@ class BertEncoder:
                  head_mask: Optional[AnyTensor] = None,
                  output_attentions: Optional[bool] = False,
                  output_hidden_states: Optional[bool] = False,
-                 return_type: Optional[ReturnType] = None):
+                 return_type: Optional[ReturnType] = None,
+                 timing: Optional[dict] = None):
         all_hidden_states = ()
         all_attentions = ()
         hidden_states = try_convert(hidden_states)
+        timer = StageTimer(timing)
         for l in self.layer:
             layer_outputs = l(hidden_states=hidden_states,
                               attention_mask=attention_mask,
@@ -282,6 +284,7 @@ class BertEncoder:
             hidden_states = layer_outputs[0]
             if output_attentions:
                 all_attentions = all_attentions + (layer_outputs[1], )
+            timer.lap_layer()
 
         outputs = (convert_returns_as_type(hidden_states, return_type), )
         # Add last layer
@@ -366,6 +369,42 @@ class BertPooler(cxx.BertPooler):
                           try_convert(f['pooler.dense.bias']))
 
 
+class EmbeddingHead(cxx.EmbeddingHead):
+    """
+    Pools the final hidden states, applies an optional dense projection,
+    L2 normalizes and quantizes them into a uint8 tensor of shape
+    (batch, n_bytes). quant_type is one of 'Float32', 'Float16', 'Int8'
+    (a float scale followed by the int8 values) and 'Binary' (sign bits
+    packed like numpy.packbits).
+    """
+    def __call__(self,
+                 hidden_states: AnyTensor,
+                 attention_mask: Optional[AnyTensor] = None,
+                 return_type: Optional[ReturnType] = None,
+                 output: Optional[cxx.Tensor] = None):
+        hidden_states = try_convert(hidden_states)
+        attention_mask = create_empty_if_none(try_convert(attention_mask))
+        output = create_empty_if_none(output)
+        super(EmbeddingHead, self).__call__(hidden_states, attention_mask,
+                                            output)
+        return convert_returns_as_type(output, return_type)
+
+    @staticmethod
+    def from_torch(dense: Optional[torch.nn.Linear] = None,
+                   pooling_type: PoolingType = PoolingType.MEAN,
+                   normalize: bool = True,
+                   quant_type: str = 'Int8'):
+        weight = cxx.Tensor.create_empty()
+        bias = cxx.Tensor.create_empty()
+        if dense is not None:
+            weight = convert2tt_tensor(
+                torch.clone(torch.t(dense.weight).contiguous()))
+            if dense.bias is not None:
+                bias = convert2tt_tensor(dense.bias)
+        return EmbeddingHead(PoolingMap[pooling_type], weight, bias,
+                             normalize, quant_type)
+
+
 class BertModelNoPooler:
     def __init__(self, embeddings: BertEmbeddings, encoder: BertEncoder):
         self.embeddings = embeddings
@@ -384,7 +423,13 @@ class BertModelNoPooler:
             output_hidden_states: Optional[bool] = None,
             pooling_type: PoolingType = PoolingType.
             FIRST,  #the following parameters are exclusive for turbo
-            return_type: Optional[ReturnType] = None):
+            return_type: Optional[ReturnType] = None,
+            timing: Optional[dict] = None):
+        """
+        timing, a dict, receives where the time of the request went, see
+        StageTimer.
+        """
+        timer = StageTimer(timing)
         attention_masks = try_convert(create_empty_if_none(attention_masks))
         token_type_ids = try_convert(create_empty_if_none(token_type_ids))
         position_ids = try_convert(create_empty_if_none(position_ids))
@@ -393,19 +438,23 @@ class BertModelNoPooler:
 
         self.prepare(inputs, attention_masks, token_type_ids, position_ids,
                      extended_attention_masks)
+        timer.lap('prepare_ms')
 
         hidden_cache = self.embeddings(
             inputs,
             position_ids=position_ids,
             token_type_ids=token_type_ids,
             return_type=ReturnType.turbo_transformers)
+        timer.lap('embedding_ms')
 
         encoder_outputs = self.encoder(
             hidden_states=hidden_cache,
             attention_mask=extended_attention_masks,
             output_attentions=output_attentions,
             output_hidden_states=output_hidden_states,
-            return_type=return_type)
+            return_type=return_type,
+            timing=timing)
+        timer.finish()
         return encoder_outputs
 
     @staticmethod
@@ -458,8 +507,18 @@ class BertModel:
                  output_hidden_states: Optional[bool] = None,
                  pooling_type: PoolingType = PoolingType.FIRST,
                  pooler_output: Optional[AnyTensor] = None,
-                 return_type: Optional[ReturnType] = None):
+                 return_type: Optional[ReturnType] = None,
+                 timing: Optional[dict] = None):
+        """
+        timing, a dict, receives where the time of the request went on the
+        turbo backend, e.g. to log the slow requests:
+            timing = {}
+            outputs = model(inputs, timing=timing)
+            if timing['total_ms'] > 50:
+                logging.warning('slow request %s', timing)
+        """
         if self.backend == "turbo":
+            timer = StageTimer(timing)
             encoder_outputs = self.bertmodel_nopooler(
                 inputs,
                 attention_masks,
@@ -469,7 +528,9 @@ class BertModel:
                 output_attentions=output_attentions,
                 output_hidden_states=output_hidden_states,
                 pooling_type=pooling_type,
-                return_type=ReturnType.turbo_transformers)
+                return_type=ReturnType.turbo_transformers,
+                timing=timing)
+            timer.skip()
 
             sequence_output = encoder_outputs[0]
             self.seq_pool = SequencePool(PoolingMap[pooling_type])
@@ -478,6 +539,8 @@ class BertModel:
                 return_type=ReturnType.turbo_transformers)
             pooler_output = self.pooler(sequence_pool_output, return_type,
                                         pooler_output)
+            timer.lap('pooling_ms')
+            timer.finish()
             return (
                 convert_returns_as_type(sequence_output, return_type),
                 pooler_output,
@@ -28,6 +28,7 @@ from transformers.modeling_bert import BertAttention as TorchBertAttention
 from onmt.modules.position_ffn import PositionwiseFeedForward as OnmtPositionwiseFeedForward
 from onmt.decoders.transformer import TransformerDecoderLayer as OnmtTransformerDecoderLayer
 from onmt.decoders.transformer import TransformerDecoder as OnmtTransformerDecoder
+from onmt.encoders.transformer import TransformerEncoder as OnmtTransformerEncoder
 from onmt.modules import Embeddings as TorchBertEmbeddings
 
 from torch.nn import LayerNorm as TorchLayerNorm
@@ -38,7 +39,7 @@ import numpy as np
 
 __all__ = [
     'MultiHeadedAttention', 'PositionwiseFeedForward',
-    'TransformerDecoderLayer', 'TransformerDecoder'
+    'TransformerDecoderLayer', 'TransformerDecoder', 'TransformerEncoder'
 ]
 
 
@@ -56,10 +57,14 @@ class MultiHeadedAttention(cxx.MultiHeadedAttention):
                  is_trans_weight: bool = False,
                  return_type: Optional[ReturnType] = None,
                  output: Optional[cxx.Tensor] = None,
-                 attn: Optional[cxx.Tensor] = None):
+                 attn: Optional[cxx.Tensor] = None,
+                 is_causal: bool = False):
         """ Implement a MultiHeadedAttention of OpenNMT-py
         https://github.com/OpenNMT/OpenNMT-py/blob/master/onmt/modules/multi_headed_attn.py
 
+        is_causal applies the future mask of self attention in the kernel,
+        which skips the masked scores, mask then only holds the padding.
+
         Attention: Now layer_cache only contains Nones
         For self-dot Attention elements in dict `layer_cache` are Nones.
         https://github.com/OpenNMT/OpenNMT-py/blob/master/onmt/decoders/transformer.py#L339
@@ -84,7 +89,7 @@ class MultiHeadedAttention(cxx.MultiHeadedAttention):
               self).__call__(key_tensor, value_tensor, query_tensor, mask,
                              attn_type, output, attn, layer_cache_tmp,
                              pre_layernorm, post_layernorm, post_add_input,
-                             is_trans_weight)
+                             is_trans_weight, is_causal)
 
         if layer_cache is not None:
             for k, v in layer_cache_tmp.items():
@@ -362,6 +367,7 @@ class TransformerDecoderLayer:
         """
         # dec_mask = None which is no mask
         dec_mask = None
+        is_causal = False
 
         input_tensor = try_convert(input_tensor)
         memory_bank = try_convert(memory_bank)
@@ -370,7 +376,12 @@ class TransformerDecoderLayer:
 
         if step is None:
             tgt_len = tgt_pad_mask.size(-1)
-            if not future:  # apply future_mask, result mask in (B, T, T)
+            if not future and tgt_pad_mask.device.type == 'cpu':
+                # the CPU causal kernel applies future_mask, result mask in
+                # (B, 1, T)
+                dec_mask = tgt_pad_mask.float()
+                is_causal = True
+            elif not future:  # apply future_mask, result mask in (B, T, T)
                 future_mask = torch.ones([tgt_len, tgt_len],
                                          device=tgt_pad_mask.device,
                                          dtype=torch.float32)
@@ -398,7 +409,8 @@ class TransformerDecoderLayer:
                                   attn_type="self",
                                   pre_layernorm=True,
                                   post_add_input=True,
-                                  return_type=ReturnType.turbo_transformers)
+                                  return_type=ReturnType.turbo_transformers,
+                                  is_causal=is_causal)
 
         mid, attns = self.context_attn(
             memory_bank,
@@ -550,8 +562,14 @@ class TransformerDecoder:
                  tgt: torch.Tensor,
                  memory_bank: torch.Tensor,
                  step: Optional[int] = None,
+                 memory_bank_batch_first: bool = False,
                  **kwargs):
-        """Decode, possibly stepwise."""
+        """Decode, possibly stepwise.
+        memory_bank is ``(src_len, batch_size, model_dim)``, or
+        ``(batch_size, src_len, model_dim)`` with memory_bank_batch_first, as
+        returned by TransformerEncoder with batch_first, which the layers
+        consume without a transpose.
+        """
         if step == 0:
             self._init_cache(memory_bank)
 
@@ -561,7 +579,10 @@ class TransformerDecoder:
         assert emb.dim() == 3  # len x batch x embedding_dim
 
         output = emb.transpose(0, 1).contiguous()
-        src_memory_bank = memory_bank.transpose(0, 1).contiguous()
+        if memory_bank_batch_first:
+            src_memory_bank = memory_bank
+        else:
+            src_memory_bank = memory_bank.transpose(0, 1).contiguous()
 
         pad_idx = self.embeddings.word_padding_idx
         src_lens = kwargs["memory_lengths"]
@@ -631,3 +652,100 @@ class TransformerDecoder:
         ]
         return TransformerDecoder(model.embeddings, layers, model.layer_norm,
                                   model._copy, model.alignment_layer)
+
+
+class TransformerEncoder:
+    """
+    The encoder of the OpenNMT Transformer, the pre-norm layers and the final
+    layer norm run by the native TransformerEncoder, the embeddings (with
+    their positional encoding) by PyTorch.
+    https://github.com/OpenNMT/OpenNMT-py/blob/master/onmt/encoders/transformer.py
+    """
+    def __init__(self, embeddings: TorchBertEmbeddings,
+                 encoder: cxx.TransformerEncoder):
+        self.embeddings = embeddings
+        self.encoder = encoder
+
+    def __call__(self,
+                 src: torch.Tensor,
+                 lengths: Optional[torch.Tensor] = None,
+                 batch_first: bool = False,
+                 return_type: Optional[ReturnType] = None):
+        """
+        Args:
+            src (LongTensor): ``(src_len, batch_size, n_feats)``
+            lengths (LongTensor): ``(batch_size)``
+            batch_first (bool): returns the memory bank as
+                ``(batch_size, src_len, model_dim)``, the layout consumed by
+                TransformerDecoder with memory_bank_batch_first, instead of
+                ``(src_len, batch_size, model_dim)`` as OpenNMT.
+        Returns:
+            (emb, memory_bank, lengths) as the OpenNMT encoder.
+        """
+        emb = self.embeddings(src)
+        inputs = try_convert(emb.transpose(0, 1).contiguous())
+        if lengths is None:
+            mask = cxx.Tensor.create_empty()
+        else:
+            src_pad_mask = ~sequence_mask(lengths, src.shape[0]).unsqueeze(1)
+            mask = try_convert(src_pad_mask.float() * -1e18)
+        output = cxx.Tensor.create_empty()
+        self.encoder(inputs, mask, output)
+        memory_bank = convert_returns_as_type(output, return_type)
+        if not batch_first:
+            memory_bank = memory_bank.transpose(0, 1)
+        return emb, memory_bank, lengths
+
+    @staticmethod
+    def onmt_params(state_dict: dict) -> dict:
+        """
+        The parameters of the native encoder from the state dict of an OpenNMT
+        encoder, as saved by tools/convert_onmt_encoder_to_npz.py: the q, k
+        and v projections fused into qkv and the weights transposed.
+        """
+        params = {}
+        for name, value in state_dict.items():
+            if 'embeddings' in name:
+                continue
+            key = name if name.startswith('encoder.') else 'encoder.' + name
+            if key.endswith('linear_query.weight') or key.endswith(
+                    'linear_query.bias'):
+                prefix, suffix = key.rsplit('linear_query.', 1)
+                value = torch.cat((value, state_dict[name.replace(
+                    'linear_query', 'linear_keys')], state_dict[name.replace(
+                        'linear_query', 'linear_values')]), 0)
+                key = prefix + 'qkv.' + suffix
+            elif 'linear_keys' in key or 'linear_values' in key:
+                continue
+            if key.endswith('.weight') and value.dim() == 2:
+                value = torch.t(value)
+            params[key] = value.detach().contiguous()
+        return params
+
+    @staticmethod
+    def from_onmt(model: OnmtTransformerEncoder,
+                  device: Optional[torch.device] = None):
+        if device is not None and 'cuda' in device.type and torch.cuda.is_available(
+        ):
+            model.to(device)
+        layer = model.transformer[0]
+        params = TransformerEncoder.onmt_params(model.state_dict())
+        encoder = cxx.TransformerEncoder(
+            {k: convert2tt_tensor(v)
+             for k, v in params.items()}, len(model.transformer),
+            layer.self_attn.head_count)
+        return TransformerEncoder(model.embeddings, encoder)
+
+    @staticmethod
+    def from_npz(file_name: str, embeddings: TorchBertEmbeddings,
+                 num_layers: int, num_attention_heads: int):
+        """
+        Loads the output of tools/convert_onmt_encoder_to_npz.py, the
+        embeddings are the module of the OpenNMT encoder.
+        """
+        f = np.load(file_name)
+        encoder = cxx.TransformerEncoder(
+            {k: try_convert(f[k])
+             for k in f.files if not k.startswith('encoder.embeddings.')},
+            num_layers, num_attention_heads)
+        return TransformerEncoder(embeddings, encoder)
@@ -0,0 +1,173 @@
+# Copyright (C) 2020 THL A29 Limited, a Tencent company.
+# All rights reserved.
+# Licensed under the BSD 3-Clause License (the "License"); you may
+# not use this file except in compliance with the License. You may
+# obtain a copy of the License at
+# https://opensource.org/licenses/BSD-3-Clause
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# See the AUTHORS file for names of contributors.
+
+
+import time
+from typing import Callable, Dict, Iterable, List, Optional, Sequence, Tuple
+
+import torch
+
+__all__ = [
+    'linear_modules', 'apply_precision_plan', 'save_precision_plan',
+    'load_precision_plan', 'plan_precision'
+]
+
+# The precision plan maps a linear module, named as in the npz of the model,
+# to one of the precisions of the native layers. It is stored as
+# "module precision" lines, the format layers::PrecisionPlan of the C++ loader
+# reads.
+PrecisionPlan = Dict[str, str]
+
+
+def _encoder_of(model):
+    if hasattr(model, 'bertmodel_nopooler'):
+        model = model.bertmodel_nopooler
+    if hasattr(model, 'encoder'):
+        model = model.encoder
+    if not hasattr(model, 'layer'):
+        raise ValueError(
+            "plan_precision needs a BertModel of the turbo backend")
+    return model
+
+
+def linear_modules(model) -> List[Tuple[str, Callable[[str], None]]]:
+    """
+    The linear modules of a turbo BertModel whose precision can be set, as
+    (name, set_precision) pairs.
+    """
+    modules = []
+    for i, layer in enumerate(_encoder_of(model).layer):
+        prefix = f'encoder.layer.{i}.'
+        attention = layer.attention
+        modules += [
+            (prefix + 'attention.qkv',
+             lambda p, a=attention: a.set_precision('qkv', p)),
+            (prefix + 'attention.output.dense',
+             lambda p, a=attention: a.set_precision('dense', p)),
+            (prefix + 'intermediate.dense', layer.intermediate.set_precision),
+            (prefix + 'output.dense', layer.output.set_precision),
+        ]
+    return modules
+
+
+def apply_precision_plan(model, plan: PrecisionPlan):
+    for name, set_precision in linear_modules(model):
+        set_precision(plan.get(name, 'Float32'))
+
+
+def save_precision_plan(plan: PrecisionPlan, filename: str):
+    with open(filename, 'w') as f:
+        for name in sorted(plan):
+            f.write(f'{name} {plan[name]}\n')
+
+
+def load_precision_plan(filename: str) -> PrecisionPlan:
+    plan = {}
+    with open(filename) as f:
+        for line in f:
+            if line.strip():
+                # an optional third column holds the static int8 input scale
+                # of calibration, which only the C++ loader reads
+                name, precision = line.split()[:2]
+                plan[name] = precision
+    return plan
+
+
+def _cosine(a: torch.Tensor, b: torch.Tensor) -> float:
+    return torch.nn.functional.cosine_similarity(a.flatten().double(),
+                                                 b.flatten().double(),
+                                                 dim=0).item()
+
+
+def plan_precision(model,
+                   calibration_inputs: Sequence,
+                   budget: float = 0.999,
+                   precisions: Iterable[str] = ('Int8', ),
+                   run: Optional[Callable] = None,
+                   n_repeat: int = 3,
+                   verbose: bool = False) -> PrecisionPlan:
+    """
+    Chooses the precision of each linear module of model, keeping the cosine
+    similarity of every calibration output to the Float32 output at or above
+    budget.
+    Each module is first switched alone to each precision to measure its
+    sensitivity, the accuracy it loses, and the latency it saves. The
+    candidates are then added greedily by saved latency per lost accuracy,
+    and a candidate is kept only if the whole plan still meets the budget.
+    The plan is left applied to model.
+    Args:
+        model: a turbo_transformers.BertModel of the turbo backend.
+        calibration_inputs: the inputs of run, e.g. input_ids of real data.
+        budget: the minimal cosine similarity of an output.
+        precisions: the precisions to try besides Float32. 'Int4' releases
+            the float weights and can not be tried.
+        run: run(model, input) returns the output to compare, by default
+            the sequence output model(input)[0].
+        n_repeat: the latency of a plan is the median of n_repeat runs.
+    """
+    if run is None:
+        run = lambda m, x: m(x)[0]
+    precisions = [p for p in precisions if p != 'Float32']
+    if 'Int4' in precisions:
+        raise ValueError('Int4 releases the float weights, it can not be '
+                         'planned')
+    modules = linear_modules(model)
+    apply_precision_plan(model, {})
+
+    with torch.no_grad():
+        references = [run(model, x).clone() for x in calibration_inputs]
+
+        def similarity() -> float:
+            return min(
+                _cosine(run(model, x), ref)
+                for x, ref in zip(calibration_inputs, references))
+
+        def latency() -> float:
+            times = []
+            for _ in range(n_repeat):
+                start = time.perf_counter()
+                for x in calibration_inputs:
+                    run(model, x)
+                times.append(time.perf_counter() - start)
+            return sorted(times)[len(times) // 2]
+
+        base_latency = latency()
+        candidates = []
+        for name, set_precision in modules:
+            for precision in precisions:
+                set_precision(precision)
+                score = similarity()
+                saved = base_latency - latency()
+                set_precision('Float32')
+                if verbose:
+                    print(f'{name} {precision}: cosine {score:.6f}, '
+                          f'saved {saved * 1e3:.3f} ms')
+                if score >= budget and saved > 0:
+                    lost = max(1. - score, 1e-9)
+                    candidates.append((saved / lost, name, precision))
+
+        setters = dict(modules)
+        plan = {}
+        for _, name, precision in sorted(candidates, reverse=True):
+            if name in plan:
+                continue
+            setters[name](precision)
+            if similarity() >= budget:
+                plan[name] = precision
+            else:
+                setters[name]('Float32')
+
+    if verbose:
+        print(f'{len(plan)} of {len(modules)} modules changed precision, '
+              f'latency {base_latency * 1e3:.3f} -> {latency() * 1e3:.3f} ms')
+    return plan
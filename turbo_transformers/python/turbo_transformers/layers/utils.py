@@ -16,6 +16,7 @@ import torch.utils.dlpack as dlpack
 from torch import Tensor, device, dtype, nn
 from typing import Union
 import numpy as np
+import time
 from typing import Callable, Dict, List, Optional, Tuple
 
 try:
@@ -27,7 +28,7 @@ from .return_type import convert_returns_as_type, ReturnType
 
 __all__ = [
     'try_convert', 'convert2tt_tensor', 'to_param_dict_convert_tt',
-    'to_param_dict', 'create_empty_if_none', 'AnyTensor'
+    'to_param_dict', 'create_empty_if_none', 'AnyTensor', 'StageTimer'
 ]
 
 
@@ -119,3 +120,40 @@ def get_extended_attention_mask(attention_mask: Tensor, input_shape: Tuple,
 
 
 AnyTensor = Union[cxx.Tensor, torch.Tensor]
+
+
+class StageTimer:
+    """
+    Times the consecutive stages of a request into timing, a dict with the
+    fields of the C++ RequestTiming as keys in milliseconds, e.g. prepare_ms,
+    embedding_ms, layer_ms (one per encoder layer), pooling_ms and total_ms.
+    Does nothing when timing is None. On GPU the stages time the launches
+    only, the kernels are waited for by the copy of the outputs.
+    """
+    def __init__(self, timing: Optional[Dict]):
+        self.timing = timing
+        if timing is not None:
+            self.start = self.last = time.perf_counter()
+
+    def _lap_ms(self):
+        now = time.perf_counter()
+        ms = (now - self.last) * 1e3
+        self.last = now
+        return ms
+
+    def lap(self, stage: str):
+        if self.timing is not None:
+            self.timing[stage] = self.timing.get(stage, 0.) + self._lap_ms()
+
+    def skip(self):
+        # ends the current stage unrecorded, e.g. a call timing its own stages
+        if self.timing is not None:
+            self._lap_ms()
+
+    def lap_layer(self):
+        if self.timing is not None:
+            self.timing.setdefault('layer_ms', []).append(self._lap_ms())
+
+    def finish(self):
+        if self.timing is not None:
+            self.timing['total_ms'] = (time.perf_counter() - self.start) * 1e3
@@ -20,7 +20,10 @@ import contextlib
 
 __all__ = [
     'pref_guard', 'set_num_threads', 'set_stderr_verbose_level',
-    'disable_perf', 'enable_perf'
+    'disable_perf', 'enable_perf', 'trim_memory', 'get_resident_memory_bytes',
+    'CostModel', 'CostCoefficients', 'BertCostConfig', 'list_gemm_backends',
+    'load_gemm_backend', 'set_gemm_backend', 'get_gemm_backend',
+    'gemm_backend_guard', 'TokenStream', 'generate_stream'
 ]
 
 set_num_threads = cxx.set_num_threads
@@ -29,9 +32,57 @@ set_stderr_verbose_level = cxx.set_stderr_verbose_level
 disable_perf = cxx.disable_perf
 enable_perf = cxx.enable_perf
 
+# release the cached memory of the allocators back to the system, call it
+# between requests after a burst of long inputs.
+trim_memory = cxx.trim_memory
+get_resident_memory_bytes = cxx.get_resident_memory_bytes
+
+# predicts the latency and the peak memory of a request, e.g.
+#   model = CostModel.calibrate()
+#   report = model.predict_bert(BertCostConfig(), batch_size, seq_len)
+CostModel = cxx.CostModel
+CostCoefficients = cxx.CostCoefficients
+BertCostConfig = cxx.BertCostConfig
+
+# the providers of the CPU GEMMs, e.g.
+#   load_gemm_backend('openblas-so', '/usr/lib/libopenblas.so')
+#   set_gemm_backend('openblas-so', call_site='BatchMatMul')
+list_gemm_backends = cxx.list_gemm_backends
+load_gemm_backend = cxx.load_gemm_backend
+set_gemm_backend = cxx.set_gemm_backend
+get_gemm_backend = cxx.get_gemm_backend
+
+TokenStream = cxx.TokenStream
+
 
 @contextlib.contextmanager
 def pref_guard(filename: str):
     cxx.enable_perf(filename)
     yield
     cxx.disable_perf()
+
+
+@contextlib.contextmanager
+def gemm_backend_guard(name: str):
+    # the models run by this thread in the scope use the backend name
+    prev = cxx.set_thread_gemm_backend(name)
+    try:
+        yield
+    finally:
+        cxx.set_thread_gemm_backend(prev)
+
+
+def generate_stream(step,
+                    max_new_tokens: int,
+                    eos_token_id: int = -1,
+                    capacity: int = 16):
+    """
+    Runs the decoding loop on a native thread and yields the tokens as soon
+    as they are decoded. step(i) returns the i-th new token, e.g. a greedy
+    step of a model with a KV cache. Waiting for a token releases the GIL.
+    Call stop() of the returned stream, or drop it, to stop decoding early. first_token_ms and inter_token_ms of the stream hold the
+    latencies seen by the consumer.
+    """
+    stream = cxx.TokenStream(capacity)
+    stream.start(step, max_new_tokens, eos_token_id)
+    return stream